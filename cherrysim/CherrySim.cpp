@@ -0,0 +1,1538 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#include <CherrySim.h>
+#include <GlobalState.h>
+#include <FruityMesh.h>
+#include <FruityHal.h>
+#include <ConnectionManager.h>
+#include <MeshConnection.h>
+#include <MeshAccessConnection.h>
+#include <Logger.h>
+#include <Terminal.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+extern "C" {
+void app_timer_handler(void * p_context);
+}
+
+CherrySim* cherrySimInstance = nullptr;
+SIM_THREAD_LOCAL SimNodeHardware* simHw = nullptr;
+SIM_THREAD_LOCAL SimNode* CherrySim::currentNode = nullptr;
+SIM_THREAD_LOCAL SimTime CherrySim::simTimeUs = 0;
+SIM_THREAD_LOCAL SimPartition* CherrySim::currentPartition = nullptr;
+
+//Used by the Terminal to block while a gateway injects commands, never used in the simulator itself
+bool meshGwCommunication = false;
+
+//The connection type resolvers are collected in a linker section on the real hardware, the linker symbols
+//hold the section boundaries as values in the simulator
+static ConnTypeResolver connTypeResolvers[] = {
+	MeshConnection::ConnTypeResolver,
+	MeshAccessConnection::ConnTypeResolver
+};
+u32 __application_start_address = 0;
+u32 __application_end_address = 0;
+u32 __application_ram_start_address = 0;
+u32 __start_conn_type_resolvers = (u32)(uintptr_t)connTypeResolvers;
+u32 __stop_conn_type_resolvers = (u32)(uintptr_t)connTypeResolvers + sizeof(connTypeResolvers) / sizeof(ConnTypeResolver) * sizeof(u32);
+
+//Time that passes between a reset and the start of the firmware
+constexpr SimTime SIM_REBOOT_DELAY_US = 10 * SIM_TIME_MS;
+//Time needed by the flash controller
+constexpr SimTime SIM_FLASH_PAGE_ERASE_US = 22 * SIM_TIME_MS;
+constexpr SimTime SIM_FLASH_WORD_WRITE_US = 46;
+//Maximum random delay that the link layer adds to every advertising event
+constexpr u32 SIM_ADV_RANDOM_DELAY_US = 10 * SIM_TIME_MS;
+//RSSI events are generated with this interval once RSSI reporting was started
+constexpr SimTime SIM_RSSI_REPORT_INTERVAL_US = 1 * SIM_TIME_SEC;
+//Safety net against nodes that create events for themselves in an endless loop
+constexpr u32 SIM_MAX_EVENT_LOOPER_ROUNDS = 1000;
+
+static SimTime TicksToUs(unsigned long long ticks)
+{
+	return ticks * SIM_TIME_SEC / SIM_RTC_FREQUENCY;
+}
+
+static bool IsSameAddress(const ble_gap_addr_t& a, const ble_gap_addr_t& b)
+{
+	return memcmp(a.addr, b.addr, BLE_GAP_ADDR_LEN) == 0;
+}
+
+static u32 Xorshift32(u32& state)
+{
+	u32 x = state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	state = x;
+	return x;
+}
+
+static bool IsConnectable(u8 advType)
+{
+	return advType == BLE_GAP_ADV_TYPE_ADV_IND || advType == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND;
+}
+
+CherrySim::CherrySim(const SimConfiguration& simConfig)
+	: nextPartition(0), simConfig(simConfig)
+{
+	randomState = simConfig.seed != 0 ? simConfig.seed : 1;
+	lookaheadUs = simConfig.lookaheadUs != 0 ? simConfig.lookaheadUs : TicksToUs(MAIN_TIMER_TICK);
+	simTimeUs = 0;
+	cherrySimInstance = this;
+}
+
+CherrySim::~CherrySim()
+{
+	StopWorkers();
+	for (auto& node : nodes) {
+		if (node->hw.globalState != nullptr) {
+			SetCurrentNode(node.get());
+			GS->~GlobalState();
+			node->hw.globalState = nullptr;
+		}
+	}
+	if (cherrySimInstance == this) cherrySimInstance = nullptr;
+	SetCurrentNode(nullptr);
+}
+
+#define _________________SETUP____________________
+
+void CherrySim::Init()
+{
+	if (simConfig.numNodes == 0 || simConfig.numNodes > SIM_MAX_NODES
+		|| simConfig.numPartitions == 0 || simConfig.numPartitions > SIM_MAX_PARTITIONS || simConfig.numPartitions > simConfig.numNodes
+		|| simConfig.numThreads == 0
+	) {
+		SIMEXCEPTION(IllegalArgumentException);
+		return;
+	}
+
+	nodes.clear();
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		std::unique_ptr<SimNode> node(new SimNode());
+		node->index = i;
+		node->id = (NodeId)(i + 1);
+
+		//Beacons alternate between both sides of the road, each side belongs to one driving direction
+		node->x = i * simConfig.nodeSpacingMeters;
+		node->y = (node->id % 2 == 1) ? 0.0 : simConfig.roadWidthMeters;
+		node->direction = (node->id % 2 == 1) ? 3 : 9;
+		node->randomState = (simConfig.seed * 7919u + node->id * 104729u) | 1;
+		node->radioRandomState = (simConfig.seed * 104729u + node->id * 7919u) | 1;
+
+		//Erased flash reads as all ones
+		node->flashMemory.assign(SIM_FLASH_SIZE / sizeof(u32), 0xFFFFFFFF);
+		node->hw.flash = (uint8_t*)node->flashMemory.data();
+		node->hw.globalState = nullptr;
+		node->globalStateMemory.reset(new u8[sizeof(GlobalState)]);
+
+		CheckedMemset(&node->hw.ficr, 0x00, sizeof(node->hw.ficr));
+		node->hw.ficr.CODEPAGESIZE = SIM_FLASH_PAGE_SIZE;
+		node->hw.ficr.CODESIZE = SIM_FLASH_NUM_PAGES;
+		node->hw.ficr.NUMRAMBLOCK = 4;
+		node->hw.ficr.SIZERAMBLOCKS = 8 * 1024;
+		node->hw.ficr.DEVICEID[0] = NextNodeRandom(*node);
+		node->hw.ficr.DEVICEID[1] = node->id;
+		node->hw.ficr.DEVICEADDRTYPE = 1;
+		node->hw.ficr.DEVICEADDR[0] = 0x00F0F000 | node->id;
+		node->hw.ficr.DEVICEADDR[1] = 0xC0;
+		for (u32 k = 0; k < 4; k++) {
+			node->hw.ficr.ER[k] = NextNodeRandom(*node);
+			node->hw.ficr.IR[k] = NextNodeRandom(*node);
+		}
+
+		CheckedMemset(&node->hw.uicr, 0xFF, sizeof(node->hw.uicr));
+		node->hw.uicr.BOOTLOADERADDR = SIM_BOOTLOADER_ADDRESS;
+		CheckedMemset(&node->hw.gpio, 0x00, sizeof(node->hw.gpio));
+
+		//The SoftDevice uses a random static address that is derived from the FICR
+		CheckedMemset(&node->address, 0x00, sizeof(node->address));
+		node->address.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+		memcpy(node->address.addr, node->hw.ficr.DEVICEADDR, BLE_GAP_ADDR_LEN);
+		node->address.addr[5] |= 0xC0;
+
+		CheckedMemset(&node->ramRetainStruct, 0x00, sizeof(node->ramRetainStruct));
+
+		nodes.push_back(std::move(node));
+	}
+
+	CreatePartitions();
+	BuildNeighbourLists();
+
+	//Beacons on a highway are not powered on at exactly the same time
+	for (auto& node : nodes) {
+		ScheduleEvent(simTimeUs + NextRandom() % SIM_TIME_SEC, SimEventType::NODE_BOOT, node->index, node->rebootCounter);
+	}
+
+	StartWorkers();
+}
+
+//The nodes are sorted along the road, so consecutive nodes form a partition and only
+//the nodes close to a partition border have neighbours in another partition
+void CherrySim::CreatePartitions()
+{
+	partitions.clear();
+	for (u32 i = 0; i < simConfig.numPartitions; i++) {
+		std::unique_ptr<SimPartition> partition(new SimPartition());
+		partition->index = i;
+		partition->firstNode = (u32)((unsigned long long)i * nodes.size() / simConfig.numPartitions);
+		partition->endNode = (u32)((unsigned long long)(i + 1) * nodes.size() / simConfig.numPartitions);
+		partition->timeUs = simTimeUs;
+		for (u32 k = partition->firstNode; k < partition->endNode; k++) {
+			nodes[k]->partition = i;
+		}
+		partitions.push_back(std::move(partition));
+	}
+}
+
+void CherrySim::BuildNeighbourLists()
+{
+	for (auto& node : nodes) {
+		node->neighbours.clear();
+		for (auto& other : nodes) {
+			if (node == other) continue;
+			double distance = std::hypot(node->x - other->x, node->y - other->y);
+			i8 rssi = CalculateRssi(distance);
+			//Keep some margin so that noise can still lift a packet above the sensitivity
+			if (rssi + simConfig.rssiNoise >= simConfig.receiverSensitivity) {
+				node->neighbours.push_back({ other->index, rssi, other->partition != node->partition });
+			}
+		}
+	}
+}
+
+i8 CherrySim::CalculateRssi(double distanceMeters) const
+{
+	if (distanceMeters < 1.0) distanceMeters = 1.0;
+	double rssi = simConfig.rssiAtOneMeter - 10.0 * simConfig.pathLossExponent * std::log10(distanceMeters);
+	if (rssi < -127) rssi = -127;
+	return (i8)std::lround(rssi);
+}
+
+i8 CherrySim::AddRssiNoise(SimNode& receiver, i8 rssi)
+{
+	if (simConfig.rssiNoise == 0) return rssi;
+	i32 noise = (i32)(NextRadioRandom(receiver) % (2 * simConfig.rssiNoise + 1)) - simConfig.rssiNoise;
+	i32 result = rssi + noise;
+	if (result < -127) result = -127;
+	if (result > 0) result = 0;
+	return (i8)result;
+}
+
+bool CherrySim::RollLoss(SimNode& node, u32 lossPercent)
+{
+	return NextRadioRandom(node) % 100 < lossPercent;
+}
+
+//A packet is only received if it falls into the scan window and is not lost otherwise
+bool CherrySim::RollScanReception(SimNode& receiver, const ble_gap_scan_params_t& scanParams, u32 lossPercent)
+{
+	if (scanParams.interval == 0) return false;
+	u32 duty = (u32)scanParams.window * 10000 / scanParams.interval;
+	if (NextRadioRandom(receiver) % 10000 >= duty) return false;
+	return !RollLoss(receiver, lossPercent);
+}
+
+u32 CherrySim::NextRandom()
+{
+	return Xorshift32(randomState);
+}
+
+u32 CherrySim::NextNodeRandom(SimNode& node)
+{
+	return Xorshift32(node.randomState);
+}
+
+//The radio model only draws from the nodes that are simulated by the calling thread
+u32 CherrySim::NextRadioRandom(SimNode& node)
+{
+	return Xorshift32(node.radioRandomState);
+}
+
+#define _________________THREADS__________________
+
+void CherrySim::StartWorkers()
+{
+	StopWorkers();
+	shuttingDown = false;
+	for (u32 i = 1; i < simConfig.numThreads; i++) {
+		workers.emplace_back(&CherrySim::WorkerLoop, this);
+	}
+}
+
+void CherrySim::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> guard(windowMutex);
+		shuttingDown = true;
+	}
+	windowStarted.notify_all();
+	for (std::thread& worker : workers) worker.join();
+	workers.clear();
+}
+
+void CherrySim::WorkerLoop()
+{
+	u32 window = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(windowMutex);
+			windowStarted.wait(guard, [&]() { return shuttingDown || windowCounter != window; });
+			if (shuttingDown) return;
+			window = windowCounter;
+		}
+
+		SimulatePartitions();
+
+		std::lock_guard<std::mutex> guard(windowMutex);
+		busyWorkers--;
+		if (busyWorkers == 0) windowFinished.notify_one();
+	}
+}
+
+//Every thread takes the next partition that nobody works on until all partitions reached the window end
+void CherrySim::SimulatePartitions()
+{
+	for (u32 i = nextPartition.fetch_add(1); i < partitions.size(); i = nextPartition.fetch_add(1)) {
+		SimPartition& partition = *partitions[i];
+		try {
+			SimulatePartition(partition);
+		}
+		catch (...) {
+			partition.failure = std::current_exception();
+		}
+	}
+	currentPartition = nullptr;
+	SetCurrentNode(nullptr);
+}
+
+void CherrySim::SimulatePartition(SimPartition& partition)
+{
+	currentPartition = &partition;
+	simTimeUs = partition.timeUs;
+
+	std::vector<SimEvent>& queue = partition.eventQueue;
+	while (!queue.empty() && queue.front().timeUs < windowEndUs) {
+		std::pop_heap(queue.begin(), queue.end(), std::greater<SimEvent>());
+		SimEvent event = std::move(queue.back());
+		queue.pop_back();
+		if (event.timeUs > simTimeUs) simTimeUs = event.timeUs;
+
+		partition.processedEvents++;
+		ProcessEvent(event);
+		FlushEventLoopers(partition);
+	}
+
+	partition.timeUs = windowEndUs;
+}
+
+//Moves the messages of the last window into the event queue, sorted so that the order does not depend on the threads
+void CherrySim::CollectMessages(SimPartition& partition)
+{
+	std::vector<SimMessage*> messages;
+	for (SimMessage* message = partition.mailbox.TakeAll(); message != nullptr; message = message->next) {
+		messages.push_back(message);
+	}
+	std::sort(messages.begin(), messages.end(), [](const SimMessage* a, const SimMessage* b) {
+		if (a->arrivalUs != b->arrivalUs) return a->arrivalUs < b->arrivalUs;
+		if (a->sourcePartition != b->sourcePartition) return a->sourcePartition < b->sourcePartition;
+		return a->sequence < b->sequence;
+	});
+
+	for (SimMessage* message : messages) {
+		message->next = nullptr;
+		SimEvent event;
+		event.timeUs = message->arrivalUs;
+		event.type = SimEventType::MESSAGE;
+		event.index = message->targetIndex;
+		event.generation = 0;
+		event.param = 0;
+		CheckedMemset(&event.uuid, 0x00, sizeof(event.uuid));
+		event.message.reset(message);
+		PushEvent(partition, std::move(event));
+	}
+}
+
+void CherrySim::UpdateStatistics()
+{
+	processedEvents = 0;
+	establishedConnections = 0;
+	deliveredAdvertisements = 0;
+	deliveredPackets = 0;
+	sentMessages = 0;
+	simErrors = 0;
+	statCounters.clear();
+	statAverages.clear();
+
+	for (auto& partition : partitions) {
+		processedEvents += partition->processedEvents;
+		establishedConnections += partition->establishedConnections;
+		deliveredAdvertisements += partition->deliveredAdvertisements;
+		deliveredPackets += partition->deliveredPackets;
+		sentMessages += partition->sentMessages;
+		simErrors += partition->simErrors;
+		for (auto& counter : partition->statCounters) {
+			statCounters[counter.first] += counter.second;
+		}
+		for (auto& average : partition->statAverages) {
+			auto& entry = statAverages[average.first];
+			entry.first += average.second.first;
+			entry.second += average.second.second;
+		}
+	}
+}
+
+SimMailbox::~SimMailbox()
+{
+	SimMessage* message = TakeAll();
+	while (message != nullptr) {
+		SimMessage* next = message->next;
+		delete message;
+		message = next;
+	}
+}
+
+void SimMailbox::Push(SimMessage* message)
+{
+	message->next = head.load(std::memory_order_relaxed);
+	while (!head.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed));
+}
+
+SimMessage* SimMailbox::TakeAll()
+{
+	return head.exchange(nullptr, std::memory_order_acquire);
+}
+
+#define _________________NODES____________________
+
+void CherrySim::SetCurrentNode(SimNode* node)
+{
+	currentNode = node;
+	simHw = node != nullptr ? &node->hw : nullptr;
+}
+
+SimNode* CherrySim::FindNodeById(NodeId id)
+{
+	if (id == 0 || id > nodes.size()) return nullptr;
+	return nodes[id - 1].get();
+}
+
+SimPartition& CherrySim::GetPartition(const SimNode& node)
+{
+	return *partitions[node.partition];
+}
+
+bool CherrySim::IsTerminalNode(const SimNode& node) const
+{
+	return simConfig.terminalId == 0 || simConfig.terminalId == node.id;
+}
+
+//Boots a node the same way as main() does on the hardware, the event loop is driven by the simulator
+void CherrySim::BootNode(SimNode& node)
+{
+	SetCurrentNode(&node);
+
+	//GS must already point to the memory as the members might use GS during construction
+	node.hw.globalState = node.globalStateMemory.get();
+	new (node.hw.globalState) GlobalState();
+	GS->ramRetainStructPtr = &node.ramRetainStruct;
+	GS->rebootMagicNumberPtr = &node.rebootMagicNumber;
+
+	node.booted = true;
+	node.bootTimeUs = simTimeUs;
+	node.state = SimNodeState();
+
+	try {
+		BootFruityMesh();
+
+		const u32 moduleMemoryBlockSize = INITIALIZE_MODULES(false);
+		node.moduleMemory.assign(CEIL_DIV(moduleMemoryBlockSize, sizeof(u32)), 0);
+		GS->moduleAllocator.setMemory((u8*)node.moduleMemory.data(), moduleMemoryBlockSize);
+		BootModules();
+	}
+	catch (const NodeRebootException&) {
+		ResetNode(node);
+		return;
+	}
+
+	if (simConfig.muteOtherNodes && !IsTerminalNode(node)) {
+		GS->logger.disableAll();
+	}
+
+	//Start the app timer with a random phase
+	node.timerTicks = 0;
+	node.timerStartUs = simTimeUs + NextRadioRandom(node) % TicksToUs(MAIN_TIMER_TICK);
+	ScheduleEvent(node.timerStartUs + TicksToUs(MAIN_TIMER_TICK), SimEventType::NODE_TIMER, node.index, node.rebootCounter);
+
+	MarkNodePending(node);
+}
+
+//Resets the simulated chip, flash, ram retained data and the UICR survive the reset
+void CherrySim::ResetNode(SimNode& node)
+{
+	SetCurrentNode(&node);
+
+	//All connections are lost, the partners will only notice after the supervision timeout
+	for (SimLink& link : node.links) {
+		if (!link.active) continue;
+		if (!link.partnerLost) {
+			SimMessage message;
+			message.type = SimMessageType::LINK_LOST;
+			message.targetIndex = link.partnerIndex;
+			message.linkId = link.linkId;
+			SendMessage(node, message);
+		}
+		DeactivateLink(link);
+	}
+
+	if (node.hw.globalState != nullptr) {
+		GS->~GlobalState();
+		node.hw.globalState = nullptr;
+	}
+
+	node.booted = false;
+	node.rebootCounter++;
+	node.bleEnabled = false;
+	node.advertising = false;
+	node.advGeneration++;
+	node.scanning = false;
+	node.scanGeneration++;
+	node.connecting = false;
+	node.connectingGeneration++;
+	node.bleEvents.clear();
+	node.socEvents.clear();
+	//An interrupted flash operation is lost
+	node.flashBusy = false;
+	node.services.clear();
+	node.characteristics.clear();
+	node.vendorUuids.clear();
+	node.nextAttributeHandle = 1;
+	node.eventLooperPending = false;
+	node.state = SimNodeState();
+
+	ScheduleEvent(simTimeUs + SIM_REBOOT_DELAY_US, SimEventType::NODE_BOOT, node.index, node.rebootCounter);
+}
+
+void CherrySim::MarkNodePending(SimNode& node)
+{
+	if (node.eventLooperPending) return;
+	node.eventLooperPending = true;
+	GetPartition(node).pendingNodes.push_back(node.index);
+}
+
+//Runs the event loop of all nodes that have received new events until no node has work left
+void CherrySim::FlushEventLoopers(SimPartition& partition)
+{
+	for (u32 round = 0; !partition.pendingNodes.empty(); round++) {
+		if (round >= SIM_MAX_EVENT_LOOPER_ROUNDS) {
+			printf("CherrySim: Nodes keep creating events for themselves, giving up at %llu us" EOL, simTimeUs);
+			partition.pendingNodes.clear();
+			SIMEXCEPTION(IllegalStateException);
+			break;
+		}
+
+		std::vector<u32> current;
+		current.swap(partition.pendingNodes);
+		for (u32 index : current) {
+			SimNode& node = *nodes[index];
+			node.eventLooperPending = false;
+			if (!node.booted) continue;
+
+			SetCurrentNode(&node);
+			try {
+				FruityHal::EventLooper();
+			}
+			catch (const NodeRebootException&) {
+				ResetNode(node);
+			}
+		}
+	}
+}
+
+//Runs between two windows, so the node can safely be executed by the calling thread
+void CherrySim::SendTerminalCommand(NodeId id, const char* command)
+{
+	SimNode* node = FindNodeById(id);
+	if (node == nullptr || !node->booted) {
+		SIMEXCEPTION(IllegalArgumentException);
+		return;
+	}
+
+	//The terminal only processes input on the terminal node, so the target is made the terminal for this command
+	NodeId terminalId = simConfig.terminalId;
+	simConfig.terminalId = id;
+
+	SimPartition& partition = GetPartition(*node);
+	currentPartition = &partition;
+	SetCurrentNode(node);
+	GS->terminal.PutIntoReadBuffer(command);
+	MarkNodePending(*node);
+	FlushEventLoopers(partition);
+	currentPartition = nullptr;
+	SetCurrentNode(nullptr);
+
+	simConfig.terminalId = terminalId;
+}
+
+u32 CherrySim::AddVehicle(const SimVehicle& vehicle)
+{
+	vehicles.push_back(vehicle);
+	u32 index = (u32)vehicles.size() - 1;
+	SimTime start = vehicle.startTimeUs > simTimeUs ? vehicle.startTimeUs : simTimeUs;
+
+	//All copies of the vehicle use the same random numbers so that they advertise at the same time
+	u32 vehicleSeed = NextRandom() | 1;
+	for (auto& partition : partitions) {
+		partition->vehicleRandomState.push_back(vehicleSeed);
+
+		SimEvent event;
+		event.timeUs = start;
+		event.type = SimEventType::VEHICLE_ADVERTISING;
+		event.index = index;
+		event.generation = 0;
+		event.param = 0;
+		CheckedMemset(&event.uuid, 0x00, sizeof(event.uuid));
+		PushEvent(*partition, std::move(event));
+	}
+	return index;
+}
+
+#define _________________EVENTS___________________
+
+void CherrySim::PushEvent(SimPartition& partition, SimEvent&& event)
+{
+	event.sequence = partition.eventSequence++;
+	partition.eventQueue.push_back(std::move(event));
+	std::push_heap(partition.eventQueue.begin(), partition.eventQueue.end(), std::greater<SimEvent>());
+}
+
+//Node events always go to the partition of the node, which is the one of the calling thread
+void CherrySim::ScheduleEvent(SimTime timeUs, SimEventType type, u32 index, u32 generation, u32 param, const ble_uuid_t* uuid)
+{
+	SimEvent event;
+	event.timeUs = timeUs;
+	event.type = type;
+	event.index = index;
+	event.generation = generation;
+	event.param = param;
+	if (uuid != nullptr) event.uuid = *uuid;
+	else CheckedMemset(&event.uuid, 0x00, sizeof(event.uuid));
+	PushEvent(GetPartition(*nodes[index]), std::move(event));
+}
+
+ble_evt_t* CherrySim::PushBleEvent(SimNode& node, u16 eventId, u16 length)
+{
+	node.bleEvents.emplace_back();
+	SimBleEvent& simEvent = node.bleEvents.back();
+	CheckedMemset(simEvent.data, 0x00, sizeof(simEvent.data));
+	simEvent.length = length;
+
+	ble_evt_t* evt = (ble_evt_t*)simEvent.data;
+	evt->header.evt_id = eventId;
+	evt->header.evt_len = length - sizeof(ble_evt_hdr_t);
+
+	MarkNodePending(node);
+	return evt;
+}
+
+void CherrySim::PushSocEvent(SimNode& node, u32 eventId)
+{
+	node.socEvents.push_back(eventId);
+	MarkNodePending(node);
+}
+
+void CherrySim::SimulateStep()
+{
+	SimulateWindow(simTimeUs + lookaheadUs);
+}
+
+//Messages that were sent in the last window are collected first, none of them can be due before the
+//window end as a window is never longer than the lookahead
+void CherrySim::SimulateWindow(SimTime endUs)
+{
+	for (auto& partition : partitions) {
+		CollectMessages(*partition);
+	}
+
+	windowEndUs = endUs;
+	nextPartition = 0;
+	if (workers.empty()) {
+		SimulatePartitions();
+	}
+	else {
+		{
+			std::lock_guard<std::mutex> guard(windowMutex);
+			busyWorkers = (u32)workers.size();
+			windowCounter++;
+		}
+		windowStarted.notify_all();
+		SimulatePartitions();
+
+		std::unique_lock<std::mutex> guard(windowMutex);
+		windowFinished.wait(guard, [&]() { return busyWorkers == 0; });
+	}
+
+	simTimeUs = windowEndUs;
+	simulatedWindows++;
+	UpdateStatistics();
+
+	for (auto& partition : partitions) {
+		if (partition->failure) {
+			std::exception_ptr failure = partition->failure;
+			partition->failure = nullptr;
+			std::rethrow_exception(failure);
+		}
+	}
+}
+
+void CherrySim::SimulateUntil(SimTime timeUs)
+{
+	while (simTimeUs < timeUs) {
+		SimulateWindow(std::min(simTimeUs + lookaheadUs, timeUs));
+	}
+}
+
+bool CherrySim::SimulateUntilCondition(SimTime maxTimeUs, std::function<bool()> condition)
+{
+	while (simTimeUs < maxTimeUs) {
+		SimulateWindow(std::min(simTimeUs + lookaheadUs, maxTimeUs));
+		if (condition()) return true;
+	}
+	return condition();
+}
+
+void CherrySim::ProcessEvent(SimEvent& event)
+{
+	switch (event.type)
+	{
+	case SimEventType::VEHICLE_ADVERTISING:
+		ProcessVehicleAdvertising(*currentPartition, event.index);
+		return;
+	case SimEventType::MESSAGE:
+		ReceiveMessage(*event.message);
+		return;
+	default:
+		break;
+	}
+
+	//All other events belong to a node and are discarded if the node rebooted in the meantime
+	SimNode& node = *nodes[event.index];
+	if (event.type == SimEventType::NODE_BOOT) {
+		if (event.generation == node.rebootCounter && !node.booted) BootNode(node);
+		return;
+	}
+
+	//Link events are discarded if the link was closed in the meantime
+	if (event.type == SimEventType::CONNECTION_EVENT || event.type == SimEventType::SUPERVISION_TIMEOUT) {
+		if (event.param >= SIM_MAX_CONNECTIONS_PER_NODE) return;
+		SimLink& link = node.links[event.param];
+		if (!link.active || link.generation != event.generation) return;
+
+		SetCurrentNode(&node);
+		if (event.type == SimEventType::CONNECTION_EVENT) ProcessConnectionEvent(node, (u16)event.param);
+		else ProcessSupervisionTimeout(node, (u16)event.param);
+		return;
+	}
+
+	if (!node.booted || event.generation != node.rebootCounter) return;
+
+	SetCurrentNode(&node);
+	switch (event.type)
+	{
+	case SimEventType::NODE_TIMER:
+		ProcessNodeTimer(node);
+		break;
+	case SimEventType::ADVERTISING:
+		ProcessAdvertising(node, event.param);
+		break;
+	case SimEventType::GAP_TIMEOUT:
+		ProcessGapTimeout(node, (u8)(event.param & 0xFF), event.param >> 8);
+		break;
+	case SimEventType::FLASH_OPERATION:
+		ProcessFlashOperation(node);
+		break;
+	case SimEventType::SERVICE_DISCOVERY:
+		ProcessServiceDiscovery(node, (u16)event.param, event.uuid);
+		break;
+	default:
+		break;
+	}
+}
+
+u32 CherrySim::GetRtcTicks(const SimNode& node) const
+{
+	return (u32)((simTimeUs - node.bootTimeUs) * SIM_RTC_FREQUENCY / SIM_TIME_SEC) & SIM_RTC_MASK;
+}
+
+void CherrySim::ProcessNodeTimer(SimNode& node)
+{
+	try {
+		app_timer_handler(nullptr);
+	}
+	catch (const NodeRebootException&) {
+		ResetNode(node);
+		return;
+	}
+	MarkNodePending(node);
+
+	//Timer events are calculated from the start time so that no rounding error accumulates
+	node.timerTicks += MAIN_TIMER_TICK;
+	ScheduleEvent(node.timerStartUs + TicksToUs(node.timerTicks + MAIN_TIMER_TICK), SimEventType::NODE_TIMER, node.index, node.rebootCounter);
+}
+
+#define _________________MESSAGES_________________
+
+//Messages within a partition are handled right away, all others are delayed by the lookahead. The
+//lookahead is what allows the partitions to be simulated in parallel.
+void CherrySim::SendMessage(SimNode& sender, SimMessage& message)
+{
+	message.sourceIndex = sender.index;
+	message.sentUs = simTimeUs;
+
+	SimNode& target = *nodes[message.targetIndex];
+	if (target.partition == sender.partition) {
+		message.arrivalUs = simTimeUs;
+		ReceiveMessage(message);
+		return;
+	}
+
+	SimPartition& source = GetPartition(sender);
+	SimMessage* remote = new SimMessage(message);
+	remote->arrivalUs = simTimeUs + lookaheadUs;
+	remote->sourcePartition = source.index;
+	remote->sequence = source.messageSequence++;
+	source.sentMessages++;
+	GetPartition(target).mailbox.Push(remote);
+}
+
+void CherrySim::ReceiveMessage(SimMessage& message)
+{
+	SimNode& target = *nodes[message.targetIndex];
+	switch (message.type)
+	{
+	case SimMessageType::ADVERTISEMENT:
+		ReceiveRemoteAdvertisement(message);
+		break;
+	case SimMessageType::CONNECT_REQUEST:
+		ReceiveConnectRequest(target, message);
+		break;
+	default:
+		ReceiveLinkMessage(target, message);
+		break;
+	}
+}
+
+#define _________________RADIO____________________
+
+void CherrySim::ScheduleAdvertising(SimNode& node, bool firstEvent)
+{
+	SimTime intervalUs = (SimTime)node.advParams.interval * 625;
+	SimTime delay = firstEvent
+		? NextRadioRandom(node) % (intervalUs + 1)
+		: intervalUs + NextRadioRandom(node) % SIM_ADV_RANDOM_DELAY_US;
+	ScheduleEvent(simTimeUs + delay, SimEventType::ADVERTISING, node.index, node.rebootCounter, node.advGeneration);
+}
+
+//Events of an earlier advertising set are dropped, otherwise every restart would add another advertiser
+void CherrySim::ProcessAdvertising(SimNode& node, u32 generation)
+{
+	if (!node.advertising || node.advGeneration != generation) return;
+
+	SimMessage message;
+	message.type = SimMessageType::ADVERTISEMENT;
+	message.sourceIndex = node.index;
+	message.sentUs = simTimeUs;
+	message.arrivalUs = simTimeUs;
+	message.address = node.address;
+	message.advType = node.advParams.type;
+	message.dataLength = node.advDataLength;
+	memcpy(message.data, node.advData, node.advDataLength);
+
+	//Other partitions get a single message and check their part of the neighbours themselves
+	u32 lastRemotePartition = node.partition;
+	for (const SimNeighbour& neighbour : node.neighbours) {
+		SimNode& receiver = *nodes[neighbour.nodeIndex];
+		if (neighbour.remote) {
+			if (receiver.partition != lastRemotePartition) {
+				lastRemotePartition = receiver.partition;
+				message.targetIndex = receiver.index;
+				SendMessage(node, message);
+			}
+			continue;
+		}
+
+		//The advertiser stops advertising once a neighbour has connected
+		if (ReceiveAdvertisement(receiver, message, neighbour.rssi)) break;
+	}
+
+	if (node.advertising && node.advGeneration == generation) {
+		ScheduleAdvertising(node, false);
+	}
+}
+
+//The reception is decided by the receiver, so it draws from the random numbers of its own partition.
+//Returns true if the receiver has connected to the advertiser.
+bool CherrySim::ReceiveAdvertisement(SimNode& receiver, const SimMessage& message, i8 rssi)
+{
+	if (!receiver.booted || !receiver.bleEnabled) return false;
+	if (!receiver.connecting && !receiver.scanning) return false;
+
+	rssi = AddRssiNoise(receiver, rssi);
+	if (rssi < simConfig.receiverSensitivity) return false;
+
+	if (receiver.connecting) {
+		if (IsConnectable(message.advType)
+			&& IsSameAddress(receiver.connectingAddress, message.address)
+			&& RollScanReception(receiver, receiver.connectingScanParams, simConfig.advertisingLossPercent)
+		) {
+			ConnectToAdvertiser(receiver, message, rssi);
+			return true;
+		}
+	}
+	else if (RollScanReception(receiver, receiver.scanParams, simConfig.advertisingLossPercent)) {
+		DeliverAdvertisement(receiver, message.address, message.advType, message.data, message.dataLength, rssi);
+	}
+	return false;
+}
+
+//The neighbour list of the advertiser never changes after Init, so it can be read by any partition
+void CherrySim::ReceiveRemoteAdvertisement(const SimMessage& message)
+{
+	const SimNode& advertiser = *nodes[message.sourceIndex];
+	const u32 partition = nodes[message.targetIndex]->partition;
+
+	for (const SimNeighbour& neighbour : advertiser.neighbours) {
+		SimNode& receiver = *nodes[neighbour.nodeIndex];
+		if (receiver.partition != partition) continue;
+		//Only one of the receivers can connect before the advertiser stops
+		if (ReceiveAdvertisement(receiver, message, neighbour.rssi)) break;
+	}
+}
+
+void CherrySim::DeliverAdvertisement(SimNode& receiver, const ble_gap_addr_t& address, u8 advType, const u8* data, u8 length, i8 rssi)
+{
+	ble_evt_t* evt = PushBleEvent(receiver, BLE_GAP_EVT_ADV_REPORT);
+	evt->evt.gap_evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+	ble_gap_evt_adv_report_t& report = evt->evt.gap_evt.params.adv_report;
+	report.peer_addr = address;
+	report.rssi = rssi;
+	report.scan_rsp = 0;
+	report.type = advType;
+	report.dlen = length;
+	memcpy(report.data, data, length);
+
+	GetPartition(receiver).deliveredAdvertisements++;
+}
+
+//Each partition only checks its own nodes, the vehicle position is the same in all partitions
+void CherrySim::ProcessVehicleAdvertising(SimPartition& partition, u32 vehicleIndex)
+{
+	SimVehicle& vehicle = vehicles[vehicleIndex];
+	if (simTimeUs > vehicle.endTimeUs) return;
+
+	double x = vehicle.x + vehicle.speedMetersPerSec * (double)(simTimeUs - vehicle.startTimeUs) / SIM_TIME_SEC;
+
+	for (u32 i = partition.firstNode; i < partition.endNode; i++) {
+		SimNode& receiver = *nodes[i];
+		if (!receiver.booted || !receiver.bleEnabled || !receiver.scanning) continue;
+
+		double distance = std::hypot(receiver.x - x, receiver.y - vehicle.y);
+		i8 rssi = AddRssiNoise(receiver, CalculateRssi(distance));
+		if (rssi < simConfig.receiverSensitivity) continue;
+
+		if (RollScanReception(receiver, receiver.scanParams, simConfig.advertisingLossPercent)) {
+			DeliverAdvertisement(receiver, vehicle.address, BLE_GAP_ADV_TYPE_ADV_NONCONN_IND, vehicle.advData, vehicle.advDataLength, rssi);
+		}
+	}
+
+	SimEvent event;
+	event.timeUs = simTimeUs + vehicle.advIntervalMs * SIM_TIME_MS + Xorshift32(partition.vehicleRandomState[vehicleIndex]) % SIM_ADV_RANDOM_DELAY_US;
+	event.type = SimEventType::VEHICLE_ADVERTISING;
+	event.index = vehicleIndex;
+	event.generation = 0;
+	event.param = 0;
+	CheckedMemset(&event.uuid, 0x00, sizeof(event.uuid));
+	PushEvent(partition, std::move(event));
+}
+
+//The generation makes sure that the timeout belongs to the procedure that is still running
+void CherrySim::ScheduleGapTimeout(SimNode& node, u8 source, u32 generation, u16 timeoutSec)
+{
+	if (timeoutSec == 0) return;
+	ScheduleEvent(simTimeUs + timeoutSec * SIM_TIME_SEC, SimEventType::GAP_TIMEOUT, node.index, node.rebootCounter, source | ((generation & 0xFFFFFF) << 8));
+}
+
+void CherrySim::ProcessGapTimeout(SimNode& node, u8 source, u32 generation)
+{
+	if (source == BLE_GAP_TIMEOUT_SRC_ADVERTISING) {
+		if (!node.advertising || (node.advGeneration & 0xFFFFFF) != generation) return;
+		node.advertising = false;
+		node.advGeneration++;
+	}
+	else if (source == BLE_GAP_TIMEOUT_SRC_SCAN) {
+		if (!node.scanning || (node.scanGeneration & 0xFFFFFF) != generation) return;
+		node.scanning = false;
+		node.scanGeneration++;
+	}
+	else if (source == BLE_GAP_TIMEOUT_SRC_CONN) {
+		if (!node.connecting || (node.connectingGeneration & 0xFFFFFF) != generation) return;
+		node.connecting = false;
+		node.connectingGeneration++;
+	}
+
+	ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_TIMEOUT);
+	evt->evt.gap_evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+	evt->evt.gap_evt.params.timeout.src = source;
+}
+
+#define _________________CONNECTIONS______________
+
+//The SoftDevice hands out the lowest free connection handle
+SimLink* CherrySim::ActivateLink(SimNode& node, u16* connHandle)
+{
+	for (u16 handle = 0; handle < SIM_MAX_CONNECTIONS_PER_NODE; handle++) {
+		SimLink& link = node.links[handle];
+		if (link.active) continue;
+
+		u32 generation = link.generation + 1;
+		link = SimLink();
+		link.generation = generation;
+		link.active = true;
+		link.lastRssiReportUs = simTimeUs;
+		*connHandle = handle;
+		return &link;
+	}
+	return nullptr;
+}
+
+void CherrySim::DeactivateLink(SimLink& link)
+{
+	link.active = false;
+	link.generation++;
+	link.queue.clear();
+	link.partnerServices.clear();
+	link.partnerCharacteristics.clear();
+}
+
+SimLink* CherrySim::FindLink(SimNode& node, u16 connHandle)
+{
+	if (connHandle >= SIM_MAX_CONNECTIONS_PER_NODE || !node.links[connHandle].active) return nullptr;
+	return &node.links[connHandle];
+}
+
+SimLink* CherrySim::FindLinkById(SimNode& node, unsigned long long linkId, u16* connHandle)
+{
+	for (u16 handle = 0; handle < SIM_MAX_CONNECTIONS_PER_NODE; handle++) {
+		SimLink& link = node.links[handle];
+		if (link.active && link.linkId == linkId) {
+			*connHandle = handle;
+			return &link;
+		}
+	}
+	return nullptr;
+}
+
+u32 CherrySim::CountLinks(const SimNode& node, u8 role) const
+{
+	u32 count = 0;
+	for (const SimLink& link : node.links) {
+		if (link.active && link.role == role) count++;
+	}
+	return count;
+}
+
+//The central reports the connection right away, just as the SoftDevice does after sending the connect request.
+//If the peripheral turns out to be gone, the connection fails to be established.
+void CherrySim::ConnectToAdvertiser(SimNode& central, const SimMessage& advertisement, i8 rssi)
+{
+	u16 connHandle;
+	SimLink* link = ActivateLink(central, &connHandle);
+	if (link == nullptr) return;
+
+	link->linkId = ((unsigned long long)central.index << 32) | central.linkCounter++;
+	link->role = BLE_GAP_ROLE_CENTRAL;
+	link->partnerIndex = advertisement.sourceIndex;
+	link->partnerAddress = advertisement.address;
+	link->params = central.connectingConnParams;
+	link->rssi = rssi;
+	//The first connection event happens after the transmit window
+	link->anchorUs = simTimeUs + 1250;
+
+	central.connecting = false;
+	central.connectingGeneration++;
+	PushConnected(central, connHandle);
+
+	SimMessage request;
+	request.type = SimMessageType::CONNECT_REQUEST;
+	request.targetIndex = link->partnerIndex;
+	request.linkId = link->linkId;
+	request.rssi = rssi;
+	request.address = central.address;
+	request.params = link->params;
+	request.anchorUs = link->anchorUs;
+	request.services = central.services;
+	request.characteristics = central.characteristics;
+	SendMessage(central, request);
+}
+
+void CherrySim::ReceiveConnectRequest(SimNode& peripheral, const SimMessage& message)
+{
+	SimMessage reply;
+	reply.targetIndex = message.sourceIndex;
+	reply.linkId = message.linkId;
+
+	u16 connHandle = 0;
+	SimLink* link = nullptr;
+	if (peripheral.booted
+		&& peripheral.advertising
+		&& IsConnectable(peripheral.advParams.type)
+		&& CountLinks(peripheral, BLE_GAP_ROLE_PERIPH) < peripheral.maxPeripheralConnections
+	) {
+		link = ActivateLink(peripheral, &connHandle);
+	}
+	if (link == nullptr) {
+		reply.type = SimMessageType::CONNECT_REJECT;
+		SendMessage(peripheral, reply);
+		return;
+	}
+
+	link->linkId = message.linkId;
+	link->role = BLE_GAP_ROLE_PERIPH;
+	link->partnerIndex = message.sourceIndex;
+	link->partnerAddress = message.address;
+	link->established = true;
+	link->params = message.params;
+	link->rssi = message.rssi;
+	link->anchorUs = message.anchorUs;
+	link->partnerServices = message.services;
+	link->partnerCharacteristics = message.characteristics;
+
+	peripheral.advertising = false;
+	peripheral.advGeneration++;
+	PushConnected(peripheral, connHandle);
+	GetPartition(peripheral).establishedConnections++;
+
+	reply.type = SimMessageType::CONNECT_ACCEPT;
+	reply.services = peripheral.services;
+	reply.characteristics = peripheral.characteristics;
+	SendMessage(peripheral, reply);
+}
+
+//Handles all messages that belong to an existing link, messages for a link that is already closed are dropped
+void CherrySim::ReceiveLinkMessage(SimNode& node, const SimMessage& message)
+{
+	u16 connHandle;
+	SimLink* link = FindLinkById(node, message.linkId, &connHandle);
+	if (link == nullptr) return;
+
+	switch (message.type)
+	{
+	case SimMessageType::CONNECT_ACCEPT:
+		link->established = true;
+		link->partnerServices = message.services;
+		link->partnerCharacteristics = message.characteristics;
+		ScheduleConnectionEvent(node, connHandle);
+		break;
+	case SimMessageType::CONNECT_REJECT:
+		PushDisconnected(node, connHandle, BLE_HCI_CONN_FAILED_TO_BE_ESTABLISHED);
+		DeactivateLink(*link);
+		break;
+	case SimMessageType::PACKET:
+	{
+		const SimPacket& packet = message.packet;
+		if (packet.type == SimPacketType::NOTIFICATION) {
+			ble_evt_t* evt = PushBleEvent(node, BLE_GATTC_EVT_HVX, (u16)(sizeof(ble_evt_t) + packet.length));
+			evt->evt.gattc_evt.conn_handle = connHandle;
+			evt->evt.gattc_evt.gatt_status = BLE_GATT_STATUS_SUCCESS;
+			ble_gattc_evt_hvx_t& hvx = evt->evt.gattc_evt.params.hvx;
+			hvx.handle = packet.handle;
+			hvx.type = BLE_GATT_HVX_NOTIFICATION;
+			hvx.len = packet.length;
+			memcpy(hvx.data, packet.data, packet.length);
+		}
+		else {
+			ble_evt_t* evt = PushBleEvent(node, BLE_GATTS_EVT_WRITE, (u16)(sizeof(ble_evt_t) + packet.length));
+			evt->evt.gatts_evt.conn_handle = connHandle;
+			ble_gatts_evt_write_t& write = evt->evt.gatts_evt.params.write;
+			write.handle = packet.handle;
+			write.op = packet.type == SimPacketType::WRITE_REQ ? BLE_GATTS_OP_WRITE_REQ : BLE_GATTS_OP_WRITE_CMD;
+			write.len = packet.length;
+			memcpy(write.data, packet.data, packet.length);
+		}
+		break;
+	}
+	case SimMessageType::PARAM_UPDATE:
+	{
+		link->params = message.params;
+		link->anchorUs = message.anchorUs;
+		ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_CONN_PARAM_UPDATE);
+		evt->evt.gap_evt.conn_handle = connHandle;
+		evt->evt.gap_evt.params.conn_param_update.conn_params = link->params;
+		break;
+	}
+	case SimMessageType::ENCRYPTION_REQUEST:
+	{
+		link->securityInfoRequested = true;
+		link->securityInfoReplied = false;
+		memcpy(link->centralKey, message.key, BLE_GAP_SEC_KEY_LEN);
+		ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_SEC_INFO_REQUEST);
+		evt->evt.gap_evt.conn_handle = connHandle;
+		evt->evt.gap_evt.params.sec_info_request.peer_addr = link->partnerAddress;
+		evt->evt.gap_evt.params.sec_info_request.enc_info = 1;
+		break;
+	}
+	case SimMessageType::ENCRYPTION_COMPLETE:
+		link->encryptionRequested = false;
+		link->encryptionRequestSent = false;
+		PushConnSecUpdate(node, connHandle);
+		break;
+	case SimMessageType::DISCONNECT:
+		PushDisconnected(node, connHandle, message.reason);
+		DeactivateLink(*link);
+		break;
+	case SimMessageType::LINK_LOST:
+	{
+		//The supervision timeout runs from the moment the partner was lost, not from the arrival of the message
+		link->partnerLost = true;
+		link->queue.clear();
+		SimTime timeoutUs = message.sentUs + (SimTime)link->params.conn_sup_timeout * 10 * SIM_TIME_MS;
+		if (timeoutUs <= simTimeUs) timeoutUs = simTimeUs + 1;
+		ScheduleEvent(timeoutUs, SimEventType::SUPERVISION_TIMEOUT, node.index, link->generation, connHandle);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void CherrySim::PushConnected(SimNode& node, u16 connHandle)
+{
+	const SimLink& link = node.links[connHandle];
+	ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_CONNECTED);
+	evt->evt.gap_evt.conn_handle = connHandle;
+	ble_gap_evt_connected_t& connected = evt->evt.gap_evt.params.connected;
+	connected.peer_addr = link.partnerAddress;
+	connected.own_addr = node.address;
+	connected.role = link.role;
+	connected.conn_params = link.params;
+}
+
+void CherrySim::PushDisconnected(SimNode& node, u16 connHandle, u8 reason)
+{
+	ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_DISCONNECTED);
+	evt->evt.gap_evt.conn_handle = connHandle;
+	evt->evt.gap_evt.params.disconnected.reason = reason;
+}
+
+void CherrySim::PushConnSecUpdate(SimNode& node, u16 connHandle)
+{
+	ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_CONN_SEC_UPDATE);
+	evt->evt.gap_evt.conn_handle = connHandle;
+	ble_gap_conn_sec_t& connSec = evt->evt.gap_evt.params.conn_sec_update.conn_sec;
+	connSec.sec_mode.sm = 1;
+	connSec.sec_mode.lv = 2;
+	connSec.encr_key_size = BLE_GAP_SEC_KEY_LEN;
+}
+
+void CherrySim::PushTxComplete(SimNode& node, u16 connHandle, u8 count)
+{
+	ble_evt_t* evt = PushBleEvent(node, BLE_EVT_TX_COMPLETE);
+	evt->evt.common_evt.conn_handle = connHandle;
+	evt->evt.common_evt.params.tx_complete.count = count;
+}
+
+void CherrySim::ScheduleConnectionEvent(SimNode& node, u16 connHandle)
+{
+	SimLink& link = node.links[connHandle];
+	if (!link.active || link.eventScheduled) return;
+
+	//Connection events are only simulated if there is something to do
+	bool ready = link.established && !link.partnerLost;
+	bool work = link.disconnecting;
+	if (ready) {
+		work = work
+			|| link.paramUpdatePending
+			|| (link.encryptionRequested && !link.encryptionRequestSent)
+			|| link.securityInfoReplied
+			|| !link.queue.empty();
+	}
+
+	SimTime earliest = simTimeUs + 1;
+	if (!work) {
+		if (!ready || !link.rssiReporting) return;
+		SimTime nextReport = link.lastRssiReportUs + SIM_RSSI_REPORT_INTERVAL_US;
+		if (nextReport > earliest) earliest = nextReport;
+	}
+
+	SimTime intervalUs = (SimTime)link.params.min_conn_interval * 1250;
+	if (intervalUs == 0) intervalUs = 1250;
+	SimTime eventTime = link.anchorUs;
+	if (earliest > eventTime) {
+		eventTime += (earliest - eventTime + intervalUs - 1) / intervalUs * intervalUs;
+	}
+
+	link.eventScheduled = true;
+	ScheduleEvent(eventTime, SimEventType::CONNECTION_EVENT, node.index, link.generation, connHandle);
+}
+
+//Each side runs its own connection events, everything that concerns the partner is sent to it as a message
+void CherrySim::ProcessConnectionEvent(SimNode& node, u16 connHandle)
+{
+	SimLink& link = node.links[connHandle];
+	link.eventScheduled = false;
+
+	//A disconnect takes one connection event to reach the partner
+	if (link.disconnecting) {
+		TerminateLink(node, connHandle, BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION, link.disconnectReason);
+		return;
+	}
+	if (!link.established || link.partnerLost) return;
+
+	SimMessage message;
+	message.targetIndex = link.partnerIndex;
+	message.linkId = link.linkId;
+
+	if (link.paramUpdatePending) {
+		link.paramUpdatePending = false;
+		link.params = link.pendingParams;
+		link.anchorUs = simTimeUs;
+		ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_CONN_PARAM_UPDATE);
+		evt->evt.gap_evt.conn_handle = connHandle;
+		evt->evt.gap_evt.params.conn_param_update.conn_params = link.params;
+
+		message.type = SimMessageType::PARAM_UPDATE;
+		message.params = link.params;
+		message.anchorUs = link.anchorUs;
+		SendMessage(node, message);
+	}
+
+	//Encryption procedure: Central starts encryption, peripheral is asked for its key and compares both
+	if (link.encryptionRequested && !link.encryptionRequestSent) {
+		link.encryptionRequestSent = true;
+		message.type = SimMessageType::ENCRYPTION_REQUEST;
+		memcpy(message.key, link.centralKey, BLE_GAP_SEC_KEY_LEN);
+		SendMessage(node, message);
+	}
+	else if (link.securityInfoReplied) {
+		link.securityInfoRequested = false;
+		link.securityInfoReplied = false;
+
+		if (memcmp(link.centralKey, link.peripheralKey, BLE_GAP_SEC_KEY_LEN) != 0) {
+			TerminateLink(node, connHandle, BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE, BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE);
+			return;
+		}
+		PushConnSecUpdate(node, connHandle);
+		message.type = SimMessageType::ENCRYPTION_COMPLETE;
+		SendMessage(node, message);
+	}
+
+	//A lost packet is retransmitted in the next connection event
+	//Acknowledgements are reported in the order in which the packets were queued
+	u8 completed = 0;
+	message.type = SimMessageType::PACKET;
+	for (u32 sent = 0; sent < SIM_PACKETS_PER_CONNECTION_EVENT && !link.queue.empty(); sent++) {
+		if (RollLoss(node, simConfig.connectionPacketLossPercent)) break;
+
+		message.packet = link.queue.front();
+		link.queue.pop_front();
+		GetPartition(node).deliveredPackets++;
+		SendMessage(node, message);
+
+		if (message.packet.type == SimPacketType::WRITE_REQ) {
+			if (completed > 0) {
+				PushTxComplete(node, connHandle, completed);
+				completed = 0;
+			}
+			link.writeResponsePending = false;
+			ble_evt_t* evt = PushBleEvent(node, BLE_GATTC_EVT_WRITE_RSP);
+			evt->evt.gattc_evt.conn_handle = connHandle;
+			evt->evt.gattc_evt.gatt_status = BLE_GATT_STATUS_SUCCESS;
+			evt->evt.gattc_evt.params.write_rsp.handle = message.packet.handle;
+			evt->evt.gattc_evt.params.write_rsp.write_op = BLE_GATT_OP_WRITE_REQ;
+		}
+		else {
+			completed++;
+			link.txBuffersUsed--;
+		}
+	}
+	if (completed > 0) PushTxComplete(node, connHandle, completed);
+
+	if (link.rssiReporting && simTimeUs >= link.lastRssiReportUs + SIM_RSSI_REPORT_INTERVAL_US) {
+		link.lastRssiReportUs = simTimeUs;
+		ble_evt_t* evt = PushBleEvent(node, BLE_GAP_EVT_RSSI_CHANGED);
+		evt->evt.gap_evt.conn_handle = connHandle;
+		evt->evt.gap_evt.params.rssi_changed.rssi = AddRssiNoise(node, link.rssi);
+	}
+
+	ScheduleConnectionEvent(node, connHandle);
+}
+
+void CherrySim::TerminateLink(SimNode& node, u16 connHandle, u8 localReason, u8 remoteReason)
+{
+	SimLink& link = node.links[connHandle];
+	PushDisconnected(node, connHandle, localReason);
+
+	if (!link.partnerLost) {
+		SimMessage message;
+		message.type = SimMessageType::DISCONNECT;
+		message.targetIndex = link.partnerIndex;
+		message.linkId = link.linkId;
+		message.reason = remoteReason;
+		SendMessage(node, message);
+	}
+
+	DeactivateLink(link);
+}
+
+void CherrySim::ProcessSupervisionTimeout(SimNode& node, u16 connHandle)
+{
+	SimLink& link = node.links[connHandle];
+	if (!link.partnerLost) return;
+
+	PushDisconnected(node, connHandle, BLE_HCI_CONNECTION_TIMEOUT);
+	DeactivateLink(link);
+}
+
+#define _________________SERVICES_________________
+
+void CherrySim::ProcessFlashOperation(SimNode& node)
+{
+	if (!node.flashBusy) return;
+	node.flashBusy = false;
+
+	SimFlashOperation& op = node.flashOperation;
+	if (op.erase) {
+		memset(node.hw.flash + op.page * SIM_FLASH_PAGE_SIZE, 0xFF, SIM_FLASH_PAGE_SIZE);
+	}
+	else {
+		//Flash bits can only be cleared by a write
+		for (u32 i = 0; i < op.data.size(); i++) {
+			op.destination[i] &= op.data[i];
+		}
+	}
+
+	PushSocEvent(node, NRF_EVT_FLASH_OPERATION_SUCCESS);
+}
+
+void CherrySim::StartServiceDiscovery(u16 connHandle, const ble_uuid_t& uuid, int delayMs)
+{
+	ScheduleEvent(simTimeUs + (SimTime)delayMs * SIM_TIME_MS, SimEventType::SERVICE_DISCOVERY, currentNode->index, currentNode->rebootCounter, connHandle, &uuid);
+}
+
+//Searches the copy of the partner GATT table and reports the result to the discovery handler
+void CherrySim::ProcessServiceDiscovery(SimNode& node, u16 connHandle, const ble_uuid_t& uuid)
+{
+	SimLink* link = FindLink(node, connHandle);
+	if (link == nullptr || link->partnerLost || GS->dbDiscoveryHandler == nullptr) return;
+
+	//The GATT table of the peripheral arrives together with the acceptance of the connection
+	if (!link->established) {
+		ScheduleEvent(simTimeUs + lookaheadUs, SimEventType::SERVICE_DISCOVERY, node.index, node.rebootCounter, connHandle, &uuid);
+		return;
+	}
+
+	ble_db_discovery_evt_t evt;
+	CheckedMemset(&evt, 0x00, sizeof(evt));
+	evt.conn_handle = connHandle;
+	evt.evt_type = BLE_DB_DISCOVERY_SRV_NOT_FOUND;
+
+	for (const SimGattService& service : link->partnerServices) {
+		if (service.uuid.uuid != uuid.uuid || service.uuid.type != uuid.type) continue;
+
+		evt.evt_type = BLE_DB_DISCOVERY_COMPLETE;
+		ble_gatt_db_srv_t& db = evt.params.discovered_db;
+		db.srv_uuid = service.uuid;
+		db.handle_range.start_handle = service.handle;
+		db.handle_range.end_handle = service.endHandle;
+
+		for (const SimGattAttribute& c : link->partnerCharacteristics) {
+			if (c.serviceHandle != service.handle || db.char_count >= BLE_GATT_DB_MAX_CHARS) continue;
+			ble_gatt_db_char_t& dbChar = db.charateristics[db.char_count];
+			dbChar.characteristic.uuid = c.uuid;
+			dbChar.characteristic.char_props = c.properties;
+			dbChar.characteristic.handle_decl = c.valueHandle - 1;
+			dbChar.characteristic.handle_value = c.valueHandle;
+			dbChar.cccd_handle = c.cccdHandle;
+			db.char_count++;
+		}
+		break;
+	}
+
+	try {
+		GS->dbDiscoveryHandler(&evt);
+	}
+	catch (const NodeRebootException&) {
+		ResetNode(node);
+		return;
+	}
+	MarkNodePending(node);
+}
+
+#define _________________STATISTICS_______________
+
+//Statistics are collected per partition so that the threads need not share them
+void CherrySim::CountStatistic(const char* key)
+{
+	GetPartition(*currentNode).statCounters[key]++;
+}
+
+void CherrySim::AverageStatistic(const char* key, int value)
+{
+	auto& entry = GetPartition(*currentNode).statAverages[key];
+	entry.first += value;
+	entry.second++;
+}
+
+void CherrySim::ReportError(const char* file, int line)
+{
+	GetPartition(*currentNode).simErrors++;
+	fprintf(stderr, "CherrySim: Error on node %u in %s:%d" EOL, currentNode->id, file, line);
+}
+
+#define _________________TERMINAL_________________
+
+void CherrySim::ChooseSimulatorTerminal()
+{
+	if (simConfig.terminalId != 0 && currentNode->id == simConfig.terminalId) {
+		printf("CherrySim: Terminal is connected to node %u" EOL, currentNode->id);
+	}
+}
+
+void CherrySim::TerminalPrintHandler(const char* message)
+{
+	if (!IsTerminalNode(*currentNode)) return;
+	fputs(message, stdout);
+}
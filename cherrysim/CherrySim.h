@@ -0,0 +1,573 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * CherrySim runs any number of FruityMesh nodes in a single host process. It
+ * is a discrete event simulator: all radio, flash and timer activity of the
+ * simulated SoftDevice is converted into events that are processed in virtual
+ * time, so a simulation runs as fast as the host can execute the firmware and
+ * not as fast as the real radio would.
+ *
+ * Each node owns a complete GlobalState. Before the firmware of a node is
+ * executed, CherrySim swaps the node hardware (see SystemTest.h) so that GS,
+ * the register maps and the flash point to that node.
+ *
+ * The nodes are split into partitions of neighbouring nodes, each with its own
+ * event queue. Partitions are simulated in parallel in time windows of the
+ * configured lookahead. Nodes only interact through messages: inside a
+ * partition they are delivered immediately, across partitions they arrive
+ * one lookahead later through the mailbox of the receiving partition. As no
+ * message can arrive within the window in which it was sent, the results
+ * only depend on the seed and the number of partitions, never on the number
+ * of threads.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Exceptions.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <ble.h>
+#include <ble_gap.h>
+#include <ble_gatts.h>
+#include <ble_hci.h>
+#include <nrf_soc.h>
+#include <ble_db_discovery.h>
+#include <ble_stack_handler_types.h>
+}
+
+class GlobalState;
+
+//Virtual time is kept in microseconds
+typedef unsigned long long SimTime;
+
+constexpr SimTime SIM_TIME_MS = 1000ULL;
+constexpr SimTime SIM_TIME_SEC = 1000ULL * SIM_TIME_MS;
+constexpr u32 SIM_RTC_FREQUENCY = 32768;
+constexpr u32 SIM_RTC_MASK = 0x00FFFFFF; //The RTC of the nRF is 24 bit wide
+constexpr u32 SIM_MAX_NODES = 4000;
+constexpr u32 SIM_MAX_PARTITIONS = 256;
+constexpr u32 SIM_MAX_CONNECTIONS_PER_NODE = 8;
+constexpr u32 SIM_TX_BUFFERS_PER_CONNECTION = 7;
+constexpr u32 SIM_PACKETS_PER_CONNECTION_EVENT = 6;
+
+struct SimConfiguration
+{
+	u32 seed = 1;
+	u32 numNodes = 500;
+
+	//Highway deployment: beacons alternate between both road sides, odd node ids
+	//are placed on the lane that drives towards higher node ids
+	double nodeSpacingMeters = 50.0;
+	double roadWidthMeters = 20.0;
+
+	//Log-distance path loss model, packets below the sensitivity are not received
+	i8 rssiAtOneMeter = -40;
+	double pathLossExponent = 2.0;
+	i8 receiverSensitivity = -90;
+	u8 rssiNoise = 3;
+
+	//Probability in percent that a packet is lost although the receiver is in range
+	u32 advertisingLossPercent = 5;
+	u32 connectionPacketLossPercent = 2;
+
+	bool useS130 = false;
+
+	//The results depend on the number of partitions, the number of threads only changes the speed
+	u32 numPartitions = 1;
+	u32 numThreads = 1;
+	//Delay of messages between partitions and length of a time window, 0 uses one MAIN_TIMER_TICK
+	SimTime lookaheadUs = 0;
+
+	//Terminal input and output is only enabled for this node, 0 enables all nodes
+	//and an id that does not belong to a simulated node disables the terminal
+	NodeId terminalId = 1;
+	bool verboseCommands = true;
+	//All log output of the other nodes is discarded
+	bool muteOtherNodes = true;
+	bool interactive = false;
+};
+
+struct SimBleEvent
+{
+	u16 length;
+	u32 data[CEIL_DIV(BLE_STACK_EVT_MSG_BUF_SIZE, sizeof(u32))];
+};
+
+struct SimGattAttribute
+{
+	u16 serviceHandle;
+	ble_uuid_t uuid;
+	ble_gatt_char_props_t properties;
+	u16 valueHandle;
+	u16 cccdHandle;
+};
+
+struct SimGattService
+{
+	ble_uuid_t uuid;
+	u16 handle;
+	u16 endHandle;
+};
+
+struct SimNeighbour
+{
+	u32 nodeIndex;
+	i8 rssi;
+	//Set if the neighbour belongs to a different partition
+	bool remote;
+};
+
+struct SimNodeState
+{
+	bool initialized = false;
+};
+
+struct SimFlashOperation
+{
+	bool erase = false;
+	u32 page = 0;
+	u32* destination = nullptr;
+	std::vector<u32> data;
+};
+
+enum class SimPacketType : u8
+{
+	WRITE_REQ,
+	WRITE_CMD,
+	NOTIFICATION
+};
+
+struct SimPacket
+{
+	SimPacketType type;
+	u16 handle;
+	u8 length;
+	u8 data[GATT_MTU_SIZE_DEFAULT];
+};
+
+//One side of a connection, the connection handle is the index in the link table of the node.
+//Both sides only share the link id and keep each other up to date through messages.
+struct SimLink
+{
+	bool active = false;
+	u32 generation = 0;
+	unsigned long long linkId = 0;
+	u8 role = BLE_GAP_ROLE_INVALID;
+	u32 partnerIndex = 0;
+	ble_gap_addr_t partnerAddress;
+	//The central may only transmit once the peripheral has accepted the connection
+	bool established = false;
+	//Set once the partner rebooted, the link only notices after the supervision timeout
+	bool partnerLost = false;
+	ble_gap_conn_params_t params;
+	SimTime anchorUs = 0;
+	bool eventScheduled = false;
+	i8 rssi = 0;
+
+	std::deque<SimPacket> queue;
+	bool writeResponsePending = false;
+	u8 txBuffersUsed = 0;
+	bool rssiReporting = false;
+	SimTime lastRssiReportUs = 0;
+
+	//Central: encryption was started and the key is sent with the next connection event
+	bool encryptionRequested = false;
+	bool encryptionRequestSent = false;
+	//Peripheral: the central asked for encryption and waits for the key of the firmware
+	bool securityInfoRequested = false;
+	bool securityInfoReplied = false;
+	u8 centralKey[BLE_GAP_SEC_KEY_LEN];
+	u8 peripheralKey[BLE_GAP_SEC_KEY_LEN];
+
+	bool disconnecting = false;
+	u8 disconnectReason = 0;
+
+	bool paramUpdatePending = false;
+	ble_gap_conn_params_t pendingParams;
+
+	//Copy of the GATT table of the partner, it is exchanged when the connection is set up
+	std::vector<SimGattService> partnerServices;
+	std::vector<SimGattAttribute> partnerCharacteristics;
+};
+
+struct SimNode
+{
+	u32 index = 0;
+	NodeId id = 0;
+	u8 direction = 0;
+	double x = 0;
+	double y = 0;
+	u32 partition = 0;
+
+	SimNodeHardware hw;
+	std::unique_ptr<u8[]> globalStateMemory;
+	std::vector<u32> flashMemory;
+	std::vector<u32> moduleMemory;
+	RamRetainStruct ramRetainStruct;
+	u32 rebootMagicNumber = 0;
+	u32 hardwareRebootReason = 0;
+	u32 rebootCounter = 0;
+	//Random numbers of the firmware and of the radio model are kept apart
+	u32 randomState = 0;
+	u32 radioRandomState = 0;
+	bool booted = false;
+	SimTime bootTimeUs = 0;
+	SimTime timerStartUs = 0;
+	unsigned long long timerTicks = 0;
+
+	//Used by the firmware when running in the simulator
+	u32 fakeDfuVersion = 0;
+	bool fakeDfuVersionArmed = false;
+	SimNodeState state;
+
+	//Simulated SoftDevice
+	bool bleEnabled = false;
+	u8 maxPeripheralConnections = 0;
+	u8 maxCentralConnections = 0;
+	ble_gap_addr_t address;
+
+	bool advertising = false;
+	ble_gap_adv_params_t advParams;
+	u8 advData[BLE_GAP_ADV_MAX_SIZE];
+	u8 advDataLength = 0;
+	u32 advGeneration = 0;
+
+	bool scanning = false;
+	ble_gap_scan_params_t scanParams;
+	u32 scanGeneration = 0;
+
+	bool connecting = false;
+	ble_gap_addr_t connectingAddress;
+	ble_gap_scan_params_t connectingScanParams;
+	ble_gap_conn_params_t connectingConnParams;
+	u32 connectingGeneration = 0;
+
+	SimLink links[SIM_MAX_CONNECTIONS_PER_NODE];
+	//Survives reboots so that a link id is never used twice
+	u32 linkCounter = 0;
+
+	std::deque<SimBleEvent> bleEvents;
+	std::deque<u32> socEvents;
+	bool flashBusy = false;
+	SimFlashOperation flashOperation;
+
+	std::vector<SimGattService> services;
+	std::vector<SimGattAttribute> characteristics;
+	std::vector<ble_uuid128_t> vendorUuids;
+	u16 nextAttributeHandle = 1;
+
+	std::vector<SimNeighbour> neighbours;
+	bool eventLooperPending = false;
+};
+
+enum class SimMessageType : u8
+{
+	ADVERTISEMENT,
+	CONNECT_REQUEST,
+	CONNECT_ACCEPT,
+	CONNECT_REJECT,
+	PACKET,
+	PARAM_UPDATE,
+	ENCRYPTION_REQUEST,
+	ENCRYPTION_COMPLETE,
+	DISCONNECT,
+	LINK_LOST
+};
+
+//Everything that a node does to another node, only the fields of the message type are used
+struct SimMessage
+{
+	//Intrusive link of the mailbox
+	SimMessage* next = nullptr;
+	SimTime sentUs = 0;
+	SimTime arrivalUs = 0;
+	u32 sourcePartition = 0;
+	unsigned long long sequence = 0;
+
+	SimMessageType type = SimMessageType::ADVERTISEMENT;
+	u32 sourceIndex = 0;
+	u32 targetIndex = 0;
+	unsigned long long linkId = 0;
+	u8 reason = 0;
+	i8 rssi = 0;
+
+	ble_gap_addr_t address;
+	u8 advType = 0;
+	u8 dataLength = 0;
+	u8 data[BLE_GAP_ADV_MAX_SIZE];
+
+	SimPacket packet;
+	ble_gap_conn_params_t params;
+	SimTime anchorUs = 0;
+	u8 key[BLE_GAP_SEC_KEY_LEN];
+	std::vector<SimGattService> services;
+	std::vector<SimGattAttribute> characteristics;
+};
+
+//Lock-free multiple producer, single consumer mailbox. All partitions push their
+//messages during a window, the receiving partition takes them all between two windows.
+class SimMailbox
+{
+private:
+	std::atomic<SimMessage*> head;
+
+public:
+	SimMailbox() : head(nullptr) {}
+	~SimMailbox();
+
+	void Push(SimMessage* message);
+	//Returns the messages in reverse order of their arrival
+	SimMessage* TakeAll();
+};
+
+enum class SimEventType : u8
+{
+	NODE_BOOT,
+	NODE_TIMER,
+	ADVERTISING,
+	CONNECTION_EVENT,
+	GAP_TIMEOUT,
+	FLASH_OPERATION,
+	SERVICE_DISCOVERY,
+	SUPERVISION_TIMEOUT,
+	VEHICLE_ADVERTISING,
+	MESSAGE
+};
+
+struct SimEvent
+{
+	SimTime timeUs;
+	unsigned long long sequence;
+	SimEventType type;
+	u32 index;
+	u32 generation;
+	u32 param;
+	ble_uuid_t uuid;
+	std::unique_ptr<SimMessage> message;
+
+	bool operator>(const SimEvent& other) const
+	{
+		if (timeUs != other.timeUs) return timeUs > other.timeUs;
+		return sequence > other.sequence;
+	}
+};
+
+//A vehicle that drives along the road and broadcasts non connectable advertising packets
+struct SimVehicle
+{
+	double x = 0;
+	double y = 0;
+	double speedMetersPerSec = 0;
+	SimTime startTimeUs = 0;
+	SimTime endTimeUs = 0;
+	u16 advIntervalMs = 100;
+	u8 advData[BLE_GAP_ADV_MAX_SIZE];
+	u8 advDataLength = 0;
+	ble_gap_addr_t address;
+};
+
+//A group of neighbouring nodes that is simulated by one thread at a time
+struct SimPartition
+{
+	u32 index = 0;
+	u32 firstNode = 0;
+	u32 endNode = 0;
+	SimTime timeUs = 0;
+
+	//Min heap of events, the events are moved out of it so that messages need not be copied
+	std::vector<SimEvent> eventQueue;
+	unsigned long long eventSequence = 0;
+	unsigned long long messageSequence = 0;
+	std::vector<u32> pendingNodes;
+	SimMailbox mailbox;
+	//Every partition advertises its own copy of each vehicle to its own nodes
+	std::vector<u32> vehicleRandomState;
+	std::exception_ptr failure;
+
+	unsigned long long processedEvents = 0;
+	unsigned long long establishedConnections = 0;
+	unsigned long long deliveredAdvertisements = 0;
+	unsigned long long deliveredPackets = 0;
+	unsigned long long sentMessages = 0;
+	u32 simErrors = 0;
+	std::map<std::string, unsigned long long> statCounters;
+	std::map<std::string, std::pair<long long, unsigned long long>> statAverages;
+};
+
+class CherrySim
+{
+private:
+	u32 randomState = 1;
+	SimTime lookaheadUs = 0;
+	static SIM_THREAD_LOCAL SimPartition* currentPartition;
+
+	//Worker threads, the thread that calls SimulateUntil works on the partitions as well
+	std::vector<std::thread> workers;
+	std::mutex windowMutex;
+	std::condition_variable windowStarted;
+	std::condition_variable windowFinished;
+	u32 windowCounter = 0;
+	u32 busyWorkers = 0;
+	bool shuttingDown = false;
+	SimTime windowEndUs = 0;
+	std::atomic<u32> nextPartition;
+
+	void CreatePartitions();
+	void StartWorkers();
+	void StopWorkers();
+	void WorkerLoop();
+	void SimulatePartitions();
+	void SimulatePartition(SimPartition& partition);
+	void SimulateWindow(SimTime endUs);
+	void CollectMessages(SimPartition& partition);
+	void UpdateStatistics();
+
+	void BuildNeighbourLists();
+	i8 CalculateRssi(double distanceMeters) const;
+	i8 AddRssiNoise(SimNode& receiver, i8 rssi);
+	bool RollLoss(SimNode& node, u32 lossPercent);
+	bool RollScanReception(SimNode& receiver, const ble_gap_scan_params_t& scanParams, u32 lossPercent);
+	u32 NextRadioRandom(SimNode& node);
+
+	void BootNode(SimNode& node);
+	void ResetNode(SimNode& node);
+	void FlushEventLoopers(SimPartition& partition);
+
+	void PushEvent(SimPartition& partition, SimEvent&& event);
+	void ProcessEvent(SimEvent& event);
+	void ProcessNodeTimer(SimNode& node);
+	void ProcessAdvertising(SimNode& node, u32 generation);
+	void ProcessConnectionEvent(SimNode& node, u16 connHandle);
+	void ProcessGapTimeout(SimNode& node, u8 source, u32 generation);
+	void ProcessFlashOperation(SimNode& node);
+	void ProcessServiceDiscovery(SimNode& node, u16 connHandle, const ble_uuid_t& uuid);
+	void ProcessSupervisionTimeout(SimNode& node, u16 connHandle);
+	void ProcessVehicleAdvertising(SimPartition& partition, u32 vehicleIndex);
+
+	void SendMessage(SimNode& sender, SimMessage& message);
+	void ReceiveMessage(SimMessage& message);
+	bool ReceiveAdvertisement(SimNode& receiver, const SimMessage& message, i8 rssi);
+	void ReceiveRemoteAdvertisement(const SimMessage& message);
+	void ReceiveConnectRequest(SimNode& peripheral, const SimMessage& message);
+	void ReceiveLinkMessage(SimNode& node, const SimMessage& message);
+
+	void DeliverAdvertisement(SimNode& receiver, const ble_gap_addr_t& address, u8 advType, const u8* data, u8 length, i8 rssi);
+	void ConnectToAdvertiser(SimNode& central, const SimMessage& advertisement, i8 rssi);
+	SimLink* ActivateLink(SimNode& node, u16* connHandle);
+	void DeactivateLink(SimLink& link);
+	SimLink* FindLinkById(SimNode& node, unsigned long long linkId, u16* connHandle);
+	void PushConnected(SimNode& node, u16 connHandle);
+	void PushConnSecUpdate(SimNode& node, u16 connHandle);
+	void PushDisconnected(SimNode& node, u16 connHandle, u8 reason);
+	void TerminateLink(SimNode& node, u16 connHandle, u8 localReason, u8 remoteReason);
+	void PushTxComplete(SimNode& node, u16 connHandle, u8 count);
+
+public:
+	SimConfiguration simConfig;
+	//Node and time of the calling thread, each worker simulates a different partition
+	static SIM_THREAD_LOCAL SimNode* currentNode;
+	static SIM_THREAD_LOCAL SimTime simTimeUs;
+	u32 globalBreakCounter = 0;
+
+	std::vector<std::unique_ptr<SimNode>> nodes;
+	std::vector<std::unique_ptr<SimPartition>> partitions;
+	std::vector<SimVehicle> vehicles;
+
+	//Statistics, summed up over all partitions after each window
+	unsigned long long processedEvents = 0;
+	unsigned long long establishedConnections = 0;
+	unsigned long long deliveredAdvertisements = 0;
+	unsigned long long deliveredPackets = 0;
+	unsigned long long sentMessages = 0;
+	unsigned long long simulatedWindows = 0;
+	u32 simErrors = 0;
+	std::map<std::string, unsigned long long> statCounters;
+	std::map<std::string, std::pair<long long, unsigned long long>> statAverages;
+
+	//Called after a node has changed its advertising data, may be called by several threads at once
+	std::function<void(SimNode& node, const u8* data, u8 length)> advertisingDataHandler;
+
+	explicit CherrySim(const SimConfiguration& simConfig);
+	~CherrySim();
+
+	void Init();
+	//Simulates one lookahead window
+	void SimulateStep();
+	//Processes all events before the given time
+	void SimulateUntil(SimTime timeUs);
+	//The condition is checked after every window
+	bool SimulateUntilCondition(SimTime maxTimeUs, std::function<bool()> condition);
+
+	void SetCurrentNode(SimNode* node);
+	SimNode* FindNodeById(NodeId id);
+	SimPartition& GetPartition(const SimNode& node);
+	bool IsTerminalNode(const SimNode& node) const;
+	void SendTerminalCommand(NodeId id, const char* command);
+	u32 AddVehicle(const SimVehicle& vehicle);
+
+	//Interface that is used by the simulated SoftDevice, always for nodes of the calling thread
+	void ScheduleEvent(SimTime timeUs, SimEventType type, u32 index, u32 generation = 0, u32 param = 0, const ble_uuid_t* uuid = nullptr);
+	ble_evt_t* PushBleEvent(SimNode& node, u16 eventId, u16 length = sizeof(ble_evt_t));
+	void PushSocEvent(SimNode& node, u32 eventId);
+	void MarkNodePending(SimNode& node);
+	//Random numbers for setting up a simulation, must not be used by the nodes
+	u32 NextRandom();
+	u32 NextNodeRandom(SimNode& node);
+	u32 GetRtcTicks(const SimNode& node) const;
+	void ScheduleAdvertising(SimNode& node, bool firstEvent);
+	void ScheduleConnectionEvent(SimNode& node, u16 connHandle);
+	void ScheduleGapTimeout(SimNode& node, u8 source, u32 generation, u16 timeoutSec);
+	SimLink* FindLink(SimNode& node, u16 connHandle);
+	u32 CountLinks(const SimNode& node, u8 role) const;
+
+	//Interface that is used by the firmware
+	void ChooseSimulatorTerminal();
+	void StartServiceDiscovery(u16 connHandle, const ble_uuid_t& uuid, int delayMs);
+	void TerminalPrintHandler(const char* message);
+	void CountStatistic(const char* key);
+	void AverageStatistic(const char* key, int value);
+	void ReportError(const char* file, int line);
+};
+
+extern CherrySim* cherrySimInstance;
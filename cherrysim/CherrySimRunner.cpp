@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The CherrySim runner simulates a highway that is equipped with beacons on both
+ * road sides. It measures how long it takes until all beacons have formed a
+ * single cluster and how fast the rescue lane alarm of an emergency vehicle is
+ * propagated to the beacons afterwards.
+ *
+ * Usage: cherrySim_runner [numNodes] [seed] [numThreads] [numPartitions] [terminalNodeId]
+ * The results only depend on the seed and the number of partitions, the number
+ * of threads defaults to the number of cores. The log output of all nodes is
+ * discarded unless a terminal node is given.
+ */
+
+#include <CherrySim.h>
+#include <GlobalState.h>
+#include <Node.h>
+#include <AlarmModule.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+//How long we wait for the mesh to form before the emergency vehicle starts
+constexpr SimTime RUNNER_MAX_CLUSTERING_TIME_US = 600 * SIM_TIME_SEC;
+constexpr SimTime RUNNER_CLUSTER_CHECK_INTERVAL_US = 1 * SIM_TIME_SEC;
+constexpr SimTime RUNNER_ALARM_DURATION_US = 60 * SIM_TIME_SEC;
+
+//The emergency vehicle drives with 130 km/h on the lane of the odd node ids
+constexpr double RUNNER_VEHICLE_SPEED_METERS_PER_SEC = 36.0;
+constexpr u8 RUNNER_VEHICLE_DIRECTION = 3;
+constexpr u8 RUNNER_DEVICE_TYPE_EMERGENCY = 3;
+
+//A node id that is not used by any simulated node, disables the terminal
+constexpr NodeId RUNNER_NO_TERMINAL = SIM_MAX_NODES + 1;
+//Enough partitions to keep the usual number of cores busy, each one still spans several radio ranges
+constexpr u32 RUNNER_DEFAULT_PARTITIONS = 16;
+
+static SimTime alarmStartUs = 0;
+static std::vector<SimTime> alarmReceivedUs;
+
+//Returns the size of the largest cluster, reads the node state of every booted node
+static u32 GetLargestClusterSize(CherrySim& sim)
+{
+	std::unordered_map<ClusterId, u32> clusterSizes;
+	u32 largest = 0;
+	for (auto& node : sim.nodes) {
+		if (!node->booted) continue;
+		sim.SetCurrentNode(node.get());
+		u32 size = ++clusterSizes[GS->node.clusterId];
+		if (size > largest) largest = size;
+	}
+	sim.SetCurrentNode(nullptr);
+	return largest;
+}
+
+//Looks for the penguin advertising data and checks if a rescue lane alarm is included
+static void AdvertisingDataHandler(SimNode& node, const u8* data, u8 length)
+{
+	if (alarmStartUs == 0 || alarmReceivedUs[node.index] != 0) return;
+
+	u8 i = 0;
+	while (i + 1 < length) {
+		u8 fieldLength = data[i];
+		if (fieldLength == 0 || i + fieldLength >= length) return;
+
+		if (data[i + 1] == SERVICE_TYPE_ALARM_UPDATE && fieldLength + 1 >= (u8)sizeof(AdvPacketPenguinData)) {
+			AdvPacketPenguinData penguinData;
+			memcpy(&penguinData, data + i, sizeof(AdvPacketPenguinData));
+			if (penguinData.nearestRescueLaneNodeId != 0 || penguinData.nearestRescueLaneOppositeLaneNodeId != 0) {
+				alarmReceivedUs[node.index] = cherrySimInstance->simTimeUs;
+			}
+			return;
+		}
+		i += fieldLength + 1;
+	}
+}
+
+static SimVehicle CreateEmergencyVehicle(CherrySim& sim)
+{
+	SimVehicle vehicle;
+	vehicle.x = 0;
+	vehicle.y = 0;
+	vehicle.speedMetersPerSec = RUNNER_VEHICLE_SPEED_METERS_PER_SEC;
+	vehicle.startTimeUs = sim.simTimeUs;
+	vehicle.endTimeUs = sim.simTimeUs + RUNNER_ALARM_DURATION_US;
+	vehicle.advIntervalMs = 100;
+
+	vehicle.address.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	for (u32 i = 0; i < BLE_GAP_ADDR_LEN; i++) vehicle.address.addr[i] = (u8)sim.NextRandom();
+	vehicle.address.addr[BLE_GAP_ADDR_LEN - 1] |= 0xC0;
+
+	AdvPacketCarData carData;
+	CheckedMemset(&carData, 0x00, sizeof(AdvPacketCarData));
+	carData.len = SIZE_ADV_PACKET_CAR_DATA - 1;
+	carData.deviceType = RUNNER_DEVICE_TYPE_EMERGENCY;
+	carData.direction = RUNNER_VEHICLE_DIRECTION;
+	carData.isEmergency = 1;
+	carData.deviceID = 0xE001;
+
+	advPacketCarServiceAndDataHeader header;
+	CheckedMemset(&header, 0x00, sizeof(advPacketCarServiceAndDataHeader));
+	header.flags = 0x0103;
+	header.mway_service_uuid = 0xFE12;
+	header.flags2 = 0x0103;
+	header.mway_service_uuid2 = 0xFE12;
+	memcpy(header.data, &carData, SIZE_ADV_PACKET_CAR_DATA);
+
+	vehicle.advDataLength = (u8)std::min<size_t>(sizeof(advPacketCarServiceAndDataHeader), BLE_GAP_ADV_MAX_SIZE);
+	memcpy(vehicle.advData, &header, vehicle.advDataLength);
+
+	return vehicle;
+}
+
+static double ToSec(SimTime timeUs)
+{
+	return (double)timeUs / SIM_TIME_SEC;
+}
+
+int main(int argc, char** argv)
+{
+	SimConfiguration simConfig;
+	if (argc > 1) simConfig.numNodes = (u32)strtoul(argv[1], nullptr, 10);
+	if (argc > 2) simConfig.seed = (u32)strtoul(argv[2], nullptr, 10);
+	simConfig.numThreads = argc > 3 ? (u32)strtoul(argv[3], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+	simConfig.numPartitions = argc > 4 ? (u32)strtoul(argv[4], nullptr, 10) : std::min(RUNNER_DEFAULT_PARTITIONS, simConfig.numNodes);
+	simConfig.terminalId = argc > 5 ? (NodeId)strtoul(argv[5], nullptr, 10) : RUNNER_NO_TERMINAL;
+	simConfig.muteOtherNodes = true;
+
+	auto wallStart = std::chrono::steady_clock::now();
+
+	CherrySim sim(simConfig);
+	alarmReceivedUs.assign(simConfig.numNodes, 0);
+	sim.advertisingDataHandler = AdvertisingDataHandler;
+	sim.Init();
+
+	printf("Simulating %u nodes on %.1f km of highway, seed %u, %u partitions on %u threads\n",
+		simConfig.numNodes, simConfig.numNodes / 2 * simConfig.nodeSpacingMeters / 1000.0, simConfig.seed,
+		simConfig.numPartitions, simConfig.numThreads);
+
+	//Phase 1: Wait until all nodes are part of the same cluster
+	u32 largestCluster = 0;
+	SimTime nextCheckUs = RUNNER_CLUSTER_CHECK_INTERVAL_US;
+	bool clustered = sim.SimulateUntilCondition(RUNNER_MAX_CLUSTERING_TIME_US, [&]() {
+		if (sim.simTimeUs < nextCheckUs) return false;
+		nextCheckUs += RUNNER_CLUSTER_CHECK_INTERVAL_US;
+		largestCluster = GetLargestClusterSize(sim);
+		return largestCluster == simConfig.numNodes;
+	});
+
+	if (clustered) {
+		printf("Cluster formation: all nodes clustered after %.3f s\n", ToSec(sim.simTimeUs));
+	}
+	else {
+		printf("Cluster formation: largest cluster has %u of %u nodes after %.3f s\n", largestCluster, simConfig.numNodes, ToSec(sim.simTimeUs));
+	}
+
+	//Phase 2: An emergency vehicle enters the highway at the first node
+	alarmStartUs = sim.simTimeUs;
+	sim.AddVehicle(CreateEmergencyVehicle(sim));
+	sim.SimulateUntil(alarmStartUs + RUNNER_ALARM_DURATION_US);
+
+	std::vector<SimTime> latencies;
+	for (SimTime receivedUs : alarmReceivedUs) {
+		if (receivedUs != 0) latencies.push_back(receivedUs - alarmStartUs);
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("Alarm propagation: %u of %u nodes advertise the rescue lane\n", (u32)latencies.size(), simConfig.numNodes);
+	if (!latencies.empty()) {
+		printf("Alarm latency: min %.3f s, median %.3f s, p90 %.3f s, max %.3f s\n",
+			ToSec(latencies.front()),
+			ToSec(latencies[latencies.size() / 2]),
+			ToSec(latencies[latencies.size() * 9 / 10]),
+			ToSec(latencies.back()));
+	}
+
+	double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	printf("Simulated %.3f s in %.3f s wall time (%.1fx real time)\n", ToSec(sim.simTimeUs), wallSec, wallSec > 0 ? ToSec(sim.simTimeUs) / wallSec : 0);
+	printf("Events %llu, connections %llu, advertisements %llu, packets %llu, errors %u\n",
+		sim.processedEvents, sim.establishedConnections, sim.deliveredAdvertisements, sim.deliveredPackets, sim.simErrors);
+	printf("Windows %llu, messages between partitions %llu\n", sim.simulatedWindows, sim.sentMessages);
+	for (auto& counter : sim.statCounters) {
+		printf("  %s: %llu\n", counter.first.c_str(), counter.second);
+	}
+
+	return clustered ? 0 : 1;
+}
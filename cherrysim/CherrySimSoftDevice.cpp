@@ -0,0 +1,670 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Simulated SoftDevice and chip peripherals for CherrySim. All functions act on
+ * the node that is currently executed (cherrySimInstance->currentNode), effects
+ * on other nodes are sent to them as simulator messages.
+ */
+
+#include <CherrySim.h>
+#include <GlobalState.h>
+
+#include <cstdio>
+#include <cstring>
+#include <typeindex>
+#include <unordered_set>
+
+extern "C" {
+#include <app_timer.h>
+#include <nrf_error.h>
+}
+
+static SimNode& CurrentNode()
+{
+	return *cherrySimInstance->currentNode;
+}
+
+static bool IsTransmitLengthValid(u16 length)
+{
+	//One ATT packet with the default MTU
+	return length <= GATT_MTU_SIZE_DEFAULT - 3;
+}
+
+#define _________________EXCEPTIONS_______________
+
+static std::unordered_set<std::type_index> ignoredExceptions;
+
+bool sim_is_exception_ignored(const std::type_index& type)
+{
+	return ignoredExceptions.find(type) != ignoredExceptions.end();
+}
+
+void sim_set_exception_ignored(const std::type_index& type, bool ignored)
+{
+	if (ignored) ignoredExceptions.insert(type);
+	else ignoredExceptions.erase(type);
+}
+
+void sim_report_exception(const char* name, const char* file, int line)
+{
+	NodeId id = (cherrySimInstance != nullptr && cherrySimInstance->currentNode != nullptr) ? cherrySimInstance->currentNode->id : 0;
+	fprintf(stderr, "CherrySim: %s on node %u in %s:%d" EOL, name, id, file, line);
+}
+
+#define _________________AES______________________
+
+//Compact AES-128 implementation for the ECB peripheral
+static const u8 aesSbox[256] = {
+	0x63,0x7c,0x77,0x7b,0xf2,0x6b,0x6f,0xc5,0x30,0x01,0x67,0x2b,0xfe,0xd7,0xab,0x76,
+	0xca,0x82,0xc9,0x7d,0xfa,0x59,0x47,0xf0,0xad,0xd4,0xa2,0xaf,0x9c,0xa4,0x72,0xc0,
+	0xb7,0xfd,0x93,0x26,0x36,0x3f,0xf7,0xcc,0x34,0xa5,0xe5,0xf1,0x71,0xd8,0x31,0x15,
+	0x04,0xc7,0x23,0xc3,0x18,0x96,0x05,0x9a,0x07,0x12,0x80,0xe2,0xeb,0x27,0xb2,0x75,
+	0x09,0x83,0x2c,0x1a,0x1b,0x6e,0x5a,0xa0,0x52,0x3b,0xd6,0xb3,0x29,0xe3,0x2f,0x84,
+	0x53,0xd1,0x00,0xed,0x20,0xfc,0xb1,0x5b,0x6a,0xcb,0xbe,0x39,0x4a,0x4c,0x58,0xcf,
+	0xd0,0xef,0xaa,0xfb,0x43,0x4d,0x33,0x85,0x45,0xf9,0x02,0x7f,0x50,0x3c,0x9f,0xa8,
+	0x51,0xa3,0x40,0x8f,0x92,0x9d,0x38,0xf5,0xbc,0xb6,0xda,0x21,0x10,0xff,0xf3,0xd2,
+	0xcd,0x0c,0x13,0xec,0x5f,0x97,0x44,0x17,0xc4,0xa7,0x7e,0x3d,0x64,0x5d,0x19,0x73,
+	0x60,0x81,0x4f,0xdc,0x22,0x2a,0x90,0x88,0x46,0xee,0xb8,0x14,0xde,0x5e,0x0b,0xdb,
+	0xe0,0x32,0x3a,0x0a,0x49,0x06,0x24,0x5c,0xc2,0xd3,0xac,0x62,0x91,0x95,0xe4,0x79,
+	0xe7,0xc8,0x37,0x6d,0x8d,0xd5,0x4e,0xa9,0x6c,0x56,0xf4,0xea,0x65,0x7a,0xae,0x08,
+	0xba,0x78,0x25,0x2e,0x1c,0xa6,0xb4,0xc6,0xe8,0xdd,0x74,0x1f,0x4b,0xbd,0x8b,0x8a,
+	0x70,0x3e,0xb5,0x66,0x48,0x03,0xf6,0x0e,0x61,0x35,0x57,0xb9,0x86,0xc1,0x1d,0x9e,
+	0xe1,0xf8,0x98,0x11,0x69,0xd9,0x8e,0x94,0x9b,0x1e,0x87,0xe9,0xce,0x55,0x28,0xdf,
+	0x8c,0xa1,0x89,0x0d,0xbf,0xe6,0x42,0x68,0x41,0x99,0x2d,0x0f,0xb0,0x54,0xbb,0x16
+};
+
+static u8 AesXtime(u8 x)
+{
+	return (u8)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+static void Aes128EncryptBlock(const u8* key, const u8* input, u8* output)
+{
+	u8 roundKeys[176];
+	memcpy(roundKeys, key, 16);
+	u8 rcon = 0x01;
+	for (u32 i = 16; i < 176; i += 4) {
+		u8 t[4] = { roundKeys[i - 4], roundKeys[i - 3], roundKeys[i - 2], roundKeys[i - 1] };
+		if (i % 16 == 0) {
+			u8 first = t[0];
+			t[0] = aesSbox[t[1]] ^ rcon;
+			t[1] = aesSbox[t[2]];
+			t[2] = aesSbox[t[3]];
+			t[3] = aesSbox[first];
+			rcon = AesXtime(rcon);
+		}
+		for (u32 k = 0; k < 4; k++) roundKeys[i + k] = roundKeys[i - 16 + k] ^ t[k];
+	}
+
+	u8 state[16];
+	for (u32 i = 0; i < 16; i++) state[i] = input[i] ^ roundKeys[i];
+
+	for (u32 round = 1; round <= 10; round++) {
+		//SubBytes and ShiftRows, the state is stored column by column
+		u8 tmp[16];
+		for (u32 col = 0; col < 4; col++) {
+			for (u32 row = 0; row < 4; row++) {
+				tmp[col * 4 + row] = aesSbox[state[((col + row) % 4) * 4 + row]];
+			}
+		}
+		//MixColumns is skipped in the last round
+		if (round != 10) {
+			for (u32 col = 0; col < 4; col++) {
+				u8* c = &tmp[col * 4];
+				u8 all = c[0] ^ c[1] ^ c[2] ^ c[3];
+				u8 first = c[0];
+				c[0] ^= all ^ AesXtime(c[0] ^ c[1]);
+				c[1] ^= all ^ AesXtime(c[1] ^ c[2]);
+				c[2] ^= all ^ AesXtime(c[2] ^ c[3]);
+				c[3] ^= all ^ AesXtime(c[3] ^ first);
+			}
+		}
+		for (u32 i = 0; i < 16; i++) state[i] = tmp[i] ^ roundKeys[round * 16 + i];
+	}
+
+	memcpy(output, state, 16);
+}
+
+#define _________________CHIP_____________________
+
+extern "C" {
+
+uint32_t ST_getRebootReason(void)
+{
+	return CurrentNode().hardwareRebootReason;
+}
+
+uint32_t sim_get_stack_type(void)
+{
+	return cherrySimInstance->simConfig.useS130 ? (u32)BleStackType::NRF_SD_130_ANY : (u32)BleStackType::NRF_SD_132_ANY;
+}
+
+void sim_stat_count(const char* key)
+{
+	cherrySimInstance->CountStatistic(key);
+}
+
+void sim_stat_avg(const char* key, int value)
+{
+	cherrySimInstance->AverageStatistic(key, value);
+}
+
+void sim_error(const char* file, int line)
+{
+	cherrySimInstance->ReportError(file, line);
+}
+
+//A reset unwinds the stack of the firmware, CherrySim catches it and reboots the node
+void NVIC_SystemReset(void)
+{
+	throw NodeRebootException();
+}
+
+uint32_t sd_nvic_SystemReset(void)
+{
+	throw NodeRebootException();
+}
+
+uint32_t sd_nvic_ClearPendingIRQ(uint32_t irq)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t * p_ticks)
+{
+	*p_ticks = cherrySimInstance->GetRtcTicks(CurrentNode());
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t * p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & SIM_RTC_MASK;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_app_evt_wait(void)
+{
+	//The simulator continues with the next event once the event loop of every node is done
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_evt_get(uint32_t * p_evt_id)
+{
+	SimNode& node = CurrentNode();
+	if (node.socEvents.empty()) return NRF_ERROR_NOT_FOUND;
+	*p_evt_id = node.socEvents.front();
+	node.socEvents.pop_front();
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_power_dcdc_mode_set(uint8_t dcdc_mode)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_power_mode_set(uint8_t power_mode)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_power_reset_reason_clr(uint32_t reset_reason_clr_msk)
+{
+	CurrentNode().hardwareRebootReason &= ~reset_reason_clr_msk;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_rand_application_vector_get(uint8_t * p_buff, uint8_t length)
+{
+	SimNode& node = CurrentNode();
+	for (u32 i = 0; i < length; i++) {
+		p_buff[i] = (u8)cherrySimInstance->NextNodeRandom(node);
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data)
+{
+	Aes128EncryptBlock(p_ecb_data->key, p_ecb_data->cleartext, p_ecb_data->ciphertext);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size)
+{
+	SimNode& node = CurrentNode();
+	if (node.flashBusy) return NRF_ERROR_BUSY;
+
+	u8* flashStart = node.hw.flash;
+	u8* destination = (u8*)p_dst;
+	if (destination < flashStart
+		|| destination + size * sizeof(u32) > flashStart + SIM_FLASH_SIZE
+		|| ((uintptr_t)destination % sizeof(u32)) != 0
+	) {
+		return NRF_ERROR_INVALID_ADDR;
+	}
+
+	//The source buffer is copied, the firmware is not allowed to rely on that
+	node.flashBusy = true;
+	node.flashOperation.erase = false;
+	node.flashOperation.destination = p_dst;
+	node.flashOperation.data.assign(p_src, p_src + size);
+
+	cherrySimInstance->ScheduleEvent(cherrySimInstance->simTimeUs + 46 * (SimTime)size, SimEventType::FLASH_OPERATION, node.index, node.rebootCounter);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_page_erase(uint32_t page_number)
+{
+	SimNode& node = CurrentNode();
+	if (node.flashBusy) return NRF_ERROR_BUSY;
+	if (page_number >= SIM_FLASH_NUM_PAGES) return NRF_ERROR_INVALID_ADDR;
+
+	node.flashBusy = true;
+	node.flashOperation.erase = true;
+	node.flashOperation.page = page_number;
+	node.flashOperation.data.clear();
+
+	cherrySimInstance->ScheduleEvent(cherrySimInstance->simTimeUs + 22 * SIM_TIME_MS, SimEventType::FLASH_OPERATION, node.index, node.rebootCounter);
+	return NRF_SUCCESS;
+}
+
+#define _________________BLE_COMMON_______________
+
+uint32_t sd_ble_enable(ble_enable_params_t * p_ble_enable_params, uint32_t * p_app_ram_base)
+{
+	SimNode& node = CurrentNode();
+	if (node.bleEnabled) return NRF_ERROR_INVALID_STATE;
+
+	//The S130 only supports a single peripheral connection
+	if (cherrySimInstance->simConfig.useS130 && p_ble_enable_params->gap_enable_params.periph_conn_count > 1) {
+		return NRF_ERROR_CONN_COUNT;
+	}
+	if (p_ble_enable_params->gap_enable_params.periph_conn_count + p_ble_enable_params->gap_enable_params.central_conn_count > SIM_MAX_CONNECTIONS_PER_NODE) {
+		return NRF_ERROR_CONN_COUNT;
+	}
+
+	node.maxPeripheralConnections = p_ble_enable_params->gap_enable_params.periph_conn_count;
+	node.maxCentralConnections = p_ble_enable_params->gap_enable_params.central_conn_count;
+	node.bleEnabled = true;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_evt_get(uint8_t * p_dest, uint16_t * p_len)
+{
+	SimNode& node = CurrentNode();
+	if (node.bleEvents.empty()) return NRF_ERROR_NOT_FOUND;
+
+	const SimBleEvent& evt = node.bleEvents.front();
+	if (p_dest == nullptr) {
+		*p_len = evt.length;
+		return NRF_SUCCESS;
+	}
+	if (*p_len < evt.length) return NRF_ERROR_DATA_SIZE;
+
+	memcpy(p_dest, evt.data, evt.length);
+	*p_len = evt.length;
+	node.bleEvents.pop_front();
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count)
+{
+	if (cherrySimInstance->FindLink(CurrentNode(), conn_handle) == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	*p_count = SIM_TX_BUFFERS_PER_CONNECTION;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+	SimNode& node = CurrentNode();
+	for (u32 i = 0; i < node.vendorUuids.size(); i++) {
+		if (memcmp(node.vendorUuids[i].uuid128, p_vs_uuid->uuid128, sizeof(p_vs_uuid->uuid128)) == 0) {
+			*p_uuid_type = (u8)(BLE_UUID_TYPE_VENDOR_BEGIN + i);
+			return NRF_SUCCESS;
+		}
+	}
+	node.vendorUuids.push_back(*p_vs_uuid);
+	*p_uuid_type = (u8)(BLE_UUID_TYPE_VENDOR_BEGIN + node.vendorUuids.size() - 1);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_opt_set(uint32_t opt_id, ble_opt_t const * p_opt)
+{
+	return NRF_SUCCESS;
+}
+
+#define _________________GAP______________________
+
+uint32_t sd_ble_gap_address_set(uint8_t addr_cycle_mode, ble_gap_addr_t const * p_addr)
+{
+	CurrentNode().address = *p_addr;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t * p_addr)
+{
+	*p_addr = CurrentNode().address;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_tx_power_set(int8_t tx_power)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_set(uint16_t appearance)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const * p_conn_params)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const * p_write_perm, uint8_t const * p_dev_name, uint16_t len)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_data_set(uint8_t const * p_data, uint8_t dlen, uint8_t const * p_sr_data, uint8_t srdlen)
+{
+	if (dlen > BLE_GAP_ADV_MAX_SIZE || srdlen > BLE_GAP_ADV_MAX_SIZE) return NRF_ERROR_INVALID_LENGTH;
+	if (p_data == nullptr) return NRF_SUCCESS;
+
+	SimNode& node = CurrentNode();
+	memcpy(node.advData, p_data, dlen);
+	node.advDataLength = dlen;
+
+	if (cherrySimInstance->advertisingDataHandler) {
+		cherrySimInstance->advertisingDataHandler(node, node.advData, node.advDataLength);
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const * p_adv_params)
+{
+	SimNode& node = CurrentNode();
+	if (node.advertising) return NRF_ERROR_INVALID_STATE;
+	if (p_adv_params->interval < BLE_GAP_ADV_INTERVAL_MIN || p_adv_params->interval > BLE_GAP_ADV_INTERVAL_MAX) return NRF_ERROR_INVALID_PARAM;
+
+	bool connectable = p_adv_params->type == BLE_GAP_ADV_TYPE_ADV_IND || p_adv_params->type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND;
+	if (connectable && cherrySimInstance->CountLinks(node, BLE_GAP_ROLE_PERIPH) >= node.maxPeripheralConnections) {
+		return NRF_ERROR_CONN_COUNT;
+	}
+
+	node.advParams = *p_adv_params;
+	node.advertising = true;
+	node.advGeneration++;
+	cherrySimInstance->ScheduleAdvertising(node, true);
+	cherrySimInstance->ScheduleGapTimeout(node, BLE_GAP_TIMEOUT_SRC_ADVERTISING, node.advGeneration, p_adv_params->timeout);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop(void)
+{
+	SimNode& node = CurrentNode();
+	if (!node.advertising) return NRF_ERROR_INVALID_STATE;
+	node.advertising = false;
+	node.advGeneration++;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_start(ble_gap_scan_params_t const * p_scan_params)
+{
+	SimNode& node = CurrentNode();
+	if (node.connecting || node.scanning) return NRF_ERROR_INVALID_STATE;
+	if (p_scan_params->window > p_scan_params->interval) return NRF_ERROR_INVALID_PARAM;
+
+	node.scanParams = *p_scan_params;
+	node.scanning = true;
+	node.scanGeneration++;
+	cherrySimInstance->ScheduleGapTimeout(node, BLE_GAP_TIMEOUT_SRC_SCAN, node.scanGeneration, p_scan_params->timeout);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_stop(void)
+{
+	SimNode& node = CurrentNode();
+	if (!node.scanning) return NRF_ERROR_INVALID_STATE;
+	node.scanning = false;
+	node.scanGeneration++;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_connect(ble_gap_addr_t const * p_peer_addr, ble_gap_scan_params_t const * p_scan_params, ble_gap_conn_params_t const * p_conn_params)
+{
+	SimNode& node = CurrentNode();
+	if (node.connecting) return NRF_ERROR_BUSY;
+	if (p_scan_params->window > p_scan_params->interval) return NRF_ERROR_INVALID_PARAM;
+	if (cherrySimInstance->CountLinks(node, BLE_GAP_ROLE_CENTRAL) >= node.maxCentralConnections) return NRF_ERROR_CONN_COUNT;
+
+	//Connecting implicitly stops scanning
+	node.scanning = false;
+	node.scanGeneration++;
+
+	node.connecting = true;
+	node.connectingGeneration++;
+	node.connectingAddress = *p_peer_addr;
+	node.connectingScanParams = *p_scan_params;
+	node.connectingConnParams = *p_conn_params;
+	cherrySimInstance->ScheduleGapTimeout(node, BLE_GAP_TIMEOUT_SRC_CONN, node.connectingGeneration, p_scan_params->timeout);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_connect_cancel(void)
+{
+	SimNode& node = CurrentNode();
+	if (!node.connecting) return NRF_ERROR_INVALID_STATE;
+	node.connecting = false;
+	node.connectingGeneration++;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (link->disconnecting) return NRF_ERROR_INVALID_STATE;
+
+	link->disconnecting = true;
+	link->disconnectReason = hci_status_code;
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const * p_conn_params)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (link->paramUpdatePending) return NRF_ERROR_BUSY;
+	if (p_conn_params == nullptr) return NRF_SUCCESS;
+
+	link->paramUpdatePending = true;
+	link->pendingParams = *p_conn_params;
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_rssi_start(uint16_t conn_handle, uint8_t threshold_dbm, uint8_t skip_count)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+
+	link->rssiReporting = true;
+	link->lastRssiReportUs = cherrySimInstance->simTimeUs;
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_rssi_stop(uint16_t conn_handle)
+{
+	SimLink* link = cherrySimInstance->FindLink(CurrentNode(), conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	link->rssiReporting = false;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_encrypt(uint16_t conn_handle, ble_gap_master_id_t const * p_master_id, ble_gap_enc_info_t const * p_enc_info)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (link->role != BLE_GAP_ROLE_CENTRAL) return NRF_ERROR_INVALID_STATE;
+	if (link->encryptionRequested) return NRF_ERROR_BUSY;
+
+	link->encryptionRequested = true;
+	link->encryptionRequestSent = false;
+	memcpy(link->centralKey, p_enc_info->ltk, BLE_GAP_SEC_KEY_LEN);
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_sec_info_reply(uint16_t conn_handle, ble_gap_enc_info_t const * p_enc_info, ble_gap_irk_t const * p_id_info, ble_gap_sign_info_t const * p_sign_info)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (link->role != BLE_GAP_ROLE_PERIPH || !link->securityInfoRequested) return NRF_ERROR_INVALID_STATE;
+
+	//Without a key, the link cannot be encrypted
+	if (p_enc_info != nullptr) {
+		memcpy(link->peripheralKey, p_enc_info->ltk, BLE_GAP_SEC_KEY_LEN);
+	}
+	else {
+		for (u32 i = 0; i < BLE_GAP_SEC_KEY_LEN; i++) link->peripheralKey[i] = ~link->centralKey[i];
+	}
+	link->securityInfoReplied = true;
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+#define _________________GATT_____________________
+
+static uint32_t QueuePacket(uint16_t conn_handle, SimPacketType type, u16 handle, const u8* data, u16 length)
+{
+	SimNode& node = CurrentNode();
+	SimLink* link = cherrySimInstance->FindLink(node, conn_handle);
+	if (link == nullptr) return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (!IsTransmitLengthValid(length)) return NRF_ERROR_DATA_SIZE;
+
+	if (type == SimPacketType::WRITE_REQ) {
+		if (link->writeResponsePending) return NRF_ERROR_BUSY;
+		link->writeResponsePending = true;
+	}
+	else {
+		if (link->txBuffersUsed >= SIM_TX_BUFFERS_PER_CONNECTION) return BLE_ERROR_NO_TX_PACKETS;
+		link->txBuffersUsed++;
+	}
+
+	SimPacket packet;
+	packet.type = type;
+	packet.handle = handle;
+	packet.length = (u8)length;
+	memcpy(packet.data, data, length);
+	link->queue.push_back(packet);
+
+	cherrySimInstance->ScheduleConnectionEvent(node, conn_handle);
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const * p_write_params)
+{
+	SimPacketType type;
+	if (p_write_params->write_op == BLE_GATT_OP_WRITE_REQ) type = SimPacketType::WRITE_REQ;
+	else if (p_write_params->write_op == BLE_GATT_OP_WRITE_CMD) type = SimPacketType::WRITE_CMD;
+	else return NRF_ERROR_INVALID_PARAM;
+
+	return QueuePacket(conn_handle, type, p_write_params->handle, p_write_params->p_value, p_write_params->len);
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params)
+{
+	if (p_hvx_params->type != BLE_GATT_HVX_NOTIFICATION || p_hvx_params->p_len == nullptr || p_hvx_params->p_data == nullptr) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+	return QueuePacket(conn_handle, SimPacketType::NOTIFICATION, p_hvx_params->handle, p_hvx_params->p_data, *p_hvx_params->p_len);
+}
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle)
+{
+	SimNode& node = CurrentNode();
+
+	SimGattService service;
+	service.uuid = *p_uuid;
+	service.handle = node.nextAttributeHandle++;
+	service.endHandle = service.handle;
+	node.services.push_back(service);
+
+	*p_handle = service.handle;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const * p_char_md, ble_gatts_attr_t const * p_attr_char_value, ble_gatts_char_handles_t * p_handles)
+{
+	SimNode& node = CurrentNode();
+
+	SimGattService* service = nullptr;
+	for (SimGattService& s : node.services) {
+		if (s.handle == service_handle) service = &s;
+	}
+	if (service == nullptr) return NRF_ERROR_INVALID_PARAM;
+
+	//Declaration and value, followed by a CCCD if notifications or indications are supported
+	SimGattAttribute attribute;
+	attribute.serviceHandle = service_handle;
+	attribute.uuid = *p_attr_char_value->p_uuid;
+	attribute.properties = p_char_md->char_props;
+	node.nextAttributeHandle++;
+	attribute.valueHandle = node.nextAttributeHandle++;
+	attribute.cccdHandle = BLE_GATT_HANDLE_INVALID;
+	if (p_char_md->char_props.notify || p_char_md->char_props.indicate) {
+		attribute.cccdHandle = node.nextAttributeHandle++;
+	}
+	node.characteristics.push_back(attribute);
+	service->endHandle = node.nextAttributeHandle - 1;
+
+	CheckedMemset(p_handles, 0x00, sizeof(*p_handles));
+	p_handles->value_handle = attribute.valueHandle;
+	p_handles->cccd_handle = attribute.cccdHandle;
+	p_handles->user_desc_handle = BLE_GATT_HANDLE_INVALID;
+	p_handles->sccd_handle = BLE_GATT_HANDLE_INVALID;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const * p_sys_attr_data, uint16_t len, uint32_t flags)
+{
+	return NRF_SUCCESS;
+}
+
+} //extern "C"
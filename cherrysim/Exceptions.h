@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Exceptions that are thrown by the firmware through SIMEXCEPTION when it runs
+ * inside CherrySim. Real firmware builds compile SIMEXCEPTION to nothing, the
+ * simulator turns every assertion into a C++ exception so that a broken
+ * invariant stops the simulation at the place where it happened.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+#include <typeinfo>
+#include <typeindex>
+
+struct FruityMeshException { virtual ~FruityMeshException() {} };
+
+#define DECLARE_SIM_EXCEPTION(T) struct T : public FruityMeshException {}
+
+DECLARE_SIM_EXCEPTION(BLEStackError);
+DECLARE_SIM_EXCEPTION(BufferTooSmallException);
+DECLARE_SIM_EXCEPTION(CommandNotFoundException);
+DECLARE_SIM_EXCEPTION(CommandTooLongException);
+DECLARE_SIM_EXCEPTION(CommandbufferAlreadyInUseException);
+DECLARE_SIM_EXCEPTION(ErrorCodeUnknownException);
+DECLARE_SIM_EXCEPTION(GotUnsupportedActionTypeException);
+DECLARE_SIM_EXCEPTION(HardfaultException);
+DECLARE_SIM_EXCEPTION(IllegalArgumentException);
+DECLARE_SIM_EXCEPTION(IllegalStateException);
+DECLARE_SIM_EXCEPTION(IndexOutOfBoundsException);
+DECLARE_SIM_EXCEPTION(InvalidStateException);
+DECLARE_SIM_EXCEPTION(MemoryCorruptionException);
+DECLARE_SIM_EXCEPTION(MessageTypeInvalidException);
+DECLARE_SIM_EXCEPTION(ModuleAllocatorMemoryAlreadySetException);
+DECLARE_SIM_EXCEPTION(NotFromThisAllocatorException);
+DECLARE_SIM_EXCEPTION(OutOfMemoryException);
+DECLARE_SIM_EXCEPTION(PaketTooBigException);
+DECLARE_SIM_EXCEPTION(PaketTooSmallException);
+DECLARE_SIM_EXCEPTION(SafeBootTriggeredException);
+DECLARE_SIM_EXCEPTION(TooManyArgumentsException);
+DECLARE_SIM_EXCEPTION(TooManyModulesException);
+DECLARE_SIM_EXCEPTION(TooManyTerminalCommandListenersException);
+DECLARE_SIM_EXCEPTION(UartNotSetException);
+DECLARE_SIM_EXCEPTION(ZeroOnNonPodTypeException);
+DECLARE_SIM_EXCEPTION(NodeRebootException);
+
+//Exceptions can be ignored per type, e.g. by a scenario that provokes them on purpose
+bool sim_is_exception_ignored(const std::type_index& type);
+void sim_set_exception_ignored(const std::type_index& type, bool ignored);
+void sim_report_exception(const char* name, const char* file, int line);
+
+#define SIMEXCEPTION(T) \
+	do { \
+		sim_report_exception(#T, __FILE__, __LINE__); \
+		if (!sim_is_exception_ignored(std::type_index(typeid(T)))) throw T(); \
+	} while (0)
+
+#define IGNOREEXCEPTION(T) sim_set_exception_ignored(std::type_index(typeid(T)), true)
+#define UNIGNOREEXCEPTION(T) sim_set_exception_ignored(std::type_index(typeid(T)), false)
+
+#else
+#define SIMEXCEPTION(T)
+#define IGNOREEXCEPTION(T)
+#endif //__cplusplus
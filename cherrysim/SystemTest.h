@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * SystemTest.h is force-included into every firmware translation unit of the
+ * simulator build. It redirects all accesses to per-node state (GlobalState,
+ * FICR, UICR, GPIO, flash) to the node that CherrySim is currently executing
+ * so that many FruityMesh instances can live in a single process.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef SIM_ENABLED
+#error "SystemTest.h must only be used for simulator builds"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Reduced register maps of the nRF51, only the registers used by FruityMesh are simulated
+typedef struct {
+	uint32_t CODEPAGESIZE;
+	uint32_t CODESIZE;
+	uint32_t CLENR0;
+	uint32_t PPFC;
+	uint32_t NUMRAMBLOCK;
+	uint32_t SIZERAMBLOCKS;
+	uint32_t CONFIGID;
+	uint32_t DEVICEID[2];
+	uint32_t ER[4];
+	uint32_t IR[4];
+	uint32_t DEVICEADDRTYPE;
+	uint32_t DEVICEADDR[2];
+} NRF_FICR_Type;
+
+typedef struct {
+	uint32_t CLENR0;
+	uint32_t RBPCONF;
+	uint32_t XTALFREQ;
+	uint32_t FWID;
+	uint32_t BOOTLOADERADDR;
+	uint32_t NRFFW[14];
+	uint32_t NRFHW[12];
+	uint32_t CUSTOMER[32];
+	uint32_t NFCPINS;
+} NRF_UICR_Type;
+
+typedef struct {
+	uint32_t OUT;
+	uint32_t OUTSET;
+	uint32_t OUTCLR;
+	uint32_t IN;
+	uint32_t DIR;
+	uint32_t DIRSET;
+	uint32_t DIRCLR;
+	uint32_t PIN_CNF[32];
+} NRF_GPIO_Type;
+
+//Hardware of a single simulated node, swapped by CherrySim before a node is executed
+typedef struct SimNodeHardware {
+	void* globalState;
+	uint8_t* flash;
+	NRF_FICR_Type ficr;
+	NRF_UICR_Type uicr;
+	NRF_GPIO_Type gpio;
+} SimNodeHardware;
+
+//CherrySim executes the partitions of the simulation on several threads, each thread executes its own node
+#ifdef _MSC_VER
+#define SIM_THREAD_LOCAL __declspec(thread)
+#else
+#define SIM_THREAD_LOCAL __thread
+#endif
+
+extern SIM_THREAD_LOCAL SimNodeHardware* simHw;
+
+//Values of the simulated chip
+#define SIM_FLASH_PAGE_SIZE 1024
+#define SIM_FLASH_NUM_PAGES 256
+#define SIM_FLASH_SIZE (SIM_FLASH_PAGE_SIZE * SIM_FLASH_NUM_PAGES)
+#define SIM_BOOTLOADER_ADDRESS 0x3C000
+
+#define NRF_FICR (&simHw->ficr)
+#define NRF_UICR (&simHw->uicr)
+#define NRF_GPIO (&simHw->gpio)
+#define FLASH_REGION_START_ADDRESS ((uint32_t)(uintptr_t)simHw->flash)
+
+uint32_t ST_getRebootReason(void);
+uint32_t sim_get_stack_type(void);
+
+//Statistics that the firmware can feed into the simulator
+void sim_stat_count(const char* key);
+void sim_stat_avg(const char* key, int value);
+void sim_error(const char* file, int line);
+
+#define SIMSTATCOUNT(key) sim_stat_count(key)
+#define SIMSTATAVG(key, value) sim_stat_avg((key), (value))
+#define SIMERROR() sim_error(__FILE__, __LINE__)
+
+void NVIC_SystemReset(void);
+
+//The NVIC functions of the SoftDevice are inlined in nrf_nvic.h, the simulator implements them itself
+#define SD_EVT_IRQn 0
+uint32_t sd_nvic_ClearPendingIRQ(uint32_t irq);
+uint32_t sd_nvic_SystemReset(void);
+
+#ifdef __cplusplus
+}
+
+class GlobalState;
+#define GS ((GlobalState*)simHw->globalState)
+
+//Featureset hooks that are used by Config.h instead of a FEATURESET
+struct ModuleConfiguration;
+void setFeaturesetConfiguration_CherrySim(ModuleConfiguration* config, void* module);
+uint32_t initializeModules_CherrySim(bool createModule);
+#endif
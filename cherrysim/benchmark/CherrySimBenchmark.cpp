@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Runs the host micro benchmarks.
+ *
+ * Usage: cherrySim_benchmark [benchmarkName] [rounds]
+ * Without a name, all benchmarks are run.
+ */
+
+#include "CherrySimBenchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+constexpr u32 BENCHMARK_DEFAULT_ROUNDS = 1000;
+constexpr SimTime BENCHMARK_MAX_BOOT_TIME_US = 10 * SIM_TIME_SEC;
+
+static const Benchmark benchmarks[] = {
+	{ "packetqueue", RunPacketQueueBenchmark },
+	{ "recordstorage", RunRecordStorageBenchmark },
+	{ "recordwear", RunRecordStorageWearBenchmark },
+};
+
+void PrintBenchmarkResult(const char* name, uint64_t operations, double elapsedSec)
+{
+	printf("  %-40s %10.1f ns/op (%llu ops)\n", name, operations > 0 ? elapsedSec * 1e9 / operations : 0.0, (unsigned long long)operations);
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = argc > 1 ? argv[1] : nullptr;
+	u32 rounds = argc > 2 ? (u32)strtoul(argv[2], nullptr, 10) : BENCHMARK_DEFAULT_ROUNDS;
+
+	//A single node is enough, it only provides the GlobalState for the firmware code
+	SimConfiguration simConfig;
+	simConfig.numNodes = 1;
+	simConfig.numPartitions = 1;
+	simConfig.numThreads = 1;
+	simConfig.terminalId = SIM_MAX_NODES + 1;
+
+	CherrySim sim(simConfig);
+	sim.Init();
+	sim.SimulateUntilCondition(BENCHMARK_MAX_BOOT_TIME_US, [&]() { return sim.nodes[0]->booted; });
+	if (!sim.nodes[0]->booted) {
+		printf("Node did not boot\n");
+		return 1;
+	}
+
+	bool found = false;
+	for (const Benchmark& benchmark : benchmarks) {
+		if (name != nullptr && strcmp(name, benchmark.name) != 0) continue;
+		found = true;
+
+		printf("%s (%u rounds)\n", benchmark.name, rounds);
+		sim.SetCurrentNode(sim.nodes[0].get());
+		benchmark.function(sim, rounds);
+		sim.SetCurrentNode(nullptr);
+	}
+
+	if (!found) {
+		printf("Unknown benchmark %s\n", name);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Micro benchmarks for firmware data structures that run on the host. Each
+ * benchmark works on the firmware of a single simulated node so that logging
+ * and error reporting behave like in the simulator.
+ */
+
+#pragma once
+
+#include <CherrySim.h>
+
+typedef void (*BenchmarkFunction)(CherrySim& sim, u32 rounds);
+
+struct Benchmark
+{
+	const char* name;
+	BenchmarkFunction function;
+};
+
+//Measures the time per operation in nanoseconds and prints it
+void PrintBenchmarkResult(const char* name, uint64_t operations, double elapsedSec);
+
+void RunPacketQueueBenchmark(CherrySim& sim, u32 rounds);
+void RunRecordStorageBenchmark(CherrySim& sim, u32 rounds);
+void RunRecordStorageWearBenchmark(CherrySim& sim, u32 rounds);
@@ -0,0 +1,108 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Drains full packet queues the way a connection does: FillTransmitBuffers
+ * peeks at the first unsent element while the sent ones are still queued,
+ * HandlePacketSent discards from the front and FlashStorage discards from
+ * the back.
+ */
+
+#include "CherrySimBenchmark.h"
+
+#include <BaseConnection.h>
+#include <PacketQueue.h>
+
+#include <chrono>
+
+//The packet lengths that are queued, BaseConnection adds its metadata in front of every packet
+static const u16 packetLengths[] = { 1, 20, 200 };
+
+static u32 FillQueue(PacketQueue& queue, u16 dataLength)
+{
+	u32 count = 0;
+	while (true) {
+		u8* data = queue.Reserve(dataLength);
+		if (data == nullptr) break;
+		data[0] = (u8)count;
+		count++;
+	}
+	return count;
+}
+
+void RunPacketQueueBenchmark(CherrySim& sim, u32 rounds)
+{
+	u32 buffer[PACKET_SEND_BUFFER_SIZE / sizeof(u32)];
+	u16 index[PacketQueue::IndexLength(PACKET_SEND_BUFFER_SIZE, SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + 1)];
+	PacketQueue queue(buffer, PACKET_SEND_BUFFER_SIZE, index, sizeof(index) / sizeof(u16));
+
+	for (u16 packetLength : packetLengths) {
+		u16 dataLength = SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + packetLength;
+		uint64_t peekOps = 0;
+		uint64_t lastOps = 0;
+		u32 checksum = 0;
+		std::chrono::duration<double> peekTime(0);
+		std::chrono::duration<double> lastTime(0);
+
+		for (u32 round = 0; round < rounds; round++) {
+			//Like FillTransmitBuffers, peek at every position while nothing is discarded, then discard from the front
+			queue.Clean();
+			u32 count = FillQueue(queue, dataLength);
+			auto start = std::chrono::steady_clock::now();
+			for (u32 i = 0; i < count; i++) {
+				checksum += queue.PeekNext(i).data[0];
+			}
+			while (queue._numElements > 0) {
+				checksum += queue.PeekNext().data[0];
+				queue.DiscardNext();
+			}
+			peekTime += std::chrono::steady_clock::now() - start;
+			peekOps += count;
+
+			//Drain from the back
+			queue.Clean();
+			count = FillQueue(queue, dataLength);
+			start = std::chrono::steady_clock::now();
+			while (queue._numElements > 0) {
+				checksum += queue.PeekLast().data[0];
+				queue.DiscardLast();
+			}
+			lastTime += std::chrono::steady_clock::now() - start;
+			lastOps += count;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "%u byte packets, peek all + discard next", packetLength);
+		PrintBenchmarkResult(name, peekOps, peekTime.count());
+		snprintf(name, sizeof(name), "%u byte packets, peek last + discard last", packetLength);
+		PrintBenchmarkResult(name, lastOps, lastTime.count());
+		printf("  %u packets per full queue, checksum %u\n", (u32)(peekOps / rounds), checksum);
+	}
+}
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Reads records the way the module configuration loading does. The records
+ * are first saved through the RecordStorage queue, every id is updated a few
+ * times so that outdated versions are stored as well. The simulated settings
+ * pages are small, so the number of records is limited by what fits on them.
+ *
+ * The wear benchmark updates a few records over and over like frequently
+ * changing configurations do and estimates the flash lifetime from the page
+ * erase counters.
+ */
+
+#include "CherrySimBenchmark.h"
+
+#include <GlobalState.h>
+#include <RecordStorage.h>
+
+#include <chrono>
+
+constexpr u16 BENCHMARK_RECORD_ID_BASE = 1000;
+constexpr u16 BENCHMARK_MISSING_RECORD_ID_BASE = 2000;
+constexpr u32 BENCHMARK_RECORD_UPDATES = 3;
+
+//Guaranteed erase cycles of the nRF52 flash and the assumed number of record updates
+constexpr u32 BENCHMARK_FLASH_ENDURANCE_CYCLES = 10000;
+constexpr u32 BENCHMARK_RECORD_UPDATES_PER_DAY = 24 * 60;
+constexpr u16 BENCHMARK_WEAR_STATIC_RECORDS = 8;
+constexpr u16 BENCHMARK_WEAR_UPDATED_RECORDS = 4;
+constexpr u16 BENCHMARK_WEAR_RECORD_LENGTH = 16;
+
+//The number of distinct record ids that are read
+static const u16 recordCounts[] = { 5, 20 };
+
+class BenchmarkRecordListener : public RecordStorageEventListener
+{
+public:
+	u32 finished = 0;
+	u32 failed = 0;
+
+	void RecordStorageEventHandler(u16 recordId, RecordStorageResultCode resultCode, u32 userType, u8* userData, u16 userDataLength) override
+	{
+		finished++;
+		if (resultCode != RecordStorageResultCode::SUCCESS) failed++;
+	}
+};
+
+//Saves a record and simulates until the flash operations are done
+static bool SaveRecordAndWait(CherrySim& sim, BenchmarkRecordListener& listener, u16 recordId, u8* data, u16 dataLength)
+{
+	u32 expected = listener.finished + 1;
+	if (GS->recordStorage.SaveRecord(recordId, data, dataLength, &listener, 0) != RecordStorageResultCode::SUCCESS) return false;
+
+	SimNode* node = sim.currentNode;
+	sim.SimulateUntilCondition(sim.simTimeUs + SIM_TIME_SEC, [&]() { return listener.finished >= expected; });
+	sim.SetCurrentNode(node);
+
+	return listener.finished >= expected && listener.failed == 0;
+}
+
+void RunRecordStorageBenchmark(CherrySim& sim, u32 rounds)
+{
+	BenchmarkRecordListener listener;
+	u16 savedRecords = 0;
+
+	for (u16 recordCount : recordCounts) {
+		//Save new ids and update all ids so that old versions are on the page as well
+		for (u32 update = 0; update < BENCHMARK_RECORD_UPDATES; update++) {
+			for (u16 i = update == 0 ? savedRecords : 0; i < recordCount; i++) {
+				if (!SaveRecordAndWait(sim, listener, BENCHMARK_RECORD_ID_BASE + i, (u8*)&update, sizeof(update))) {
+					printf("  Could not save record %u\n", BENCHMARK_RECORD_ID_BASE + i);
+					return;
+				}
+			}
+		}
+		savedRecords = recordCount;
+
+		uint64_t hitOps = 0;
+		uint64_t missOps = 0;
+		u32 checksum = 0;
+		std::chrono::duration<double> hitTime(0);
+		std::chrono::duration<double> missTime(0);
+
+		for (u32 round = 0; round < rounds; round++) {
+			auto start = std::chrono::steady_clock::now();
+			for (u16 i = 0; i < recordCount; i++) {
+				SizedData data = GS->recordStorage.GetRecordData(BENCHMARK_RECORD_ID_BASE + i);
+				checksum += data.length;
+			}
+			hitTime += std::chrono::steady_clock::now() - start;
+			hitOps += recordCount;
+
+			//Modules without a stored configuration look up ids that do not exist
+			start = std::chrono::steady_clock::now();
+			for (u16 i = 0; i < recordCount; i++) {
+				SizedData data = GS->recordStorage.GetRecordData(BENCHMARK_MISSING_RECORD_ID_BASE + i);
+				checksum += data.length;
+			}
+			missTime += std::chrono::steady_clock::now() - start;
+			missOps += recordCount;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "%u records, get existing", recordCount);
+		PrintBenchmarkResult(name, hitOps, hitTime.count());
+		snprintf(name, sizeof(name), "%u records, get missing", recordCount);
+		PrintBenchmarkResult(name, missOps, missTime.count());
+		printf("  %u versions per record, checksum %u\n", BENCHMARK_RECORD_UPDATES, checksum);
+	}
+}
+
+void RunRecordStorageWearBenchmark(CherrySim& sim, u32 rounds)
+{
+	BenchmarkRecordListener listener;
+	u8 data[BENCHMARK_WEAR_RECORD_LENGTH] = {};
+
+	u32 eraseCountersBefore[RECORD_STORAGE_NUM_PAGES];
+	for (u32 i = 0; i < RECORD_STORAGE_NUM_PAGES; i++) {
+		eraseCountersBefore[i] = GS->recordStorage.GetPageEraseCounter(i);
+	}
+
+	//Records that are never changed must be moved from time to time as well
+	for (u16 i = 0; i < BENCHMARK_WEAR_STATIC_RECORDS; i++) {
+		SaveRecordAndWait(sim, listener, BENCHMARK_RECORD_ID_BASE + i, data, sizeof(data));
+	}
+
+	for (u32 round = 0; round < rounds; round++) {
+		memcpy(data, &round, sizeof(round));
+		if (!SaveRecordAndWait(sim, listener, BENCHMARK_MISSING_RECORD_ID_BASE + round % BENCHMARK_WEAR_UPDATED_RECORDS, data, sizeof(data))) {
+			printf("  Could not save update %u\n", round);
+			return;
+		}
+	}
+
+	u32 maxErases = 0;
+	u32 totalErases = 0;
+	for (u32 i = 0; i < RECORD_STORAGE_NUM_PAGES; i++) {
+		u32 erases = GS->recordStorage.GetPageEraseCounter(i) - eraseCountersBefore[i];
+		printf("  page %u erased %u times\n", i, erases);
+		totalErases += erases;
+		if (erases > maxErases) maxErases = erases;
+	}
+
+	//The most erased page limits the lifetime
+	double updatesPerErase = maxErases > 0 ? (double)rounds / maxErases : 0.0;
+	double lifetimeYears = updatesPerErase * BENCHMARK_FLASH_ENDURANCE_CYCLES / BENCHMARK_RECORD_UPDATES_PER_DAY / 365.0;
+	printf("  %u updates, %u erases, %u failed, %.1f updates per erase of the most erased page\n", rounds, totalErases, listener.failed, updatesPerErase);
+	printf("  Expected lifetime at %u updates per day: %.1f years\n", BENCHMARK_RECORD_UPDATES_PER_DAY, lifetimeYears);
+}
@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Featureset that is used for all nodes in the simulator build. Module
+ * instantiation and default configuration are delegated to the
+ * CherrySim featureset hooks (see Config.h) so that every simulated node
+ * can get its own nodeId, position and device type.
+ */
+
+#pragma once
+
+#define ACTIVATE_LOGGING 1
+#define ACTIVATE_JSON_LOGGING 1
+#define ACTIVATE_STDIO 1
+#define ACTIVATE_UART 0
+#define ACTIVATE_SEGGER_RTT 0
+#define ACTIVATE_BUTTONS 0
+#define ACTIVATE_WATCHDOG 0
+#define ACTIVATE_WATCHDOG_SAFE_BOOT_MODE 0
+#define ACTIVATE_BATTERY_MEASUREMENT 0
+#define ACTIVATE_ALARM_MODULE
+
+#define SET_FW_GROUPID_CHIPSET GROUP_ID_NRF51
+#define SET_FW_GROUPID_FEATURESET GROUP_ID_NRF51_MESH
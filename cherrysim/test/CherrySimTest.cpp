@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Runs the simulated scenario tests.
+ *
+ * Usage: cherrySim_test [testName]
+ * Without a name, all tests are run.
+ */
+
+#include "CherrySimTest.h"
+
+#include <GlobalState.h>
+
+#include <cstdio>
+#include <cstring>
+
+constexpr SimTime TEST_CLUSTER_CHECK_INTERVAL_US = SIM_TIME_SEC;
+
+static const SimTest tests[] = {
+	{ "unicastrepeat", TestRepeatedUnicastActionIsDelivered },
+	{ "alarmduplicate", TestDuplicateAlarmFloodIsDropped },
+	{ "clusteringoverlap", TestClusteringAttemptsOverlap },
+};
+
+SimConfiguration CreateTestConfiguration(u32 numNodes)
+{
+	SimConfiguration simConfig;
+	simConfig.numNodes = numNodes;
+	simConfig.numPartitions = 1;
+	simConfig.numThreads = 1;
+	simConfig.nodeSpacingMeters = 10.0;
+	simConfig.advertisingLossPercent = 0;
+	simConfig.connectionPacketLossPercent = 0;
+	simConfig.terminalId = SIM_MAX_NODES + 1;
+	return simConfig;
+}
+
+bool SimulateUntilClustered(CherrySim& sim, SimTime maxTimeUs)
+{
+	SimTime nextCheckUs = sim.simTimeUs + TEST_CLUSTER_CHECK_INTERVAL_US;
+	return sim.SimulateUntilCondition(maxTimeUs, [&]() {
+		if (sim.simTimeUs < nextCheckUs) return false;
+		nextCheckUs += TEST_CLUSTER_CHECK_INTERVAL_US;
+
+		bool clustered = true;
+		for (auto& node : sim.nodes) {
+			sim.SetCurrentNode(node.get());
+			if (!node->booted || GS->node.clusterSize != sim.nodes.size()) clustered = false;
+		}
+		sim.SetCurrentNode(nullptr);
+		return clustered;
+	});
+}
+
+unsigned long long GetStatCounter(const CherrySim& sim, const char* key)
+{
+	auto it = sim.statCounters.find(key);
+	return it != sim.statCounters.end() ? it->second : 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = argc > 1 ? argv[1] : nullptr;
+
+	u32 failed = 0;
+	bool found = false;
+	for (const SimTest& test : tests) {
+		if (name != nullptr && strcmp(name, test.name) != 0) continue;
+		found = true;
+
+		bool passed = test.function();
+		printf("%-40s %s\n", test.name, passed ? "passed" : "FAILED");
+		if (!passed) failed++;
+	}
+
+	if (!found) {
+		printf("Unknown test %s\n", name);
+		return 1;
+	}
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Scenario tests that run a small simulated mesh. Each test sets up its own
+ * CherrySim instance and returns false if an expectation was not met.
+ */
+
+#pragma once
+
+#include <CherrySim.h>
+
+#include <cstdio>
+
+typedef bool (*TestFunction)();
+
+struct SimTest
+{
+	const char* name;
+	TestFunction function;
+};
+
+//Prints the message and returns false if the condition does not hold
+#define SIMTEST_EXPECT(condition, ...) do{ if(!(condition)){ printf("  FAILED %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); return false; } }while(0)
+
+//A lossless mesh of nodes that are all within radio range of each other, only the terminal of no node is enabled
+SimConfiguration CreateTestConfiguration(u32 numNodes);
+//Simulates until all nodes are part of a single cluster
+bool SimulateUntilClustered(CherrySim& sim, SimTime maxTimeUs);
+unsigned long long GetStatCounter(const CherrySim& sim, const char* key);
+
+bool TestRepeatedUnicastActionIsDelivered();
+bool TestDuplicateAlarmFloodIsDropped();
+bool TestClusteringAttemptsOverlap();
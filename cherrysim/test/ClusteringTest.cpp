@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * A node connects to the next clustering candidate while the handshake of
+ * its previous attempt is still running. The second connection must not be
+ * dropped because another connection is in its handshake.
+ */
+
+#include "CherrySimTest.h"
+
+//Enough nodes in range of each other so that every node has several candidates
+constexpr u32 TEST_CLUSTERING_NUM_NODES = 10;
+constexpr SimTime TEST_CLUSTERING_MAX_TIME_US = 120 * SIM_TIME_SEC;
+
+bool TestClusteringAttemptsOverlap()
+{
+	CherrySim sim(CreateTestConfiguration(TEST_CLUSTERING_NUM_NODES));
+	sim.Init();
+	SIMTEST_EXPECT(SimulateUntilClustered(sim, TEST_CLUSTERING_MAX_TIME_US), "Nodes did not cluster");
+
+	//Counted for every connection of an attempt that was established while another handshake was running
+	const unsigned long long parallelAttempts = GetStatCounter(sim, "parallelClusteringAttempt");
+	SIMTEST_EXPECT(parallelAttempts > 0, "No clustering attempts overlapped");
+	return true;
+}
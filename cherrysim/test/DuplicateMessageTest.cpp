@@ -0,0 +1,103 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The duplicate cache of the ConnectionManager must only drop copies of alarm
+ * floods. A command that is sent again to a single node with the same
+ * requestHandle is a new request and must be delivered every time.
+ */
+
+#include "CherrySimTest.h"
+
+#include <GlobalState.h>
+#include <AlarmModule.h>
+
+constexpr u32 TEST_DUPLICATE_NUM_NODES = 3;
+constexpr SimTime TEST_DUPLICATE_MAX_CLUSTERING_TIME_US = 60 * SIM_TIME_SEC;
+//Less than the DUPLICATE_CACHE_WINDOW_DS of the ConnectionManager
+constexpr SimTime TEST_DUPLICATE_DELIVERY_TIME_US = 2 * SIM_TIME_SEC;
+constexpr u8 TEST_DUPLICATE_REQUEST_HANDLE = 7;
+
+//AlarmModuleTriggerActionMessages::SET_ALARM_SYSTEM_UPDATE, a black ice incident that is saved
+constexpr u8 TEST_ALARM_SET_ALARM_SYSTEM_UPDATE = 2;
+constexpr u8 TEST_ALARM_INCIDENT_BLACK_ICE = 1;
+constexpr u8 TEST_ALARM_ACTION_SAVE = 1;
+
+//Sends the same alarm update twice with the same requestHandle and returns how often it was received
+static unsigned long long SendAlarmUpdateTwice(CherrySim& sim, NodeId receiver)
+{
+	const unsigned long long receivedBefore = GetStatCounter(sim, "alarmUpdateReceived");
+
+	AlarmModuleUpdateMessage message;
+	CheckedMemset(&message, 0x00, sizeof(AlarmModuleUpdateMessage));
+	message.meshDeviceId = (u8)sim.nodes[0]->id;
+	message.meshIncidentType = TEST_ALARM_INCIDENT_BLACK_ICE;
+	message.meshActionType = TEST_ALARM_ACTION_SAVE;
+
+	for (u32 i = 0; i < 2; i++) {
+		sim.SetCurrentNode(sim.nodes[0].get());
+		GS->cm.SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION, ModuleId::ALARM_MODULE, receiver,
+			TEST_ALARM_SET_ALARM_SYSTEM_UPDATE, TEST_DUPLICATE_REQUEST_HANDLE, (u8*)&message, SIZEOF_ALARM_MODULE_UPDATE_MESSAGE, false);
+		sim.SetCurrentNode(nullptr);
+
+		sim.SimulateUntil(sim.simTimeUs + TEST_DUPLICATE_DELIVERY_TIME_US);
+	}
+
+	return GetStatCounter(sim, "alarmUpdateReceived") - receivedBefore;
+}
+
+bool TestRepeatedUnicastActionIsDelivered()
+{
+	CherrySim sim(CreateTestConfiguration(TEST_DUPLICATE_NUM_NODES));
+	sim.Init();
+	SIMTEST_EXPECT(SimulateUntilClustered(sim, TEST_DUPLICATE_MAX_CLUSTERING_TIME_US), "Nodes did not cluster");
+
+	const unsigned long long droppedBefore = GetStatCounter(sim, "duplicateDropped");
+	const unsigned long long received = SendAlarmUpdateTwice(sim, sim.nodes[TEST_DUPLICATE_NUM_NODES - 1]->id);
+
+	SIMTEST_EXPECT(received == 2, "Unicast update was received %llu times instead of 2", received);
+	SIMTEST_EXPECT(GetStatCounter(sim, "duplicateDropped") == droppedBefore, "Unicast update was dropped as duplicate");
+	return true;
+}
+
+bool TestDuplicateAlarmFloodIsDropped()
+{
+	CherrySim sim(CreateTestConfiguration(TEST_DUPLICATE_NUM_NODES));
+	sim.Init();
+	SIMTEST_EXPECT(SimulateUntilClustered(sim, TEST_DUPLICATE_MAX_CLUSTERING_TIME_US), "Nodes did not cluster");
+
+	const unsigned long long droppedBefore = GetStatCounter(sim, "duplicateDropped");
+	const unsigned long long received = SendAlarmUpdateTwice(sim, NODE_ID_BROADCAST);
+
+	//Every other node handles the first copy only
+	SIMTEST_EXPECT(received == TEST_DUPLICATE_NUM_NODES - 1, "Broadcast update was received %llu times instead of %u", received, TEST_DUPLICATE_NUM_NODES - 1);
+	SIMTEST_EXPECT(GetStatCounter(sim, "duplicateDropped") > droppedBefore, "Second broadcast was not dropped");
+	return true;
+}
@@ -122,17 +122,135 @@ static_assert(false, "Featureset was not defined, which is mandatory!");
 #endif
 #endif
 
+// Each node learns over which connection other nodes can be reached, this is the number of nodes it remembers
+#ifndef MESH_ROUTE_TABLE_SIZE
+#ifdef NRF51
+#define MESH_ROUTE_TABLE_SIZE 16
+#else
+#define MESH_ROUTE_TABLE_SIZE 128
+#endif
+#endif
+
+// Number of recently received module messages that each node remembers to drop duplicates
+#ifndef DUPLICATE_CACHE_SIZE
+#ifdef NRF51
+#define DUPLICATE_CACHE_SIZE 8
+#else
+#define DUPLICATE_CACHE_SIZE 32
+#endif
+#endif
+
+// Number of JOIN_ME packets of other nodes that are kept as candidates for clustering
+#ifndef JOIN_ME_PACKET_BUFFER_SIZE
+#ifdef NRF51
+#define JOIN_ME_PACKET_BUFFER_SIZE 10
+#else
+#define JOIN_ME_PACKET_BUFFER_SIZE 20
+#endif
+#endif
+
+// Number of outgoing mesh connections that may be connecting or in their handshake at the same time
+#ifndef CLUSTERING_MAX_PARALLEL_ATTEMPTS
+#define CLUSTERING_MAX_PARALLEL_ATTEMPTS 2
+#endif
+
 // Each connection also has a high prio buffer e.g. for mesh clustering packets
 #ifndef PACKET_SEND_BUFFER_HIGH_PRIO_SIZE
 #define PACKET_SEND_BUFFER_HIGH_PRIO_SIZE 100
 #endif
 
+// Medium prio packets (e.g. alarms) and lowest prio packets (e.g. bulk telemetry) are queued separately
+#ifndef PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE
+#ifdef NRF51
+#define PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE 100
+#else
+#define PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE 300
+#endif
+#endif
+
+#ifndef PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE
+#ifdef NRF51
+#define PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE 100
+#else
+#define PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE 300
+#endif
+#endif
+
+// A non empty queue that was passed over this many times in favour of a higher priority queue gets served once
+#ifndef PACKET_SEND_QUEUE_AGING_LIMIT
+#define PACKET_SEND_QUEUE_AGING_LIMIT 8
+#endif
+
+// If less than this percentage of a send queue is free on the connections to which a node relays, it asks
+// its mesh partners to stop sending LOWEST prio packets (or LOW and LOWEST prio packets)
+#ifndef CONGESTION_SHED_LOWEST_FREE_PERCENT
+#define CONGESTION_SHED_LOWEST_FREE_PERCENT 50
+#endif
+
+#ifndef CONGESTION_SHED_LOW_FREE_PERCENT
+#define CONGESTION_SHED_LOW_FREE_PERCENT 20
+#endif
+
+// Minimum time between two clusterInfoUpdates on a connection, changes in between are combined into one update
+#ifndef CLUSTER_INFO_UPDATE_INTERVAL_DS
+#define CLUSTER_INFO_UPDATE_INTERVAL_DS 3
+#endif
+
+// Packets to the shortest sink are spread over all connections whose sink is at most this many hops further away
+// than the nearest one. Connections whose send queue is fuller than the given percentage are avoided
+#ifndef SINK_ROUTING_HOP_SLACK
+#define SINK_ROUTING_HOP_SLACK 1
+#endif
+
+#ifndef SINK_ROUTING_CONGESTED_PERCENT
+#define SINK_ROUTING_CONGESTED_PERCENT 50
+#endif
+
+// Number of long term keys of MeshAccess partners that are cached so that a reconnect can resume the session
+// with a single handshake round trip, tickets are dropped after the timeout
+#ifndef MESH_ACCESS_SESSION_TICKET_CACHE_SIZE
+#ifdef NRF51
+#define MESH_ACCESS_SESSION_TICKET_CACHE_SIZE 2
+#else
+#define MESH_ACCESS_SESSION_TICKET_CACHE_SIZE 4
+#endif
+#endif
+
+#ifndef MESH_ACCESS_SESSION_TICKET_TIMEOUT_DS
+#define MESH_ACCESS_SESSION_TICKET_TIMEOUT_DS SEC_TO_DS(10 * 60)
+#endif
+
+// Number of bytes that each connection may hand to the SoftDevice per scheduling round before the next connection is served
+#ifndef TRANSMIT_SCHEDULER_QUANTUM
+#define TRANSMIT_SCHEDULER_QUANTUM (2 * MAX_DATA_SIZE_PER_WRITE)
+#endif
+
 // Each connection does also have a buffer to assemble packets that were split into 20 byte chunks
 // This is the maximum size that these packets can have
 #ifndef PACKET_REASSEMBLY_BUFFER_SIZE
 #define PACKET_REASSEMBLY_BUFFER_SIZE MAX_MESH_PACKET_SIZE
 #endif
 
+// Split packets of the different send queues are interleaved on mesh connections with partners that support it,
+// each queue then uses its own stream and the partner needs a reassembly context for every stream
+#ifndef ACTIVATE_SPLIT_STREAMS
+#ifdef NRF51
+#define ACTIVATE_SPLIT_STREAMS 0
+#else
+#define ACTIVATE_SPLIT_STREAMS 1
+#endif
+#endif
+
+// Number of split packets that can be reassembled in parallel on each connection, one per send queue
+// if split streams are active, otherwise only stream 0 is used
+#ifndef PACKET_REASSEMBLY_CONTEXT_COUNT
+#if ACTIVATE_SPLIT_STREAMS == 1
+#define PACKET_REASSEMBLY_CONTEXT_COUNT 4
+#else
+#define PACKET_REASSEMBLY_CONTEXT_COUNT 1
+#endif
+#endif
+
 // Defines the maximum size of the mesh write attribute. This space is required in the ATTR table
 #ifndef MESH_CHARACTERISTIC_MAX_LENGTH
 #define MESH_CHARACTERISTIC_MAX_LENGTH 100
@@ -143,12 +261,75 @@ static_assert(false, "Featureset was not defined, which is mandatory!");
 #define ATTR_TABLE_MAX_SIZE 0x200
 #endif
 
+// Number of advertisement subscriptions that each module can register to receive advertisement reports
+#ifndef MODULE_MAX_ADVERTISEMENT_SUBSCRIPTIONS
+#define MODULE_MAX_ADVERTISEMENT_SUBSCRIPTIONS 2
+#endif
+
 // ########### Flash Settings ##########################################
 // Number of pages used to store records, at least 2 are required for swapping
 #ifndef RECORD_STORAGE_NUM_PAGES
 #define RECORD_STORAGE_NUM_PAGES 2
 #endif
 
+// Number of recordIds for which the location of the newest record is kept in RAM, other records are searched in flash
+#ifndef RECORD_STORAGE_INDEX_SIZE
+#ifdef NRF51
+#define RECORD_STORAGE_INDEX_SIZE 32
+#else
+#define RECORD_STORAGE_INDEX_SIZE 64
+#endif
+#endif
+
+// A page is defragmented in the background once no page has this many free bytes left
+// and the defragmentation would free at least as many bytes
+#ifndef RECORD_STORAGE_BACKGROUND_DEFRAGMENT_FREE_BYTES
+#define RECORD_STORAGE_BACKGROUND_DEFRAGMENT_FREE_BYTES 256
+#endif
+
+// A page that was erased this many times less than the most erased page is moved in the background
+// so that pages with records that never change take part in the wear leveling
+#ifndef RECORD_STORAGE_WEAR_LEVELING_THRESHOLD
+#define RECORD_STORAGE_WEAR_LEVELING_THRESHOLD 16
+#endif
+
+// Number of pages directly below the record storage pages that keep the event log, less than 2 disables it
+// These pages must not overlap the application
+#ifndef EVENT_LOG_NUM_PAGES
+#ifdef NRF51
+#define EVENT_LOG_NUM_PAGES 0
+#else
+#define EVENT_LOG_NUM_PAGES 2
+#endif
+#endif
+
+// Number of events that can be kept in RAM until they are written to flash
+#ifndef EVENT_LOG_PENDING_SIZE
+#if EVENT_LOG_NUM_PAGES < 2
+#define EVENT_LOG_PENDING_SIZE 1
+#else
+#define EVENT_LOG_PENDING_SIZE 12
+#endif
+#endif
+
+// Events are written to flash once this many are pending or the oldest one waited for EVENT_LOG_FLUSH_INTERVAL_DS
+#ifndef EVENT_LOG_BATCH_SIZE
+#define EVENT_LOG_BATCH_SIZE 6
+#endif
+
+#ifndef EVENT_LOG_FLUSH_INTERVAL_DS
+#define EVENT_LOG_FLUSH_INTERVAL_DS SEC_TO_DS(30)
+#endif
+
+// Queued writes to adjacent or overlapping flash addresses are programmed together up to this many bytes
+#ifndef FLASH_STORAGE_COALESCE_MAX_BYTES
+#ifdef NRF51
+#define FLASH_STORAGE_COALESCE_MAX_BYTES 64
+#else
+#define FLASH_STORAGE_COALESCE_MAX_BYTES 128
+#endif
+#endif
+
 // ########### General ##########################################
 // GAP device name (Not used by the mesh)
 #ifndef DEVICE_NAME
@@ -186,6 +367,43 @@ static_assert(false, "Featureset was not defined, which is mandatory!");
 #define ACTIVATE_FAKE_NODE_POSITIONS 0
 #endif
 
+// Small packets are combined into a single write on mesh connections with partners that support it
+#ifndef ACTIVATE_PACKET_AGGREGATION
+#define ACTIVATE_PACKET_AGGREGATION 1
+#endif
+
+// The central of a mesh connection makes the connection interval faster on busy links and slower on idle links
+// The interval is kept between meshMinConnectionInterval and ADAPTIVE_CONNECTION_INTERVAL_MAX (units of 1.25ms)
+#ifndef ACTIVATE_ADAPTIVE_CONNECTION_INTERVAL
+#define ACTIVATE_ADAPTIVE_CONNECTION_INTERVAL 1
+#endif
+
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_MAX
+#define ADAPTIVE_CONNECTION_INTERVAL_MAX 80
+#endif
+
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_PERIOD_DS
+#define ADAPTIVE_CONNECTION_INTERVAL_PERIOD_DS SEC_TO_DS(2)
+#endif
+
+// A link is busy if it used this much of the capacity of one packet per connection event or if packets are waiting
+// to be handed to the SoftDevice. It is idle if the utilization stays below the idle percentage for some periods
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_BUSY_PERCENT
+#define ADAPTIVE_CONNECTION_INTERVAL_BUSY_PERCENT 50
+#endif
+
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_BACKLOG_PACKETS
+#define ADAPTIVE_CONNECTION_INTERVAL_BACKLOG_PACKETS 3
+#endif
+
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERCENT
+#define ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERCENT 10
+#endif
+
+#ifndef ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERIODS
+#define ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERIODS 3
+#endif
+
 // ########### Logging ##########################################
 // Define which kind of output should be compiled in or not
 // Enabling different kinds of output will increase the size of the binary a lot
@@ -398,6 +616,8 @@ class Conf
 		TerminalMode terminalMode : 8;
 
 		bool enableSinkRouting;
+		//Unicast packets are only sent over the connection on which the receiver was last heard of
+		bool enableUnicastRouting;
 		// ########### TIMINGS ################################################
 
 		//Mesh connection parameters (used when a connection is set up)
@@ -55,6 +55,7 @@ enum class MessageType : u8
 	INVALID = 0,
 	SPLIT_WRITE_CMD = 16, //Used if a WRITE_CMD message is split
 	SPLIT_WRITE_CMD_END = 17, //Used if a WRITE_CMD message is split
+	AGGREGATED_WRITE_CMD = 18, //Used if multiple small WRITE_CMD messages are sent in one write
 
 	//Mesh clustering and handshake: Protocol defined
 	CLUSTER_WELCOME = 20, //The initial message after a connection setup (Sent between two nodes)
@@ -129,17 +130,35 @@ STATIC_ASSERT_SIZE(componentMessageHeader, 12);
 //Used for new message splitting
 //Each split packet uses this header (first one, subsequent ones)
 //First byte must be identical in with connPacketHeader
+//The parts of split packets with different stream ids may be interleaved, stream 0 is compatible with
+//nodes that only support a single split packet at a time. Other streams are only used if the partner
+//supports CONNECTION_FEATURE_SPLIT_STREAMS
 #define SIZEOF_CONN_PACKET_SPLIT_HEADER 2
 typedef struct
 {
 	MessageType splitMessageType;
-	u8 splitCounter;
+	u8 splitCounter : 5;
+	u8 splitStreamId : 3;
 }connPacketSplitHeader;
 STATIC_ASSERT_SIZE(connPacketSplitHeader, 2);
 
+//Aggregated packets consist of this header followed by the packets, each packet is preceded by its length
+#define SIZEOF_CONN_PACKET_AGGREGATE_HEADER 1
+typedef struct
+{
+	MessageType aggregateMessageType;
+}connPacketAggregateHeader;
+STATIC_ASSERT_SIZE(connPacketAggregateHeader, 1);
+
+//Features that a node supports on a mesh connection, exchanged during the handshake
+#define CONNECTION_FEATURE_PACKET_AGGREGATION 0x01
+#define CONNECTION_FEATURE_CONGESTION_CONTROL 0x02
+#define CONNECTION_FEATURE_SPLIT_STREAMS 0x04
+
 //CLUSTER_WELCOME
 #define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME 11
 #define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_WITH_NETWORK_ID 13
+#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_WITH_FEATURES 14
 typedef struct
 {
 	ClusterId clusterId;
@@ -148,35 +167,40 @@ typedef struct
 	ClusterSize hopsToSink;
 	u8 preferredConnectionInterval;
 	NetworkId networkId;
+	u8 connectionFeatures; //CONNECTION_FEATURE_* flags
 }connPacketPayloadClusterWelcome;
-STATIC_ASSERT_SIZE(connPacketPayloadClusterWelcome, 13);
+STATIC_ASSERT_SIZE(connPacketPayloadClusterWelcome, 14);
 
 #define SIZEOF_CONN_PACKET_CLUSTER_WELCOME (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME)
 #define SIZEOF_CONN_PACKET_CLUSTER_WELCOME_WITH_NETWORK_ID (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_WITH_NETWORK_ID)
+#define SIZEOF_CONN_PACKET_CLUSTER_WELCOME_WITH_FEATURES (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_WITH_FEATURES)
 typedef struct
 {
 	connPacketHeader header;
 	connPacketPayloadClusterWelcome payload;
 }connPacketClusterWelcome;
-STATIC_ASSERT_SIZE(connPacketClusterWelcome, 18);
+STATIC_ASSERT_SIZE(connPacketClusterWelcome, 19);
 
 
 //CLUSTER_ACK_1
 #define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK_1 3
+#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK_1_WITH_FEATURES 4
 typedef struct
 {
 	ClusterSize hopsToSink;
 	u8 preferredConnectionInterval;
+	u8 connectionFeatures; //CONNECTION_FEATURE_* flags
 }connPacketPayloadClusterAck1;
-STATIC_ASSERT_SIZE(connPacketPayloadClusterAck1, 3);
+STATIC_ASSERT_SIZE(connPacketPayloadClusterAck1, 4);
 
 #define SIZEOF_CONN_PACKET_CLUSTER_ACK_1 (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK_1)
+#define SIZEOF_CONN_PACKET_CLUSTER_ACK_1_WITH_FEATURES (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK_1_WITH_FEATURES)
 typedef struct
 {
 	connPacketHeader header;
 	connPacketPayloadClusterAck1 payload;
 }connPacketClusterAck1;
-STATIC_ASSERT_SIZE(connPacketClusterAck1, 8);
+STATIC_ASSERT_SIZE(connPacketClusterAck1, 9);
 
 
 //CLUSTER_ACK_2
@@ -207,7 +231,8 @@ typedef struct
 	ClusterSize hopsToSink;
 	u8 connectionMasterBitHandover : 1; //Used to hand over the connection master bit
 	u8 counter : 1; //A very small counter to protect against duplicate clusterUpdates
-	u8 reserved : 6;
+	u8 congestionLevel : 2; //CongestionLevel of the sender, only used if both nodes support CONNECTION_FEATURE_CONGESTION_CONTROL
+	u8 reserved : 4;
 	
 }connPacketPayloadClusterInfoUpdate;
 STATIC_ASSERT_SIZE(connPacketPayloadClusterInfoUpdate, 9);
@@ -247,11 +272,22 @@ typedef struct
 	u8 version;
 	u32 fmKeyId;
 	u8 tunnelType : 2;
-	u8 reserved : 6;
+	u8 resumeSession : 1; //Set if the central has a session ticket and appended its nonce
+	u8 reserved : 5;
 
 }connPacketEncryptCustomStart;
 STATIC_ASSERT_SIZE(connPacketEncryptCustomStart, 11);
 
+//Sent instead of the start packet if the central wants to resume a previous session
+#define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START_RESUME (SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START + 8)
+typedef struct
+{
+	connPacketEncryptCustomStart start;
+	u32 cnonce[2];
+
+}connPacketEncryptCustomStartResume;
+STATIC_ASSERT_SIZE(connPacketEncryptCustomStartResume, 19);
+
 #define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE (SIZEOF_CONN_PACKET_HEADER + 8)
 typedef struct
 {
@@ -261,6 +297,17 @@ typedef struct
 }connPacketEncryptCustomANonce;
 STATIC_ASSERT_SIZE(connPacketEncryptCustomANonce, 13);
 
+//Answer of the peripheral if it accepted the resumption, the handshake is done after this packet
+#define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE_RESUMED (SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE + 1)
+typedef struct
+{
+	connPacketEncryptCustomANonce anonce;
+	u8 sessionResumed : 1;
+	u8 reserved : 7;
+
+}connPacketEncryptCustomANonceResumed;
+STATIC_ASSERT_SIZE(connPacketEncryptCustomANonceResumed, 14);
+
 #define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_SNONCE (SIZEOF_CONN_PACKET_HEADER + 8)
 typedef struct
 {
@@ -270,14 +317,16 @@ typedef struct
 }connPacketEncryptCustomSNonce;
 STATIC_ASSERT_SIZE(connPacketEncryptCustomSNonce, 13);
 
-#define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_DONE (SIZEOF_CONN_PACKET_HEADER + 1)
+#define SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_DONE (SIZEOF_CONN_PACKET_HEADER + 2)
 typedef struct
 {
 	connPacketHeader header;
 	u8 status;
+	u8 sessionResumable : 1; //The central may store a session ticket and resume the session on reconnect
+	u8 reserved : 7;
 
 }connPacketEncryptCustomDone;
-STATIC_ASSERT_SIZE(connPacketEncryptCustomDone, 6);
+STATIC_ASSERT_SIZE(connPacketEncryptCustomDone, 7);
 
 
 //DATA_PACKET
@@ -208,6 +208,7 @@ enum class BleStackType {
 #define RECORD_STORAGE_RECORD_ID_UPDATE_STATUS 1000 //Stores the done status of an update
 #define RECORD_STORAGE_RECORD_ID_UICR_REPLACEMENT 1001 //Can be used, if UICR can not be flashed, e.g. when updating another beacon with different firmware
 #define RECORD_STORAGE_RECORD_ID_FAKE_NODE_POSITIONS 1002 //Used to store fake positions for nodes to modify the incoming events
+#define RECORD_STORAGE_RECORD_ID_ERASE_COUNTER 1003 //Reserved, holds the erase counter of a RecordStorage page, never accessible through the RecordStorage
 
 
 /*## Modules #############################################################*/
@@ -308,6 +309,7 @@ enum class CustomErrorTypes : u8{
 	FATAL_CONNECTION_ALLOCATOR_OUT_OF_MEMORY = 41,
 	FATAL_CONNECTION_REMOVED_WHILE_TIME_SYNC = 42,
 	FATAL_COULD_NOT_RETRIEVE_CAPABILITIES = 43,
+	COUNT_SHED_PACKETS = 44,
 };
 
 // The reason why the device was rebooted
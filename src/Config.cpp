@@ -108,6 +108,7 @@ void Conf::LoadDefaults(){
 	defaultLedMode = LedMode::CONNECTIONS;
 
 	enableSinkRouting = false;
+	enableUnicastRouting = true;
 	//Check if the BLE stack supports the number of connections and correct if not
 #ifdef SIM_ENABLED
 	BleStackType stackType = FruityHal::GetBleStackType();
@@ -467,6 +467,12 @@ void FruityHal::DispatchBleEvents(void* eventVirtualPointer)
 			GS->cm.GapRssiChangedEventHandler(rce);
 		}
 		break;
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+		{
+			GapConnParamUpdateEvent cpue(&bleEvent);
+			GS->cm.GapConnParamUpdateEventHandler(cpue);
+		}
+		break;
 	case BLE_GAP_EVT_ADV_REPORT:
 		{
 			GapAdvertisementReportEvent are(&bleEvent);
@@ -478,12 +484,8 @@ void FruityHal::DispatchBleEvents(void* eventVirtualPointer)
 				return;
 			}
 #endif
+			//Also dispatches the report to the node and all subscribed modules
 			ScanController::getInstance().ScanEventHandler(are);
-			for (u32 i = 0; i < GS->amountOfModules; i++) {
-				if (GS->activeModules[i]->configurationPointer->moduleActive) {
-					GS->activeModules[i]->GapAdvertisementReportEventHandler(are);
-				}
-			}
 		}
 		break;
 	case BLE_GAP_EVT_CONNECTED:
@@ -629,7 +631,12 @@ void FruityHal::DispatchBleEvents(void* eventVirtualPointer)
 	}
 }
 
+#ifdef SIM_ENABLED
+//CherrySim executes nodes on several threads at once
+static SIM_THREAD_LOCAL ble_evt_t* currentEvent = nullptr;
+#else
 static ble_evt_t* currentEvent = nullptr;
+#endif
 
 GapConnParamUpdateEvent::GapConnParamUpdateEvent(void* _evt)
 	:GapEvent(_evt)
@@ -2270,6 +2277,7 @@ void FruityHal::disableUart()
 
 void FruityHal::enableUart()
 {
+#ifndef SIM_ENABLED
 	//Configure pins
 	nrf_gpio_pin_set(Boardconfig->uartTXPin);
 	nrf_gpio_cfg_output(Boardconfig->uartTXPin);
@@ -2309,13 +2317,15 @@ void FruityHal::enableUart()
 
 	//Start receiving RX events
 	FruityHal::enableUartReadInterrupt();
-
+#endif
 }
 
 void FruityHal::enableUartReadInterrupt()
 {
+#ifndef SIM_ENABLED
 	//Enables Interrupts
 	nrf_uart_int_enable(NRF_UART0, NRF_UART_INT_MASK_RXDRDY | NRF_UART_INT_MASK_ERROR);
+#endif
 }
 
 bool FruityHal::checkAndHandleUartTimeout()
@@ -2355,23 +2365,20 @@ u32 FruityHal::checkAndHandleUartError()
 
 bool FruityHal::readUartByte(char * outByte)
 {
-
+#ifndef SIM_ENABLED
 	if (nrf_uart_int_enable_check(NRF_UART0, NRF_UART_INT_MASK_RXDRDY) &&
 		nrf_uart_event_check(NRF_UART0, NRF_UART_EVENT_RXDRDY))
 	{
 		//Reads the byte
 		nrf_uart_event_clear(NRF_UART0, NRF_UART_EVENT_RXDRDY);
-#ifndef SIM_ENABLED
 		*outByte = NRF_UART0->RXD;
-#else
-		*outByte = nrf_uart_rxd_get(NRF_UART0);
-#endif
 
 		//Disable the interrupt to stop receiving until instructed further
 		nrf_uart_int_disable(NRF_UART0, NRF_UART_INT_MASK_RXDRDY | NRF_UART_INT_MASK_ERROR);
 
 		return true;
 	}
+#endif
 
 	return false;
 }
@@ -46,6 +46,7 @@
 #include "Terminal.h"
 #include "FlashStorage.h"
 #include "RecordStorage.h"
+#include "EventLog.h"
 #include "LedWrapper.h"
 #include "Node.h"
 #include "ConnectionAllocator.h"
@@ -122,6 +123,7 @@ class GlobalState
 		Terminal terminal;
 		FlashStorage flashStorage;
 		RecordStorage recordStorage;
+		EventLog eventLog;
 
 		LedWrapper ledRed;
 		LedWrapper ledGreen;
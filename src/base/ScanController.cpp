@@ -203,23 +203,99 @@ void ScanController::ScanningHasStopped()
 //If a BLE event occurs, this handler will be called to do the work
 bool ScanController::ScanEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) const
 {
-	//Check if packet is a valid mesh advertising packet
-	const advPacketHeader* packetHeader = (const advPacketHeader*)advertisementReportEvent.getData();
+	//The report is parsed once, all receivers only get the index of it
+	AdvertisementReportIndex index;
+	index.Build(advertisementReportEvent.getData(), (u8)advertisementReportEvent.getDataLength());
 
+	if (index.isMeshPacket)
+	{
+		//Packet is valid and belongs to our network, forward to Node for further processing
+		GS->node.GapAdvertisementMessageHandler(advertisementReportEvent, index);
+	}
+
+	for (u32 i = 0; i < GS->amountOfModules; i++) {
+		if (GS->activeModules[i]->configurationPointer->moduleActive && GS->activeModules[i]->IsSubscribedTo(index)) {
+			GS->activeModules[i]->GapAdvertisementReportEventHandler(advertisementReportEvent, index);
+		}
+	}
+
+	return true;
+}
+
+#define _________________ADVERTISEMENT_REPORT_INDEX____________
+
+//AD structures are not aligned, so the 16 bit values are read bytewise
+static u16 ReadU16(const u8* data)
+{
+	return (u16)(data[0] | (data[1] << 8));
+}
+
+void AdvertisementReportIndex::Build(const u8* data, u8 dataLength)
+{
+	this->data = data;
+	this->dataLength = dataLength;
+	structureCount = 0;
+	isMeshPacket = false;
+	meshMessageType = 0;
+	serviceData = nullptr;
+	serviceDataLength = 0;
+	serviceDataUuid = 0;
+	serviceDataMessageType = 0;
+
+	u8 offset = 0;
+	while (offset < dataLength && structureCount < ADV_REPORT_MAX_AD_STRUCTURES)
+	{
+		const u8 len = data[offset];
+		//A length of 0 terminates the significant part of the advertising data
+		if (len == 0) break;
+		//A malformed structure must not hide the well-formed structures in front of it
+		if ((u32)offset + len + 1 > dataLength) break;
+
+		const u8 adType = data[offset + 1];
+		adTypes[structureCount] = adType;
+		offsets[structureCount] = offset;
+		structureCount++;
+
+		if (adType == BLE_GAP_AD_TYPE_SERVICE_DATA && serviceData == nullptr && len >= 3)
+		{
+			serviceData = data + offset;
+			serviceDataLength = len + 1;
+			serviceDataUuid = ReadU16(data + offset + 2);
+			if (len >= SIZEOF_ADV_STRUCTURE_SERVICE_DATA_AND_TYPE - 1)
+			{
+				serviceDataMessageType = ReadU16(data + offset + 4);
+			}
+		}
+
+		offset += len + 1;
+	}
+
+	//Mesh packets have a fixed layout, the receivers cast the whole report to their packet structure
+	//The header is therefore checked directly and does not depend on the AD structures being well-formed
+	const advPacketHeader* packetHeader = (const advPacketHeader*)data;
 	if (
-			advertisementReportEvent.getDataLength() >= SIZEOF_ADV_PACKET_HEADER
+			dataLength >= SIZEOF_ADV_PACKET_HEADER
 			&& packetHeader->manufacturer.companyIdentifier == COMPANY_IDENTIFIER
 			&& packetHeader->meshIdentifier == MESH_IDENTIFIER
 			&& packetHeader->networkId == GS->node.configuration.networkId
 		)
 	{
-		//Packet is valid and belongs to our network, forward to Node for further processing
-		GS->node.GapAdvertisementMessageHandler(advertisementReportEvent);
-
+		isMeshPacket = true;
+		meshMessageType = packetHeader->messageType;
 	}
-
-	return true;
 }
 
+const u8* AdvertisementReportIndex::FindStructure(u8 adType, u16 leadingUuid) const
+{
+	for (u32 i = 0; i < structureCount; i++)
+	{
+		const u8* structure = data + offsets[i];
+		if (adTypes[i] == adType && structure[0] >= 3 && ReadU16(structure + 2) == leadingUuid)
+		{
+			return structure;
+		}
+	}
+	return nullptr;
+}
 
 //EOF
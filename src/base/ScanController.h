@@ -41,6 +41,55 @@
 
 #define SCAN_CONTROLLER_JOBS_MAX	4
 
+//An advertising packet has at most 31 bytes and every AD structure at least 2
+#define ADV_REPORT_MAX_AD_STRUCTURES	15
+
+//Index over the AD structures of an advertisement report, built in a single pass when the report is received
+//so that the modules do not have to parse the raw data themselves
+class AdvertisementReportIndex
+{
+public:
+	const u8* data;
+	u8 dataLength;
+
+	//Type and offset of all AD structures in the order of the report
+	u8 structureCount;
+	u8 adTypes[ADV_REPORT_MAX_AD_STRUCTURES];
+	u8 offsets[ADV_REPORT_MAX_AD_STRUCTURES];
+
+	//Set if the report is a mesh advertising packet (advPacketHeader) of our network
+	bool isMeshPacket;
+	u8 meshMessageType;
+
+	//First service data structure, points to its length byte, nullptr if there is none
+	const u8* serviceData;
+	u8 serviceDataLength; //Including the length and type byte
+	u16 serviceDataUuid;
+	u16 serviceDataMessageType; //0 if the structure is too short to contain a messageType
+
+	//Indexing stops at the first AD structure that exceeds the report, the structures before it are kept
+	void Build(const u8* data, u8 dataLength);
+
+	//Returns the first AD structure of the given type whose data starts with the 16 bit uuid or nullptr
+	const u8* FindStructure(u8 adType, u16 leadingUuid) const;
+};
+
+enum class AdvertisementSubscriptionType : u8 {
+	MESH_MESSAGE = 0, //Mesh advertising packet of our network with the given messageType
+	SERVICE_DATA = 1, //Service data with the given uuid and messageType
+	AD_STRUCTURE = 2, //Any AD structure of the given type whose data starts with the given uuid
+};
+
+#define ADV_SUBSCRIPTION_ANY_MESSAGE_TYPE	0xFFFF
+
+typedef struct AdvertisementSubscription
+{
+	AdvertisementSubscriptionType type;
+	u8 adType; //Only used for AD_STRUCTURE
+	u16 uuid; //Not used for MESH_MESSAGE
+	u16 messageType;
+}AdvertisementSubscription;
+
 enum class ScanJobState : u8{
 	INACTIVE,
 	ACTIVE,
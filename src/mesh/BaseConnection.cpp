@@ -47,16 +47,32 @@ constexpr int BASE_CONNECTION_MAX_SEND_FAIL  = 10;
 //The parallel flow of multiple connections
 
 BaseConnection::BaseConnection(u8 id, ConnectionDirection direction, fh_ble_gap_addr_t* partnerAddress)
-	: packetSendQueue(packetSendBuffer, PACKET_SEND_BUFFER_SIZE),
-	packetSendQueueHighPrio(packetSendBufferHighPrio, PACKET_SEND_BUFFER_HIGH_PRIO_SIZE)
+	: packetSendQueue(packetSendBuffer, PACKET_SEND_BUFFER_SIZE, packetSendIndex, sizeof(packetSendIndex) / sizeof(u16)),
+	packetSendQueueHighPrio(packetSendBufferHighPrio, PACKET_SEND_BUFFER_HIGH_PRIO_SIZE, packetSendIndexHighPrio, sizeof(packetSendIndexHighPrio) / sizeof(u16)),
+	packetSendQueueMediumPrio(packetSendBufferMediumPrio, PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE, packetSendIndexMediumPrio, sizeof(packetSendIndexMediumPrio) / sizeof(u16)),
+	packetSendQueueLowestPrio(packetSendBufferLowestPrio, PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE, packetSendIndexLowestPrio, sizeof(packetSendIndexLowestPrio) / sizeof(u16))
 {
+	packetSendQueues[(u8)DeliveryPriority::MESH_INTERNAL_HIGH] = &packetSendQueueHighPrio;
+	packetSendQueues[(u8)DeliveryPriority::MEDIUM] = &packetSendQueueMediumPrio;
+	packetSendQueues[(u8)DeliveryPriority::LOW] = &packetSendQueue;
+	packetSendQueues[(u8)DeliveryPriority::LOWEST] = &packetSendQueueLowestPrio;
+	CheckedMemset(packetSendQueueSkips, 0, sizeof(packetSendQueueSkips));
+	transmitDeficit = 0;
+
 	//Initialize to defaults
 	connectionType = ConnectionType::INVALID;
 	unreliableBuffersFree = 0;
 	reliableBuffersFree = 1;
 	partnerId = 0;
 	connectionHandle = BLE_CONN_HANDLE_INVALID;
-	packetReassemblyPosition = 0;
+	ClearReassemblyContexts();
+	packetsInSoftdeviceStart = 0;
+	packetsInSoftdeviceCount = 0;
+	packetAggregationEnabled = false;
+	splitStreamsEnabled = false;
+	reservedQueue = nullptr;
+	reservedSendData = nullptr;
+	splitHeaderPosition = nullptr;
 	packetQueuedHandleCounter = PACKET_QUEUED_HANDLE_COUNTER_START;
 	connectionHandshakedTimestampDs = 0;
 	disconnectedTimestampDs = 0;
@@ -71,6 +87,7 @@ BaseConnection::BaseConnection(u8 id, ConnectionDirection direction, fh_ble_gap_
 	sentReliable = 0;
 	sentUnreliable = 0;
 	connectionPayloadSize = MAX_DATA_SIZE_PER_WRITE;
+	connectionInterval = 0;
 	clusterUpdateCounter = 0;
 	nextExpectedClusterUpdateCounter = 1;
 	manualPacketsSent = 0;
@@ -136,39 +153,54 @@ bool BaseConnection::QueueData(const BaseConnectionSendData &sendData, u8* data)
 
 bool BaseConnection::QueueData(const BaseConnectionSendData &sendData, u8* data, bool fillTxBuffers)
 {
-	//Reserve space in our sendQueue for the metadata and our data
-	u8* buffer;
+	u8* buffer = ReserveData(sendData);
+
+	if(buffer != nullptr){
+		memcpy(buffer, data, sendData.dataLength);
+		return CommitData(sendData.dataLength, fillTxBuffers);
+	} else {
+		//For safety, we try to fill the transmitbuffers if it got stuck
+		if(fillTxBuffers) FillTransmitBuffers();
+		return false;
+	}
+}
 
-	//Select the correct packet Queue
-	//TODO: currently we only allow non-split data for high prio
-	PacketQueue* activeQueue;
+//Reserves space for a packet of up to sendData.dataLength bytes in the packet queue and returns a pointer
+//where the packet can be written to directly. The packet is only queued once CommitData is called
+//with the number of bytes that were written. Nothing else must be queued in between.
+u8* BaseConnection::ReserveData(const BaseConnectionSendData &sendData)
+{
+	//Select the correct packet Queue, packets that do not fit in the queue of their priority use the normal queue
+	DeliveryPriority queuePriority = DeliveryPriority::LOW;
 
-	if(sendData.priority == DeliveryPriority::MESH_INTERNAL_HIGH && sendData.dataLength <= connectionMtu)
+	if(sendData.priority < DeliveryPriority::INVALID
+		&& SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + sendData.dataLength <= packetSendQueues[(u8)sendData.priority]->bufferLength)
 	{
-		logt("CM", "Queuing in high prio queue");
-		activeQueue = &packetSendQueueHighPrio;
-	} else {
-		logt("CM", "Queuing in normal prio queue");
-		activeQueue = &packetSendQueue;
+		queuePriority = sendData.priority;
 	}
+	logt("CM", "Queuing in prio %u queue", (u32)queuePriority);
+	PacketQueue* activeQueue = packetSendQueues[(u8)queuePriority];
 
-	buffer = activeQueue->Reserve(SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + sendData.dataLength);
+	//Reserve space in our sendQueue for the metadata and our data
+	u8* buffer = activeQueue->ReserveUncommitted(SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + sendData.dataLength);
 
 	if(buffer != nullptr){
-		activeQueue->numUnsentElements++;
-
-		//Copy both to the reserved space
+		//Fill in the metadata, the data is written by the caller
 		BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)buffer;
 		sendDataPacked->characteristicHandle = sendData.characteristicHandle;
 		sendDataPacked->deliveryOption = (u8)sendData.deliveryOption;
-		sendDataPacked->priority = (u8)sendData.priority;
+		sendDataPacked->priority = (u8)queuePriority;
 		sendDataPacked->dataLength = sendData.dataLength;
 		sendDataPacked->sendHandle = PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
 
-		memcpy(buffer + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, data, sendData.dataLength);
-		if (fillTxBuffers) FillTransmitBuffers();
-		return true;
+		reservedQueue = activeQueue;
+		reservedSendData = sendDataPacked;
+
+		return buffer + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED;
 	} else {
+		reservedQueue = nullptr;
+		reservedSendData = nullptr;
+
 		GS->cm.droppedMeshPackets++;
 		droppedPackets++;
 
@@ -179,48 +211,180 @@ bool BaseConnection::QueueData(const BaseConnectionSendData &sendData, u8* data,
 		logt("ERROR", "Send queue is already full");
 		SIMSTATCOUNT("sendQueueFull");
 
-		//For safety, we try to fill the transmitbuffers if it got stuck
-		if(fillTxBuffers) FillTransmitBuffers();
+		return nullptr;
+	}
+}
+
+//Queues the packet that was written to the space given by ReserveData, dataLength must not exceed the reserved length
+bool BaseConnection::CommitData(u16 dataLength, bool fillTxBuffers)
+{
+	if(reservedQueue == nullptr || dataLength > reservedSendData->dataLength){
+		logt("ERROR", "No data reserved");
+		SIMEXCEPTION(IllegalStateException);
+		return false;
+	}
+
+	PacketQueue* activeQueue = reservedQueue;
+	reservedSendData->dataLength = dataLength;
+	reservedQueue = nullptr;
+	reservedSendData = nullptr;
+
+	if(!activeQueue->Commit(SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + dataLength)){
 		return false;
 	}
+
+	activeQueue->numUnsentElements++;
+
+	if (fillTxBuffers) FillTransmitBuffers();
+	return true;
 }
 
 void BaseConnection::FillTransmitBuffers()
+{
+	FillTransmitBuffers(0);
+}
+
+//The mesh internal queue is always served first. The other queues are served by priority, but a queue that
+//was passed over PACKET_SEND_QUEUE_AGING_LIMIT times gets one packet through so that it cannot starve
+//Other packets may be sent between the parts of a split packet
+DeliveryPriority BaseConnection::SelectSendQueue() const
+{
+	if(IsSendQueueReady(DeliveryPriority::MESH_INTERNAL_HIGH)){
+		return DeliveryPriority::MESH_INTERNAL_HIGH;
+	}
+
+	DeliveryPriority selected = DeliveryPriority::INVALID;
+	for(u8 i = (u8)DeliveryPriority::MEDIUM; i < (u8)DeliveryPriority::INVALID; i++){
+		if(!IsSendQueueReady((DeliveryPriority)i)) continue;
+
+		if(selected == DeliveryPriority::INVALID){
+			selected = (DeliveryPriority)i;
+		} else if(packetSendQueueSkips[i] >= PACKET_SEND_QUEUE_AGING_LIMIT){
+			return (DeliveryPriority)i;
+		}
+	}
+	return selected;
+}
+
+//Checks if the queue has a packet that can be sent now
+bool BaseConnection::IsSendQueueReady(DeliveryPriority priority) const
+{
+	const PacketQueue* queue = packetSendQueues[(u8)priority];
+
+	if(queue->numUnsentElements == 0) return false;
+
+	//Continue a split packet, the numElements mismatch is handled by the caller
+	if(queue->packetSendPosition != 0 || queue->_numElements < queue->numUnsentElements) return true;
+
+	//A new split packet can only be started once all parts of the previous one from this queue were sent.
+	//Without split streams, the partner only reassembles one split packet at a time
+	SizedData packet = queue->PeekNext(queue->_numElements - queue->numUnsentElements);
+	if(((BaseConnectionSendDataPacked*)packet.data)->dataLength > connectionPayloadSize){
+		if(queue->packetSentRemaining != 0 || (!splitStreamsEnabled && GetActiveSplitStreams() > 0)){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Must be called after a packet of the given queue was sent, all other waiting queues age
+void BaseConnection::HandleSendQueueServed(DeliveryPriority servedPriority)
+{
+	for(u8 i = (u8)DeliveryPriority::MEDIUM; i < (u8)DeliveryPriority::INVALID; i++){
+		if(i == (u8)servedPriority){
+			packetSendQueueSkips[i] = 0;
+		} else if(packetSendQueues[i]->numUnsentElements > 0 && packetSendQueueSkips[i] < PACKET_SEND_QUEUE_AGING_LIMIT){
+			packetSendQueueSkips[i]++;
+		}
+	}
+}
+
+//Packs the next unsent packet of the queue together with the small packets that follow it into the aggregateBuffer
+//and changes sendData and data to the aggregated packet. Returns the number of packets that were packed,
+//or 1 if the packet has to be sent on its own
+u8 BaseConnection::AggregatePackets(const PacketQueue& queue, BaseConnectionSendData* sendData, u8** data, u8* aggregateBuffer) const
+{
+	if(!packetAggregationEnabled || !handshakeDone() || sendData->deliveryOption != DeliveryOption::WRITE_CMD){
+		return 1;
+	}
+
+	u16 length = SIZEOF_CONN_PACKET_AGGREGATE_HEADER;
+	u8 numPackets = 0;
+	for(u16 i = queue._numElements - queue.numUnsentElements; i < queue._numElements; i++){
+		SizedData packet = queue.PeekNext(i);
+		BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
+
+		if(sendDataPacked->deliveryOption != (u8)DeliveryOption::WRITE_CMD
+			|| sendDataPacked->characteristicHandle != sendData->characteristicHandle
+			|| length + 1 + sendDataPacked->dataLength > connectionPayloadSize
+		){
+			break;
+		}
+
+		aggregateBuffer[length] = (u8)sendDataPacked->dataLength;
+		memcpy(aggregateBuffer + length + 1, packet.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, sendDataPacked->dataLength);
+		length += 1 + sendDataPacked->dataLength;
+		numPackets++;
+	}
+
+	if(numPackets < 2){
+		return 1;
+	}
+
+	((connPacketAggregateHeader*)aggregateBuffer)->aggregateMessageType = MessageType::AGGREGATED_WRITE_CMD;
+	sendData->dataLength = length;
+	*data = aggregateBuffer;
+
+	return numPackets;
+}
+
+bool BaseConnection::FillTransmitBuffers(u16 byteQuantum)
 {
 	u32 err = 0;
+	bool sentSomething = false;
+
+	//Unused bytes of a round are not carried over, a deficit from the last round is
+	if(byteQuantum != 0 && transmitDeficit < (i16)byteQuantum) transmitDeficit += byteQuantum;
 
+	//Only used by subclasses that have to modify the packet before sending it, split packets are sent from the queue
 	DYNAMIC_ARRAY(packetBuffer, connectionMtu);
+	//Used to combine multiple small packets into one write
+	DYNAMIC_ARRAY(aggregateBuffer, connectionMtu);
 	BaseConnectionSendData sendDataStruct;
 	BaseConnectionSendData* sendData = &sendDataStruct;
 	u8* data;
 
 	while(isConnected() && connectionState != ConnectionState::REESTABLISHING && connectionState != ConnectionState::REESTABLISHING_HANDSHAKE)
 	{
+		//Stop if the connection has used up its share of the current scheduling round
+		if(byteQuantum != 0 && transmitDeficit <= 0){
+			return sentSomething;
+		}
+
 		//Check if there is important data from the subclass to be sent
-		if(packetSendQueue.packetSendPosition == 0){
-			TransmitHighPrioData();
+		TransmitHighPrioData();
+
+		//The softdevice reports sent packets in order, so we must be able to remember each queued one
+		if(packetsInSoftdeviceCount >= PACKETS_IN_SOFTDEVICE_MAX){
+			return sentSomething;
 		}
 
 		//Next, select the correct Queue from which we should be transmitting
-		//TODO: Currently we do not allow message splitting in HighPrio Queue
-		PacketQueue* activeQueue;
-		if(packetSendQueueHighPrio.numUnsentElements > 0 && packetSendQueue.packetSendPosition == 0){
-			//logt("CONN", "Queuing from high prio queue");
-			activeQueue = &packetSendQueueHighPrio;
-		} else if(packetSendQueue.numUnsentElements > 0){
-			//logt("CONN", "Queuing from normal prio queue");
-			activeQueue = &packetSendQueue;
-		} else {
-			return;
+		DeliveryPriority activePriority = SelectSendQueue();
+		if(activePriority == DeliveryPriority::INVALID){
+			transmitDeficit = 0;
+			return sentSomething;
 		}
+		PacketQueue* activeQueue = packetSendQueues[(u8)activePriority];
 
 		if (activeQueue->_numElements < activeQueue->numUnsentElements) {
 			logt("ERROR", "Fail: Queue numElements");
 			SIMERROR();
-			GS->logger.logCustomError(CustomErrorTypes::FATAL_QUEUE_NUM_MISMATCH, (u16)(activeQueue == &packetSendQueue));
+			GS->logger.logCustomError(CustomErrorTypes::FATAL_QUEUE_NUM_MISMATCH, (u16)activePriority);
 
 			GS->cm.ForceDisconnectAllConnections(AppDisconnectReason::QUEUE_NUM_MISMATCH);
-			return;
+			return sentSomething;
 		}
 
 		//Get the next packet from the packet queue that was not yet queued
@@ -241,21 +405,18 @@ void BaseConnection::FillTransmitBuffers()
 			|| (sendData->deliveryOption == DeliveryOption::NOTIFICATION && unreliableBuffersFree > 0)
 			) {
 
-			//Check if this packet must be split, if yes make sure that there is no other split packet currently queued, we only allow one split
-			//packet to be queued at one time (after one was queued, the packetSendPosition is reset to 0, as long as there are packetSentRemaining
-			//we have not received acknowledgements for all parts
-			if (packet.length > connectionPayloadSize && activeQueue->packetSendPosition == 0 && activeQueue->packetSentRemaining != 0) {
-				return;
-			}
+			//Small packets that follow in the same queue may be sent together with this one
+			u8 numPackets = AggregatePackets(*activeQueue, sendData, &data, aggregateBuffer);
 
 			//The subclass is allowed to modify the packet before it is sent, it will place the modified packet into the sentData struct
 			//This could be e.g. only a part of the original packet ( a split packet )
 			SizedData sentData = ProcessDataBeforeTransmission(sendData, data, packetBuffer);
 
 			if(sentData.length == 0){
+				RestoreSplitData();
 				logt("ERROR", "Packet processing failed");
 				GS->logger.logCustomError(CustomErrorTypes::FATAL_PACKET_PROCESSING_FAILED, partnerId);
-				return; //FIXME: this could break a connection
+				return sentSomething; //FIXME: this could break a connection
 			}
 
 
@@ -295,26 +456,50 @@ void BaseConnection::FillTransmitBuffers()
 					unreliableBuffersFree--;
 				}
 
-				//FIXME: This is not using the preprocessed data (sentData)
-				PacketSuccessfullyQueuedWithSoftdevice(activeQueue, sendDataPacked, data, &sentData);
+				if(numPackets > 1){
+					//Each of the aggregated packets was queued as if it was sent on its own
+					for(u32 i=0; i<numPackets; i++){
+						SizedData part = activeQueue->PeekNext(activeQueue->_numElements - activeQueue->numUnsentElements);
+						SizedData partData = { part.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, (u16)(part.length - SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED) };
+						PacketSuccessfullyQueuedWithSoftdevice(activeQueue, (BaseConnectionSendDataPacked*)part.data, partData.data, &partData);
+					}
+				} else {
+					//FIXME: This is not using the preprocessed data (sentData)
+					PacketSuccessfullyQueuedWithSoftdevice(activeQueue, sendDataPacked, data, &sentData);
+				}
+
+				//The SoftDevice has copied the data, so a split header can be removed from the queue again
+				RestoreSplitData();
+
+				u8 softdevicePosition = (packetsInSoftdeviceStart + packetsInSoftdeviceCount) % PACKETS_IN_SOFTDEVICE_MAX;
+				packetsInSoftdevice[softdevicePosition] = (u8)activePriority;
+				packetsInSoftdeviceNumPackets[softdevicePosition] = numPackets;
+				packetsInSoftdeviceCount++;
+
+				HandleSendQueueServed(activePriority);
+				if(byteQuantum != 0) transmitDeficit -= sentData.length;
+				sentSomething = true;
 
 			} else {
 				logt("ERROR", "GATT WRITE ERROR 0x%x on handle %u", err, connectionHandle);
 
 				GS->logger.logCustomError(CustomErrorTypes::WARN_GATT_WRITE_ERROR, err);
 
+				RestoreSplitData();
 				HandlePacketQueuingFail(*activeQueue, sendDataPacked, err);
 
 				//Stop queuing packets for this connection to prevent infinite loops
-				return;
+				return sentSomething;
 			}
 
 		} else {
 			//Go to next connection if a packet (either reliable or unreliable)
 			//could not be sent because the corresponding buffers are full
-			return;
+			transmitDeficit = 0;
+			return sentSomething;
 		}
 	}
+	return sentSomething;
 }
 
 void BaseConnection::HandlePacketQueued(PacketQueue* activeQueue, BaseConnectionSendDataPacked* sendDataPacked)
@@ -334,8 +519,6 @@ void BaseConnection::HandlePacketSent(u8 sentUnreliable, u8 sentReliable)
 	//logt("CONN", "Data was sent %u, %u", sentUnreliable, sentReliable);
 
 	//TODO: are write cmds and write reqs sent sequentially?
-	//TODO: we must not send more than 100 packets from one queue, otherwise, the handles between
-	//the queues will not match anymore to the sequence in that the packets were sent
 	
 	//We must iterate in a loop to delete all packets if more than one was sent
 	u8 numSent = sentUnreliable + sentReliable;
@@ -348,83 +531,56 @@ void BaseConnection::HandlePacketSent(u8 sentUnreliable, u8 sentReliable)
 			continue;
 		}
 
-		//Find the queue from which the packet was sent
-		PacketQueue* activeQueue;
-
-		SizedData packet = packetSendQueue.PeekNext();
-		BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
-		u8 handle = packet.length > 0 ? sendDataPacked->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
-
-		packet = packetSendQueueHighPrio.PeekNext();
-		BaseConnectionSendDataPacked* sendDataPackedHighPrio = (BaseConnectionSendDataPacked*)packet.data;
-		u8 handleHighPrio = packet.length > 0 ? sendDataPackedHighPrio->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
-
-		//If no queue has a handle, the packets must be from the normal queue because it was sending a split packet (but not all parts yet)
-		if (handle < PACKET_QUEUED_HANDLE_COUNTER_START && handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
-			activeQueue = &packetSendQueue;
-#ifdef SIM_ENABLED
-			if (packetSendQueue.packetSentRemaining == 0) {
-				SIMEXCEPTION(IllegalStateException);
-			}
-#endif
-		}
-		//Check if we do not have a queued packet in the normal queue
-		else if (handle < PACKET_QUEUED_HANDLE_COUNTER_START) {
-			activeQueue = &packetSendQueueHighPrio;
-		}
-		//Check if we do not have a queued packet in the high prio queue
-		else if (handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
-			activeQueue = &packetSendQueue;
-		}
-		//Check which handle is lower than the other handle using unsigned variables that will wrap
-		else {
-			//Must be casted to u8, otherwhise type promotion results in an integer!
-			if ((u8)(handle - handleHighPrio) < 100) {
-				activeQueue = &packetSendQueueHighPrio;
-			}
-			else {
-				activeQueue = &packetSendQueue;
-			}
-		}
-
-
-		if(activeQueue->_numElements == 0){
+		//Find the queue from which the packet was sent, packets are reported in the order in which they were queued
+		if (packetsInSoftdeviceCount == 0 || packetSendQueues[packetsInSoftdevice[packetsInSoftdeviceStart]]->_numElements == 0) {
 			//TODO: Save Error
 			logt("ERROR", "Fail: Queue");
 			SIMERROR();
 
 			GS->logger.logCustomError(CustomErrorTypes::FATAL_HANDLE_PACKET_SENT_ERROR, partnerId);
+			continue;
 		}
 
-		//Check if a split packet should be acknowledged
-		bool ackForSplitPacket = false;
-		if (activeQueue == &packetSendQueue && activeQueue->packetSentRemaining > 0 && sendDataPacked != nullptr && sendDataPacked->dataLength > connectionPayloadSize) {
-			activeQueue->packetSentRemaining--;
-			ackForSplitPacket = true;
-		}
+		PacketQueue* activeQueue = packetSendQueues[packetsInSoftdevice[packetsInSoftdeviceStart]];
+		u8 numPackets = packetsInSoftdeviceNumPackets[packetsInSoftdeviceStart];
+		packetsInSoftdeviceStart = (packetsInSoftdeviceStart + 1) % PACKETS_IN_SOFTDEVICE_MAX;
+		packetsInSoftdeviceCount--;
+
+		//An aggregated write contains multiple packets that are all removed
+		for (u32 k = 0; k < numPackets && activeQueue->_numElements > 0; k++) {
+			SizedData packet = activeQueue->PeekNext();
+			BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
+
+			//Check if a split packet should be acknowledged
+			bool ackForSplitPacket = false;
+			if (activeQueue->packetSentRemaining > 0 && sendDataPacked->dataLength > connectionPayloadSize) {
+				activeQueue->packetSentRemaining--;
+				ackForSplitPacket = true;
+			}
 
-		//Otherwise, either a normal packet or a split packet can be removed
-		if (!ackForSplitPacket || activeQueue->packetSentRemaining == 0) {
-			SizedData data = activeQueue->PeekNext();
+			//Otherwise, either a normal packet or a split packet can be removed
+			if (!ackForSplitPacket || activeQueue->packetSentRemaining == 0) {
+				SizedData data = activeQueue->PeekNext();
 
-			BaseConnectionSendDataPacked* sendData = (BaseConnectionSendDataPacked*)data.data;
-			connPacketHeader* packetHeader = (connPacketHeader*)(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
+				BaseConnectionSendDataPacked* sendData = (BaseConnectionSendDataPacked*)data.data;
+				connPacketHeader* packetHeader = (connPacketHeader*)(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
 
-			//We must only remove the packet if it has a handle, it might have only been sent partially so far
-			if (sendData->sendHandle != 0) {
+				//We must only remove the packet if it has a handle, it might have only been sent partially so far
+				if (sendData->sendHandle != 0) {
 
 #ifdef SIM_ENABLED
-				if (GS->node.configuration.nodeId == 37 && connectionHandle == 680) {
-					//printf("Q@NODE %u DISCARDS %s (packetHandle %u), gid %u (%u)" EOL, GS->node.configuration.nodeId, sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ ? "WRITE_REQ" : "WRITE_CMD", sendData->sendHandle, *((u32*)(packetHeader + 1)), sendData->dataLength);
-				}
-				//A quick check if a wrong packet was removed (not a 100% check, but helps)
-				if (sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ && !sentReliable) {
-					SIMEXCEPTION(IllegalStateException);
-				}
+					if (GS->node.configuration.nodeId == 37 && connectionHandle == 680) {
+						//printf("Q@NODE %u DISCARDS %s (packetHandle %u), gid %u (%u)" EOL, GS->node.configuration.nodeId, sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ ? "WRITE_REQ" : "WRITE_CMD", sendData->sendHandle, *((u32*)(packetHeader + 1)), sendData->dataLength);
+					}
+					//A quick check if a wrong packet was removed (not a 100% check, but helps)
+					if (sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ && !sentReliable) {
+						SIMEXCEPTION(IllegalStateException);
+					}
 #endif
 
-				DataSentHandler(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, data.length - SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
-				activeQueue->DiscardNext();
+					DataSentHandler(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, data.length - SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
+					activeQueue->DiscardNext();
+				}
 			}
 		}
 	}
@@ -490,13 +646,14 @@ void BaseConnection::PacketSuccessfullyQueuedWithSoftdevice(PacketQueue* queue,
 //This function can split a packet if necessary for sending
 //WARNING: Can only be used for one characteristic, does not support to be used in parallel
 //The implementation must manage packetSendPosition and packetQueue discarding itself
-//packetBuffer must have a size of connectionMtu
-//The function will return a pointer to the packet and the dataLength (do not use packetBuffer, use this pointer)
-SizedData BaseConnection::GetSplitData(const BaseConnectionSendData &sendData, u8* data, u8* packetBuffer) const
+//The parts are not copied: The split header is written into the queue directly in front of the part
+//that is sent, which overwrites the end of the previous part or the queue metadata. These bytes are saved
+//and must be put back using RestoreSplitData once the SoftDevice has copied the part.
+//The function will return a pointer to the packet and the dataLength
+SizedData BaseConnection::GetSplitData(const BaseConnectionSendData &sendData, u8* data)
 {
 	SizedData result;
-	connPacketSplitHeader* resultHeader = (connPacketSplitHeader*) packetBuffer;
-	
+
 	//If we do not have to split the data, return data unmodified
 	if(sendData.dataLength <= connectionPayloadSize){
 		result.data = data;
@@ -504,19 +661,27 @@ SizedData BaseConnection::GetSplitData(const BaseConnectionSendData &sendData, u
 		return result;
 	}
 
+	//The packet is in the queue of its priority as set by ReserveData
+	const PacketQueue* queue = packetSendQueues[(u8)sendData.priority];
+
 	u16 payloadSize = connectionPayloadSize - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+	u16 payloadOffset = queue->packetSendPosition * payloadSize;
+
+	//Save whatever is in front of this part and place the split header there
+	RestoreSplitData();
+	splitHeaderPosition = data + payloadOffset - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+	memcpy(splitHeaderBackup, splitHeaderPosition, SIZEOF_CONN_PACKET_SPLIT_HEADER);
+
+	connPacketSplitHeader* resultHeader = (connPacketSplitHeader*) splitHeaderPosition;
+	resultHeader->splitCounter = queue->packetSendPosition;
+	resultHeader->splitStreamId = GetSplitStreamId(sendData.priority);
+	result.data = splitHeaderPosition;
 
 	//Check if this is the last packet
-	if((packetSendQueue.packetSendPosition+1) * payloadSize >= sendData.dataLength){
+	if(payloadOffset + payloadSize >= sendData.dataLength){
 		//End packet
 		resultHeader->splitMessageType = MessageType::SPLIT_WRITE_CMD_END;
-		resultHeader->splitCounter = packetSendQueue.packetSendPosition;
-		memcpy(
-				packetBuffer + SIZEOF_CONN_PACKET_SPLIT_HEADER,
-			data + packetSendQueue.packetSendPosition * payloadSize,
-			sendData.dataLength - packetSendQueue.packetSendPosition * payloadSize);
-		result.data = packetBuffer;
-		result.length = (sendData.dataLength - packetSendQueue.packetSendPosition * payloadSize) + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+		result.length = (sendData.dataLength - payloadOffset) + SIZEOF_CONN_PACKET_SPLIT_HEADER;
 		if(result.length < 5){
 			logt("ERROR", "Split packet because of very few bytes, optimisation?");
 		}
@@ -528,12 +693,6 @@ SizedData BaseConnection::GetSplitData(const BaseConnectionSendData &sendData, u
 	} else {
 		//Intermediate packet
 		resultHeader->splitMessageType = MessageType::SPLIT_WRITE_CMD;
-		resultHeader->splitCounter = packetSendQueue.packetSendPosition;
-		memcpy(
-				packetBuffer + SIZEOF_CONN_PACKET_SPLIT_HEADER,
-			data + packetSendQueue.packetSendPosition * payloadSize,
-			payloadSize);
-		result.data = packetBuffer;
 		result.length = connectionPayloadSize;
 
 		char stringBuffer[100];
@@ -544,6 +703,38 @@ SizedData BaseConnection::GetSplitData(const BaseConnectionSendData &sendData, u
 	return result;
 }
 
+#if ACTIVATE_SPLIT_STREAMS == 1
+static_assert((u8)DeliveryPriority::INVALID < (1 << 3), "The stream ids of all send queues must fit into splitStreamId");
+static_assert(PACKET_REASSEMBLY_CONTEXT_COUNT >= (u8)DeliveryPriority::INVALID, "Each stream needs its own reassembly context");
+#endif
+
+//Each queue sends its split packets in a separate stream, the normal queue uses stream 0 so that
+//its split packets can still be reassembled by nodes that do not know about streams
+u8 BaseConnection::GetSplitStreamId(DeliveryPriority priority) const
+{
+	if(!splitStreamsEnabled) return 0;
+	return priority == DeliveryPriority::LOW ? 0 : (u8)priority + 1;
+}
+
+//Returns the number of queues that are currently in the middle of sending a split packet
+u8 BaseConnection::GetActiveSplitStreams() const
+{
+	u8 activeStreams = 0;
+	for (u32 i = 0; i < (u8)DeliveryPriority::INVALID; i++) {
+		if (packetSendQueues[i]->packetSendPosition != 0) activeStreams++;
+	}
+	return activeStreams;
+}
+
+//Puts back the queue bytes that were replaced by the split header of GetSplitData
+void BaseConnection::RestoreSplitData()
+{
+	if(splitHeaderPosition != nullptr){
+		memcpy(splitHeaderPosition, splitHeaderBackup, SIZEOF_CONN_PACKET_SPLIT_HEADER);
+		splitHeaderPosition = nullptr;
+	}
+}
+
 #define _________________RECEIVING_________________
 
 //A reassembly function that can reassemble split packets, can be used from subclasses
@@ -557,35 +748,59 @@ u8* BaseConnection::ReassembleData(BaseConnectionSendData* sendData, u8* data)
 		return data;
 	}
 
+	//Find the context in which this stream is reassembled or a free one
+	PacketReassemblyContext* context = nullptr;
+	for(u32 i=0; i<PACKET_REASSEMBLY_CONTEXT_COUNT; i++){
+		if(packetReassemblyContexts[i].position != 0 && packetReassemblyContexts[i].streamId == packetHeader->splitStreamId){
+			context = &packetReassemblyContexts[i];
+			break;
+		}
+	}
+	for(u32 i=0; i<PACKET_REASSEMBLY_CONTEXT_COUNT && context == nullptr; i++){
+		if(packetReassemblyContexts[i].position == 0){
+			context = &packetReassemblyContexts[i];
+			context->streamId = packetHeader->splitStreamId;
+		}
+	}
+	if(context == nullptr){
+		logt("ERROR", "No free reassembly context");
+		return nullptr;
+	}
+
+	//The first part starts a new packet, a previous packet of that stream that was not finished is lost
+	if(packetHeader->splitCounter == 0){
+		context->position = 0;
+	}
+
 	//Check if reassembly buffer limit is reached
-	if(sendData->dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER + packetReassemblyPosition > packetReassemblyBuffer.length){
+	if(sendData->dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER + context->position > context->buffer.length){
 		logt("ERROR", "Packet too big for reassembly");
 		GS->logger.logCustomError(CustomErrorTypes::FATAL_PACKET_TOO_BIG, sendData->dataLength);
-		packetReassemblyPosition = 0;
+		context->position = 0;
 		return nullptr;
 	}
 
 	u16 packetReassemblyDestination = packetHeader->splitCounter * (connectionPayloadSize - SIZEOF_CONN_PACKET_SPLIT_HEADER);
 
 	//Check if a packet was missing inbetween
-	if(packetReassemblyPosition != packetReassemblyDestination){
-		packetReassemblyPosition = 0;
+	if(context->position != packetReassemblyDestination){
+		context->position = 0;
 		return nullptr;
 	}
 
 	//Intermediate packets must always be a full MTU
 	if(packetHeader->splitMessageType == MessageType::SPLIT_WRITE_CMD && sendData->dataLength != connectionPayloadSize){
-		packetReassemblyPosition = 0;
+		context->position = 0;
 		return nullptr;
 	}
 
 	//Save at correct position in the reassembly buffer
 	memcpy(
-		packetReassemblyBuffer.getRaw() + packetReassemblyDestination,
+		context->buffer.getRaw() + packetReassemblyDestination,
 		data + SIZEOF_CONN_PACKET_SPLIT_HEADER,
-		sendData->dataLength);
+		sendData->dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER);
 
-	packetReassemblyPosition += sendData->dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+	context->position += sendData->dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER;
 
 	//Intermediate packet, no full packet yet received
 	if(packetHeader->splitMessageType == MessageType::SPLIT_WRITE_CMD)
@@ -596,17 +811,24 @@ u8* BaseConnection::ReassembleData(BaseConnectionSendData* sendData, u8* data)
 	else if(packetHeader->splitMessageType == MessageType::SPLIT_WRITE_CMD_END)
 	{
 		//Modify info for the reassembled packet
-		sendData->dataLength = packetReassemblyPosition;
-		data = packetReassemblyBuffer.getRaw();
+		sendData->dataLength = context->position;
+		data = context->buffer.getRaw();
 
 		//Reset the assembly buffer
-		packetReassemblyPosition = 0;
+		context->position = 0;
 
 		return data;
 	}
 	return data;
 }
 
+void BaseConnection::ClearReassemblyContexts()
+{
+	for(u32 i=0; i<PACKET_REASSEMBLY_CONTEXT_COUNT; i++){
+		packetReassemblyContexts[i].position = 0;
+	}
+}
+
 #define __________________HANDLER__________________
 
 void BaseConnection::ConnectionSuccessfulHandler(u16 connectionHandle)
@@ -638,6 +860,10 @@ void BaseConnection::GapReconnectionSuccessfulHandler(const GapConnectedEvent& c
 	FruityHal::BleTxPacketCountGet(this->connectionHandle, &unreliableBuffersFree);
 	reliableBuffersFree = 1;
 
+	//Packets that were queued in the softdevice for the old connection will not be reported as sent
+	packetsInSoftdeviceStart = 0;
+	packetsInSoftdeviceCount = 0;
+
 	connectionState = ConnectionState::HANDSHAKE_DONE;
 
 	//TODO: do we have to get the tx_packet_count or update any other variables?
@@ -689,6 +915,15 @@ u8 BaseConnection::GetNextQueueHandle()
 }
 
 
+bool BaseConnection::GetPendingPackets()
+{
+	u16 pendingPackets = 0;
+	for (u32 i = 0; i < (u8)DeliveryPriority::INVALID; i++) {
+		pendingPackets += packetSendQueues[i]->_numElements;
+	}
+	return pendingPackets;
+}
+
 SizedData BaseConnection::GetNextPacketToSend(const PacketQueue& queue) const
 {
 	for (u32 i = 0; i < queue._numElements; i++) {
@@ -709,16 +944,9 @@ SizedData BaseConnection::GetNextPacketToSend(const PacketQueue& queue) const
 //in the debugger
 void BaseConnection::PrintQueueInfo()
 {
-	PacketQueue* queue;
-	for (int i = 0; i < 2; i++) {
-		if (i == 0) {
-			queue = &packetSendQueue;
-			printf("------ Normal Queue Last to First (%u), sendRemaining %u ------" EOL, queue->_numElements, queue->packetSentRemaining);
-		}
-		else if (i == 1) {
-			queue = &packetSendQueueHighPrio;
-			printf("------ High Prio Queue Last to First (%u), sendRemaining %u ------" EOL, queue->_numElements, queue->packetSentRemaining);
-		}
+	for (int i = 0; i < (u8)DeliveryPriority::INVALID; i++) {
+		PacketQueue* queue = packetSendQueues[i];
+		printf("------ Prio %u Queue Last to First (%u), sendRemaining %u, skips %u ------" EOL, i, queue->_numElements, queue->packetSentRemaining, packetSendQueueSkips[i]);
 
 		for (int k = 0; k < queue->_numElements; k++) {
 			SizedData data = queue->PeekNext(k);
@@ -46,6 +46,9 @@ extern "C"{
 #define PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD 0
 #define PACKET_QUEUED_HANDLE_COUNTER_START 10
 
+//Maximum number of packets (or parts of split packets) that can be queued in the softdevice at once
+#define PACKETS_IN_SOFTDEVICE_MAX 16
+
 
 enum class DeliveryOption : u8 {
 	INVALID,
@@ -83,6 +86,13 @@ typedef struct BaseConnectionSendDataPacked {
 #pragma pack(pop)
 STATIC_ASSERT_SIZE(BaseConnectionSendDataPacked, 6);
 
+//State for reassembling the parts of one split packet
+typedef struct PacketReassemblyContext {
+	u8 streamId;
+	u8 position; //Set to 0 if no reassembly is in progress
+	SimpleArray<u8, PACKET_REASSEMBLY_BUFFER_SIZE> buffer;
+} PacketReassemblyContext;
+
 class Node;
 class ConnectionManager;
 
@@ -158,6 +168,9 @@ class BaseConnection
 		//Will Queue the data in the packet queue of the connection
 		bool QueueData(const BaseConnectionSendData& sendData, u8* data);
 		bool QueueData(const BaseConnectionSendData& sendData, u8* data, bool fillTxBuffers); // Can be used to avoid infinite recursion in queue and fillTxBuffers
+		//Allows to build the data directly in the packet queue instead of copying it
+		u8* ReserveData(const BaseConnectionSendData& sendData);
+		bool CommitData(u16 dataLength, bool fillTxBuffers);
 
 		bool PrepareBaseConnection(fh_ble_gap_addr_t* address, ConnectionType connectionType) const;
 
@@ -197,8 +210,10 @@ class BaseConnection
 		//Called after data has been queued in the softdevice, pay attention that data points to the full packet in the queue
 		//whereas sentData is the data that was really sent (e.g. the packet was split or preprocessed in some way before sending)
 		virtual void PacketSuccessfullyQueuedWithSoftdevice(PacketQueue* queue, BaseConnectionSendDataPacked* sendDataPacked, u8* data, SizedData* sentData);
-		//Fills the tx buffers of the softdevice with the packets from the packet queue
+		//Fills the tx buffers of the softdevice with the packets from the packet queues
 		virtual void FillTransmitBuffers();
+		//Same, but only hands about byteQuantum bytes to the softdevice (0 = unlimited), returns true if something was sent
+		bool FillTransmitBuffers(u16 byteQuantum);
 		virtual void DataSentHandler(const u8* data, u16 length) {};
 
 		//Handler
@@ -210,18 +225,28 @@ class BaseConnection
 		virtual void ReceiveDataHandler(BaseConnectionSendData* sendData, u8* data) = 0;
 		//Can be called by subclasses to use the connPacketHeader reassembly
 		u8* ReassembleData(BaseConnectionSendData* sendData, u8* data);
-		SizedData GetSplitData(const BaseConnectionSendData &sendData, u8* data, u8* packetBuffer) const;
+		void ClearReassemblyContexts();
+		SizedData GetSplitData(const BaseConnectionSendData &sendData, u8* data);
+		void RestoreSplitData();
+		u8 GetSplitStreamId(DeliveryPriority priority) const;
+		u8 GetActiveSplitStreams() const;
 
 		//Helpers
 		virtual void PrintStatus() = 0;
 
 		i8 GetAverageRSSI() const;
 		//Must return the number of packets that are queued. (Not just in the Packetqueues, also HighPrioData!)
-		virtual bool GetPendingPackets() { return packetSendQueue._numElements + packetSendQueueHighPrio._numElements; };
+		virtual bool GetPendingPackets();
 
 
 		SizedData GetNextPacketToSend(const PacketQueue& queue) const;
 
+		//Returns the priority of the queue that should transmit next or DeliveryPriority::INVALID if none
+		bool IsSendQueueReady(DeliveryPriority priority) const;
+		DeliveryPriority SelectSendQueue() const;
+		void HandleSendQueueServed(DeliveryPriority servedPriority);
+		u8 AggregatePackets(const PacketQueue& queue, BaseConnectionSendData* sendData, u8** data, u8* aggregateBuffer) const;
+
 		void HandlePacketQueued(PacketQueue* activeQueue, BaseConnectionSendDataPacked* sendDataPacked);
 		void HandlePacketQueuingFail(PacketQueue& activeQueue, BaseConnectionSendDataPacked* sendDataPacked, u32 err);
 		void HandlePacketSent(u8 sentUnreliable, u8 sentReliable);
@@ -251,24 +276,56 @@ class BaseConnection
 		u8 unreliableBuffersFree; //Number of
 		u8 reliableBuffersFree; //reliable transmit buffers that are available currently to this connection
 
+		bool packetAggregationEnabled; //Set if the partner can unpack aggregated packets
+		bool splitStreamsEnabled; //Set if the partner reassembles the split packets of all send queues in parallel
+
 		u8 manualPacketsSent; //Used to count the packets manually sent to the softdevice using bleWriteCharacteristic, will be decremented first before packets from the queue are removed. Packets must not be sent while the queue is working
 
 		//Normal Prio Queue
 		u32 packetSendBuffer[PACKET_SEND_BUFFER_SIZE/sizeof(u32)];
+		u16 packetSendIndex[PacketQueue::IndexLength(PACKET_SEND_BUFFER_SIZE, SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + 1)];
 		PacketQueue packetSendQueue;
 
 		//High Prio Queue
 		u32 packetSendBufferHighPrio[PACKET_SEND_BUFFER_HIGH_PRIO_SIZE/sizeof(u32)];
+		u16 packetSendIndexHighPrio[PacketQueue::IndexLength(PACKET_SEND_BUFFER_HIGH_PRIO_SIZE, SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + 1)];
 		PacketQueue packetSendQueueHighPrio;
 
+		//Medium Prio Queue
+		u32 packetSendBufferMediumPrio[PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE/sizeof(u32)];
+		u16 packetSendIndexMediumPrio[PacketQueue::IndexLength(PACKET_SEND_BUFFER_MEDIUM_PRIO_SIZE, SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + 1)];
+		PacketQueue packetSendQueueMediumPrio;
+
+		//Lowest Prio Queue
+		u32 packetSendBufferLowestPrio[PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE/sizeof(u32)];
+		u16 packetSendIndexLowestPrio[PacketQueue::IndexLength(PACKET_SEND_BUFFER_LOWEST_PRIO_SIZE, SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED + 1)];
+		PacketQueue packetSendQueueLowestPrio;
+
+		//All queues indexed by DeliveryPriority, LOW uses the normal queue as it is the only one that supports split packets
+		PacketQueue* packetSendQueues[(u8)DeliveryPriority::INVALID];
+		u8 packetSendQueueSkips[(u8)DeliveryPriority::INVALID]; //How often a non empty queue was passed over, used for aging
+		i16 transmitDeficit; //Bytes that this connection may still send in the current scheduling round
+
+		//Priorities of the queues from which packets were queued in the softdevice, in the order in which they were queued
+		u8 packetsInSoftdevice[PACKETS_IN_SOFTDEVICE_MAX];
+		u8 packetsInSoftdeviceNumPackets[PACKETS_IN_SOFTDEVICE_MAX]; //Number of queued packets that were sent in this write
+		u8 packetsInSoftdeviceStart;
+		u8 packetsInSoftdeviceCount;
+
 		u8 packetQueuedHandleCounter; //Used to assign handles to queued packets
 
-		SimpleArray<u8, PACKET_REASSEMBLY_BUFFER_SIZE> packetReassemblyBuffer;
-		u8 packetReassemblyPosition; //Set to 0 if no reassembly is in progress
+		PacketQueue* reservedQueue; //Queue in which ReserveData has reserved space, nullptr if nothing is reserved
+		BaseConnectionSendDataPacked* reservedSendData; //Metadata of the reserved packet
+
+		u8* splitHeaderPosition; //Position in the queue where GetSplitData has placed a split header, nullptr if none
+		u8 splitHeaderBackup[SIZEOF_CONN_PACKET_SPLIT_HEADER]; //The queue bytes that were replaced by the split header
+
+		PacketReassemblyContext packetReassemblyContexts[PACKET_REASSEMBLY_CONTEXT_COUNT];
 
 		//Partner
 		NodeId partnerId;
 		u16 connectionHandle; //The handle that is given from the BLE stack to identify a connection
+		u16 connectionInterval; //Current connection interval in units of 1.25ms, 0 if not known
 		fh_ble_gap_addr_t partnerAddress;
 
 		//Times
@@ -61,11 +61,17 @@ ConnectionManager::ConnectionManager()
 
 	pendingConnection = nullptr;
 	uniqueConnectionIdCounter = 0;
+	transmitSchedulerOffset = 0;
 	droppedMeshPackets = 0;
+	shedMeshPackets = 0;
+	connectionIntervalChanges = 0;
+	adaptiveConnectionInterval = ACTIVATE_ADAPTIVE_CONNECTION_INTERVAL == 1;
 	sentMeshPacketsReliable = 0;
 	sentMeshPacketsUnreliable = 0;
 
 	CheckedMemset(allConnections, 0x00, sizeof(allConnections));
+	ClearMeshRoutes();
+	CheckedMemset(seenMeshMessages, 0x00, sizeof(seenMeshMessages));
 }
 
 #define _______________CONNECTIVITY______________
@@ -129,6 +135,12 @@ void ConnectionManager::DeleteConnection(BaseConnection* connection, AppDisconne
 
 	logt("CM", "Cleaning up conn %u", connection->connectionId);
 
+	//Only connections that were established are logged, failed connection attempts are too frequent
+	ConnectionState state = connection->connectionState == ConnectionState::DISCONNECTED ? connection->connectionStateBeforeDisconnection : connection->connectionState;
+	if (state >= ConnectionState::HANDSHAKE_DONE) {
+		GS->eventLog.Log(EventLogEntryType::CONNECTION_REMOVED, (u8)connection->connectionType, connection->partnerId, (u32)reason);
+	}
+
 	for(u32 i=0; i<TOTAL_NUM_CONNECTIONS; i++){
 		if(connection == allConnections[i]){
 			allConnections[i] = nullptr;
@@ -180,8 +192,10 @@ void ConnectionManager::ForceDisconnectAllConnections(AppDisconnectReason appDis
 }
 
 //Changes the connection interval of all mesh connections
-void ConnectionManager::SetMeshConnectionInterval(u16 connectionInterval) const
+void ConnectionManager::SetMeshConnectionInterval(u16 connectionInterval)
 {
+	adaptiveConnectionInterval = false;
+
 	//Go through all connections that we control as a central
 	MeshConnections conn = GetMeshConnections(ConnectionDirection::DIRECTION_OUT);
 	for(u32 i=0; i< conn.count; i++){
@@ -289,7 +303,7 @@ void ConnectionManager::SendMeshMessageInternal(u8* data, u16 dataLength, Delive
 	//Packets to the shortest sink, can only be sent to mesh partners
 	if (packetHeader->receiver == NODE_ID_SHORTEST_SINK)
 	{
-		MeshConnection* dest = GetMeshConnectionToShortestSink(nullptr);
+		MeshConnection* dest = GetMeshConnectionToShortestSink(nullptr, packetHeader);
 
 		if (GS->config.enableSinkRouting && dest)
 		{
@@ -325,7 +339,12 @@ void ConnectionManager::SendMeshMessageInternal(u8* data, u16 dataLength, Delive
 			}
 		}
 
-		//Send to receiver or broadcast if not directly connected to us
+		//Otherwise, use the route that we have learned from packets of the receiver
+		if(receiverConn == nullptr){
+			receiverConn = GetMeshRoute(packetHeader->receiver, nullptr);
+		}
+
+		//Send to receiver or broadcast if we do not know the way
 		if(receiverConn != nullptr){
 			receiverConn->SendData(data, dataLength, priority, reliable);
 		} else {
@@ -397,13 +416,23 @@ ConnectionManager & ConnectionManager::getInstance()
 	return GS->cm;
 }
 
-void ConnectionManager::fillTransmitBuffers() const
+//Deficit round robin over all connections: In each round, every connection may hand TRANSMIT_SCHEDULER_QUANTUM
+//bytes to the SoftDevice, the connection that starts a round rotates so that no connection is always served first
+void ConnectionManager::fillTransmitBuffers()
 {
 	BaseConnections conn = GetBaseConnections(ConnectionDirection::INVALID);
-	for(u32 i=0; i< conn.count; i++){
-		BaseConnection* bc = allConnections[conn.connectionIndizes[i]];
-		if (bc != nullptr) {
-			bc->FillTransmitBuffers();
+	if(conn.count == 0) return;
+
+	transmitSchedulerOffset = (transmitSchedulerOffset + 1) % conn.count;
+
+	bool sentSomething = true;
+	while(sentSomething){
+		sentSomething = false;
+		for(u32 i=0; i< conn.count; i++){
+			BaseConnection* bc = allConnections[conn.connectionIndizes[(i + transmitSchedulerOffset) % conn.count]];
+			if (bc != nullptr && bc->FillTransmitBuffers(TRANSMIT_SCHEDULER_QUANTUM)) {
+				sentSomething = true;
+			}
 		}
 	}
 }
@@ -515,10 +544,13 @@ void ConnectionManager::GattcHandleValueEventHandler(const GattcHandleValueEvent
 }
 
 //This method accepts connPackets and distributes it to all other mesh connections
-void ConnectionManager::RouteMeshData(BaseConnection* connection, BaseConnectionSendData* sendData, u8* data) const
+void ConnectionManager::RouteMeshData(BaseConnection* connection, BaseConnectionSendData* sendData, u8* data)
 {
 	connPacketHeader* packetHeader = (connPacketHeader*) data;
 
+	//Remember where the sender is so that we can route packets back to it
+	LearnMeshRoute(packetHeader->sender, connection);
+
 
 	/*#################### Modification ############################*/
 	//We ask all our modules to decide if this packet should be routed, the modules could also modify the packet content
@@ -542,7 +574,7 @@ void ConnectionManager::RouteMeshData(BaseConnection* connection, BaseConnection
 	//The packet should continue to the shortest sink
 	else if(packetHeader->receiver == NODE_ID_SHORTEST_SINK)
 	{
-		MeshConnection* connectionSink = GS->cm.GetMeshConnectionToShortestSink(connection);
+		MeshConnection* connectionSink = GS->cm.GetMeshConnectionToShortestSink(connection, packetHeader);
 
 		if(GS->config.enableSinkRouting && connectionSink && !(routingDecision & ROUTING_DECISION_BLOCK_TO_MESH))
 		{
@@ -571,8 +603,19 @@ void ConnectionManager::RouteMeshData(BaseConnection* connection, BaseConnection
 		if(packetHeader->messageType != MessageType::CLUSTER_INFO_UPDATE
 			&& packetHeader->messageType != MessageType::UPDATE_TIMESTAMP)
 		{
-			//Send to all other connections
-			BroadcastMeshData(connection, sendData, data, routingDecision);
+			//If we know the way to the receiver, the packet only has to go there (and to our MeshAccess connections)
+			MeshConnection* routeConnection = GetMeshRoute(packetHeader->receiver, connection);
+			if(routeConnection != nullptr && !(routingDecision & ROUTING_DECISION_BLOCK_TO_MESH))
+			{
+				sendData->characteristicHandle = routeConnection->partnerWriteCharacteristicHandle;
+				routeConnection->SendData(sendData, data);
+				BroadcastMeshData(connection, sendData, data, routingDecision | ROUTING_DECISION_BLOCK_TO_MESH);
+			}
+			else
+			{
+				//Send to all other connections
+				BroadcastMeshData(connection, sendData, data, routingDecision);
+			}
 		}
 	}
 }
@@ -641,6 +684,7 @@ void ConnectionManager::GapConnectionConnectedHandler(const GapConnectedEvent &
 	if (reestablishedConnection != nullptr)
 	{
 		reestablishedConnection->GapReconnectionSuccessfulHandler(connectedEvent);
+		reestablishedConnection->connectionInterval = connectedEvent.getMinConnectionInterval();
 
 		//Check if there is another connection in reestablishing state that we can try to reconnect
 		MeshConnections conns = GetMeshConnections(ConnectionDirection::DIRECTION_OUT);
@@ -666,13 +710,19 @@ void ConnectionManager::GapConnectionConnectedHandler(const GapConnectedEvent &
 	}
 
 	/* Part B: A normal incoming/outgoing connection */
-	if (GetConnectionInHandshakeState() != nullptr)
+	//Only one handshake runs at a time, but the outgoing connections of clustering attempts may overlap
+	const bool isParallelClusteringAttempt = connectedEvent.getRole() == GapRole::CENTRAL
+		&& pendingConnection != nullptr
+		&& GS->node.IsClusteringAttempt(pendingConnection->uniqueConnectionId)
+		&& GetNumConnectionsInHandshakeState() < CLUSTERING_MAX_PARALLEL_ATTEMPTS;
+	if (GetConnectionInHandshakeState() != nullptr && !isParallelClusteringAttempt)
 	{
 		logt("CM", "Currently in handshake, disconnect");
 
 		//If we have a pendingConnection for this, we must clean it
 		if(connectedEvent.getRole() == GapRole::CENTRAL){
 			if(pendingConnection != nullptr){
+				GS->node.ClusteringAttemptAborted(pendingConnection->uniqueConnectionId);
 				DeleteConnection(pendingConnection, AppDisconnectReason::CURRENTLY_IN_HANDSHAKE);
 			}
 		}
@@ -680,6 +730,10 @@ void ConnectionManager::GapConnectionConnectedHandler(const GapConnectedEvent &
 
 		return;
 	}
+	if (GetConnectionInHandshakeState() != nullptr)
+	{
+		SIMSTATCOUNT("parallelClusteringAttempt");
+	}
 
 	BaseConnection* c = nullptr;
 
@@ -727,6 +781,7 @@ void ConnectionManager::GapConnectionConnectedHandler(const GapConnectedEvent &
 
 		c = pendingConnection;
 		pendingConnection = nullptr;
+		c->connectionInterval = connectedEvent.getMinConnectionInterval();
 
 		//Call Prepare again so that the clusterID and size backup are created with up to date values
 		c->ConnectionSuccessfulHandler(connectedEvent.getConnectionHandle());
@@ -796,6 +851,7 @@ void ConnectionManager::GapConnectionDisconnectedHandler(const GapDisconnectedEv
 	logt("CM", "Gap Connection handle %u disconnected", disconnectedEvent.getConnectionHandle());
 
 	GS->logger.logCount(ErrorTypes::HCI_ERROR, disconnectedEvent.getReason());
+	GS->eventLog.Log(EventLogEntryType::GAP_DISCONNECTED, (u8)connection->connectionType, connection->partnerId, disconnectedEvent.getReason());
 
 	//Notify the connection itself
 	bool result = connection->GapDisconnectionHandler(disconnectedEvent.getReason());
@@ -902,6 +958,17 @@ MeshConnection* ConnectionManager::GetConnectionInHandshakeState() const
 	return nullptr;
 }
 
+u8 ConnectionManager::GetNumConnectionsInHandshakeState() const
+{
+	u8 count = 0;
+	for(u32 i=0; i<TOTAL_NUM_CONNECTIONS; i++){
+		if(allConnections[i] != nullptr && allConnections[i]->connectionType == ConnectionType::FRUITYMESH && allConnections[i]->connectionState == ConnectionState::HANDSHAKING){
+			count++;
+		}
+	}
+	return count;
+}
+
 BaseConnections ConnectionManager::GetConnectionsOfType(ConnectionType connectionType, ConnectionDirection direction) const{
 	BaseConnections fc;
 	CheckedMemset(&fc, 0x00, sizeof(BaseConnections));
@@ -933,6 +1000,128 @@ MeshConnection* ConnectionManager::GetMeshConnectionToPartner(NodeId partnerId)
 	return nullptr;
 }
 
+#define _________________ROUTES____________
+
+//Saves the connection over which a packet from the given node was received
+void ConnectionManager::LearnMeshRoute(NodeId nodeId, const BaseConnection* connection)
+{
+	//Only individual nodes can be routed to and only mesh connections are part of the tree
+	if (
+		nodeId < NODE_ID_DEVICE_BASE
+		|| nodeId >= NODE_ID_GROUP_BASE
+		|| nodeId == GS->node.configuration.nodeId
+		|| connection == nullptr
+		|| connection->connectionType != ConnectionType::FRUITYMESH
+		|| !connection->handshakeDone()
+	) {
+		return;
+	}
+
+	//Update the existing entry or replace an empty or the oldest one
+	MeshRoute* route = &meshRoutes[0];
+	for (u32 i = 0; i < MESH_ROUTE_TABLE_SIZE; i++) {
+		if (meshRoutes[i].nodeId == nodeId) {
+			route = &meshRoutes[i];
+			break;
+		}
+		if (route->nodeId != NODE_ID_BROADCAST && (meshRoutes[i].nodeId == NODE_ID_BROADCAST || meshRoutes[i].lastSeenDs < route->lastSeenDs)) {
+			route = &meshRoutes[i];
+		}
+	}
+
+	route->nodeId = nodeId;
+	route->uniqueConnectionId = connection->uniqueConnectionId;
+	route->lastSeenDs = GS->appTimerDs;
+}
+
+MeshConnection* ConnectionManager::GetMeshRoute(NodeId nodeId, const BaseConnection* excludeConnection) const
+{
+	if (!GS->config.enableUnicastRouting || nodeId < NODE_ID_DEVICE_BASE || nodeId >= NODE_ID_GROUP_BASE) return nullptr;
+
+	for (u32 i = 0; i < MESH_ROUTE_TABLE_SIZE; i++) {
+		if (meshRoutes[i].nodeId != nodeId) continue;
+
+		//Old routes are not trusted anymore, the packet will be broadcasted which also refreshes the route with the answer
+		if (GS->appTimerDs - meshRoutes[i].lastSeenDs > MESH_ROUTE_MAX_AGE_DS) return nullptr;
+
+		BaseConnection* connection = GetConnectionByUniqueId(meshRoutes[i].uniqueConnectionId);
+		if (
+			connection == nullptr
+			|| connection == excludeConnection
+			|| connection->connectionType != ConnectionType::FRUITYMESH
+			|| !connection->handshakeDone()
+		) {
+			return nullptr;
+		}
+
+		SIMSTATCOUNT("routedUnicast");
+		return (MeshConnection*)connection;
+	}
+
+	return nullptr;
+}
+
+void ConnectionManager::ClearMeshRoutes()
+{
+	CheckedMemset(meshRoutes, 0x00, sizeof(meshRoutes));
+}
+
+#define _________________DUPLICATES____________
+
+//Alarm floods can reach a node more than once, e.g. if a packet is sent again after a connection was reestablished
+//or while the tree is reorganized. Alarm messages carry the requestHandle that the sender increments, so
+//together with the sender, the moduleId and a crc of the content, a copy can be recognized and dropped.
+//Other modules reuse requestHandles for repeated commands, so only the alarm floods are checked and
+//messages that are addressed to a single node are always delivered
+bool ConnectionManager::IsDuplicateMeshMessage(const BaseConnectionSendData* sendData, const u8* data)
+{
+	if (sendData->dataLength < SIZEOF_CONN_PACKET_MODULE) return false;
+
+	const connPacketModule* packet = (const connPacketModule*)data;
+	if (
+		packet->header.messageType != MessageType::MODULE_TRIGGER_ACTION
+		|| packet->moduleId != ModuleId::ALARM_MODULE
+		|| packet->requestHandle == 0
+	) {
+		return false;
+	}
+
+	const NodeId receiver = packet->header.receiver;
+	const bool isFlood = receiver == NODE_ID_BROADCAST
+		|| (receiver >= NODE_ID_GROUP_BASE && receiver < NODE_ID_GROUP_BASE + NODE_ID_GROUP_BASE_SIZE)
+		|| (receiver > NODE_ID_HOPS_BASE && receiver < NODE_ID_HOPS_BASE + NODE_ID_HOPS_BASE_SIZE);
+	if (!isFlood) return false;
+
+	//The receiver is not part of the crc as the hop counter is decremented on the way
+	const u32 contentCrc = Utility::CalculateCrc32(data + SIZEOF_CONN_PACKET_HEADER, sendData->dataLength - SIZEOF_CONN_PACKET_HEADER);
+
+	for (u32 i = 0; i < DUPLICATE_CACHE_SIZE; i++) {
+		const SeenMeshMessage& seen = seenMeshMessages[i];
+		if (
+			seen.requestHandle == packet->requestHandle
+			&& seen.sender == packet->header.sender
+			&& seen.moduleId == packet->moduleId
+			&& seen.contentCrc == contentCrc
+			&& GS->appTimerDs - seen.seenDs <= DUPLICATE_CACHE_WINDOW_DS
+		) {
+			logt("CM", "Dropped duplicate from %u, handle %u", packet->header.sender, packet->requestHandle);
+			SIMSTATCOUNT("duplicateDropped");
+			return true;
+		}
+	}
+
+	//Remember the message, the oldest entry is overwritten
+	SeenMeshMessage& seen = seenMeshMessages[seenMeshMessagesPos];
+	seen.sender = packet->header.sender;
+	seen.moduleId = packet->moduleId;
+	seen.requestHandle = packet->requestHandle;
+	seen.contentCrc = contentCrc;
+	seen.seenDs = GS->appTimerDs;
+	seenMeshMessagesPos = (seenMeshMessagesPos + 1) % DUPLICATE_CACHE_SIZE;
+
+	return false;
+}
+
 //Returns the pending packets of all connection types
 u16 ConnectionManager::GetPendingPackets() const
 {
@@ -964,7 +1153,7 @@ BaseConnection* ConnectionManager::IsConnectionReestablishment(const GapConnecte
 }
 
 //TODO: Only return mesh connections, check
-MeshConnection* ConnectionManager::GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection) const
+MeshConnection* ConnectionManager::GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection, const connPacketHeader* packetHeader) const
 {
 	ClusterSize min = INT16_MAX;
 	MeshConnection* c = nullptr;
@@ -979,7 +1168,31 @@ MeshConnection* ConnectionManager::GetMeshConnectionToShortestSink(const BaseCon
 			c = conn.connections[i];
 		}
 	}
-	return c;
+	if (c == nullptr || packetHeader == nullptr) return c;
+
+	//As the mesh is a tree, every connection with a hopsToSink leads to a different sink (or a different path to it)
+	//without loops, so the traffic can be spread over all paths that are not much longer than the shortest one
+	MeshConnection* candidates[TOTAL_NUM_CONNECTIONS];
+	u32 numCandidates = 0;
+	for (int i = 0; i < conn.count; i++)
+	{
+		MeshConnection* candidate = conn.connections[i];
+		if (candidate == excludeConnection || !candidate->handshakeDone() || candidate->hopsToSink <= -1) continue;
+		if (candidate->hopsToSink > min + SINK_ROUTING_HOP_SLACK) continue;
+
+		//Avoid paths that are already congested, either in our queue or further ahead
+		const PacketQueue& queue = *candidate->packetSendQueues[(u8)DeliveryPriority::LOW];
+		if ((u32)queue.GetUsedBytes() * 100 >= (u32)queue.bufferLength * SINK_ROUTING_CONGESTED_PERCENT) continue;
+		if (candidate->partnerCongestionLevel != MeshConnection::CongestionLevel::NONE) continue;
+
+		candidates[numCandidates] = candidate;
+		numCandidates++;
+	}
+	if (numCandidates == 0) return c;
+
+	//All packets of the same sender and type take the same path as long as the candidates do not change so that they stay in order
+	const u32 flowHash = (u32)packetHeader->sender * 31 + (u32)packetHeader->messageType;
+	return candidates[flowHash % numCandidates];
 }
 
 ClusterSize ConnectionManager::GetMeshHopsToShortestSink(const BaseConnection* excludeConnection) const
@@ -1024,11 +1237,49 @@ void ConnectionManager::GapRssiChangedEventHandler(const GapRssiChangedEvent & r
 	}
 }
 
+void ConnectionManager::GapConnParamUpdateEventHandler(const GapConnParamUpdateEvent & connParamUpdateEvent) const
+{
+	BaseConnection* connection = GetConnectionFromHandle(connParamUpdateEvent.getConnectionHandle());
+	if (connection != nullptr) {
+		connection->connectionInterval = connParamUpdateEvent.getMaxConnectionInterval();
+
+		logt("CM", "Connection %u has interval %u", connection->connectionId, connection->connectionInterval);
+	}
+}
+
 void ConnectionManager::TimerEventHandler(u16 passedTimeDs)
 {
 	//Check if there are unsent packet (Can happen if the softdevice was busy and it was not possible to queue packets the last time)
-	if (SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, SEC_TO_DS(1)) && GetPendingPackets() > 0) {
-		fillTransmitBuffers();
+	if (SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, SEC_TO_DS(1))) {
+		//Check if our partners should throttle their traffic, changed levels are sent with the next fillTransmitBuffers
+		MeshConnections meshConns = GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 i = 0; i < meshConns.count; i++) {
+			meshConns.connections[i]->UpdateCongestionLevel();
+		}
+
+		if (GetPendingPackets() > 0) {
+			fillTransmitBuffers();
+		}
+	}
+	else if (SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, CLUSTER_INFO_UPDATE_INTERVAL_DS)) {
+		//Send clusterInfoUpdates that were held back by their rate limit
+		MeshConnections meshConns = GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 i = 0; i < meshConns.count; i++) {
+			if (meshConns.connections[i]->clusterInfoUpdateDelayed) {
+				fillTransmitBuffers();
+				break;
+			}
+		}
+	}
+
+	//Only the central of a connection can change its parameters
+	if (adaptiveConnectionInterval && SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, ADAPTIVE_CONNECTION_INTERVAL_PERIOD_DS)) {
+		MeshConnections meshConns = GetMeshConnections(ConnectionDirection::DIRECTION_OUT);
+		for (u32 i = 0; i < meshConns.count; i++) {
+			if (meshConns.connections[i]->handshakeDone()) {
+				meshConns.connections[i]->AdaptConnectionInterval();
+			}
+		}
 	}
 
 	{
@@ -59,6 +59,23 @@ typedef struct ClcAppConnections{
 } ClcAppConnections;
 #endif
 
+//A learned route to a node: the mesh connection over which the last packet from that node was received
+//As the mesh is a tree, packets to that node take the reverse path
+typedef struct MeshRoute{
+	NodeId nodeId; //NODE_ID_BROADCAST if the entry is unused
+	u16 uniqueConnectionId;
+	u32 lastSeenDs;
+} MeshRoute;
+
+//A module message that was recently received, used to drop copies of it that arrive again
+typedef struct SeenMeshMessage{
+	NodeId sender;
+	ModuleId moduleId;
+	u8 requestHandle; //0 if the entry is unused
+	u32 contentCrc;
+	u32 seenDs;
+} SeenMeshMessage;
+
 typedef BaseConnection* (*ConnTypeResolver)(BaseConnection* oldConnection, BaseConnectionSendData* sendData, u8* data);
 
 class ConnectionManager
@@ -73,12 +90,24 @@ class ConnectionManager
 		static constexpr u16 TIME_BETWEEN_TIME_SYNC_INTERVALS_DS = SEC_TO_DS(5);
 		u16 timeSinceLastTimeSyncIntervalDs = 0;	//Let's not spam the connections with time syncs.
 
+		//Learned unicast routes, the oldest entry is replaced if the table is full
+		//Routes that were not confirmed by a packet for this long are no longer used
+		static constexpr u32 MESH_ROUTE_MAX_AGE_DS = SEC_TO_DS(60);
+		MeshRoute meshRoutes[MESH_ROUTE_TABLE_SIZE];
+
+		void LearnMeshRoute(NodeId nodeId, const BaseConnection* connection);
+
+		//Ring of recently received module messages, copies within this time are dropped
+		static constexpr u32 DUPLICATE_CACHE_WINDOW_DS = SEC_TO_DS(5);
+		SeenMeshMessage seenMeshMessages[DUPLICATE_CACHE_SIZE];
+		u8 seenMeshMessagesPos = 0;
+
 	public:
 		ConnectionManager();
 		static ConnectionManager& getInstance();
 
 		//This method is called when empty buffers are available and there is data to send
-		void fillTransmitBuffers() const;
+		void fillTransmitBuffers();
 
 		u8 freeMeshInConnections;
 		u8 freeMeshOutConnections;
@@ -86,8 +115,12 @@ class ConnectionManager
 		BaseConnection* pendingConnection;
 
 		u16 uniqueConnectionIdCounter; //Counts all created connections to assign "unique" ids
+		u8 transmitSchedulerOffset; //Connection that is served first in the next transmit scheduling round
 
 		u16 droppedMeshPackets;
+		u16 shedMeshPackets;
+		u16 connectionIntervalChanges; //Connection parameter updates requested by the adaptive connection interval
+		bool adaptiveConnectionInterval;
 		u16 sentMeshPacketsUnreliable;
 		u16 sentMeshPacketsReliable;
 
@@ -105,6 +138,7 @@ class ConnectionManager
 
 		//Returns the connection that is currently doing a handshake or nullptr
 		MeshConnection* GetConnectionInHandshakeState() const;
+		u8 GetNumConnectionsInHandshakeState() const;
 
 		void ConnectAsMaster(NodeId partnerId, fh_ble_gap_addr_t* address, u16 writeCharacteristicHandle, u16 connectionIv);
 
@@ -121,7 +155,7 @@ class ConnectionManager
 
 		void BroadcastMeshPacket(u8* data, u16 dataLength, DeliveryPriority priority, bool reliable) const;
 
-		void RouteMeshData(BaseConnection* connection, BaseConnectionSendData* sendData, u8* data) const;
+		void RouteMeshData(BaseConnection* connection, BaseConnectionSendData* sendData, u8* data);
 		void BroadcastMeshData(const BaseConnection* ignoreConnection, BaseConnectionSendData* sendData, u8* data, RoutingDecision routingDecision) const;
 
 		//Call this to dispatch a message to the node and all modules, this method will perform some basic
@@ -137,12 +171,23 @@ class ConnectionManager
 		BaseConnection* GetConnectionByUniqueId(u16 uniqueConnectionId) const;
 		MeshConnection* GetMeshConnectionToPartner(NodeId partnerId) const;
 
-		MeshConnection* GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection) const;
+		//Returns the learned route to a node or nullptr if packets to that node have to be broadcasted
+		MeshConnection* GetMeshRoute(NodeId nodeId, const BaseConnection* excludeConnection) const;
+		//Must be called if the routes might have changed, e.g. after a mesh connection was lost or the cluster changed
+		void ClearMeshRoutes();
+
+		//Returns true if the same module message was already received recently and must neither be routed nor dispatched
+		//Only messages with a requestHandle are checked, the sender uses it as a sequence number
+		bool IsDuplicateMeshMessage(const BaseConnectionSendData* sendData, const u8* data);
+
+		//If the packet is given, its flow is assigned to one of several near equal paths towards a sink
+		MeshConnection* GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection, const connPacketHeader* packetHeader = nullptr) const;
 		ClusterSize GetMeshHopsToShortestSink(const BaseConnection* excludeConnection) const;
 
 		u16 GetPendingPackets() const;
 
-		void SetMeshConnectionInterval(u16 connectionInterval) const;
+		//Sets a fixed interval for all mesh connections, this disables the adaptive connection interval
+		void SetMeshConnectionInterval(u16 connectionInterval);
 
 		void DeleteConnection(BaseConnection* connection, AppDisconnectReason reason);
 
@@ -170,6 +215,7 @@ class ConnectionManager
 
 		//Callbacks are kinda complicated, so we handle BLE events directly in this class
 		void GapRssiChangedEventHandler(const GapRssiChangedEvent& rssiChangedEvent) const;
+		void GapConnParamUpdateEventHandler(const GapConnParamUpdateEvent& connParamUpdateEvent) const;
 		void TimerEventHandler(u16 passedTimeDs);
 
 		void ResetTimeSync();
@@ -165,6 +165,7 @@ void BootFruityMesh()
 	Logger::getInstance().enableTag("RCONN");
 	Logger::getInstance().enableTag("CONFIG");
 	Logger::getInstance().enableTag("RS");
+//	Logger::getInstance().enableTag("EVENTLOG");
 //	Logger::getInstance().enableTag("PQ");
 	Logger::getInstance().enableTag("C");
 //	Logger::getInstance().enableTag("FH");
@@ -193,6 +194,10 @@ void BootFruityMesh()
 	
 	//Log the reboot reason to our ram log so that it is automatically queried by the sink
 	Logger::getInstance().logError(ErrorTypes::REBOOT, (u32)GS->ramRetainStructPtr->rebootReason, GS->ramRetainStructPtr->code1);
+
+	//The reboot is also kept in the flash event log so that it survives further reboots
+	EventLog::getInstance().Init();
+	EventLog::getInstance().Log(EventLogEntryType::REBOOT, (u8)GS->ramRetainStructPtr->rebootReason, 0, GS->ramRetainStructPtr->code1);
 	
 	//If the nordic secure dfu bootloader is enabled, disable it as soon as fruitymesh boots the first time
 #if IS_INACTIVE(GW_SAVE_SPACE)
@@ -320,6 +325,10 @@ void DispatchTimerEvents(u16 passedTimeDs)
 
 	FlashStorage::getInstance().TimerEventHandler(passedTimeDs);
 
+	RecordStorage::getInstance().TimerEventHandler(passedTimeDs);
+
+	EventLog::getInstance().TimerEventHandler(passedTimeDs);
+
 	AdvertisingController::getInstance().TimerEventHandler(passedTimeDs);
 
 	ScanController::getInstance().TimerEventHandler(passedTimeDs);
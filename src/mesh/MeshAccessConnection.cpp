@@ -79,6 +79,13 @@ MeshAccessConnection::MeshAccessConnection(u8 id, ConnectionDirection direction,
 	CheckedMemset(this->key, 0x00, 16);
 	this->useCustomKey = false;
 
+	CheckedMemset(this->longTermKey, 0x00, 16);
+	this->longTermKeyValid = false;
+	CheckedMemset(this->resumeNonce, 0x00, sizeof(this->resumeNonce));
+	this->sessionResumeRequested = false;
+	this->sessionResumed = false;
+	this->sessionResumeConfirmed = false;
+
 	this->partnerRxCharacteristicHandle = 0;
 	this->partnerTxCharacteristicCccdHandle = 0;
 	this->partnerTxCharacteristicHandle = 0;
@@ -243,6 +250,28 @@ void MeshAccessConnection::StartHandshake(u16 fmKeyId)
 	packet.fmKeyId = fmKeyId;
 	packet.tunnelType = (u8)tunnelType;
 
+	//If we still have a session ticket for this partner, we append our nonce so that the
+	//peripheral can finish the handshake with its answer
+	if(CanResumeSession() && meshAccessMod->GetSessionTicket(partnerAddress, fmKeyId) != nullptr)
+	{
+		logt("MACONN", "Requesting session resumption");
+
+		connPacketEncryptCustomStartResume resumePacket;
+		CheckedMemset(&resumePacket, 0x00, sizeof(connPacketEncryptCustomStartResume));
+		resumePacket.start = packet;
+		resumePacket.start.resumeSession = 1;
+		resumeNonce[0] = resumePacket.cnonce[0] = Utility::GetRandomInteger();
+		resumeNonce[1] = resumePacket.cnonce[1] = Utility::GetRandomInteger();
+		sessionResumeRequested = true;
+
+		SendData(
+			(u8*)&resumePacket,
+			SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START_RESUME,
+			DeliveryPriority::MESH_INTERNAL_HIGH,
+			false);
+		return;
+	}
+
 	SendData(
 		(u8*)&packet,
 		SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START,
@@ -251,7 +280,7 @@ void MeshAccessConnection::StartHandshake(u16 fmKeyId)
 }
 
 //This method is called by the peripheral after the Encryption Start Handshake packet was received
-void MeshAccessConnection::HandshakeANonce(connPacketEncryptCustomStart* inPacket){
+void MeshAccessConnection::HandshakeANonce(connPacketEncryptCustomStart* inPacket, const u32* centralNonce){
 	//Process Starthandshake packet
 	//P=>C: Type=ANouce (Will stay the same random number until attempt was made), supportedKeyIds=1,2,345,56,...,supportsAuthenticate(true/false)
 
@@ -293,6 +322,17 @@ void MeshAccessConnection::HandshakeANonce(connPacketEncryptCustomStart* inPacke
 	decryptionNonce[0] = packet.anonce[0] = Utility::GetRandomInteger();
 	decryptionNonce[1] = packet.anonce[1] = Utility::GetRandomInteger();
 
+	//If the central wants to resume a session for which we still have a ticket, we use the cached long term key
+	const u8* ticket = nullptr;
+	if(centralNonce != nullptr && CanResumeSession()){
+		ticket = meshAccessMod->GetSessionTicket(partnerAddress, fmKeyId);
+	}
+	if(ticket != nullptr){
+		memcpy(longTermKey, ticket, 16);
+		longTermKeyValid = true;
+		sessionResumed = true;
+	}
+
 	//Generate the session key for decryption
 	bool keyValid = GenerateSessionKey((u8*)decryptionNonce, partnerId, fmKeyId, sessionDecryptionKey);
 
@@ -302,6 +342,42 @@ void MeshAccessConnection::HandshakeANonce(connPacketEncryptCustomStart* inPacke
 		return;
 	}
 
+	if(sessionResumed){
+		//Our encryption nonce is combined from both nonces so that a replayed start packet does not result in a reused keystream
+		encryptionNonce[0] = centralNonce[0] ^ decryptionNonce[0];
+		encryptionNonce[1] = centralNonce[1] ^ decryptionNonce[1];
+
+		keyValid = GenerateSessionKey((u8*)encryptionNonce, partnerId, fmKeyId, sessionEncryptionKey);
+		if(!keyValid){
+			logt("ERROR", "Invalid Key");
+			DisconnectAndRemove(AppDisconnectReason::INVALID_KEY);
+			return;
+		}
+
+		logt("MACONN", "-- TX Session resumed");
+
+		connPacketEncryptCustomANonceResumed resumedPacket;
+		CheckedMemset(&resumedPacket, 0x00, sizeof(connPacketEncryptCustomANonceResumed));
+		resumedPacket.anonce = packet;
+		resumedPacket.sessionResumed = 1;
+
+		SendData(
+			(u8*)&resumedPacket,
+			SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE_RESUMED,
+			DeliveryPriority::MESH_INTERNAL_HIGH,
+			false);
+
+		//The central will not send the SNonce, all following packets are encrypted in both directions
+		encryptionState = EncryptionState::ENCRYPTED;
+
+		//Needed by our packet splitting methods, payload is now less than before because of MIC
+		connectionPayloadSize = connectionMtu - MESH_ACCESS_MIC_LENGTH;
+
+		//Anybody could have sent the start packet, the handshake is only done once the
+		//first packet of the central proves that it knows the long term key
+		return;
+	}
+
 	SendData(
 		(u8*)&packet,
 		SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE,
@@ -415,6 +491,12 @@ void MeshAccessConnection::HandshakeDone(connPacketEncryptCustomSNonce* inPacket
 	packet.header.receiver = virtualPartnerId;
 	packet.status = FruityHal::SUCCESS;
 
+	//Store a session ticket so that the central can skip the second half of the handshake when it reconnects
+	if(CanResumeSession()){
+		meshAccessMod->StoreSessionTicket(partnerAddress, fmKeyId, longTermKey);
+		packet.sessionResumable = 1;
+	}
+
 	//From now on, we can just send data the normal way and the encryption is done automatically
 	SendData(
 		(u8*)&packet,
@@ -433,6 +515,71 @@ void MeshAccessConnection::HandshakeDone(connPacketEncryptCustomSNonce* inPacket
 	NotifyConnectionStateSubscriber(ConnectionState::HANDSHAKE_DONE);
 }
 
+//This method is called by the Central if the peripheral accepted to resume the session
+void MeshAccessConnection::HandshakeResumed(connPacketEncryptCustomANonceResumed* inPacket)
+{
+	logt("MACONN", "-- Session resumed, anonce %u", inPacket->anonce.anonce[1]);
+
+	const u8* ticket = meshAccessMod->GetSessionTicket(partnerAddress, fmKeyId);
+	if(ticket == nullptr){
+		logt("ERROR", "Session ticket expired");
+		DisconnectAndRemove(AppDisconnectReason::INVALID_KEY);
+		return;
+	}
+	memcpy(longTermKey, ticket, 16);
+	longTermKeyValid = true;
+	sessionResumed = true;
+
+	partnerId = inPacket->anonce.header.sender;
+
+	//We encrypt with the partners nonce and decrypt with the combination of both nonces
+	encryptionNonce[0] = inPacket->anonce.anonce[0];
+	encryptionNonce[1] = inPacket->anonce.anonce[1];
+	decryptionNonce[0] = resumeNonce[0] ^ encryptionNonce[0];
+	decryptionNonce[1] = resumeNonce[1] ^ encryptionNonce[1];
+
+	bool keyValidA = GenerateSessionKey((u8*)encryptionNonce, GS->node.configuration.nodeId, fmKeyId, sessionEncryptionKey);
+	bool keyValidB = GenerateSessionKey((u8*)decryptionNonce, GS->node.configuration.nodeId, fmKeyId, sessionDecryptionKey);
+
+	if(!keyValidA || !keyValidB){
+		logt("ERROR", "Invalid Key %u %u", (u32)keyValidA, (u32)keyValidB);
+		DisconnectAndRemove(AppDisconnectReason::INVALID_KEY);
+		return;
+	}
+
+	encryptionState = EncryptionState::ENCRYPTED;
+	connectionState = ConnectionState::HANDSHAKE_DONE;
+
+	//Needed by our packet splitting methods, payload is now less than before because of MIC
+	connectionPayloadSize = connectionMtu - MESH_ACCESS_MIC_LENGTH;
+
+	//Send the current mesh state to our partner
+	SendClusterState();
+
+	NotifyConnectionStateSubscriber(ConnectionState::HANDSHAKE_DONE);
+}
+
+//This method is called by the Peripheral of a resumed session once the first packet of the central was authenticated
+void MeshAccessConnection::ResumedHandshakeDone()
+{
+	logt("MACONN", "-- Resumed session confirmed");
+
+	connectionState = ConnectionState::HANDSHAKE_DONE;
+
+	//Send the current mesh state to our partner
+	SendClusterState();
+
+	NotifyConnectionStateSubscriber(ConnectionState::HANDSHAKE_DONE);
+}
+
+//Sessions can only be resumed for keys that do not depend on the connection
+bool MeshAccessConnection::CanResumeSession() const
+{
+	return meshAccessMod != nullptr
+		&& !useCustomKey
+		&& fmKeyId != FM_KEY_ID_ZERO;
+}
+
 void MeshAccessConnection::SendClusterState()
 {
 	connPacketClusterInfoUpdate packet;
@@ -474,10 +621,8 @@ void MeshAccessConnection::NotifyConnectionStateSubscriber(ConnectionState state
 
 //Session Key S generated as Enc#(Anonce, nodeIndex); Enc# is the chosen key
 
-bool MeshAccessConnection::GenerateSessionKey(u8* nonce, NodeId centralNodeId, u32 fmKeyId, u8* keyOut)
+bool MeshAccessConnection::GenerateLongTermKey(u32 fmKeyId, u8* ltKey)
 {
-	u8 ltKey[16];
-
 	if(useCustomKey){
 		logt("MACONN", "Using custom key");
 		memcpy(ltKey, key, 16);
@@ -519,7 +664,6 @@ bool MeshAccessConnection::GenerateSessionKey(u8* nonce, NodeId centralNodeId, u
 	else {
 		logt("MACONN", "Invalid key generated");
 		//No key
-		CheckedMemset(keyOut, 0x00, 16);
 		return false;
 	}
 
@@ -532,6 +676,20 @@ bool MeshAccessConnection::GenerateSessionKey(u8* nonce, NodeId centralNodeId, u
 		return false;
 	}
 
+	return true;
+}
+
+bool MeshAccessConnection::GenerateSessionKey(u8* nonce, NodeId centralNodeId, u32 fmKeyId, u8* keyOut)
+{
+	//The long term key is only derived once, it might also have been restored from a session ticket
+	if(!longTermKeyValid){
+		if(!GenerateLongTermKey(fmKeyId, longTermKey)){
+			CheckedMemset(keyOut, 0x00, 16);
+			return false;
+		}
+		longTermKeyValid = true;
+	}
+
 	//Generate cleartext with NodeId and ANonce
 	u8 cleartext[16];
 	CheckedMemset(cleartext, 0x00, 16);
@@ -544,7 +702,7 @@ bool MeshAccessConnection::GenerateSessionKey(u8* nonce, NodeId centralNodeId, u
 	//Encrypt with our chosen Long Term Key
 	Utility::Aes128BlockEncrypt(
 			(Aes128Block*)cleartext,
-			(Aes128Block*)ltKey,
+			(Aes128Block*)longTermKey,
 			(Aes128Block*)keyOut);
 
 	return true;
@@ -702,7 +860,7 @@ bool MeshAccessConnection::DecryptPacket(u8* data, u16 dataLength)
 SizedData MeshAccessConnection::ProcessDataBeforeTransmission(BaseConnectionSendData* sendData, u8* data, u8* packetBuffer)
 {
 	//Use the split packet from the BaseConnection to process all packets
-	SizedData splitData = GetSplitData(*sendData, data, packetBuffer);
+	SizedData splitData = GetSplitData(*sendData, data);
 
 	//We must save the message type before encrypting because we need to know if the
 	//packet was queued in the softdevice for packet splitting
@@ -712,6 +870,7 @@ SizedData MeshAccessConnection::ProcessDataBeforeTransmission(BaseConnectionSend
 	if(encryptionState == EncryptionState::ENCRYPTED){
 		//We use the given packetBuffer to store the encrypted packet + its MIC
 		memcpy(packetBuffer, splitData.data, splitData.length);
+		RestoreSplitData();
 		EncryptPacket(packetBuffer, splitData.length);
 
 		splitData.data = packetBuffer;
@@ -843,12 +1002,12 @@ void MeshAccessConnection::PacketSuccessfullyQueuedWithSoftdevice(PacketQueue* q
 	//If this was an intermediate split packet
 	if (lastProcessedMessageType == MessageType::SPLIT_WRITE_CMD) {
 		queue->packetSendPosition++;
-		packetSendQueue.packetSentRemaining++;
+		queue->packetSentRemaining++;
 	}
 	//The end of a split packet
 	else if (lastProcessedMessageType == MessageType::SPLIT_WRITE_CMD_END) {
 		queue->packetSendPosition = 0;
-		packetSendQueue.packetSentRemaining++;
+		queue->packetSentRemaining++;
 
 		//Save a queue handle for that packet
 		HandlePacketQueued(queue, sendDataPacked);
@@ -883,11 +1042,20 @@ void MeshAccessConnection::ReceiveDataHandler(BaseConnectionSendData* sendData,
 		sendData->dataLength -= MESH_ACCESS_MIC_LENGTH;
 
 		if(!valid){
+			//Either the ticket of a resumed session is outdated or the packet is not from our partner, so the
+			//ticket is kept but the next connection falls back to the full handshake
+			if(sessionResumed && !sessionResumeConfirmed) meshAccessMod->SuspendSessionTicket(partnerAddress, fmKeyId);
+
 			//Disconnect connection if a packet was received that is not valid
 			logt("ERROR", "Invalid packet");
 			DisconnectAndRemove(AppDisconnectReason::INVALID_PACKET);
 			return;
 		}
+
+		if(sessionResumed && !sessionResumeConfirmed){
+			sessionResumeConfirmed = true;
+			if(connectionState == ConnectionState::HANDSHAKING) ResumedHandshakeDone();
+		}
 	}
 
 	connPacketHeader* packetHeader = (connPacketHeader*)data;
@@ -896,6 +1064,12 @@ void MeshAccessConnection::ReceiveDataHandler(BaseConnectionSendData* sendData,
 	{
 		if(sendData->dataLength == SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START && packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_START){
 			HandshakeANonce((connPacketEncryptCustomStart*) data);
+		}
+		else if(sendData->dataLength == SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_START_RESUME && packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_START){
+			connPacketEncryptCustomStartResume* packet = (connPacketEncryptCustomStartResume*) data;
+			//Copy the nonce as the packed packet might not be aligned
+			u32 centralNonce[2] = { packet->cnonce[0], packet->cnonce[1] };
+			HandshakeANonce(&packet->start, packet->start.resumeSession ? centralNonce : nullptr);
 		} else {
 			logt("ERROR", "Wrong handshake packet");
 			DisconnectAndRemove(AppDisconnectReason::INVALID_PACKET);
@@ -906,6 +1080,14 @@ void MeshAccessConnection::ReceiveDataHandler(BaseConnectionSendData* sendData,
 		if(sendData->dataLength == SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE && packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_ANONCE){
 			HandshakeSNonce((connPacketEncryptCustomANonce*) data);
 		}
+		else if(
+			sessionResumeRequested
+			&& sendData->dataLength == SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_ANONCE_RESUMED
+			&& packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_ANONCE
+			&& ((connPacketEncryptCustomANonceResumed*)data)->sessionResumed
+		){
+			HandshakeResumed((connPacketEncryptCustomANonceResumed*) data);
+		}
 		else if(sendData->dataLength == SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_SNONCE && packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_SNONCE){
 			HandshakeDone((connPacketEncryptCustomSNonce*) data);
 		} else {
@@ -945,6 +1127,18 @@ void MeshAccessConnection::ReceiveMeshAccessMessageHandler(BaseConnectionSendDat
 		}
 	}
 
+	//The peripheral tells us with its last handshake packet if we may resume the session later
+	if(
+		packetHeader->messageType == MessageType::ENCRYPT_CUSTOM_DONE
+		&& direction == ConnectionDirection::DIRECTION_OUT
+		&& sendData->dataLength >= SIZEOF_CONN_PACKET_ENCRYPT_CUSTOM_DONE
+		&& ((connPacketEncryptCustomDone*)data)->sessionResumable
+		&& CanResumeSession()
+		&& longTermKeyValid
+	){
+		meshAccessMod->StoreSessionTicket(partnerAddress, fmKeyId, longTermKey);
+	}
+
 	//Replace the sender id with our virtual partner id
 	if(packetHeader->sender == partnerId){
 		packetHeader->sender = virtualPartnerId;
@@ -976,6 +1170,9 @@ void MeshAccessConnection::ReceiveMeshAccessMessageHandler(BaseConnectionSendDat
 		TO_HEX(data, sendData->dataLength);
 		logt("MACONN", "Received data for local mesh %s (%u) from %u aka %u", dataHex, sendData->dataLength, packetHeader->sender, virtualPartnerId);
 
+		//Copies of a message that we already received are neither routed nor dispatched
+		if(GS->cm.IsDuplicateMeshMessage(sendData, data)) return;
+
 		//Send to other Mesh-like Connections
 		if(auth <= MeshAccessAuthorization::WHITELIST) GS->cm.RouteMeshData(this, sendData, data);
 
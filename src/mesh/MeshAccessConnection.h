@@ -69,11 +69,23 @@ private:
 	u32 encryptionNonce[2];
 	u32 decryptionNonce[2];
 
+	//The long term key is derived once per connection or taken from a session ticket
+	u8 longTermKey[16];
+	bool longTermKeyValid;
+
+	//Session resumption: The central sends its nonce with the start packet if it has a ticket
+	u32 resumeNonce[2];
+	bool sessionResumeRequested;
+	bool sessionResumed;
+	bool sessionResumeConfirmed; //Set once a packet of the partner with a valid MIC was received in a resumed session
+
 
 	MessageType lastProcessedMessageType;
 
 
+	bool GenerateLongTermKey(u32 fmKeyId, u8* ltKey);
 	bool GenerateSessionKey(u8* nonce, NodeId centralNodeId, u32 fmKeyId, u8* keyOut);
+	bool CanResumeSession() const;
 
 public:
 
@@ -111,9 +123,11 @@ public:
 
 	/*############### Handshake ##################*/
 	void StartHandshake(u16 fmKeyId);
-	void HandshakeANonce(connPacketEncryptCustomStart* inPacket);
+	void HandshakeANonce(connPacketEncryptCustomStart* inPacket, const u32* centralNonce = nullptr);
 	void HandshakeSNonce(connPacketEncryptCustomANonce* inPacket);
 	void HandshakeDone(connPacketEncryptCustomSNonce* inPacket);
+	void HandshakeResumed(connPacketEncryptCustomANonceResumed* inPacket);
+	void ResumedHandshakeDone();
 
 	void SendClusterState();
 	void NotifyConnectionStateSubscriber(ConnectionState state) const;
@@ -55,6 +55,15 @@ MeshConnection::MeshConnection(u8 id, ConnectionDirection direction, fh_ble_gap_
 	clusterSizeBackup = 0;
 	hopsToSinkBackup = -1;
 	hopsToSink = -1;
+	congestionControlEnabled = false;
+	ownCongestionLevel = CongestionLevel::NONE;
+	advertisedCongestionLevel = CongestionLevel::NONE;
+	partnerCongestionLevel = CongestionLevel::NONE;
+	shedPackets = 0;
+	intervalControlBytes = 0;
+	intervalControlIdlePeriods = 0;
+	clusterInfoUpdateSentDs = 0;
+	clusterInfoUpdateDelayed = false;
 	ClearCurrentClusterInfoUpdatePacket();
 
 	//Save values from constructor
@@ -237,11 +246,12 @@ void MeshConnection::GapReconnectionSuccessfulHandler(const GapConnectedEvent& c
 	handshakeStartedDs = GS->appTimerDs;
 
 	//Reset all send queues so that the packets are being sent again
-	ResendAllPackets(packetSendQueue);
-	ResendAllPackets(packetSendQueueHighPrio);
+	for (u32 i = 0; i < (u8)DeliveryPriority::INVALID; i++) {
+		ResendAllPackets(*packetSendQueues[i]);
+	}
 
-	//Also reset our reassembly buffer
-	packetReassemblyPosition = 0;
+	//Also reset our reassembly buffers
+	ClearReassemblyContexts();
 }
 
 #define __________________SENDING_________________
@@ -304,6 +314,22 @@ bool MeshConnection::SendData(BaseConnectionSendData* sendData, u8* data)
 	//sending of packets by a factor of 14, so we only use them for mesh critical functionality such as clustering
 	sendData->deliveryOption = DeliveryOption::WRITE_CMD;
 
+	//If our partner cannot relay more traffic, we drop low priority packets here instead of letting them
+	//fill up the queues along the path. Packets that are meant for the partner itself are still sent
+	if(
+		packetHeader->receiver != partnerId
+		&& (
+			(partnerCongestionLevel >= CongestionLevel::SHED_LOWEST && sendData->priority == DeliveryPriority::LOWEST)
+			|| (partnerCongestionLevel >= CongestionLevel::SHED_LOW && sendData->priority == DeliveryPriority::LOW)
+		)
+	){
+		logt("CONN_DATA", "Shed packet type %u prio %u for partner %u", (u32)packetHeader->messageType, (u32)sendData->priority, partnerId);
+		shedPackets++;
+		GS->cm.shedMeshPackets++;
+		GS->logger.logCustomCount(CustomErrorTypes::COUNT_SHED_PACKETS);
+		return false;
+	}
+
 	logt("CONN_DATA", "PUT_PACKET(%d):len:%d,type:%d,prio:%u,hex:%s",
 			connectionId, sendData->dataLength, (u32)packetHeader->messageType, (u32)sendData->priority, stringBuffer);
 
@@ -322,9 +348,16 @@ bool MeshConnection::TransmitHighPrioData()
 				currentClusterInfoUpdatePacket.payload.clusterSizeChange != 0
 				|| currentClusterInfoUpdatePacket.payload.connectionMasterBitHandover != 0
 				|| (currentClusterInfoUpdatePacket.payload.hopsToSink != -1 && GET_DEVICE_TYPE() != DeviceType::SINK)
+				|| (congestionControlEnabled && ownCongestionLevel != advertisedCongestionLevel)
 			)
 	){
-		//If a clusterUpdate is available we send it immediately
+		//Updates are rate limited so that a burst of changes during merges results in a single update per interval
+		//The ConnectionManager sends the delayed update once the interval has passed
+		if (clusterInfoUpdateSentDs != 0 && GS->appTimerDs < clusterInfoUpdateSentDs + CLUSTER_INFO_UPDATE_INTERVAL_DS) {
+			clusterInfoUpdateDelayed = true;
+			return false;
+		}
+
 		u8* data = (u8*)&(currentClusterInfoUpdatePacket);
 
 		if(unreliableBuffersFree > 0){
@@ -344,11 +377,19 @@ bool MeshConnection::TransmitHighPrioData()
 			//Set the counter for the packet
 			currentClusterInfoUpdatePacket.payload.counter = ++clusterUpdateCounter;
 
+			//The partner always takes over the hopsToSink from an update, so it must be correct even if we only send our congestion level
+			currentClusterInfoUpdatePacket.payload.hopsToSink = GS->cm.GetMeshHopsToShortestSink(this);
+			if (congestionControlEnabled) currentClusterInfoUpdatePacket.payload.congestionLevel = (u8)ownCongestionLevel;
+
 			bool queued = QueueData(sendData, data, false);
 
 			if (queued) {
 				logt("CONN", "Queued CLUSTER UPDATE for CONN hnd %u", connectionHandle);
 
+				if (congestionControlEnabled) advertisedCongestionLevel = ownCongestionLevel;
+				clusterInfoUpdateSentDs = GS->appTimerDs;
+				clusterInfoUpdateDelayed = false;
+
 				//The current cluster info update message has been sent, we can now clear the packet
 				//Because we filled it in the buffer
 				ClearCurrentClusterInfoUpdatePacket();
@@ -380,28 +421,30 @@ void MeshConnection::ClearCurrentClusterInfoUpdatePacket()
 SizedData MeshConnection::ProcessDataBeforeTransmission(BaseConnectionSendData* sendData, u8* data, u8* packetBuffer)
 {
 	//Use the split packet from the BaseConnection to process all packets
-	return GetSplitData(*sendData, data, packetBuffer);
+	return GetSplitData(*sendData, data);
 }
 
 void MeshConnection::PacketSuccessfullyQueuedWithSoftdevice(PacketQueue* queue, BaseConnectionSendDataPacked* sendDataPacked, u8* data, SizedData* sentData)
 {
+	intervalControlBytes += sentData->length;
+
 	connPacketHeader* splitPacketHeader = (connPacketHeader*) sentData->data;
 	//If this was an intermediate split packet
 	if (splitPacketHeader->messageType == MessageType::SPLIT_WRITE_CMD) {
-		packetSendQueue.packetSendPosition++;
-		packetSendQueue.packetSentRemaining++;
+		queue->packetSendPosition++;
+		queue->packetSentRemaining++;
 	}
 	//The end of a split packet
 	else if (splitPacketHeader->messageType == MessageType::SPLIT_WRITE_CMD_END) {
 		queue->packetSendPosition = 0;
-		packetSendQueue.packetSentRemaining++;
+		queue->packetSentRemaining++;
 
 		//Save a queue handle for that packet
 		HandlePacketQueued(queue, sendDataPacked);
 	}
 	//If this was a normal packet
 	else {
-		packetSendQueue.packetSendPosition = 0;
+		queue->packetSendPosition = 0;
 
 		//Save a queue handle for that packet
 		HandlePacketQueued(queue, sendDataPacked);
@@ -442,6 +485,31 @@ void MeshConnection::ReceiveDataHandler(BaseConnectionSendData* sendData, u8* da
 
 	connPacketHeader* packetHeader = (connPacketHeader*)data;
 
+	//Aggregated packets are unpacked and each packet is handled as if it was received on its own
+	if(packetHeader->messageType == MessageType::AGGREGATED_WRITE_CMD){
+		u16 offset = SIZEOF_CONN_PACKET_AGGREGATE_HEADER;
+		while(offset < sendData->dataLength){
+			BaseConnectionSendData partSendData = *sendData;
+			partSendData.dataLength = data[offset];
+			offset++;
+
+			if(partSendData.dataLength == 0
+				|| offset + partSendData.dataLength > sendData->dataLength
+				|| ((connPacketHeader*)(data + offset))->messageType == MessageType::AGGREGATED_WRITE_CMD
+			){
+				logt("ERROR", "Invalid aggregated packet");
+				GS->logger.logCustomError(CustomErrorTypes::WARN_RX_WRONG_DATA, (u32)MessageType::AGGREGATED_WRITE_CMD);
+				return;
+			}
+
+			ReceiveDataHandler(&partSendData, data + offset);
+			offset += partSendData.dataLength;
+		}
+		return;
+	}
+
+	intervalControlBytes += sendData->dataLength;
+
 	char stringBuffer[200];
 	Logger::convertBufferToHexString(data, sendData->dataLength, stringBuffer, sizeof(stringBuffer));
 	logt("CONN_DATA", "Mesh RX %d,length:%d,deliv:%d,data:%s", (u32)packetHeader->messageType, sendData->dataLength, (u32)sendData->deliveryOption, stringBuffer);
@@ -449,7 +517,8 @@ void MeshConnection::ReceiveDataHandler(BaseConnectionSendData* sendData, u8* da
 	//This will reassemble the data for us
 	data = ReassembleData(sendData, data);
 
-	if(data != nullptr){
+	//Copies of a message that we already received are neither routed nor dispatched
+	if(data != nullptr && !GS->cm.IsDuplicateMeshMessage(sendData, data)){
 		//Route the packet to our other mesh connections
 		GS->cm.RouteMeshData(this, sendData, data);
 
@@ -541,10 +610,11 @@ void MeshConnection::StartHandshake()
 
 	packet.payload.preferredConnectionInterval = 0; //Unused at the moment
 	packet.payload.networkId = GS->node.configuration.networkId;
+	packet.payload.connectionFeatures = GetOwnConnectionFeatures();
 
 	logt("HANDSHAKE", "OUT => conn(%u) CLUSTER_WELCOME, cID:%x, cSize:%d, hops:%d", connectionId, packet.payload.clusterId, packet.payload.clusterSize, packet.payload.hopsToSink);
 
-	SendHandshakeMessage((u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_WELCOME_WITH_NETWORK_ID, true);
+	SendHandshakeMessage((u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_WELCOME_WITH_FEATURES, true);
 }
 
 void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendData, u8* data)
@@ -572,6 +642,11 @@ void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendD
 			//Save mesh write handle
 			partnerWriteCharacteristicHandle = packet->payload.meshWriteHandle;
 
+			//Later version of the packet also has the features of the partner included
+			if (sendData->dataLength >= SIZEOF_CONN_PACKET_CLUSTER_WELCOME_WITH_FEATURES) {
+				SetPartnerConnectionFeatures(packet->payload.connectionFeatures);
+			}
+
 			connectionState = ConnectionState::HANDSHAKING;
 
 			//Save a snapshot of the current clustering values, these are used in the handshake
@@ -647,10 +722,11 @@ void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendD
 				packet.header.receiver = this->partnerId;
 
 				packet.payload.hopsToSink = GET_DEVICE_TYPE() == DeviceType::SINK ? 0 : -1;
+				packet.payload.connectionFeatures = GetOwnConnectionFeatures();
 
 				logt("HANDSHAKE", "OUT => %d CLUSTER_ACK_1, hops:%d", packet.header.receiver, packet.payload.hopsToSink);
 
-				SendHandshakeMessage((u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_ACK_1, true);
+				SendHandshakeMessage((u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_ACK_1_WITH_FEATURES, true);
 				
 				//Kill other Connections and check if this connection has been removed in the process
 				GS->cm.ForceDisconnectOtherMeshConnections(this, AppDisconnectReason::I_AM_SMALLER);
@@ -674,15 +750,17 @@ void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendD
 		if (sendData->dataLength >= SIZEOF_CONN_PACKET_CLUSTER_ACK_1)
 		{
 			//Check if the other node does weird stuff
-			if(clusterAck1Packet.header.messageType != MessageType::INVALID || GS->cm.GetConnectionInHandshakeState() != this){
+			if(clusterAck1Packet.header.messageType != MessageType::INVALID || connectionState != ConnectionState::HANDSHAKING){
 				//TODO: disconnect? check this in sim
 				logt("ERROR", "HANDSHAKE ERROR ACK1 duplicate %u, %u", (u32)clusterAck1Packet.header.messageType, (u32)GS->node.currentDiscoveryState);
 
 				GS->logger.logCustomCount(CustomErrorTypes::COUNT_HANDSHAKE_ACK1_DUPLICATE);
 			}
 
-			//Save ACK1 packet for later
-			memcpy(&clusterAck1Packet, data, sizeof(connPacketClusterAck1));
+			//Save ACK1 packet for later, older versions of the packet do not include the features
+			CheckedMemset(&clusterAck1Packet, 0x00, sizeof(connPacketClusterAck1));
+			memcpy(&clusterAck1Packet, data, sendData->dataLength < sizeof(connPacketClusterAck1) ? sendData->dataLength : sizeof(connPacketClusterAck1));
+			SetPartnerConnectionFeatures(clusterAck1Packet.payload.connectionFeatures);
 
 			logt("HANDSHAKE", "IN <= %d  CLUSTER_ACK_1, hops:%d", clusterAck1Packet.header.sender, clusterAck1Packet.payload.hopsToSink);
 
@@ -724,7 +802,7 @@ void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendD
 	{
 		if (sendData->dataLength >= SIZEOF_CONN_PACKET_CLUSTER_ACK_2)
 		{
-			if(clusterAck2Packet.header.messageType != MessageType::INVALID || GS->cm.GetConnectionInHandshakeState() != this){
+			if(clusterAck2Packet.header.messageType != MessageType::INVALID || connectionState != ConnectionState::HANDSHAKING){
 				//TODO: disconnect
 				logt("ERROR", "HANDSHAKE ERROR ACK2 duplicate %u, %u", (u32)clusterAck2Packet.header.messageType, (u32)GS->node.currentDiscoveryState);
 				GS->logger.logCustomCount(CustomErrorTypes::COUNT_HANDSHAKE_ACK2_DUPLICATE);
@@ -807,15 +885,130 @@ void MeshConnection::ReceiveReconnectionHandshakePacket(connPacketReconnect* pac
 
 #define _________________OTHER_______________________
 
+ClusterSize MeshConnection::GetConnectedClusterSize() const
+{
+	return connectedClusterSize;
+}
+
+//Features that this node supports on a mesh connection
+u8 MeshConnection::GetOwnConnectionFeatures()
+{
+	u8 features = 0;
+#if ACTIVATE_PACKET_AGGREGATION == 1
+	features |= CONNECTION_FEATURE_PACKET_AGGREGATION;
+#endif
+	features |= CONNECTION_FEATURE_CONGESTION_CONTROL;
+#if ACTIVATE_SPLIT_STREAMS == 1
+	features |= CONNECTION_FEATURE_SPLIT_STREAMS;
+#endif
+	return features;
+}
+
+//Enables the features that are supported by both nodes
+void MeshConnection::SetPartnerConnectionFeatures(u8 partnerFeatures)
+{
+	u8 features = GetOwnConnectionFeatures() & partnerFeatures;
+	packetAggregationEnabled = (features & CONNECTION_FEATURE_PACKET_AGGREGATION) != 0;
+	congestionControlEnabled = (features & CONNECTION_FEATURE_CONGESTION_CONTROL) != 0;
+	splitStreamsEnabled = (features & CONNECTION_FEATURE_SPLIT_STREAMS) != 0;
+
+	logt("HANDSHAKE", "Connection features %x", features);
+}
+
+//Calculates how congested the queues are that packets from our partner are relayed to
+//Our partner is informed about changes with the next clusterInfoUpdate
+void MeshConnection::UpdateCongestionLevel()
+{
+	if (!congestionControlEnabled) return;
+
+	CongestionLevel level = CongestionLevel::NONE;
+
+	MeshConnections conns = GS->cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (u32 i = 0; i < conns.count; i++) {
+		MeshConnection* conn = conns.connections[i];
+		if (conn == this || !conn->handshakeDone()) continue;
+
+		const PacketQueue& lowQueue = *conn->packetSendQueues[(u8)DeliveryPriority::LOW];
+		const PacketQueue& lowestQueue = *conn->packetSendQueues[(u8)DeliveryPriority::LOWEST];
+		u32 lowFreePercent = (lowQueue.bufferLength - lowQueue.GetUsedBytes()) * 100UL / lowQueue.bufferLength;
+		u32 lowestFreePercent = (lowestQueue.bufferLength - lowestQueue.GetUsedBytes()) * 100UL / lowestQueue.bufferLength;
+
+		if (lowFreePercent < CONGESTION_SHED_LOW_FREE_PERCENT) {
+			level = CongestionLevel::SHED_LOW;
+			break;
+		}
+		else if (lowFreePercent < CONGESTION_SHED_LOWEST_FREE_PERCENT || lowestFreePercent < CONGESTION_SHED_LOW_FREE_PERCENT) {
+			level = CongestionLevel::SHED_LOWEST;
+		}
+	}
+
+	if (level != ownCongestionLevel) {
+		logt("CONN", "Congestion level for partner %u changed to %u", partnerId, (u32)level);
+		ownCongestionLevel = level;
+	}
+}
+
+//Called periodically for connections on which we are the central. Busy connections get a faster connection
+//interval at once, idle connections are only made slower after some idle periods so that the interval does not oscillate
+void MeshConnection::AdaptConnectionInterval()
+{
+	const u16 minInterval = Conf::getInstance().meshMinConnectionInterval;
+	const u16 maxInterval = ADAPTIVE_CONNECTION_INTERVAL_MAX > minInterval ? ADAPTIVE_CONNECTION_INTERVAL_MAX : minInterval;
+	const u16 currentInterval = connectionInterval != 0 ? connectionInterval : minInterval;
+
+	//Bytes that can be transmitted in one period with one packet per connection event (interval is in units of 1.25ms)
+	const u32 capacityBytes = ((u32)ADAPTIVE_CONNECTION_INTERVAL_PERIOD_DS * 100 * 4 / ((u32)currentInterval * 5)) * MAX_DATA_SIZE_PER_WRITE;
+	const u32 utilizationPercent = capacityBytes == 0 ? 100 : intervalControlBytes * 100 / capacityBytes;
+
+	u32 backlogPackets = 0;
+	for (u32 i = 0; i < (u8)DeliveryPriority::INVALID; i++) {
+		backlogPackets += packetSendQueues[i]->numUnsentElements;
+	}
+
+	u16 newInterval = currentInterval;
+	if (utilizationPercent >= ADAPTIVE_CONNECTION_INTERVAL_BUSY_PERCENT || backlogPackets >= ADAPTIVE_CONNECTION_INTERVAL_BACKLOG_PACKETS) {
+		intervalControlIdlePeriods = 0;
+		newInterval = currentInterval / 2 > minInterval ? currentInterval / 2 : minInterval;
+	}
+	else if (utilizationPercent < ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERCENT) {
+		intervalControlIdlePeriods++;
+		if (intervalControlIdlePeriods >= ADAPTIVE_CONNECTION_INTERVAL_IDLE_PERIODS) {
+			intervalControlIdlePeriods = 0;
+			newInterval = currentInterval * 2 < maxInterval ? currentInterval * 2 : maxInterval;
+		}
+	}
+	else {
+		intervalControlIdlePeriods = 0;
+	}
+
+	if (newInterval != currentInterval) {
+		//Report the throughput of the link and the connection events per second that the new interval costs
+		logjson("CONN", "{\"type\":\"conn_iv\",\"nodeId\":%u,\"partnerId\":%u,\"iv\":%u,\"newIv\":%u,\"bytesPerSec\":%u,\"backlog\":%u,\"eventsPerSec\":%u}" SEP,
+			GS->node.configuration.nodeId,
+			partnerId,
+			currentInterval,
+			newInterval,
+			intervalControlBytes * 10 / ADAPTIVE_CONNECTION_INTERVAL_PERIOD_DS,
+			backlogPackets,
+			800 / newInterval);
+
+		GS->gapController.RequestConnectionParameterUpdate(connectionHandle, newInterval, newInterval, 0, Conf::meshConnectionSupervisionTimeout);
+		GS->cm.connectionIntervalChanges++;
+	}
+
+	intervalControlBytes = 0;
+}
+
 bool MeshConnection::GetPendingPackets() {
 	//Adds 1 if a clusterUpdatePacket must be send
-	return packetSendQueue._numElements + packetSendQueueHighPrio._numElements + (currentClusterInfoUpdatePacket.header.messageType == MessageType::INVALID ? 0 : 1);
+	return BaseConnection::GetPendingPackets() + (currentClusterInfoUpdatePacket.header.messageType == MessageType::INVALID ? 0 : 1);
 }
 bool MeshConnection::IsValidMessageType(MessageType t)
 {
 	switch (t) {
 		case(MessageType::SPLIT_WRITE_CMD):
 		case(MessageType::SPLIT_WRITE_CMD_END):
+		case(MessageType::AGGREGATED_WRITE_CMD):
 		case(MessageType::CLUSTER_WELCOME):
 		case(MessageType::CLUSTER_ACK_1):
 		case(MessageType::CLUSTER_ACK_2):
@@ -58,6 +58,13 @@ class MeshConnection
 			CORRECTION_SENT      = 2,
 		};
 
+		//Tells the partner which priorities it should stop sending to us because our relay queues are filling up
+		enum class CongestionLevel : u8 {
+			NONE                 = 0,
+			SHED_LOWEST          = 1,
+			SHED_LOW             = 2,
+		};
+
 		u16 partnerWriteCharacteristicHandle;
 
 		//Mesh variables
@@ -74,6 +81,19 @@ class MeshConnection
 		//Multiple updates can accumulate in this variable
 		//This packet must not be sent during handshakes
 		connPacketClusterInfoUpdate currentClusterInfoUpdatePacket;
+		u32 clusterInfoUpdateSentDs; //Time when the last clusterInfoUpdate was queued
+		bool clusterInfoUpdateDelayed; //An update is waiting for CLUSTER_INFO_UPDATE_INTERVAL_DS to pass
+
+		//Congestion control, the levels are exchanged using the clusterInfoUpdate
+		bool congestionControlEnabled;
+		CongestionLevel ownCongestionLevel;
+		CongestionLevel advertisedCongestionLevel;
+		CongestionLevel partnerCongestionLevel;
+		u16 shedPackets; //Packets that were not queued because the partner is congested
+
+		//Adaptive connection interval
+		u32 intervalControlBytes; //Bytes sent and received since the last decision about the connection interval
+		u8 intervalControlIdlePeriods; //Consecutive periods in which the connection was idle
 
 		//Handshake
 		connPacketClusterAck1 clusterAck1Packet;
@@ -133,6 +153,12 @@ class MeshConnection
 		void PrintStatus() override;
 		bool GetPendingPackets() override;
 		bool IsValidMessageType(MessageType type);
+		static u8 GetOwnConnectionFeatures();
+		void SetPartnerConnectionFeatures(u8 partnerFeatures);
+		void UpdateCongestionLevel();
+		void AdaptConnectionInterval();
+		//Number of nodes that are reached through this connection
+		ClusterSize GetConnectedClusterSize() const;
 
 		//Setter
 		void setHopsToSink(ClusterSize hops);
@@ -94,6 +94,8 @@ Node::Node()
 	initializedByGateway = false;
 	
 	joinMePackets.zeroData();
+	CheckedMemset(clusteringAttempts, 0x00, sizeof(clusteringAttempts));
+	clusteringAttemptConnecting = false;
 
 	//Save configuration to base class variables
 	//sizeof configuration must be a multiple of 4 bytes
@@ -292,6 +294,11 @@ void Node::HandshakeDoneHandler(MeshConnection* connection, bool completedAsWinn
 
 	GS->logger.logCustomCount(CustomErrorTypes::COUNT_HANDSHAKE_DONE);
 
+	//The clustering attempt is finished, a later reestablishing of this connection must not block new attempts
+	for (u32 i = 0; i < CLUSTERING_MAX_PARALLEL_ATTEMPTS; i++) {
+		if (clusteringAttempts[i].uniqueConnectionId == connection->uniqueConnectionId) clusteringAttempts[i].uniqueConnectionId = 0;
+	}
+
 	//We can now commit the changes that were part of the handshake
 	//This node was the winner of the handshake and successfully acquired a new member
 	if(completedAsWinner){
@@ -422,6 +429,9 @@ void Node::MeshConnectionDisconnectedHandler(AppDisconnectReason appDisconnectRe
 	//TODO: If the local host disconnected this connection, it was already increased, we do not have to count the disconnect here
 	this->connectionLossCounter++;
 
+	//Routes over the lost connection are gone and those over other connections might have changed as well
+	GS->cm.ClearMeshRoutes();
+
 	//If the handshake was already done, this node was part of our cluster
 	//If the local host terminated the connection, we do not count it as a cluster Size change
 	if (
@@ -516,11 +526,29 @@ void Node::ReceiveClusterInfoUpdate(MeshConnection* connection, connPacketCluste
 
 	if(packet->payload.clusterSizeChange != 0){
 		logt("HANDSHAKE", "ClusterSize Change from %d to %d", this->clusterSize, this->clusterSize + packet->payload.clusterSizeChange);
+
+		//Some part of the tree has changed, a node might now be reachable over a different connection
+		GS->cm.ClearMeshRoutes();
 		this->clusterSize += packet->payload.clusterSizeChange;
 		connection->connectedClusterSize += packet->payload.clusterSizeChange;
 	}
 
-	connection->hopsToSink = packet->payload.hopsToSink > -1 ? packet->payload.hopsToSink + 1 : -1;
+	ClusterSize newHopsToSink = packet->payload.hopsToSink > -1 ? packet->payload.hopsToSink + 1 : -1;
+
+	if (connection->congestionControlEnabled) {
+		connection->partnerCongestionLevel = (MeshConnection::CongestionLevel)packet->payload.congestionLevel;
+	}
+
+	//An update that only carries the congestion level of our partner must not be propagated through the mesh
+	if (
+		packet->payload.clusterSizeChange == 0
+		&& !packet->payload.connectionMasterBitHandover
+		&& newHopsToSink == connection->hopsToSink
+	) {
+		return;
+	}
+
+	connection->hopsToSink = newHopsToSink;
 	
 	//Now look if our partner has passed over the connection master bit
 	if(packet->payload.connectionMasterBitHandover){
@@ -1325,20 +1353,34 @@ Node::DecisionStruct Node::DetermineBestClusterAvailable(void)
 		{
 			currentAckId = 0;
 
-			fh_ble_gap_addr_t address;
-			address.addr_type = bestCluster->bleAddressType;
-			memcpy(address.addr, bestCluster->bleAddress, BLE_GAP_ADDR_LEN);
-
-			//Choose a different connection interval for leaf nodes
-			u16 connectionIv = Conf::getInstance().meshMinConnectionInterval;
-			if(bestCluster->payload.deviceType == DeviceType::LEAF){
-				connectionIv = MSEC_TO_UNITS(90, UNIT_1_25_MS);
-			}
+			//Handshakes of previous attempts may still be running, the next candidate is connected to in parallel
+			ClusteringAttempt* attempt = GetFreeClusteringAttempt();
+			if (attempt != nullptr && GS->cm.pendingConnection == nullptr)
+			{
+				fh_ble_gap_addr_t address;
+				address.addr_type = bestCluster->bleAddressType;
+				memcpy(address.addr, bestCluster->bleAddress, BLE_GAP_ADDR_LEN);
+
+				//Choose a different connection interval for leaf nodes
+				u16 connectionIv = Conf::getInstance().meshMinConnectionInterval;
+				if(bestCluster->payload.deviceType == DeviceType::LEAF){
+					connectionIv = MSEC_TO_UNITS(90, UNIT_1_25_MS);
+				}
 
-			GS->cm.ConnectAsMaster(bestCluster->payload.sender, &address, bestCluster->payload.meshWriteHandle, connectionIv);
+				GS->cm.ConnectAsMaster(bestCluster->payload.sender, &address, bestCluster->payload.meshWriteHandle, connectionIv);
 
-			//Note the time that we tried to connect to this node so that we can blacklist it for some time if it does not work
-			bestCluster->lastConnectAttemptDs = GS->appTimerDs;
+				if (GS->cm.pendingConnection != nullptr)
+				{
+					attempt->uniqueConnectionId = GS->cm.pendingConnection->uniqueConnectionId;
+					attempt->clusterId = bestCluster->payload.clusterId;
+					attempt->partnerId = bestCluster->payload.sender;
+					attempt->previousConnectAttemptDs = bestCluster->lastConnectAttemptDs;
+					clusteringAttemptConnecting = true;
+
+					//Note the time that we tried to connect to this node so that we can blacklist it for some time if it does not work
+					bestCluster->lastConnectAttemptDs = GS->appTimerDs;
+				}
+			}
 
 			result.result = DecisionResult::CONNECT_AS_MASTER;
 			result.preferredPartner = bestCluster->payload.sender;
@@ -1454,6 +1496,9 @@ u32 Node::CalculateClusterScoreAsMaster(joinMeBufferPacket* packet) const
 	//If there are zero free in connections, we cannot connect as master
 	if (packet->payload.freeMeshInConnections == 0) return 0;
 
+	//Another node of that cluster is already joining us
+	if (IsClusteringAttemptRunning(packet->payload.clusterId)) return 0;
+
 	//If the other node wants to connect as a slave to another cluster, do not connect
 	if (packet->payload.ackField != 0 && packet->payload.ackField != this->clusterId) return 0;
 
@@ -1511,17 +1556,80 @@ u32 Node::CalculateClusterScoreAsSlave(joinMeBufferPacket* packet) const
 	return ModifyScoreBasedOnPreferredPartners(score, packet->payload.sender);
 }
 
-//All advertisement packets are received here if they are valid
-void Node::GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& advertisementReportEvent)
+//Score of a packet as a candidate for either connection direction, used to compare the packets in the buffer
+u32 Node::CalculateClusterScore(joinMeBufferPacket* packet) const
 {
-	if(!configuration.moduleActive) return;
+	const u32 masterScore = CalculateClusterScoreAsMaster(packet);
+	const u32 slaveScore = CalculateClusterScoreAsSlave(packet);
+	return masterScore > slaveScore ? masterScore : slaveScore;
+}
 
-	const u8* data = advertisementReportEvent.getData();
-	u16 dataLength = advertisementReportEvent.getDataLength();
+//Returns a slot for a new clustering attempt, nullptr if the maximum number of attempts is running
+Node::ClusteringAttempt* Node::GetFreeClusteringAttempt()
+{
+	for (u32 i = 0; i < CLUSTERING_MAX_PARALLEL_ATTEMPTS; i++)
+	{
+		ClusteringAttempt& attempt = clusteringAttempts[i];
+		if (attempt.uniqueConnectionId != 0)
+		{
+			//Attempts end once their connection is gone or has finished its handshake
+			BaseConnection* conn = GS->cm.GetConnectionByUniqueId(attempt.uniqueConnectionId);
+			if (conn != nullptr && !conn->handshakeDone()) continue;
+			attempt.uniqueConnectionId = 0;
+		}
+		return &attempt;
+	}
+	return nullptr;
+}
 
-	const advPacketHeader* packetHeader = (const advPacketHeader*) data;
+bool Node::IsClusteringAttempt(u16 uniqueConnectionId) const
+{
+	if (uniqueConnectionId == 0) return false;
 
-	switch (packetHeader->messageType)
+	for (u32 i = 0; i < CLUSTERING_MAX_PARALLEL_ATTEMPTS; i++)
+	{
+		if (clusteringAttempts[i].uniqueConnectionId == uniqueConnectionId) return true;
+	}
+	return false;
+}
+
+void Node::ClusteringAttemptAborted(u16 uniqueConnectionId)
+{
+	for (u32 i = 0; i < CLUSTERING_MAX_PARALLEL_ATTEMPTS; i++)
+	{
+		ClusteringAttempt& attempt = clusteringAttempts[i];
+		if (uniqueConnectionId == 0 || attempt.uniqueConnectionId != uniqueConnectionId) continue;
+
+		for (int j = 0; j < joinMePackets.length; j++)
+		{
+			if (joinMePackets[j].payload.sender == attempt.partnerId) joinMePackets[j].lastConnectAttemptDs = attempt.previousConnectAttemptDs;
+		}
+		attempt.uniqueConnectionId = 0;
+	}
+}
+
+bool Node::IsClusteringAttemptRunning(ClusterId clusterId) const
+{
+	for (u32 i = 0; i < CLUSTERING_MAX_PARALLEL_ATTEMPTS; i++)
+	{
+		const ClusteringAttempt& attempt = clusteringAttempts[i];
+		if (attempt.uniqueConnectionId == 0 || attempt.clusterId != clusterId) continue;
+
+		BaseConnection* conn = GS->cm.GetConnectionByUniqueId(attempt.uniqueConnectionId);
+		if (conn != nullptr && !conn->handshakeDone()) return true;
+	}
+	return false;
+}
+
+//All mesh advertisement packets of our network are received here
+void Node::GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index)
+{
+	if(!configuration.moduleActive) return;
+
+	const u8* data = index.data;
+	u16 dataLength = index.dataLength;
+
+	switch (index.meshMessageType)
 	{
 		case MESSAGE_TYPE_JOIN_ME_V0:
 			if (dataLength == SIZEOF_ADV_PACKET_JOIN_ME)
@@ -1532,19 +1640,26 @@ void Node::GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& adv
 
 				logt("DISCOVERY", "JOIN_ME: sender:%u, clusterId:%x, clusterSize:%d, freeIn:%u, freeOut:%u, ack:%u", packet->payload.sender, packet->payload.clusterId, packet->payload.clusterSize, packet->payload.freeMeshInConnections, packet->payload.freeMeshOutConnections, packet->payload.ackField);
 
+				joinMeBufferPacket candidate;
+				CheckedMemset(&candidate, 0x00, sizeof(candidate));
+				memcpy(candidate.bleAddress, advertisementReportEvent.getPeerAddr(), BLE_GAP_ADDR_LEN);
+				candidate.bleAddressType = advertisementReportEvent.getPeerAddrType();
+				candidate.advType = advertisementReportEvent.isConnectable() ? GapAdvType::ADV_IND : GapAdvType::ADV_NONCONN_IND;
+				candidate.rssi = advertisementReportEvent.getRssi();
+				candidate.receivedTimeDs = GS->appTimerDs;
+				candidate.payload = packet->payload;
+
 				//Look through the buffer and determine a space where we can put the packet in
-				joinMeBufferPacket* targetBuffer = findTargetBuffer(packet);
+				joinMeBufferPacket* targetBuffer = findTargetBuffer(&candidate);
 
 				//Now, we have the space for our packet and we fill it with the latest information
 				if (targetBuffer != nullptr)
 				{
-					memcpy(targetBuffer->bleAddress, advertisementReportEvent.getPeerAddr(), BLE_GAP_ADDR_LEN);
-					targetBuffer->bleAddressType = advertisementReportEvent.getPeerAddrType();
-					targetBuffer->advType = advertisementReportEvent.isConnectable() ? GapAdvType::ADV_IND : GapAdvType::ADV_NONCONN_IND;
-					targetBuffer->rssi = advertisementReportEvent.getRssi();
-					targetBuffer->receivedTimeDs = GS->appTimerDs;
-
-					targetBuffer->payload = packet->payload;
+					//Only a packet of the same node keeps the time of our last connection attempt
+					if (targetBuffer->payload.sender == candidate.payload.sender) {
+						candidate.lastConnectAttemptDs = targetBuffer->lastConnectAttemptDs;
+					}
+					*targetBuffer = candidate;
 				}
 			}
 			break;
@@ -1552,7 +1667,7 @@ void Node::GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& adv
 
 }
 
-joinMeBufferPacket* Node::findTargetBuffer(const advPacketJoinMeV0* packet)
+joinMeBufferPacket* Node::findTargetBuffer(joinMeBufferPacket* candidate)
 {
 	joinMeBufferPacket* targetBuffer = nullptr;
 
@@ -1561,7 +1676,7 @@ joinMeBufferPacket* Node::findTargetBuffer(const advPacketJoinMeV0* packet)
 	{
 		targetBuffer = &joinMePackets[i];
 
-		if (packet->payload.sender == targetBuffer->payload.sender)
+		if (candidate->payload.sender == targetBuffer->payload.sender)
 		{
 			logt("DISCOVERY", "Updated old buffer packet");
 			return targetBuffer;
@@ -1569,12 +1684,12 @@ joinMeBufferPacket* Node::findTargetBuffer(const advPacketJoinMeV0* packet)
 	}
 	targetBuffer = nullptr;
 
-	//Next, we look if there's an empty space
+	//Next, we look if there's an empty space or a packet that is too old to be used anyway
 	for (int i = 0; i < joinMePackets.length; i++)
 	{
 		targetBuffer = &(joinMePackets[i]);
 
-		if(targetBuffer->payload.sender == 0)
+		if(targetBuffer->payload.sender == 0 || GS->appTimerDs - targetBuffer->receivedTimeDs > MAX_JOIN_ME_PACKET_AGE_DS)
 		{
 			logt("DISCOVERY", "Used empty space");
 			KeepHighDiscoveryActive();
@@ -1600,28 +1715,22 @@ joinMeBufferPacket* Node::findTargetBuffer(const advPacketJoinMeV0* packet)
 		return targetBuffer;
 	}
 
-	//If there's still no space, we overwrite the oldest packet that we received, this will not fail
-	//TODO: maybe do not use oldest one but worst candidate?? Use clusterScore on all packets to find the least interesting
-	u32 minScore = UINT32_MAX;
+	//If there's still no space, we overwrite the least interesting candidate, but only if the new one is better
+	u32 minScore = CalculateClusterScore(candidate);
 	for (int i = 0; i < joinMePackets.length; i++)
 	{
 		joinMeBufferPacket* tmpPacket = &joinMePackets[i];
 
-		u32 score = 0;
-		if (packet->payload.clusterSize >= clusterSize) {
-			score = CalculateClusterScoreAsMaster(tmpPacket);
-		}
-		else {
-			score = CalculateClusterScoreAsSlave(tmpPacket);
-		}
-
+		u32 score = CalculateClusterScore(tmpPacket);
 		if(score < minScore){
 			minScore = score;
 			targetBuffer = tmpPacket;
 		}
 	}
 
-	logt("DISCOVERY", "Overwrote worst packet from different cluster");
+	if(targetBuffer != nullptr){
+		logt("DISCOVERY", "Overwrote worst packet from different cluster");
+	}
 	return targetBuffer;
 }
 
@@ -1723,7 +1832,10 @@ void Node::TimerEventHandler(u16 passedTimeDs)
 //	if(numGoodNodesInBuffer >= Config->numNodesForDecision) ...
 
 	//Check if there is a good cluster
-	if(lastDecisionTimeDs + Conf::maxTimeUntilDecisionDs < GS->appTimerDs){
+	//Once a connection attempt has finished, the next candidate is chosen immediately while the handshake is running
+	const bool clusteringAttemptFinished = clusteringAttemptConnecting && GS->cm.pendingConnection == nullptr;
+	if(lastDecisionTimeDs + Conf::maxTimeUntilDecisionDs < GS->appTimerDs || clusteringAttemptFinished){
+		clusteringAttemptConnecting = false;
 		DecisionStruct decision = DetermineBestClusterAvailable();
 
 		if (decision.result == Node::DecisionResult::NO_NODES_FOUND && noNodesFoundCounter < 100){
@@ -277,6 +277,23 @@ private:
 		//any more free outgoing connections
 		u16 emergencyDisconnectCounter;
 
+		//Outgoing connections that were created for clustering and the cluster that they will join
+		//Other nodes of the same cluster are not considered while the connection is connecting or in its handshake
+		typedef struct
+		{
+			u16 uniqueConnectionId; //0 if unused
+			ClusterId clusterId;
+			NodeId partnerId;
+			u32 previousConnectAttemptDs; //Restored if the attempt is aborted by us
+		} ClusteringAttempt;
+		ClusteringAttempt clusteringAttempts[CLUSTERING_MAX_PARALLEL_ATTEMPTS];
+		//Set while the GAP connection of an attempt is pending, the next decision is made as soon as it is finished
+		bool clusteringAttemptConnecting;
+
+		ClusteringAttempt* GetFreeClusteringAttempt();
+		bool IsClusteringAttemptRunning(ClusterId clusterId) const;
+		u32 CalculateClusterScore(joinMeBufferPacket* packet) const;
+
 #if defined(NRF52) || defined(SIM_ENABLED)
 		bool isSendingCapabilities = false;
 		constexpr static u32 TIME_BETWEEN_CAPABILITY_SENDINGS_DS = SEC_TO_DS(1);
@@ -291,7 +308,7 @@ private:
 
 
 		static constexpr int MAX_JOIN_ME_PACKET_AGE_DS = (10 * 10);
-		static constexpr int JOIN_ME_PACKET_BUFFER_MAX_ELEMENTS = 10;
+		static constexpr int JOIN_ME_PACKET_BUFFER_MAX_ELEMENTS = JOIN_ME_PACKET_BUFFER_SIZE;
 		SimpleArray<joinMeBufferPacket, JOIN_ME_PACKET_BUFFER_MAX_ELEMENTS> joinMePackets;
 		ClusterId currentAckId;
 		u16 connectionLossCounter;
@@ -370,6 +387,9 @@ private:
 		//Connection
 		void HandshakeTimeoutHandler() const;
 		void HandshakeDoneHandler(MeshConnection* connection, bool completedAsWinner); 
+		bool IsClusteringAttempt(u16 uniqueConnectionId) const;
+		//Called if the connection of an attempt is dropped for local reasons, the partner is not blacklisted
+		void ClusteringAttemptAborted(u16 uniqueConnectionId);
 		MeshAccessAuthorization CheckMeshAccessPacketAuthorization(BaseConnectionSendData* sendData, u8* data, u32 fmKeyId, DataDirection direction) override;
 
 		void SendComponentMessage(connPacketComponentMessage& message, u16 payloadSize);
@@ -386,8 +406,8 @@ private:
 
 		//Connection handlers
 		//Message handlers
-		void GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& advertisementReportEvent);
-		joinMeBufferPacket* findTargetBuffer(const advPacketJoinMeV0* packet);
+		void GapAdvertisementMessageHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index);
+		joinMeBufferPacket* findTargetBuffer(joinMeBufferPacket* candidate);
 
 		//Timers
 		void TimerEventHandler(u16 passedTimeDs) override;
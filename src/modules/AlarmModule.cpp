@@ -15,7 +15,9 @@
 extern "C"
 {
 #include "nrf_delay.h"
+#ifndef SIM_ENABLED
 #include "nrf_gpio.h"
+#endif
 #include "nrf.h"
 #include "nrf_drv_gpiote.h"
 #include "app_error.h"
@@ -32,31 +34,31 @@ AlarmModule::AlarmModule() : Module(ModuleId::ALARM_MODULE, "alarm")
 	configurationPointer = &configuration;
 	configurationLength = sizeof(AlarmModuleConfiguration);
 
+	// Cars send the service uuid in AD structures of the flags type
+	SubscribeToAdvertisements(AdvertisementSubscriptionType::AD_STRUCTURE, SERVICE_DATA_SERVICE_UUID16, ADV_SUBSCRIPTION_ANY_MESSAGE_TYPE, BLE_GAP_AD_TYPE_FLAGS);
+
 	alarmJobHandle = NULL;
 
 	//CONFIG
 	lastClusterSize = GS->node.clusterSize;
-	nearestTrafficJamNodeId = 0;
-	nearestBlackIceNodeId = 0;
-	nearestRescueLaneNodeId = 0;
-	nearestTrafficJamOppositeLaneNodeId = 0;
-	nearestBlackIceOppositeLaneNodeId = 0;
-	nearestRescueLaneOppositeLaneNodeId = 0;
+	incidents.Clear();
 
 	trafficJamAtMyNode = false;
 	blackIceAtMyNode = false;
 	rescueLaneAtMyNode = false;
 	rescueTimer = 0;
+	broadcastSequence = 0;
+	CheckedMemset(reliableUpdates, 0x00, sizeof(reliableUpdates));
+	CheckedMemset(pendingAcks, 0x00, sizeof(pendingAcks));
+	reliableUpdatesDelivered = 0;
+	reliableUpdatesFailed = 0;
 
-	trafficJamInterval = 0;
-	trafficJamPool1.setAllBytesTo(0);
-	trafficJamPool2.setAllBytesTo(0);
+	trafficJamDetector.Configure(ALARM_MODULE_TRAFFIC_JAM_DWELL_TIME_DS / ALARM_MODULE_TRAFFIC_JAM_DETECTION_TIME_DS, ALARM_MODULE_TRAFFIC_JAM_MIN_VEHICLES);
 
 	GpioInit();
 
 	//Start Broadcasting the informations
 	UpdateGpioState();
-	RequestAlarmUpdatePacket();
 	BroadcastPenguinAdvertisingPacket();
 	logt("NODE", "Started MIRO");
 
@@ -74,11 +76,11 @@ void AlarmModule::ButtonHandler(u8 buttonId, u32 holdTimeDs)
 	// Broadcast a rescue lane alarm
 	if(!blackIceAtMyNode) {
 		blackIceAtMyNode = true;
-		BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE);
+		BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE, NODE_ID_BROADCAST, true);
 		logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE);", GS->node.configuration.nodeId);
 	} else {
 		blackIceAtMyNode = false;
-		BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::DELETE);
+		BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::DELETE, NODE_ID_BROADCAST, true);
 		logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::DELETE);", GS->node.configuration.nodeId);
 	}
 }
@@ -99,28 +101,22 @@ void AlarmModule::ConfigurationLoadedHandler()
 	logt("ALARMMOD", "AlarmModule Config Loaded");
 }
 
-/*
- *	RequestAlarmUpdatePacket
- *
- *	sends a broadcast message, requesting an update from other nodes
- *
- */
-void AlarmModule::RequestAlarmUpdatePacket()
+u8 AlarmModule::NextBroadcastSequence()
 {
-	SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION,
-							0,
-							AlarmModuleTriggerActionMessages::GET_ALARM_SYSTEM_UPDATE,
-							0,
-							NULL,
-							0,
-							false);
+	broadcastSequence++;
+	if (broadcastSequence == 0) broadcastSequence = 1;
+	return broadcastSequence;
 }
 
 void AlarmModule::UpdateGpioState()
 {
+#ifndef SIM_ENABLED
 	nrf_gpio_pin_set(PIN_OUT);
 	gpioState = nrf_gpio_pin_read(PIN_IN);
 	nrf_gpio_pin_clear(PIN_OUT);
+#else
+	gpioState = 0;
+#endif
 }
 
 /*
@@ -131,23 +127,59 @@ void AlarmModule::UpdateGpioState()
  *	u8 incidentNodeId
  *	SERVICE_INCIDENT_TYPE incidentType
  *	SERVICE_ACTION_TYPE incidentAction
+ *	NodeId targetNodeId
+ *	bool reliable, the receivers acknowledge the update and it is sent again until they did
 
  */
 
-void AlarmModule::BroadcastAlarmUpdatePacket(u8 incidentNodeId, SERVICE_INCIDENT_TYPE incidentType, SERVICE_ACTION_TYPE incidentAction, NodeId targetNodeId)
+void AlarmModule::BroadcastAlarmUpdatePacket(u8 incidentNodeId, SERVICE_INCIDENT_TYPE incidentType, SERVICE_ACTION_TYPE incidentAction, NodeId targetNodeId, bool reliable)
 {
 	AlarmModuleUpdateMessage data;
+	CheckedMemset(&data, 0x00, sizeof(data));
 	data.meshDeviceId = incidentNodeId;
 	data.meshIncidentType = incidentType;
 	data.meshActionType = incidentAction;
+	data.flags = reliable ? ALARM_MODULE_UPDATE_FLAG_ACK_REQUESTED : 0;
+
+	//Our own table is updated as well, we do not receive our own broadcast
+	UpdateSavedIncident(incidentNodeId, incidentType, incidentAction);
 
+	const u8 sequence = NextBroadcastSequence();
+	SendAlarmUpdate(data, targetNodeId, sequence);
+
+	if (reliable)
+	{
+		StartReliableAlarmUpdate(data, targetNodeId, sequence);
+	}
+}
+
+void AlarmModule::SendAlarmUpdate(const AlarmModuleUpdateMessage& message, NodeId targetNodeId, u8 sequence) const
+{
 	SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION,
 							targetNodeId,
 							(u8)AlarmModuleTriggerActionMessages::SET_ALARM_SYSTEM_UPDATE,
-							0,
-							(u8 *)&data,
+							sequence,
+							(const u8 *)&message,
 							SIZEOF_ALARM_MODULE_UPDATE_MESSAGE,
-							false);
+							false,
+							true,
+							DeliveryPriority::MEDIUM);
+}
+
+void AlarmModule::SendAlarmUpdate(const AlarmModuleUpdateMessage& message, u8 sequence, MeshConnection* connection) const
+{
+	u8 buffer[SIZEOF_CONN_PACKET_MODULE + SIZEOF_ALARM_MODULE_UPDATE_MESSAGE];
+	connPacketModule* packet = (connPacketModule*)buffer;
+	packet->header.messageType = MessageType::MODULE_TRIGGER_ACTION;
+	packet->header.sender = GS->node.configuration.nodeId;
+	packet->header.receiver = NODE_ID_BROADCAST;
+	packet->moduleId = moduleId;
+	packet->requestHandle = sequence;
+	packet->actionType = (u8)AlarmModuleTriggerActionMessages::SET_ALARM_SYSTEM_UPDATE;
+	memcpy(packet->data, &message, SIZEOF_ALARM_MODULE_UPDATE_MESSAGE);
+
+	// The partner floods it to all of its other partners
+	connection->SendData(buffer, sizeof(buffer), DeliveryPriority::MEDIUM, false);
 }
 
 /*
@@ -209,20 +241,16 @@ void AlarmModule::BroadcastPenguinAdvertisingPacket()
 	alarmData->clusterSize = GS->node.clusterSize;
 	alarmData->networkId = GS->node.configuration.networkId;
 
-	// Incident data, only send if there actually is an incident (but if there is, need to send all to keep structure)
-	if (nearestRescueLaneNodeId != 0 || nearestRescueLaneOppositeLaneNodeId != 0 ||
-		nearestTrafficJamNodeId != 0 || nearestTrafficJamOppositeLaneNodeId != 0 ||
-		nearestBlackIceNodeId != 0 || nearestBlackIceOppositeLaneNodeId != 0 ||
-		rescueLaneAtMyNode || trafficJamAtMyNode || blackIceAtMyNode || !rescueLaneAtMyNode || !trafficJamAtMyNode || !blackIceAtMyNode)
-	{
-		alarmData->nearestRescueLaneNodeId = rescueLaneAtMyNode ? GS->node.configuration.nodeId : nearestRescueLaneNodeId;
-		alarmData->nearestTrafficJamNodeId = trafficJamAtMyNode ? GS->node.configuration.nodeId : nearestTrafficJamNodeId;
-		alarmData->nearestBlackIceNodeId = blackIceAtMyNode ? GS->node.configuration.nodeId : nearestBlackIceNodeId;
+	// Incident data, derived from the incident table so that the next incident shows up as soon as a nearer one is deleted
+	const u8 ownLane = GS->node.configuration.nodeId % 2;
+	const u8 oppositeLane = (GS->node.configuration.nodeId + 1) % 2;
+	alarmData->nearestRescueLaneNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::RESCUE_LANE, ownLane);
+	alarmData->nearestTrafficJamNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, ownLane);
+	alarmData->nearestBlackIceNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::BLACK_ICE, ownLane);
 
-		alarmData->nearestRescueLaneOppositeLaneNodeId = nearestRescueLaneOppositeLaneNodeId;
-		alarmData->nearestTrafficJamOppositeLaneNodeId = nearestTrafficJamOppositeLaneNodeId;
-		alarmData->nearestBlackIceOppositeLaneNodeId = nearestBlackIceOppositeLaneNodeId;
-	}
+	alarmData->nearestRescueLaneOppositeLaneNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::RESCUE_LANE, oppositeLane);
+	alarmData->nearestTrafficJamOppositeLaneNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, oppositeLane);
+	alarmData->nearestBlackIceOppositeLaneNodeId = GetNearestIncident(SERVICE_INCIDENT_TYPE::BLACK_ICE, oppositeLane);
 
 	alarmData->direction =GS->node.configuration.direction;
 
@@ -279,6 +307,29 @@ void AlarmModule::ResetToDefaultConfiguration()
 	SET_FEATURESET_CONFIGURATION(&configuration, this);
 }
 
+//Relayed packets are queued with low priority by default, alarm updates must not wait behind bulk traffic
+RoutingDecision AlarmModule::MessageRoutingInterceptor(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader)
+{
+	if (packetHeader->messageType == MessageType::MODULE_TRIGGER_ACTION && sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE)
+	{
+		connPacketModule* packet = (connPacketModule*)packetHeader;
+		if (packet->moduleId == moduleId && packet->actionType == (u8)AlarmModuleTriggerActionMessages::SET_ALARM_SYSTEM_UPDATE)
+		{
+			sendData->priority = DeliveryPriority::MEDIUM;
+		}
+	}
+	//The acknowledgements must not be delayed either, otherwise the originator retransmits its update
+	else if (packetHeader->messageType == MessageType::MODULE_ACTION_RESPONSE && sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE)
+	{
+		connPacketModule* packet = (connPacketModule*)packetHeader;
+		if (packet->moduleId == moduleId && packet->actionType == (u8)AlarmModuleActionResponseMessages::ALARM_SYSTEM_UPDATE_ACK)
+		{
+			sendData->priority = DeliveryPriority::MEDIUM;
+		}
+	}
+	return 0;
+}
+
 void AlarmModule::MeshMessageReceivedHandler(BaseConnection *connection, BaseConnectionSendData *sendData, connPacketHeader *packetHeader)
 {
 	//Must call superclass for handling
@@ -290,6 +341,7 @@ void AlarmModule::MeshMessageReceivedHandler(BaseConnection *connection, BaseCon
 		logt("ALARMMOD", "Received Alarm Update Request");
 		connPacketModule *packet = (connPacketModule *)packetHeader;
 		AlarmModuleUpdateMessage *data = (AlarmModuleUpdateMessage *)packet->data;
+		const u16 dataLength = sendData->dataLength > SIZEOF_CONN_PACKET_MODULE ? sendData->dataLength - SIZEOF_CONN_PACKET_MODULE : 0;
 
 		//Check if our module is meant and we should trigger an action
 		if (packet->moduleId == moduleId)
@@ -298,35 +350,78 @@ void AlarmModule::MeshMessageReceivedHandler(BaseConnection *connection, BaseCon
 			{
 				logt("ALARMMOD", "Received Alarm Update GET Request");
 				// if there is an incident at my node, broadcast it out
-				if (trafficJamAtMyNode)
-				{
-					BroadcastAlarmUpdatePacket(nearestTrafficJamNodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE);
-					logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE); (MeshMessageReceivedHandler)", GS->node.configuration.nodeId);
-				}
-				if (blackIceAtMyNode)
-				{
-					BroadcastAlarmUpdatePacket(nearestBlackIceNodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE);
-					logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE); (MeshMessageReceivedHandler)", GS->node.configuration.nodeId);
-					
-				}
-				if (rescueLaneAtMyNode)
-				{
-					BroadcastAlarmUpdatePacket(nearestRescueLaneNodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);
-					logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE); (MeshMessageReceivedHandler)", GS->node.configuration.nodeId);
-				}
+				BroadcastOwnIncidents();
 			}
 			if (packet->actionType == AlarmModuleTriggerActionMessages::SET_ALARM_SYSTEM_UPDATE)
 			{
 				logt("ALARMMOD", "Received Alarm Update SET Request");
+				SIMSTATCOUNT("alarmUpdateReceived");
 
 				// If incident got updated, broadcast to mobile devices
 				if (UpdateSavedIncident(data->meshDeviceId, data->meshIncidentType, data->meshActionType))
 				{
 					BroadcastPenguinAdvertisingPacket();
 				}
+
+				// Older nodes send updates without flags
+				if (dataLength >= SIZEOF_ALARM_MODULE_UPDATE_MESSAGE && (data->flags & ALARM_MODULE_UPDATE_FLAG_ACK_REQUESTED) && packet->requestHandle != 0)
+				{
+					// Updates for a single node are not seen by the nodes on the way and are acknowledged directly
+					if (packetHeader->receiver == GS->node.configuration.nodeId)
+					{
+						SendAlarmUpdateAck(packetHeader->sender, packetHeader->sender, packet->requestHandle, 1);
+					}
+					else if (connection != nullptr)
+					{
+						QueueAlarmUpdateAck(packetHeader->sender, packet->requestHandle, connection->partnerId);
+					}
+				}
+			}
+			if (packet->actionType == AlarmModuleTriggerActionMessages::ALARM_STATE_DIGEST)
+			{
+				logt("ALARMMOD", "Received alarm state digest from %u", packetHeader->sender);
+				SendAlarmStateDelta(packetHeader->sender, *(AlarmModuleStateMessage*)packet->data, dataLength);
+			}
+			if (packet->actionType == AlarmModuleTriggerActionMessages::ALARM_STATE_DELTA)
+			{
+				AlarmModuleStateMessage applied;
+				if (ApplyAlarmStateDelta(*(AlarmModuleStateMessage*)packet->data, dataLength, applied) > 0)
+				{
+					logt("ALARMMOD", "Applied %u incidents of alarm state delta from %u", applied.count, packetHeader->sender);
+					BroadcastPenguinAdvertisingPacket();
+
+					// The rest of our side of the mesh is missing these incidents as well. Forwarded deltas are broadcasted
+					// and only applied by the receivers, so this happens once per mesh partner
+					if (packetHeader->receiver == GS->node.configuration.nodeId && GS->cm.GetMeshConnections(ConnectionDirection::INVALID).count > 1)
+					{
+						SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION,
+												NODE_ID_BROADCAST,
+												(u8)AlarmModuleTriggerActionMessages::ALARM_STATE_DELTA,
+												NextBroadcastSequence(),
+												(u8 *)&applied,
+												SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER + applied.count * SIZEOF_ALARM_MODULE_INCIDENT_STATE,
+												false);
+					}
+				}
 			}
 		}
 	}
+	else if (packetHeader->messageType == MessageType::MODULE_ACTION_RESPONSE && packetHeader->receiver == GS->node.configuration.nodeId)
+	{
+		connPacketModule *packet = (connPacketModule *)packetHeader;
+
+		if (
+			packet->moduleId == moduleId
+			&& packet->actionType == AlarmModuleActionResponseMessages::ALARM_SYSTEM_UPDATE_ACK
+			&& sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE + SIZEOF_ALARM_MODULE_UPDATE_ACK_MESSAGE
+		)
+		{
+			// The message is not aligned in the packet
+			AlarmModuleUpdateAckMessage ack;
+			memcpy(&ack, packet->data, SIZEOF_ALARM_MODULE_UPDATE_ACK_MESSAGE);
+			ReceivedAlarmUpdateAck(packetHeader->sender, ack);
+		}
+	}
 }
 /* UpdateSavedIncident, updates a saved incident, if it is relevant
  *
@@ -338,121 +433,221 @@ void AlarmModule::MeshMessageReceivedHandler(BaseConnection *connection, BaseCon
  */
 bool AlarmModule::UpdateSavedIncident(u8 incidentNodeId, u8 incidentType, u8 actionType)
 {
-	bool changed = false;
 	SERVICE_INCIDENT_TYPE incType = (SERVICE_INCIDENT_TYPE)incidentType;
 	SERVICE_ACTION_TYPE actType = (SERVICE_ACTION_TYPE)actionType;
 
-	// if (abs(incidentNodeId - GS->node.configuration.nodeId) > ALARM_MODULE_TRAFFIC_JAM_WARNING_RANGE)
-	// {
-	// 	return changed;
-	// }
+	if (incidentNodeId == 0 || incidentType > BREAK_DOWN)
+	{
+		return false;
+	}
+
+	const u8 lane = incidentNodeId % 2;
+	const u8 nearestBefore = GetNearestIncident(incType, lane);
 
-	// create a generic pointer to the incidentId
-	u8 *savedIncidentNodeId = 0;
-	if (incType == TRAFFIC_JAM)
+	// Only changes of the incident table are logged, incidents are reported again periodically
+	if (actType == DELETE)
 	{
-		// check if incident id is on same road side
-		if ((incidentNodeId - GS->node.configuration.nodeId) % 2 == 0)
-		{
-			savedIncidentNodeId = &nearestTrafficJamNodeId;
-		}
-		else
+		if (incidents.Delete(incidentType, incidentNodeId))
 		{
-			savedIncidentNodeId = &nearestTrafficJamOppositeLaneNodeId;
+			GS->eventLog.Log(EventLogEntryType::INCIDENT_DELETED, incidentType, incidentNodeId, 0);
 		}
 	}
-	else if (incType == BLACK_ICE)
+	else if (actType == SAVE)
 	{
-		if ((incidentNodeId - GS->node.configuration.nodeId) % 2 == 0)
-		{
-			savedIncidentNodeId = &nearestBlackIceNodeId;
-		}
-		else
+		const bool known = incidents.Find(incidentType, incidentNodeId) != nullptr;
+		if (incidents.Save(incidentType, incidentNodeId, GS->node.configuration.nodeId, GS->appTimerDs) && !known)
 		{
-			savedIncidentNodeId = &nearestBlackIceOppositeLaneNodeId;
+			GS->eventLog.Log(EventLogEntryType::INCIDENT_SAVED, incidentType, incidentNodeId, 0);
 		}
 	}
-	else if (incType == RESCUE_LANE)
+
+	return GetNearestIncident(incType, lane) != nearestBefore;
+}
+
+/* GetNearestIncident, finds the incident that is relevant for the vehicles passing our node
+ *
+ * @param SERVICE_INCIDENT_TYPE incidentType, the type of incident
+ * @param u8 lane, 1 for the lane with uneven node ids, 0 for the other one
+ *
+ * returns u8 incidentNodeId, the id of the node where the incident is, 0 if there is none
+ */
+u8 AlarmModule::GetNearestIncident(SERVICE_INCIDENT_TYPE incidentType, u8 lane) const
+{
+	const NodeId ownNodeId = GS->node.configuration.nodeId;
+
+	// lane with uneven numbers -> driving direction is 1 -> 3 -> 5 | lane with even numbers, driving direction is 6 -> 4 -> 2 ...
+	// traffic jam and black ice are relevant ahead of us, while a rescue lane is relevant behind us.
+	// The beacon on the same position on the other lane (our id +-1) is included
+	if ((lane != 0 && (incidentType == TRAFFIC_JAM || incidentType == BLACK_ICE)) || (lane == 0 && incidentType == RESCUE_LANE))
 	{
-		if ((incidentNodeId - GS->node.configuration.nodeId) % 2 == 0)
-		{
-			savedIncidentNodeId = &nearestRescueLaneNodeId;
-		}
-		else
-		{
-			savedIncidentNodeId = &nearestRescueLaneOppositeLaneNodeId;
-		}
+		return incidents.GetFirstAtOrAbove(incidentType, lane, ownNodeId > 0 ? ownNodeId - 1 : 0);
+	}
+	else
+	{
+		return incidents.GetLastAtOrBelow(incidentType, lane, ownNodeId + 1);
 	}
+}
 
-	if (*savedIncidentNodeId == incidentNodeId && actType == DELETE)
+void AlarmModule::BroadcastOwnIncidents()
+{
+	// Only the flags tell us which incidents are ours, other nodes may also have reported incidents with our nodeId
+	const NodeId ownNodeId = GS->node.configuration.nodeId;
+	if (trafficJamAtMyNode)
+	{
+		BroadcastAlarmUpdatePacket(ownNodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE);
+		logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE); (BroadcastOwnIncidents)", ownNodeId);
+	}
+	if (blackIceAtMyNode)
 	{
-		*savedIncidentNodeId = 0;
-		changed = true;
-		// lane with uneven numbers -> driving direction is 1 -> 3 -> 5 | lane with even numbers, driving direction is 6 -> 4 -> 2 ...
+		BroadcastAlarmUpdatePacket(ownNodeId, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE);
+		logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::BLACK_ICE, SERVICE_ACTION_TYPE::SAVE); (BroadcastOwnIncidents)", ownNodeId);
 	}
-	else if (*savedIncidentNodeId != incidentNodeId && actType == SAVE)
+	if (rescueLaneAtMyNode)
 	{
-		// incident happened on lane with uneven numbers and is traffic jam or black ice, or happened on even side and is rescue lane
-		// results in the same logic, because of the driving directions (one up and one down)
-		// and the fact that rescue lane is relevant behind us, while the other are relevant ahead of us
-		if ((incidentNodeId % 2 != 0 && (incType == TRAFFIC_JAM || incType == BLACK_ICE)) || (incidentNodeId % 2 == 0 && incType == RESCUE_LANE))
+		BroadcastAlarmUpdatePacket(ownNodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);
+		logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE); (BroadcastOwnIncidents)", ownNodeId);
+	}
+}
+
+#define _________________ALARM_STATE_SYNC____________
+
+/*
+ *	MeshConnectionChangedHandler
+ *
+ *	Instead of flooding a GET_ALARM_SYSTEM_UPDATE through the whole mesh, a node only exchanges a digest of its
+ *	incident table with its new partner. Both partners answer with the incidents that the other one is missing.
+ */
+void AlarmModule::MeshConnectionChangedHandler(MeshConnection& connection)
+{
+	if (!configuration.moduleActive || !connection.handshakeDone()) return;
+
+	AlarmModuleStateMessage digest;
+	const u16 length = FillAlarmStateDigest(digest);
+
+	logt("ALARMMOD", "Sending alarm state digest with %u incidents to %u", digest.count, connection.partnerId);
+
+	SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION,
+							connection.partnerId,
+							(u8)AlarmModuleTriggerActionMessages::ALARM_STATE_DIGEST,
+							0,
+							(u8 *)&digest,
+							length,
+							false);
+}
+
+static u8 GetIncidentAgeSec(const AlarmIncident& incident)
+{
+	const u32 ageSec = (GS->appTimerDs - incident.lastSeenDs) / 10;
+	return ageSec > 0xFF ? 0xFF : (u8)ageSec;
+}
+
+u16 AlarmModule::FillAlarmStateDigest(AlarmModuleStateMessage& message) const
+{
+	message.count = incidents.GetCount();
+	for (u8 i = 0; i < message.count; i++)
+	{
+		message.incidents[i].incidentType = incidents[i].incidentType;
+		message.incidents[i].nodeId = incidents[i].nodeId;
+		message.incidents[i].ageSec = GetIncidentAgeSec(incidents[i]);
+	}
+	return SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER + message.count * SIZEOF_ALARM_MODULE_INCIDENT_STATE;
+}
+
+void AlarmModule::SendAlarmStateDelta(NodeId partnerId, const AlarmModuleStateMessage& partnerDigest, u16 partnerDigestLength)
+{
+	if (partnerDigestLength < SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER) return;
+	const u8 partnerCount = std::min((u16)std::min(partnerDigest.count, (u8)ALARM_MODULE_INCIDENT_TABLE_SIZE),
+		(u16)((partnerDigestLength - SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER) / SIZEOF_ALARM_MODULE_INCIDENT_STATE));
+
+	AlarmModuleStateMessage delta;
+	delta.count = 0;
+
+	for (u8 i = 0; i < incidents.GetCount(); i++)
+	{
+		const u8 ageSec = GetIncidentAgeSec(incidents[i]);
+
+		const AlarmModuleIncidentState* partnerIncident = nullptr;
+		for (u8 k = 0; k < partnerCount; k++)
 		{
-			// ... only new incident with an id smaller than the current saved incident id, but not smaller than our id - 1
-			// ( +1 so beacon on same position on other lane is included) are relevant
-			// if savedIncidentNodeId is 0, there is no saved incident yet, which means we only have to check if it is ahead of us
-			if ((incidentNodeId < *savedIncidentNodeId || *savedIncidentNodeId == 0) && incidentNodeId >= GS->node.configuration.nodeId - 1)
+			if (partnerDigest.incidents[k].incidentType == incidents[i].incidentType && partnerDigest.incidents[k].nodeId == incidents[i].nodeId)
 			{
-				*savedIncidentNodeId = incidentNodeId;
-				changed = true;
+				partnerIncident = &partnerDigest.incidents[k];
+				break;
 			}
 		}
+
+		bool missing = false;
+		if (partnerIncident == nullptr)
+		{
+			// If its origin did not refresh it for two intervals, it was probably deleted where the partner could see it
+			missing = ageSec * 10 <= ALARM_MODULE_INCIDENT_REFRESH_TIME_DS * 2;
+		}
 		else
 		{
-			// ... only new incident with an id bigger than the current saved incident id, but not bigger than our id + 1
-			// ( +1 so beacon on same position on other lane is included) are relevant
-			//  *savedIncidentNodeId == 0 check is not needed here because > comparison always overwrites the 0 case (no saved incident yet)
-			if (incidentNodeId > *savedIncidentNodeId && incidentNodeId <= GS->node.configuration.nodeId + 1)
-			{
-				*savedIncidentNodeId = incidentNodeId;
-				changed = true;
-			}
+			// The partner missed at least one refresh of this incident, a newer copy at the partner is never missing
+			missing = partnerIncident->ageSec > ageSec && (u32)(partnerIncident->ageSec - ageSec) * 10 > ALARM_MODULE_INCIDENT_REFRESH_TIME_DS;
+		}
+
+		if (missing)
+		{
+			delta.incidents[delta.count].incidentType = incidents[i].incidentType;
+			delta.incidents[delta.count].nodeId = incidents[i].nodeId;
+			delta.incidents[delta.count].ageSec = ageSec;
+			delta.count++;
 		}
 	}
 
-	return changed;
+	if (delta.count == 0) return;
+
+	logt("ALARMMOD", "Sending alarm state delta with %u incidents to %u", delta.count, partnerId);
+
+	SendModuleActionMessage(MessageType::MODULE_TRIGGER_ACTION,
+							partnerId,
+							(u8)AlarmModuleTriggerActionMessages::ALARM_STATE_DELTA,
+							0,
+							(u8 *)&delta,
+							SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER + delta.count * SIZEOF_ALARM_MODULE_INCIDENT_STATE,
+							false);
 }
 
-u8 AlarmModule::intersection(SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> a, SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> b)
+u8 AlarmModule::ApplyAlarmStateDelta(const AlarmModuleStateMessage& delta, u16 deltaLength, AlarmModuleStateMessage& applied)
 {
-	u8 m = a.size();
-	u8 n = b.size();
-	u8 count = 0;
-	SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> ab;
-	SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> abc;
-	ab.setAllBytesTo(0);
-	abc.setAllBytesTo(0);
+	applied.count = 0;
+	if (deltaLength < SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER) return 0;
+	const u8 count = std::min((u16)std::min(delta.count, (u8)ALARM_MODULE_INCIDENT_TABLE_SIZE),
+		(u16)((deltaLength - SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER) / SIZEOF_ALARM_MODULE_INCIDENT_STATE));
 
-	for (int i = 0; i < m; i++)
+	const NodeId ownNodeId = GS->node.configuration.nodeId;
+	for (u8 i = 0; i < count; i++)
 	{
-		for (int j = 0; j < n; j++)
+		const AlarmModuleIncidentState& state = delta.incidents[i];
+
+		// We are the only ones that know about incidents at our node
+		if (state.nodeId == ownNodeId || state.nodeId == 0 || state.incidentType > BREAK_DOWN) continue;
+
+		const u32 ageDs = (u32)state.ageSec * 10;
+		const u32 lastSeenDs = GS->appTimerDs > ageDs ? GS->appTimerDs - ageDs : 0;
+
+		const AlarmIncident* known = incidents.Find(state.incidentType, state.nodeId);
+		if (known != nullptr && known->lastSeenDs >= lastSeenDs) continue;
+
+		if (incidents.Save(state.incidentType, state.nodeId, ownNodeId, lastSeenDs))
 		{
-			if (a[i] == b[j])
-			{
-				ab[count] = a[i];
-				count++;
-				return 1;
-			}
+			applied.incidents[applied.count] = state;
+			applied.count++;
 		}
 	}
-	return (u8)ab.size();
+	return applied.count;
 }
 
 void AlarmModule::GpioInit()
 {
+#ifndef SIM_ENABLED
 	nrf_gpio_pin_dir_set(PIN_OUT, NRF_GPIO_PIN_DIR_OUTPUT);
 	nrf_gpio_cfg_output(PIN_OUT);
 	nrf_gpio_pin_set(PIN_OUT);
 	nrf_gpio_cfg_input(PIN_IN, NRF_GPIO_PIN_NOPULL);
+#endif
 }
 
 bool AlarmModule::isMyDirection(u8 direction)
@@ -468,14 +663,15 @@ bool AlarmModule::isMyDirection(u8 direction)
 	return false;
 }
 
-void AlarmModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent &advertisementReportEvent)
+void AlarmModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent &advertisementReportEvent, const AdvertisementReportIndex& index)
 {
 	if (!configuration.moduleActive)
 		return;
 
-	const advPacketCarServiceAndDataHeader *packetHeader = (const advPacketCarServiceAndDataHeader *)advertisementReportEvent.getData();
+	const advPacketCarServiceAndDataHeader *packetHeader = (const advPacketCarServiceAndDataHeader *)index.data;
 
-	if (packetHeader->mway_service_uuid == 0xFE12 && packetHeader->mway_service_uuid2 == 0xFE12)
+	// The subscription only guarantees that one of the structures carries our uuid
+	if (packetHeader->mway_service_uuid == SERVICE_DATA_SERVICE_UUID16 && packetHeader->mway_service_uuid2 == SERVICE_DATA_SERVICE_UUID16)
 	{
 		const AdvPacketCarData *packetData = (const AdvPacketCarData *)&packetHeader->data;
 
@@ -520,16 +716,15 @@ void AlarmModule::GapAdvertisementReportEventHandler(const GapAdvertisementRepor
 			if (isMyDirection(packetData->direction)) {
 				rescueLaneAtMyNode = true;
 				rescueTimer = 10;	
-				BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);
+				BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE, NODE_ID_BROADCAST, true);
 				logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);", GS->node.configuration.nodeId);
 			} else {
-				if (GS->node.configuration.nodeId % 2 != 0 && nearestRescueLaneOppositeLaneNodeId != GS->node.configuration.nodeId + 1) {
-					nearestRescueLaneOppositeLaneNodeId = GS->node.configuration.nodeId + 1;
-					BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId + 1, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);
+				const u8 oppositeLane = (GS->node.configuration.nodeId + 1) % 2;
+				if (GS->node.configuration.nodeId % 2 != 0 && GetNearestIncident(SERVICE_INCIDENT_TYPE::RESCUE_LANE, oppositeLane) != GS->node.configuration.nodeId + 1) {
+					BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId + 1, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE, NODE_ID_BROADCAST, true);
 					logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);", GS->node.configuration.nodeId);
-				} else if (GS->node.configuration.nodeId % 2 == 0 && nearestRescueLaneOppositeLaneNodeId != GS->node.configuration.nodeId - 1) {
-					nearestRescueLaneOppositeLaneNodeId = GS->node.configuration.nodeId - 1;
-					BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId - 1, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);
+				} else if (GS->node.configuration.nodeId % 2 == 0 && GetNearestIncident(SERVICE_INCIDENT_TYPE::RESCUE_LANE, oppositeLane) != GS->node.configuration.nodeId - 1) {
+					BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId - 1, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE, NODE_ID_BROADCAST, true);
 					logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::SAVE);", GS->node.configuration.nodeId);
 				}
 			}
@@ -537,26 +732,7 @@ void AlarmModule::GapAdvertisementReportEventHandler(const GapAdvertisementRepor
 
 		if (packetData->deviceType == DeviceType::VEHICLE && isMyDirection(packetData->direction))
 		{
-			if (trafficJamInterval == 0)
-			{
-				if (trafficJamPool1.size() >= TRAFFIC_JAM_POOL_SIZE)
-					trafficJamPool1.pop_front();
-
-				if (!trafficJamPool1.has(packetData->deviceID))
-				{
-					trafficJamPool1[trafficJamPool1.size()] = packetData->deviceID;
-				}
-			}
-			if (trafficJamInterval == 1)
-			{
-				if (trafficJamPool2.size() >= TRAFFIC_JAM_POOL_SIZE)
-					trafficJamPool2.pop_front();
-
-				if (!trafficJamPool2.has(packetData->deviceID))
-				{
-					trafficJamPool2[trafficJamPool2.size()] = packetData->deviceID;
-				}
-			}
+			trafficJamDetector.VehicleSeen(packetData->deviceID);
 		}
 	}
 }
@@ -568,14 +744,28 @@ void AlarmModule::TimerEventHandler(u16 passedTimeDs)
 
 	if (SHOULD_IV_TRIGGER(GS->appTimerDs + GS->appTimerRandomOffsetDs, passedTimeDs, ALARM_MODULE_BROADCAST_TRIGGER_TIME_DS))
 	{
+		incidents.RemoveExpired(ALARM_MODULE_INCIDENT_TTL_DS);
 		BroadcastPenguinAdvertisingPacket();
 	}
 
+	if (SHOULD_IV_TRIGGER(GS->appTimerDs + GS->appTimerRandomOffsetDs, passedTimeDs, ALARM_MODULE_ACK_DELAY_DS))
+	{
+		SendAlarmUpdateAcks();
+	}
+
+	RetransmitReliableAlarmUpdates();
+
+	// Other nodes forget our incidents if we do not report them again
+	if (SHOULD_IV_TRIGGER(GS->appTimerDs + GS->appTimerRandomOffsetDs, passedTimeDs, ALARM_MODULE_INCIDENT_REFRESH_TIME_DS))
+	{
+		BroadcastOwnIncidents();
+	}
+
 	if (SHOULD_IV_TRIGGER(GS->appTimerDs + GS->appTimerRandomOffsetDs, passedTimeDs, RESCUE_CAR_TIMER_INTERVAL))
 	{
 		if(rescueTimer == 0 && rescueLaneAtMyNode) {
 			rescueLaneAtMyNode = false;
-			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::DELETE);
+			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::DELETE, NODE_ID_BROADCAST, true);
 			logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::RESCUE_LANE, SERVICE_ACTION_TYPE::DELETE);", GS->node.configuration.nodeId);
 		} else if (rescueTimer > 0){
 			rescueTimer--;
@@ -586,41 +776,579 @@ void AlarmModule::TimerEventHandler(u16 passedTimeDs)
 	// Traffic jam timer
 	if (SHOULD_IV_TRIGGER(GS->appTimerDs + GS->appTimerRandomOffsetDs, passedTimeDs, ALARM_MODULE_TRAFFIC_JAM_DETECTION_TIME_DS))
 	{
-		// Log trafficJamPools
-		// for (int i = 0; i < TRAFFIC_JAM_POOL_SIZE; i++)
-		// {
-		// 	logt("ALARMMOD", "trafficJamPool1[%d] = 0x%X", i, trafficJamPool1[i]);
-		// }
-		// logt("ALARMMOD", " ");
-		// for (int i = 0; i < TRAFFIC_JAM_POOL_SIZE; i++)
-		// {
-		// 	logt("ALARMMOD", "trafficJamPool2[%d] = 0x%X", i, trafficJamPool2[i]);
-		// }
-		// logt("ALARMMOD", " ");
-
-		u8 intersections = intersection(trafficJamPool1, trafficJamPool2);
+		const bool trafficJamDetected = trafficJamDetector.NextBucket();
 
-		if (!trafficJamAtMyNode && intersections == TRAFFIC_JAM_DETECTED)
+		if (!trafficJamAtMyNode && trafficJamDetected)
 		{
 			trafficJamAtMyNode = true;
-			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE);
+			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE, NODE_ID_BROADCAST, true);
 			logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::SAVE);", GS->node.configuration.nodeId);
 		}
-		else if (trafficJamAtMyNode && intersections != TRAFFIC_JAM_DETECTED)
+		else if (trafficJamAtMyNode && !trafficJamDetected)
 		{
 			trafficJamAtMyNode = false;
-			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::DELETE);
+			BroadcastAlarmUpdatePacket(GS->node.configuration.nodeId, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::DELETE, NODE_ID_BROADCAST, true);
 			logt("BROADCAST", "BroadcastAlarmUpdatePacket(%u, SERVICE_INCIDENT_TYPE::TRAFFIC_JAM, SERVICE_ACTION_TYPE::DELETE);", GS->node.configuration.nodeId);
 		}
+	}
+}
+
+#define _________________RELIABLE_UPDATES____________
 
-		if (trafficJamInterval == 0)
-			trafficJamPool2.setAllBytesTo(0);
-			
-		if (trafficJamInterval == 1)
-			trafficJamPool1.setAllBytesTo(0);
+/*
+ *	Reliable updates
+ *
+ *	A reliable alarm update is acknowledged by every node that receives it. The acknowledgements are merged hop
+ *	by hop: A node waits until the nodes behind each of its other mesh partners acknowledged the update and then
+ *	sends a single acknowledgement with the summed up count to the partner that it received the update from.
+ *	If a branch does not answer within ALARM_MODULE_ACK_DELAY_DS, a partial count is sent and updated later.
+ *	The originator sends the update again with a new sequence number, but only to the partners whose branch
+ *	did not acknowledge it completely, at most ALARM_MODULE_RELIABLE_MAX_RETRIES times.
+ *	An update for a single node is acknowledged directly by that node.
+ */
+void AlarmModule::StartReliableAlarmUpdate(const AlarmModuleUpdateMessage& message, NodeId targetNodeId, u8 sequence)
+{
+	// A newer update of the same incident makes the pending one obsolete, otherwise a free slot is used
+	ReliableAlarmUpdate* slot = nullptr;
+	for (u32 i = 0; i < ALARM_MODULE_RELIABLE_UPDATE_SLOTS; i++)
+	{
+		ReliableAlarmUpdate& update = reliableUpdates[i];
+		if (update.sequence != 0 && update.message.meshDeviceId == message.meshDeviceId && update.message.meshIncidentType == message.meshIncidentType)
+		{
+			slot = &update;
+			break;
+		}
+		if (update.sequence == 0 && slot == nullptr)
+		{
+			slot = &update;
+		}
+	}
 
-		trafficJamInterval++;
-		if (trafficJamInterval > 1)
-			trafficJamInterval = 0;
+	// If all slots are in use, the update that was retransmitted most often is given up
+	if (slot == nullptr)
+	{
+		slot = &reliableUpdates[0];
+		for (u32 i = 1; i < ALARM_MODULE_RELIABLE_UPDATE_SLOTS; i++)
+		{
+			if (reliableUpdates[i].retries > slot->retries) slot = &reliableUpdates[i];
+		}
+		logt("ALARMMOD", "No slot for reliable update, gave up update %u", slot->sequence);
+		reliableUpdatesFailed++;
 	}
+
+	CheckedMemset(slot, 0x00, sizeof(*slot));
+	slot->message = message;
+	slot->targetNodeId = targetNodeId;
+	slot->sequence = sequence;
+	slot->sequences[0] = sequence;
+	slot->nextRetransmitDs = GS->appTimerDs + ALARM_MODULE_RELIABLE_TIMEOUT_DS;
+}
+
+u16 AlarmModule::GetExpectedAckCount(const ReliableAlarmUpdate& update)
+{
+	if (update.targetNodeId != NODE_ID_BROADCAST) return 1;
+	return GS->node.clusterSize > 1 ? GS->node.clusterSize - 1 : 0;
+}
+
+void AlarmModule::RetransmitReliableAlarmUpdates()
+{
+	for (u32 i = 0; i < ALARM_MODULE_RELIABLE_UPDATE_SLOTS; i++)
+	{
+		ReliableAlarmUpdate& update = reliableUpdates[i];
+		if (update.sequence == 0 || GS->appTimerDs < update.nextRetransmitDs) continue;
+
+		// The cluster might have become smaller in the meantime
+		const u16 ackCount = GetMergedAckCount(update.branches);
+		if (ackCount >= GetExpectedAckCount(update))
+		{
+			reliableUpdatesDelivered++;
+			update.sequence = 0;
+			continue;
+		}
+
+		if (update.retries >= ALARM_MODULE_RELIABLE_MAX_RETRIES)
+		{
+			reliableUpdatesFailed++;
+			logt("ALARMMOD", "Reliable update %u failed, %u of %u acks (%u failed)", update.sequence, ackCount, GetExpectedAckCount(update), reliableUpdatesFailed);
+			update.sequence = 0;
+			continue;
+		}
+
+		// A new sequence number is used as the nodes on the way would drop the retransmission as a duplicate
+		update.retries++;
+		update.sequence = NextBroadcastSequence();
+		update.sequences[update.retries] = update.sequence;
+		update.nextRetransmitDs = GS->appTimerDs + (ALARM_MODULE_RELIABLE_TIMEOUT_DS << update.retries);
+
+		logt("ALARMMOD", "Retransmitting reliable update as %u, %u of %u acks", update.sequence, ackCount, GetExpectedAckCount(update));
+
+		if (update.targetNodeId != NODE_ID_BROADCAST)
+		{
+			SendAlarmUpdate(update.message, update.targetNodeId, update.sequence);
+			continue;
+		}
+
+		// Branches that acknowledged the update completely do not receive it again
+		MeshConnections connections = GS->cm.GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 j = 0; j < connections.count; j++)
+		{
+			MeshConnection* connection = connections.connections[j];
+			if (!connection->handshakeDone()) continue;
+			if (GetBranchAckCount(update.branches, connection->partnerId) >= connection->GetConnectedClusterSize()) continue;
+
+			SendAlarmUpdate(update.message, update.sequence, connection);
+		}
+	}
+}
+
+void AlarmModule::ReceivedAlarmUpdateAck(NodeId sender, const AlarmModuleUpdateAckMessage& ack)
+{
+	// Our own update, each transmission of it is acknowledged separately by the branches
+	if (ack.originator == GS->node.configuration.nodeId)
+	{
+		for (u32 i = 0; i < ALARM_MODULE_RELIABLE_UPDATE_SLOTS; i++)
+		{
+			ReliableAlarmUpdate& update = reliableUpdates[i];
+			if (update.sequence == 0) continue;
+
+			bool sentByUpdate = false;
+			for (u32 j = 0; j <= update.retries; j++)
+			{
+				if (update.sequences[j] == ack.sequence) sentByUpdate = true;
+			}
+			if (!sentByUpdate) continue;
+
+			MergeBranchAck(update.branches, sender, ack.ackCount);
+
+			if (GetMergedAckCount(update.branches) >= GetExpectedAckCount(update))
+			{
+				reliableUpdatesDelivered++;
+				logt("ALARMMOD", "Reliable update %u delivered after %u retries (%u delivered)", update.sequence, update.retries, reliableUpdatesDelivered);
+				update.sequence = 0;
+			}
+			return;
+		}
+		return;
+	}
+
+	// An update that passed through us, the acknowledgement is merged with the ones of our other branches
+	for (u32 i = 0; i < ALARM_MODULE_ACK_SLOTS; i++)
+	{
+		PendingAlarmAck& pending = pendingAcks[i];
+		if (pending.originator != ack.originator || pending.sequence != ack.sequence) continue;
+
+		if (MergeBranchAck(pending.branches, sender, ack.ackCount))
+		{
+			pending.changed = true;
+			if (AreBranchesAcked(pending.branches, pending.upstreamPartnerId))
+			{
+				SendAlarmUpdateAck(pending);
+			}
+		}
+		return;
+	}
+}
+
+//Remembers the highest count of a branch, acknowledgements of a branch can arrive more than once
+bool AlarmModule::MergeBranchAck(AlarmAckBranch* branches, NodeId partnerId, u16 ackCount)
+{
+	AlarmAckBranch* slot = nullptr;
+	for (u32 i = 0; i < TOTAL_NUM_CONNECTIONS; i++)
+	{
+		if (branches[i].partnerId == partnerId)
+		{
+			slot = &branches[i];
+			break;
+		}
+		if (slot == nullptr && branches[i].partnerId == 0)
+		{
+			slot = &branches[i];
+		}
+	}
+	if (slot == nullptr || (slot->partnerId == partnerId && slot->ackCount >= ackCount)) return false;
+
+	slot->partnerId = partnerId;
+	slot->ackCount = ackCount;
+	return true;
+}
+
+u16 AlarmModule::GetBranchAckCount(const AlarmAckBranch* branches, NodeId partnerId)
+{
+	for (u32 i = 0; i < TOTAL_NUM_CONNECTIONS; i++)
+	{
+		if (branches[i].partnerId == partnerId && partnerId != 0) return branches[i].ackCount;
+	}
+	return 0;
+}
+
+u16 AlarmModule::GetMergedAckCount(const AlarmAckBranch* branches)
+{
+	u16 ackCount = 0;
+	for (u32 i = 0; i < TOTAL_NUM_CONNECTIONS; i++)
+	{
+		ackCount += branches[i].ackCount;
+	}
+	return ackCount;
+}
+
+bool AlarmModule::AreBranchesAcked(const AlarmAckBranch* branches, NodeId ignoredPartnerId)
+{
+	MeshConnections connections = GS->cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (u32 i = 0; i < connections.count; i++)
+	{
+		MeshConnection* connection = connections.connections[i];
+		if (!connection->handshakeDone() || connection->partnerId == ignoredPartnerId) continue;
+		if (GetBranchAckCount(branches, connection->partnerId) < connection->GetConnectedClusterSize()) return false;
+	}
+	return true;
+}
+
+void AlarmModule::QueueAlarmUpdateAck(NodeId originator, u8 sequence, NodeId upstreamPartnerId)
+{
+	// If all slots are in use, the oldest partial acknowledgement is sent and its slot reused
+	PendingAlarmAck* slot = nullptr;
+	for (u32 i = 0; i < ALARM_MODULE_ACK_SLOTS; i++)
+	{
+		if (pendingAcks[i].originator == 0)
+		{
+			slot = &pendingAcks[i];
+			break;
+		}
+		if (slot == nullptr || pendingAcks[i].expiresDs < slot->expiresDs)
+		{
+			slot = &pendingAcks[i];
+		}
+	}
+	if (slot->originator != 0 && slot->changed)
+	{
+		SendAlarmUpdateAck(*slot);
+	}
+
+	CheckedMemset(slot, 0x00, sizeof(*slot));
+	slot->originator = originator;
+	slot->sequence = sequence;
+	slot->upstreamPartnerId = upstreamPartnerId;
+	slot->changed = true;
+	slot->sendDs = GS->appTimerDs + ALARM_MODULE_ACK_DELAY_DS;
+	slot->expiresDs = GS->appTimerDs + ALARM_MODULE_RELIABLE_TIMEOUT_DS;
+
+	// Nodes at the end of the tree have no branches to wait for
+	if (AreBranchesAcked(slot->branches, upstreamPartnerId))
+	{
+		SendAlarmUpdateAck(*slot);
+	}
+}
+
+void AlarmModule::SendAlarmUpdateAck(NodeId receiver, NodeId originator, u8 sequence, u16 ackCount) const
+{
+	AlarmModuleUpdateAckMessage message;
+	message.originator = originator;
+	message.ackCount = ackCount;
+	message.sequence = sequence;
+
+	SendModuleActionMessage(MessageType::MODULE_ACTION_RESPONSE,
+							receiver,
+							(u8)AlarmModuleActionResponseMessages::ALARM_SYSTEM_UPDATE_ACK,
+							0,
+							(u8 *)&message,
+							SIZEOF_ALARM_MODULE_UPDATE_ACK_MESSAGE,
+							false,
+							false,
+							DeliveryPriority::MEDIUM);
+}
+
+//Sends our own acknowledgement together with the ones of our branches, the slot is freed once all branches answered
+void AlarmModule::SendAlarmUpdateAck(PendingAlarmAck& ack)
+{
+	if (ack.originator == 0) return;
+
+	SendAlarmUpdateAck(ack.upstreamPartnerId, ack.originator, ack.sequence, 1 + GetMergedAckCount(ack.branches));
+	ack.changed = false;
+
+	if (AreBranchesAcked(ack.branches, ack.upstreamPartnerId))
+	{
+		ack.originator = 0;
+	}
+}
+
+void AlarmModule::SendAlarmUpdateAcks()
+{
+	for (u32 i = 0; i < ALARM_MODULE_ACK_SLOTS; i++)
+	{
+		PendingAlarmAck& ack = pendingAcks[i];
+		if (ack.originator == 0) continue;
+
+		if (ack.changed && GS->appTimerDs >= ack.sendDs)
+		{
+			SendAlarmUpdateAck(ack);
+		}
+		// Branches that did not answer until now are not waited for any longer
+		if (GS->appTimerDs >= ack.expiresDs)
+		{
+			ack.originator = 0;
+		}
+	}
+}
+
+#define _________________INCIDENT_TABLE____________
+
+AlarmIncidentTable::AlarmIncidentTable()
+{
+	Clear();
+}
+
+void AlarmIncidentTable::Clear()
+{
+	CheckedMemset(incidents, 0x00, sizeof(incidents));
+	count = 0;
+}
+
+u16 AlarmIncidentTable::GetKey(u8 incidentType, u8 lane, u8 nodeId)
+{
+	return ((u16)incidentType << 9) | ((u16)(lane & 1) << 8) | nodeId;
+}
+
+u8 AlarmIncidentTable::LowerBound(u16 key) const
+{
+	u8 low = 0;
+	u8 high = count;
+	while (low < high)
+	{
+		const u8 middle = (low + high) / 2;
+		if (GetKey(incidents[middle].incidentType, incidents[middle].lane, incidents[middle].nodeId) < key)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+void AlarmIncidentTable::RemoveAt(u8 index)
+{
+	for (u8 i = index; i + 1 < count; i++)
+	{
+		incidents[i] = incidents[i + 1];
+	}
+	count--;
+	CheckedMemset(&incidents[count], 0x00, sizeof(AlarmIncident));
+}
+
+bool AlarmIncidentTable::Save(u8 incidentType, u8 nodeId, NodeId ownNodeId, u32 lastSeenDs)
+{
+	const u8 lane = nodeId % 2;
+	const u16 key = GetKey(incidentType, lane, nodeId);
+	u8 index = LowerBound(key);
+
+	if (index < count && GetKey(incidents[index].incidentType, incidents[index].lane, incidents[index].nodeId) == key)
+	{
+		if (lastSeenDs > incidents[index].lastSeenDs) incidents[index].lastSeenDs = lastSeenDs;
+		return true;
+	}
+
+	if (count >= ALARM_MODULE_INCIDENT_TABLE_SIZE)
+	{
+		u8 farthestIndex = 0;
+		u32 farthestDistance = 0;
+		for (u8 i = 0; i < count; i++)
+		{
+			const u32 distance = abs((i32)incidents[i].nodeId - (i32)ownNodeId);
+			if (distance > farthestDistance)
+			{
+				farthestIndex = i;
+				farthestDistance = distance;
+			}
+		}
+		if ((u32)abs((i32)nodeId - (i32)ownNodeId) >= farthestDistance)
+		{
+			return false;
+		}
+		RemoveAt(farthestIndex);
+		index = LowerBound(key);
+	}
+
+	for (u8 i = count; i > index; i--)
+	{
+		incidents[i] = incidents[i - 1];
+	}
+	incidents[index].incidentType = incidentType;
+	incidents[index].lane = lane;
+	incidents[index].nodeId = nodeId;
+	incidents[index].reserved = 0;
+	incidents[index].lastSeenDs = lastSeenDs;
+	count++;
+
+	return true;
+}
+
+bool AlarmIncidentTable::Delete(u8 incidentType, u8 nodeId)
+{
+	const u16 key = GetKey(incidentType, nodeId % 2, nodeId);
+	const u8 index = LowerBound(key);
+
+	if (index < count && GetKey(incidents[index].incidentType, incidents[index].lane, incidents[index].nodeId) == key)
+	{
+		RemoveAt(index);
+		return true;
+	}
+	return false;
+}
+
+const AlarmIncident* AlarmIncidentTable::Find(u8 incidentType, u8 nodeId) const
+{
+	const u16 key = GetKey(incidentType, nodeId % 2, nodeId);
+	const u8 index = LowerBound(key);
+
+	if (index < count && GetKey(incidents[index].incidentType, incidents[index].lane, incidents[index].nodeId) == key)
+	{
+		return &incidents[index];
+	}
+	return nullptr;
+}
+
+void AlarmIncidentTable::RemoveExpired(u32 maxAgeDs)
+{
+	u8 i = 0;
+	while (i < count)
+	{
+		if (GS->appTimerDs - incidents[i].lastSeenDs > maxAgeDs)
+		{
+			RemoveAt(i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+u8 AlarmIncidentTable::GetFirstAtOrAbove(u8 incidentType, u8 lane, NodeId minNodeId) const
+{
+	if (minNodeId > 0xFF) return 0;
+
+	const u8 index = LowerBound(GetKey(incidentType, lane, minNodeId));
+	if (index < count && incidents[index].incidentType == incidentType && incidents[index].lane == lane)
+	{
+		return incidents[index].nodeId;
+	}
+	return 0;
+}
+
+u8 AlarmIncidentTable::GetLastAtOrBelow(u8 incidentType, u8 lane, NodeId maxNodeId) const
+{
+	if (maxNodeId > 0xFF) maxNodeId = 0xFF;
+
+	//The key after maxNodeId might already belong to the next lane or type, which is still the correct bound
+	const u8 index = LowerBound(GetKey(incidentType, lane, maxNodeId) + 1);
+	if (index > 0 && incidents[index - 1].incidentType == incidentType && incidents[index - 1].lane == lane)
+	{
+		return incidents[index - 1].nodeId;
+	}
+	return 0;
+}
+
+u8 AlarmIncidentTable::GetCount() const
+{
+	return count;
+}
+
+const AlarmIncident& AlarmIncidentTable::operator[](u8 index) const
+{
+	return incidents[index];
+}
+
+#define _________________TRAFFIC_JAM_DETECTOR____________
+
+TrafficJamDetector::TrafficJamDetector()
+{
+	dwellBuckets = 1;
+	minDwellingVehicles = 1;
+	Reset();
+}
+
+void TrafficJamDetector::Configure(u8 dwellBuckets, u8 minDwellingVehicles)
+{
+	if (dwellBuckets < 1) dwellBuckets = 1;
+	if (dwellBuckets > ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT - 1) dwellBuckets = ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT - 1;
+	this->dwellBuckets = dwellBuckets;
+	this->minDwellingVehicles = minDwellingVehicles > 0 ? minDwellingVehicles : 1;
+}
+
+void TrafficJamDetector::Reset()
+{
+	CheckedMemset(deviceIds, 0x00, sizeof(deviceIds));
+	CheckedMemset(deviceCount, 0x00, sizeof(deviceCount));
+	CheckedMemset(dwellingCount, 0x00, sizeof(dwellingCount));
+	currentBucket = 0;
+	droppedDeviceIds = 0;
+}
+
+u8 TrafficJamDetector::GetSlot(u16 deviceId)
+{
+	//Fibonacci hashing, the upper bits of the product are mixed best
+	return (u8)(((u32)deviceId * 2654435769UL) >> 24) & (ALARM_MODULE_TRAFFIC_JAM_SET_SIZE - 1);
+}
+
+bool TrafficJamDetector::Contains(u8 bucket, u16 deviceId) const
+{
+	u8 slot = GetSlot(deviceId);
+	for (u32 i = 0; i < ALARM_MODULE_TRAFFIC_JAM_SET_SIZE; i++)
+	{
+		if (deviceIds[bucket][slot] == deviceId) return true;
+		if (deviceIds[bucket][slot] == 0) return false;
+		slot = (slot + 1) & (ALARM_MODULE_TRAFFIC_JAM_SET_SIZE - 1);
+	}
+	return false;
+}
+
+void TrafficJamDetector::VehicleSeen(u16 deviceId)
+{
+	//0 marks an empty slot
+	if (deviceId == 0) return;
+
+	u8 slot = GetSlot(deviceId);
+	while (deviceIds[currentBucket][slot] != 0)
+	{
+		if (deviceIds[currentBucket][slot] == deviceId) return;
+		slot = (slot + 1) & (ALARM_MODULE_TRAFFIC_JAM_SET_SIZE - 1);
+	}
+
+	//The set is never filled more than 3/4 so that probing stays short and always finds an empty slot
+	if (deviceCount[currentBucket] >= ALARM_MODULE_TRAFFIC_JAM_SET_SIZE * 3 / 4)
+	{
+		droppedDeviceIds++;
+		return;
+	}
+
+	deviceIds[currentBucket][slot] = deviceId;
+	deviceCount[currentBucket]++;
+
+	const u8 earlierBucket = (currentBucket + ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT - dwellBuckets) % ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT;
+	if (Contains(earlierBucket, deviceId))
+	{
+		dwellingCount[currentBucket]++;
+	}
+}
+
+bool TrafficJamDetector::NextBucket()
+{
+	const bool trafficJam = dwellingCount[currentBucket] >= minDwellingVehicles;
+
+	logt("ALARMMOD", "Traffic jam bucket closed: %u vehicles, %u dwelling", deviceCount[currentBucket], dwellingCount[currentBucket]);
+
+	//The oldest bucket is reused for the next interval
+	currentBucket = (currentBucket + 1) % ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT;
+	CheckedMemset(deviceIds[currentBucket], 0x00, sizeof(deviceIds[currentBucket]));
+	deviceCount[currentBucket] = 0;
+	dwellingCount[currentBucket] = 0;
+
+	return trafficJam;
+}
+
+u32 TrafficJamDetector::GetDroppedDeviceIds() const
+{
+	return droppedDeviceIds;
 }
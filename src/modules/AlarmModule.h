@@ -40,9 +40,23 @@ using namespace std;
 #define ALARM_MODULE_TRAFFIC_JAM_DETECTION_TIME_DS 30
 #define ASSET_PACKET_BUFFER_SIZE 30
 #define ALARM_MODULE_TRAFFIC_JAM_WARNING_RANGE 50
-#define TRAFFIC_JAM_POOL_SIZE 10
-#define TRAFFIC_JAM_DETECTED 1
+#define ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT 4 //Amount of detection intervals that are remembered
+#define ALARM_MODULE_TRAFFIC_JAM_DWELL_TIME_DS 30 //A vehicle that is seen again after this time is standing in a jam, multiple of the detection time
+#define ALARM_MODULE_TRAFFIC_JAM_MIN_VEHICLES 1 //Amount of standing vehicles within one detection interval that make a traffic jam
+#ifdef NRF51
+#define ALARM_MODULE_TRAFFIC_JAM_SET_SIZE 32 //Maximum amount of vehicles per detection interval, must be a power of 2
+#else
+#define ALARM_MODULE_TRAFFIC_JAM_SET_SIZE 64
+#endif
 #define RESCUE_CAR_TIMER_INTERVAL 10
+#define ALARM_MODULE_INCIDENT_TABLE_SIZE 16
+#define ALARM_MODULE_INCIDENT_TTL_DS SEC_TO_DS(180) //Incidents that were not reported again for this long are removed
+#define ALARM_MODULE_INCIDENT_REFRESH_TIME_DS SEC_TO_DS(60) //Interval in which a node reports its own incidents again
+#define ALARM_MODULE_RELIABLE_UPDATE_SLOTS 4 //Own updates that can wait for acknowledgements at the same time
+#define ALARM_MODULE_RELIABLE_TIMEOUT_DS SEC_TO_DS(3) //Time until the first retransmission, doubled for every retry
+#define ALARM_MODULE_RELIABLE_MAX_RETRIES 3
+#define ALARM_MODULE_ACK_SLOTS 4 //Updates of other nodes for which acknowledgements can be merged at the same time
+#define ALARM_MODULE_ACK_DELAY_DS 5 //Time that a node waits for the acknowledgements of its branches before it sends a partial one
 
 //Service Data (max. 24 byte)
 #define SIZEOF_ADV_STRUCTURE_ALARM_SERVICE_DATA 19 //ToDo
@@ -74,12 +88,39 @@ typedef struct {
 }AdvPacketPenguinData;
 
 // Message from Mesh to Mesh
+#define ALARM_MODULE_UPDATE_FLAG_ACK_REQUESTED 0x01
 typedef struct {
 	u8 meshDeviceId; // node id
 	u8 meshIncidentType; // type of incident, e.g traffic jam, one of SERVICE_INCIDENT_TYPE
 	u8 meshActionType; // incident type action, e.g SAVE or DELETE, one of SERVICE_ACTION_TYPE
+	u8 flags; // ALARM_MODULE_UPDATE_FLAG_*
+	u8 reserved;
 }AlarmModuleUpdateMessage;
 
+// Acknowledgement of the update that the originator sent with the requestHandle sequence. It is sent to the
+// mesh partner that the update was received from and counts the sender and all nodes behind it that received it
+#define SIZEOF_ALARM_MODULE_UPDATE_ACK_MESSAGE 5
+typedef struct {
+	NodeId originator;
+	u16 ackCount;
+	u8 sequence;
+}AlarmModuleUpdateAckMessage;
+
+// An incident as it is exchanged between mesh partners, the age is used as the version of the entry
+#define SIZEOF_ALARM_MODULE_INCIDENT_STATE 3
+typedef struct {
+	u8 incidentType; // one of SERVICE_INCIDENT_TYPE
+	u8 nodeId;
+	u8 ageSec; // seconds since the incident was last reported, saturates at 255
+}AlarmModuleIncidentState;
+
+// Digest of all known incidents or the delta that a partner is missing
+#define SIZEOF_ALARM_MODULE_STATE_MESSAGE_HEADER 1
+typedef struct {
+	u8 count;
+	AlarmModuleIncidentState incidents[ALARM_MODULE_INCIDENT_TABLE_SIZE];
+}AlarmModuleStateMessage;
+
 #define SIZE_ADV_PACKET_CAR_DATA 11
 // Message from Car to Mesh
 typedef struct {
@@ -108,6 +149,84 @@ typedef struct
 	u8 data[SIZE_ADV_PACKET_CAR_DATA];
 }advPacketCarServiceAndDataHeader;
 
+// An incident that was reported by a node, the lane is given by the parity of the nodeId
+typedef struct
+{
+	u8 incidentType; // one of SERVICE_INCIDENT_TYPE
+	u8 lane;
+	u8 nodeId;
+	u8 reserved;
+	u32 lastSeenDs;
+}AlarmIncident;
+
+// Fixed size table of all known incidents. It is kept sorted by incidentType, lane and nodeId
+// so that the nearest incident in either direction of the road can be found with a binary search
+class AlarmIncidentTable
+{
+private:
+	AlarmIncident incidents[ALARM_MODULE_INCIDENT_TABLE_SIZE];
+	u8 count;
+
+	static u16 GetKey(u8 incidentType, u8 lane, u8 nodeId);
+	// Returns the index of the first incident whose key is not smaller than the given key
+	u8 LowerBound(u16 key) const;
+	void RemoveAt(u8 index);
+
+public:
+	AlarmIncidentTable();
+
+	void Clear();
+
+	// Adds the incident or refreshes its timestamp if lastSeenDs is newer. If the table is full, the incident that is
+	// farthest away from ownNodeId is replaced, returns false if that is the new incident itself
+	bool Save(u8 incidentType, u8 nodeId, NodeId ownNodeId, u32 lastSeenDs);
+	// Returns true if the incident was known
+	bool Delete(u8 incidentType, u8 nodeId);
+	// Returns nullptr if the incident is not in the table
+	const AlarmIncident* Find(u8 incidentType, u8 nodeId) const;
+	void RemoveExpired(u32 maxAgeDs);
+
+	// Return the nodeId of the closest incident of that type and lane at or above minNodeId
+	// or at or below maxNodeId, 0 if there is none
+	u8 GetFirstAtOrAbove(u8 incidentType, u8 lane, NodeId minNodeId) const;
+	u8 GetLastAtOrBelow(u8 incidentType, u8 lane, NodeId maxNodeId) const;
+
+	u8 GetCount() const;
+	const AlarmIncident& operator[](u8 index) const;
+};
+
+// Sliding window over the vehicles that were seen during the last detection intervals. Each interval (bucket) is an
+// open addressed hash set of deviceIds, so that a vehicle can be inserted and looked up in constant time.
+// A vehicle dwells at our node if it was already seen dwellBuckets intervals before
+class TrafficJamDetector
+{
+private:
+	u16 deviceIds[ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT][ALARM_MODULE_TRAFFIC_JAM_SET_SIZE];
+	u8 deviceCount[ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT];
+	u8 dwellingCount[ALARM_MODULE_TRAFFIC_JAM_BUCKET_COUNT];
+	u8 currentBucket;
+	u8 dwellBuckets;
+	u8 minDwellingVehicles;
+	u32 droppedDeviceIds;
+
+	static u8 GetSlot(u16 deviceId);
+	bool Contains(u8 bucket, u16 deviceId) const;
+
+public:
+	TrafficJamDetector();
+
+	// dwellBuckets is clamped so that the earlier bucket is still within the window
+	void Configure(u8 dwellBuckets, u8 minDwellingVehicles);
+	void Reset();
+
+	void VehicleSeen(u16 deviceId);
+	// Closes the current bucket and starts a new one, returns true if enough vehicles dwelled in the closed bucket
+	bool NextBucket();
+
+	// Vehicles that could not be stored because a bucket was full
+	u32 GetDroppedDeviceIds() const;
+};
+
 class AlarmModule: public Module {
 private:
 #pragma pack(push, 1)
@@ -122,7 +241,9 @@ private:
 		MA_CONNECT = 0,
 		MA_DISCONNECT = 1,
 		SET_ALARM_SYSTEM_UPDATE = 2,
-		GET_ALARM_SYSTEM_UPDATE = 3
+		GET_ALARM_SYSTEM_UPDATE = 3,
+		ALARM_STATE_DIGEST = 4,
+		ALARM_STATE_DELTA = 5
 	};
 
 	enum TrafficJamTriggerActionMessages {
@@ -134,7 +255,8 @@ private:
 	};
 
 	enum AlarmModuleActionResponseMessages {
-		ALARM_SYSTEM_UPDATE = 1
+		ALARM_SYSTEM_UPDATE = 1,
+		ALARM_SYSTEM_UPDATE_ACK = 2
 	};
 
 	enum TrafficJamActionResponseMessages {
@@ -190,12 +312,20 @@ private:
 		PEDESTRIAN = 4
 	};
 
-	u8 nearestTrafficJamNodeId;
-	u8 nearestBlackIceNodeId;
-	u8 nearestRescueLaneNodeId;
-	u8 nearestTrafficJamOppositeLaneNodeId;
-	u8 nearestBlackIceOppositeLaneNodeId;
-	u8 nearestRescueLaneOppositeLaneNodeId;
+	//All incidents that we know of, including our own
+	AlarmIncidentTable incidents;
+
+	//Returns the nodeId of the nearest relevant incident of that type on the given lane, 0 if there is none
+	u8 GetNearestIncident(SERVICE_INCIDENT_TYPE incidentType, u8 lane) const;
+	//Broadcasts all incidents that happened at our node
+	void BroadcastOwnIncidents();
+
+	//Writes all incidents of our table into the message, returns the message length
+	u16 FillAlarmStateDigest(AlarmModuleStateMessage& message) const;
+	//Sends the incidents to the partner that it is missing or only knows in an older version
+	void SendAlarmStateDelta(NodeId partnerId, const AlarmModuleStateMessage& partnerDigest, u16 partnerDigestLength);
+	//Saves the incidents of a delta, returns the amount of incidents that were new or newer than ours
+	u8 ApplyAlarmStateDelta(const AlarmModuleStateMessage& delta, u16 deltaLength, AlarmModuleStateMessage& applied);
 
 	bool trafficJamAtMyNode;
 	bool blackIceAtMyNode;
@@ -203,6 +333,67 @@ private:
 
 	u8 rescueTimer;
 
+	//Used as the requestHandle of our broadcasts so that other nodes can drop copies of them, never 0
+	u8 broadcastSequence;
+	u8 NextBroadcastSequence();
+
+	//Number of nodes behind a mesh partner that acknowledged an update
+	typedef struct
+	{
+		NodeId partnerId; //0 if unused
+		u16 ackCount;
+	} AlarmAckBranch;
+
+	//An update of our own incidents that is sent again into the branches that did not acknowledge it
+	typedef struct
+	{
+		AlarmModuleUpdateMessage message;
+		NodeId targetNodeId;
+		u8 sequence; //requestHandle of the last transmission, 0 if the slot is unused
+		u8 retries;
+		u8 sequences[ALARM_MODULE_RELIABLE_MAX_RETRIES + 1]; //requestHandles of all transmissions
+		u32 nextRetransmitDs;
+		AlarmAckBranch branches[TOTAL_NUM_CONNECTIONS];
+	} ReliableAlarmUpdate;
+
+	//Acknowledgements of an update of another node, the ones of our branches are merged before they are
+	//sent to the partner that we received the update from
+	typedef struct
+	{
+		NodeId originator; //0 if the slot is unused
+		u8 sequence;
+		bool changed; //The merged count was not sent yet
+		NodeId upstreamPartnerId;
+		u32 sendDs; //A partial acknowledgement is sent at this time if not all branches answered
+		u32 expiresDs;
+		AlarmAckBranch branches[TOTAL_NUM_CONNECTIONS];
+	} PendingAlarmAck;
+
+	ReliableAlarmUpdate reliableUpdates[ALARM_MODULE_RELIABLE_UPDATE_SLOTS];
+	PendingAlarmAck pendingAcks[ALARM_MODULE_ACK_SLOTS];
+	u16 reliableUpdatesDelivered;
+	u16 reliableUpdatesFailed;
+
+	void SendAlarmUpdate(const AlarmModuleUpdateMessage& message, NodeId targetNodeId, u8 sequence) const;
+	//Sends the update only into the branch of the mesh behind the given connection
+	void SendAlarmUpdate(const AlarmModuleUpdateMessage& message, u8 sequence, MeshConnection* connection) const;
+	void StartReliableAlarmUpdate(const AlarmModuleUpdateMessage& message, NodeId targetNodeId, u8 sequence);
+	//Number of acknowledgements after which the update counts as delivered
+	static u16 GetExpectedAckCount(const ReliableAlarmUpdate& update);
+	void RetransmitReliableAlarmUpdates();
+	void ReceivedAlarmUpdateAck(NodeId sender, const AlarmModuleUpdateAckMessage& ack);
+
+	static bool MergeBranchAck(AlarmAckBranch* branches, NodeId partnerId, u16 ackCount);
+	static u16 GetBranchAckCount(const AlarmAckBranch* branches, NodeId partnerId);
+	static u16 GetMergedAckCount(const AlarmAckBranch* branches);
+	//Checks if all nodes behind our mesh partners, except the given one, acknowledged
+	static bool AreBranchesAcked(const AlarmAckBranch* branches, NodeId ignoredPartnerId);
+
+	void QueueAlarmUpdateAck(NodeId originator, u8 sequence, NodeId upstreamPartnerId);
+	void SendAlarmUpdateAck(NodeId receiver, NodeId originator, u8 sequence, u16 ackCount) const;
+	void SendAlarmUpdateAck(PendingAlarmAck& ack);
+	void SendAlarmUpdateAcks();
+
 	AlarmModuleConfiguration configuration;
 	AdvJob* alarmJobHandle;
 	u8 currentAdvChannel;
@@ -211,9 +402,7 @@ private:
 	u8 lastClusterSize;
 	u8 gpioState;
 
-	u8 trafficJamInterval;
-	SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> trafficJamPool1;
-	SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> trafficJamPool2;
+	TrafficJamDetector trafficJamDetector;
 
 #pragma pack(pop)
 
@@ -221,6 +410,10 @@ public:
 	AlarmModule();
 	void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader);
 
+	void MeshConnectionChangedHandler(MeshConnection& connection) override;
+
+	RoutingDecision MessageRoutingInterceptor(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader) override;
+
 	void ButtonHandler(u8 buttonId, u32 holdTimeDs);
 
 	void ConfigurationLoadedHandler();
@@ -229,9 +422,8 @@ public:
 
 	void BroadcastPenguinAdvertisingPacket();
 
-	void BroadcastAlarmUpdatePacket(u8 incidentNodeId, SERVICE_INCIDENT_TYPE incidentType, SERVICE_ACTION_TYPE incidentAction, NodeId targetNodeId = 0);
-
-	void RequestAlarmUpdatePacket();
+	//A reliable update is retransmitted until all nodes of the cluster (or the target) have acknowledged it
+	void BroadcastAlarmUpdatePacket(u8 incidentNodeId, SERVICE_INCIDENT_TYPE incidentType, SERVICE_ACTION_TYPE incidentAction, NodeId targetNodeId = 0, bool reliable = false);
 
 	bool UpdateSavedIncident(u8 incidentNodeId, u8 incidentType, u8 actionType);
 
@@ -246,10 +438,9 @@ public:
 	void BlinkGreenLed();
 
 	void UpdateGpioState();
-	
-	u8 intersection(SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> a, SimpleArray<u16, TRAFFIC_JAM_POOL_SIZE> b);
 
-	virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) override;
+
+	virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) override;
 
 	bool isMyDirection(u8 direction);
 };
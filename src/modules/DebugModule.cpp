@@ -100,6 +100,7 @@ void DebugModule::SendStatistics(NodeId receiver) const
 	infoMessage.sentPacketsUnreliable = GS->cm.sentMeshPacketsUnreliable;
 	infoMessage.sentPacketsReliable = GS->cm.sentMeshPacketsReliable;
 	infoMessage.droppedPackets = GS->cm.droppedMeshPackets;
+	infoMessage.shedPackets = GS->cm.shedMeshPackets;
 	infoMessage.connectionLossCounter = GS->node.connectionLossCounter;
 
 	SendModuleActionMessage(
@@ -1014,6 +1015,9 @@ void DebugModule::MeshMessageReceivedHandler(BaseConnection* connection, BaseCon
 
 				logjson("DEBUGMOD", "{\"nodeId\":%u,\"type\":\"debug_stats\", \"conLoss\":%u,", packet->header.sender, infoMessage->connectionLossCounter);
 				logjson("DEBUGMOD", "\"dropped\":%u,", infoMessage->droppedPackets);
+				if (sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE + SIZEOF_DEBUG_MODULE_INFO_MESSAGE) {
+					logjson("DEBUGMOD", "\"shed\":%u,", infoMessage->shedPackets);
+				}
 				logjson("DEBUGMOD", "\"sentRel\":%u,\"sentUnr\":%u}" SEP, infoMessage->sentPacketsReliable, infoMessage->sentPacketsUnreliable);
 			}
 			else if(actionType == DebugModuleActionResponseMessages::PING_RESPONSE){
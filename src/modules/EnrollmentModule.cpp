@@ -61,6 +61,9 @@ EnrollmentModule::EnrollmentModule()
 	configurationPointer = &configuration;
 	configurationLength = sizeof(EnrollmentModuleConfiguration);
 
+	//Nearby beacons are found through their MeshAccess advertising
+	SubscribeToAdvertisements(AdvertisementSubscriptionType::SERVICE_DATA, SERVICE_DATA_SERVICE_UUID16, SERVICE_DATA_MESSAGE_TYPE_MESH_ACCESS);
+
 	//Set defaults
 	ResetToDefaultConfiguration();
 }
@@ -768,26 +771,25 @@ void EnrollmentModule::ButtonHandler(u8 buttonId, u32 holdTimeDs)
 #endif
 
 
-void EnrollmentModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent)
+void EnrollmentModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index)
 {
 	if(!configuration.moduleActive) return;
 
 	fh_ble_gap_addr_t addr;
 	memcpy(addr.addr, advertisementReportEvent.getPeerAddr(), BLE_GAP_ADDR_LEN);
 	addr.addr_type = advertisementReportEvent.getPeerAddrType();
-	const u8* data = advertisementReportEvent.getData();
-	u16 dataLength = advertisementReportEvent.getDataLength();
 
-	const meshAccessServiceAdvMessage* message = (const meshAccessServiceAdvMessage*) data;
+	//The uuid and messageType of the service data were already checked with our subscription
+	const meshAccessServiceAdvMessage* message = (const meshAccessServiceAdvMessage*) index.data;
 
 	//Check if this is a connectable mesh access packet
 	if (
 		advertisementReportEvent.isConnectable()
 		&& advertisementReportEvent.getRssi() > STABLE_CONNECTION_RSSI_THRESHOLD
-		&& dataLength >= SIZEOF_MESH_ACCESS_SERVICE_DATA_ADV_MESSAGE
+		&& index.dataLength >= SIZEOF_MESH_ACCESS_SERVICE_DATA_ADV_MESSAGE
+		&& index.serviceData == (const u8*)&message->serviceData
 		&& message->flags.type == BLE_GAP_AD_TYPE_FLAGS
 		&& message->serviceUuids.uuid == SERVICE_DATA_SERVICE_UUID16
-		&& message->serviceData.messageType == SERVICE_DATA_MESSAGE_TYPE_MESH_ACCESS
 	){
 		//Check if the nearby serial is in our proposal list and save it if it is not
 		//This will ensure that the list of proposals is always changing "randomly"
@@ -198,7 +198,7 @@ class EnrollmentModule: public Module
 
 		void TimerEventHandler(u16 passedTimeDs) override;
 
-		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) override;
+		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) override;
 
 		void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader) override;
 
@@ -50,6 +50,10 @@ MeshAccessModule::MeshAccessModule()
 	discoveryJobHandle = nullptr;
 	logNearby = false;
 	gattRegistered = false;
+	CheckedMemset(sessionTickets, 0x00, sizeof(sessionTickets));
+
+	//Only used to log nearby beacons
+	SubscribeToAdvertisements(AdvertisementSubscriptionType::SERVICE_DATA, SERVICE_DATA_SERVICE_UUID16, SERVICE_DATA_MESSAGE_TYPE_MESH_ACCESS);
 
 	//Set defaults
 	ResetToDefaultConfiguration();
@@ -582,22 +586,14 @@ bool MeshAccessModule::TerminalCommandHandler(char* commandArgs[], u8 commandArg
 }
 #endif
 
-void MeshAccessModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent)
+void MeshAccessModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index)
 {
 #if IS_INACTIVE(GW_SAVE_SPACE)
 	if(logNearby){
-		const advPacketServiceAndDataHeader* packet = (const advPacketServiceAndDataHeader*)advertisementReportEvent.getData();
-		const advStructureMeshAccessServiceData* maPacket = (const advStructureMeshAccessServiceData*)&packet->data;
-
-		//Check if the advertising packet is an asset packet
-		if (
-				advertisementReportEvent.getDataLength() >= SIZEOF_ADV_STRUCTURE_MESH_ACCESS_SERVICE_DATA
-				&& packet->flags.len == SIZEOF_ADV_STRUCTURE_FLAGS-1
-				&& packet->uuid.len == SIZEOF_ADV_STRUCTURE_UUID16-1
-				&& packet->data.type == BLE_GAP_AD_TYPE_SERVICE_DATA
-				&& packet->data.uuid == SERVICE_DATA_SERVICE_UUID16
-				&& packet->data.messageType == SERVICE_DATA_MESSAGE_TYPE_MESH_ACCESS
-		){
+		//The uuid and messageType of the service data were already checked with our subscription
+		const advStructureMeshAccessServiceData* maPacket = (const advStructureMeshAccessServiceData*)index.serviceData;
+
+		if (index.serviceDataLength >= SIZEOF_ADV_STRUCTURE_MESH_ACCESS_SERVICE_DATA){
 			char serialNumber[6];
 			Utility::GenerateBeaconSerialForIndex(maPacket->serialIndex, serialNumber);
 
@@ -629,3 +625,65 @@ bool MeshAccessModule::IsZeroKeyConnectable(const ConnectionDirection direction)
 		|| direction == ConnectionDirection::DIRECTION_OUT)
 		&& allowUnenrolledUnsecureConnections;
 }
+
+#define ________________________SESSION_TICKETS_________________________
+
+MeshAccessSessionTicket* MeshAccessModule::FindSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId)
+{
+	for(u32 i=0; i<MESH_ACCESS_SESSION_TICKET_CACHE_SIZE; i++){
+		MeshAccessSessionTicket& ticket = sessionTickets[i];
+		if(ticket.valid
+			&& ticket.fmKeyId == fmKeyId
+			&& memcmp(&ticket.partnerAddress, &partnerAddress, FH_BLE_SIZEOF_GAP_ADDR) == 0)
+		{
+			//Expired tickets are removed once they are looked up
+			if(GS->appTimerDs - ticket.storedDs > MESH_ACCESS_SESSION_TICKET_TIMEOUT_DS){
+				ticket.valid = false;
+				return nullptr;
+			}
+			return &ticket;
+		}
+	}
+	return nullptr;
+}
+
+const u8* MeshAccessModule::GetSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId)
+{
+	MeshAccessSessionTicket* ticket = FindSessionTicket(partnerAddress, fmKeyId);
+	return ticket != nullptr && !ticket->suspended ? ticket->longTermKey : nullptr;
+}
+
+void MeshAccessModule::StoreSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId, const u8* longTermKey)
+{
+	//Refresh an existing ticket, otherwise use a free slot or replace the oldest ticket
+	MeshAccessSessionTicket* ticket = FindSessionTicket(partnerAddress, fmKeyId);
+	for(u32 i=0; i<MESH_ACCESS_SESSION_TICKET_CACHE_SIZE && ticket == nullptr; i++){
+		if(!sessionTickets[i].valid) ticket = &sessionTickets[i];
+	}
+	if(ticket == nullptr){
+		ticket = &sessionTickets[0];
+		for(u32 i=1; i<MESH_ACCESS_SESSION_TICKET_CACHE_SIZE; i++){
+			if(GS->appTimerDs - sessionTickets[i].storedDs > GS->appTimerDs - ticket->storedDs) ticket = &sessionTickets[i];
+		}
+	}
+
+	logt("MAMOD", "Storing session ticket for fmKeyId %u", fmKeyId);
+
+	ticket->partnerAddress = partnerAddress;
+	ticket->fmKeyId = fmKeyId;
+	memcpy(ticket->longTermKey, longTermKey, 16);
+	ticket->storedDs = GS->appTimerDs;
+	ticket->valid = true;
+	ticket->suspended = false;
+}
+
+//An unauthenticated failure must not destroy the ticket, the next handshake with the partner is a full one
+//and stores the ticket again once it succeeds
+void MeshAccessModule::SuspendSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId)
+{
+	MeshAccessSessionTicket* ticket = FindSessionTicket(partnerAddress, fmKeyId);
+	if(ticket != nullptr){
+		logt("MAMOD", "Suspending session ticket for fmKeyId %u", fmKeyId);
+		ticket->suspended = true;
+	}
+}
@@ -158,6 +158,18 @@ enum class MeshAccessModuleGeneralMessages : u8{
 	};
 #pragma pack(pop)
 
+//A session ticket stores the long term key that was used with a partner so that a reconnect
+//can resume the session without the full handshake
+struct MeshAccessSessionTicket
+{
+	fh_ble_gap_addr_t partnerAddress;
+	u32 fmKeyId;
+	u8 longTermKey[16];
+	u32 storedDs;
+	bool valid;
+	bool suspended; //A resumption failed before the partner was authenticated, the ticket is not used until it is stored again
+};
+
 class MeshAccessModule: public Module
 {
 	public:
@@ -179,6 +191,9 @@ class MeshAccessModule: public Module
 		bool logNearby;
 		char logWildcard[6];
 
+		MeshAccessSessionTicket sessionTickets[MESH_ACCESS_SESSION_TICKET_CACHE_SIZE];
+		MeshAccessSessionTicket* FindSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId);
+
 
 		void BroadcastMeshAccessPacket();
 
@@ -215,9 +230,15 @@ class MeshAccessModule: public Module
 		#ifdef TERMINAL_ENABLED
 		bool TerminalCommandHandler(char* commandArgs[], u8 commandArgsSize) override;
 		#endif
-		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) override;
+		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) override;
 
 		bool IsZeroKeyConnectable(const ConnectionDirection direction);
 
+		//Session tickets
+		//Returns the cached long term key for the partner or nullptr if there is no valid ticket
+		const u8* GetSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId);
+		void StoreSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId, const u8* longTermKey);
+		void SuspendSessionTicket(const fh_ble_gap_addr_t& partnerAddress, u32 fmKeyId);
+
 };
 
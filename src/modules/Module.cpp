@@ -45,12 +45,58 @@ Module::Module(ModuleId moduleId, const char* name)
 	//Overwritten by Modules
 	this->configurationPointer = nullptr;
 	this->configurationLength = 0;
+
+	this->advertisementSubscriptionCount = 0;
 }
 
 Module::~Module()
 {
 }
 
+void Module::SubscribeToAdvertisements(AdvertisementSubscriptionType type, u16 uuid, u16 messageType, u8 adType)
+{
+	if (advertisementSubscriptionCount >= MODULE_MAX_ADVERTISEMENT_SUBSCRIPTIONS)
+	{
+		SIMEXCEPTION(IllegalStateException); //LCOV_EXCL_LINE assertion
+		return;
+	}
+
+	AdvertisementSubscription& subscription = advertisementSubscriptions[advertisementSubscriptionCount];
+	subscription.type = type;
+	subscription.adType = adType;
+	subscription.uuid = uuid;
+	subscription.messageType = messageType;
+	advertisementSubscriptionCount++;
+}
+
+void Module::SubscribeToMeshAdvertisements(u16 messageType)
+{
+	SubscribeToAdvertisements(AdvertisementSubscriptionType::MESH_MESSAGE, 0, messageType);
+}
+
+bool Module::IsSubscribedTo(const AdvertisementReportIndex& index) const
+{
+	for (u32 i = 0; i < advertisementSubscriptionCount; i++)
+	{
+		const AdvertisementSubscription& subscription = advertisementSubscriptions[i];
+		switch (subscription.type)
+		{
+			case AdvertisementSubscriptionType::MESH_MESSAGE:
+				if (index.isMeshPacket
+					&& (subscription.messageType == ADV_SUBSCRIPTION_ANY_MESSAGE_TYPE || subscription.messageType == index.meshMessageType)) return true;
+				break;
+			case AdvertisementSubscriptionType::SERVICE_DATA:
+				if (index.serviceData != nullptr && index.serviceDataUuid == subscription.uuid
+					&& (subscription.messageType == ADV_SUBSCRIPTION_ANY_MESSAGE_TYPE || subscription.messageType == index.serviceDataMessageType)) return true;
+				break;
+			case AdvertisementSubscriptionType::AD_STRUCTURE:
+				if (index.FindStructure(subscription.adType, subscription.uuid) != nullptr) return true;
+				break;
+		}
+	}
+	return false;
+}
+
 void Module::LoadModuleConfigurationAndStart()
 {
 	//Load the configuration and replace the default configuration if it exists
@@ -65,8 +111,13 @@ void Module::SendModuleActionMessage(MessageType messageType, NodeId toNode, u8
 	SendModuleActionMessage(messageType, toNode, actionType, requestHandle, additionalData, additionalDataSize, reliable, true);
 }
 
-//Constructs a simple trigger action message and can take aditional payload data
 void Module::SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool loopback) const
+{
+	SendModuleActionMessage(messageType, toNode, actionType, requestHandle, additionalData, additionalDataSize, reliable, loopback, DeliveryPriority::LOW);
+}
+
+//Constructs a simple trigger action message and can take aditional payload data
+void Module::SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool loopback, DeliveryPriority priority) const
 {
 	DYNAMIC_ARRAY(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize);
 
@@ -85,7 +136,7 @@ void Module::SendModuleActionMessage(MessageType messageType, NodeId toNode, u8
 	}
 
 	//TODO: reliable is currently not supported and by default false. The input is ignored
-	GS->cm.SendMeshMessageInternal(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize, DeliveryPriority::LOW, false, loopback, true);
+	GS->cm.SendMeshMessageInternal(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize, priority, false, loopback, true);
 }
 
 #ifdef TERMINAL_ENABLED
@@ -58,6 +58,7 @@ constexpr int INVALID_U32_CONFIG = 0xFFFFFFFF;
 #include <Terminal.h>
 #include <RecordStorage.h>
 #include <MeshConnection.h>
+#include <ScanController.h>
 #include <BaseConnection.h>
 
 enum class CapabilityEntryType : u8
@@ -96,6 +97,16 @@ protected:
 		//This must be called in the constructor to reset all values to default
 		virtual void ResetToDefaultConfiguration() = 0;
 
+		//Modules only receive the advertisement reports that they subscribed to, this should be called in the constructor
+		//messageType can be ADV_SUBSCRIPTION_ANY_MESSAGE_TYPE, adType is only used for AD_STRUCTURE subscriptions
+		void SubscribeToAdvertisements(AdvertisementSubscriptionType type, u16 uuid, u16 messageType, u8 adType = 0);
+		//Mesh advertising packets of our network do not have a uuid, they are only matched by their messageType
+		void SubscribeToMeshAdvertisements(u16 messageType);
+
+	private:
+		AdvertisementSubscription advertisementSubscriptions[MODULE_MAX_ADVERTISEMENT_SUBSCRIPTIONS];
+		u8 advertisementSubscriptionCount;
+
 
 	public:
 		const ModuleId moduleId;
@@ -137,6 +148,7 @@ protected:
 		void LoadModuleConfigurationAndStart();
 
 		//Constructs a simple TriggerAction message and sends it
+		void SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool loopback, DeliveryPriority priority) const;
 		void SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool loopback) const;
 		void SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable) const;
 
@@ -159,8 +171,12 @@ protected:
 		//This handler receives all timer events
 		virtual void TimerEventHandler(u16 passedTimeDs){};
 
+		//Checks the already parsed report against the subscriptions of the module
+		bool IsSubscribedTo(const AdvertisementReportIndex& index) const;
+
 		//This handler receives all ble events and can act on them
-		virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) {};
+		//Advertisement reports are only passed if they match one of the subscriptions of the module
+		virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) {};
 		virtual void GapConnectedEventHandler(const GapConnectedEvent& connectedEvent) {};
 		virtual void GapDisconnectedEventHandler(const GapDisconnectedEvent& disconnectedEvent) {};
 		virtual void GattDataTransmittedEventHandler(const GattDataTransmittedEvent& gattDataTransmittedEvent) {};
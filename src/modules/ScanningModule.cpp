@@ -57,6 +57,8 @@ ScanningModule::ScanningModule() :
 	configurationPointer = &configuration;
 	configurationLength = sizeof(ScanningModuleConfiguration);
 
+	SubscribeToAdvertisements(AdvertisementSubscriptionType::SERVICE_DATA, SERVICE_DATA_SERVICE_UUID16, SERVICE_DATA_MESSAGE_TYPE_ASSET);
+
 	//Initialize scanFilters as empty
 	for (int i = 0; i < SCAN_FILTER_NUMBER; i++)
 	{
@@ -159,12 +161,12 @@ void ScanningModule::MeshMessageReceivedHandler(BaseConnection* connection, Base
 }
 
 
-void ScanningModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent)
+void ScanningModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index)
 {
 	if (!configuration.moduleActive) return;
 
 #if IS_INACTIVE(GW_SAVE_SPACE)
-	HandleAssetV2Packets(advertisementReportEvent);
+	HandleAssetV2Packets(advertisementReportEvent, index);
 #endif
 }
 
@@ -172,20 +174,13 @@ void ScanningModule::GapAdvertisementReportEventHandler(const GapAdvertisementRe
 
 #if IS_INACTIVE(GW_SAVE_SPACE)
 //This function checks whether we received an assetV2 packet
-void ScanningModule::HandleAssetV2Packets(const GapAdvertisementReportEvent& advertisementReportEvent)
+void ScanningModule::HandleAssetV2Packets(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index)
 {
-	const advPacketServiceAndDataHeader* packet = (const advPacketServiceAndDataHeader*)advertisementReportEvent.getData();
-	const advPacketAssetServiceData* assetPacket = (const advPacketAssetServiceData*)&packet->data;
+	//The uuid and messageType of the service data were already checked with our subscription
+	const advPacketAssetServiceData* assetPacket = (const advPacketAssetServiceData*)index.serviceData;
 
 	//Check if the advertising packet is an asset packet
-	if (
-			advertisementReportEvent.getDataLength() >= SIZEOF_ADV_STRUCTURE_ASSET_SERVICE_DATA
-			&& packet->flags.len == SIZEOF_ADV_STRUCTURE_FLAGS-1
-			&& packet->uuid.len == SIZEOF_ADV_STRUCTURE_UUID16-1
-			&& packet->data.type == BLE_GAP_AD_TYPE_SERVICE_DATA
-			&& packet->data.uuid == SERVICE_DATA_SERVICE_UUID16
-			&& packet->data.messageType == SERVICE_DATA_MESSAGE_TYPE_ASSET
-	){
+	if (index.serviceDataLength >= SIZEOF_ADV_STRUCTURE_ASSET_SERVICE_DATA){
 		char serial[6];
 		Utility::GenerateBeaconSerialForIndex(assetPacket->serialNumberIndex, serial);
 		logt("SCANMOD", "RX ASSETV2 ADV: serial %s, pressure %u, speed %u, temp %u, humid %u, cn %u, rssi %d",
@@ -167,7 +167,7 @@ class ScanningModule: public Module
 
 
 		//Asset packet handling
-		void HandleAssetV2Packets(const GapAdvertisementReportEvent& advertisementReportEvent);
+		void HandleAssetV2Packets(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index);
 		bool addTrackedAsset(const advPacketAssetServiceData* packet, i8 rssi);
 		void ReceiveTrackedAssets(BaseConnectionSendData* sendData, ScanModuleTrackedAssetsV2Message* packet) const;
 
@@ -214,7 +214,7 @@ class ScanningModule: public Module
 
 		void TimerEventHandler(u16 passedTimeDs) override;
 
-		virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) override;
+		virtual void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) override;
 
 		void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader) override;
 
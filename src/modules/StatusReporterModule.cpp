@@ -45,6 +45,9 @@ StatusReporterModule::StatusReporterModule()
 	: Module(ModuleId::STATUS_REPORTER_MODULE, "status")
 {
 	isADCInitialized = false;
+	eventLogStreamReceiver = 0;
+	eventLogStreamSequenceNumber = 0;
+	eventLogStreamRemainingEntries = 0;
 	this->batteryVoltageDv = 0;
 	number_of_adc_channels = 0;
 	//Register callbacks n' stuff
@@ -53,6 +56,9 @@ StatusReporterModule::StatusReporterModule()
 	configurationPointer = &configuration;
 	configurationLength = sizeof(StatusReporterModuleConfiguration);
 
+	//Used to measure the rssi of nearby nodes
+	SubscribeToMeshAdvertisements(MESSAGE_TYPE_JOIN_ME_V0);
+
 	//Set defaults
 	ResetToDefaultConfiguration();
 }
@@ -103,6 +109,10 @@ void StatusReporterModule::TimerEventHandler(u16 passedTimeDs)
 		|| SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, batteryMeasurementIntervalDs)){
 		BatteryVoltageADC();
 	}
+	//EventLog
+	if(eventLogStreamRemainingEntries > 0){
+		SendEventLogEntries();
+	}
 //	//ErrorLog
 //	if(SHOULD_IV_TRIGGER(node->appTimerDs+node->appTimerRandomOffsetDs, passedTimeDs, SEC_TO_DS(4))){
 //		SendErrors(0);
@@ -286,6 +296,45 @@ void StatusReporterModule::SendErrors(NodeId toNode) const{
 }
 
 
+void StatusReporterModule::SendEventLogEntries()
+{
+	for(int i=0; i<EVENT_LOG_ENTRIES_PER_TIMER_EVENT && eventLogStreamRemainingEntries > 0; i++){
+		EventLogEntry entry;
+		if(!GS->eventLog.GetEntry(eventLogStreamSequenceNumber, &entry)){
+			eventLogStreamRemainingEntries = 0;
+			break;
+		}
+
+		SendModuleActionMessage(
+			MessageType::MODULE_ACTION_RESPONSE,
+			eventLogStreamReceiver,
+			(u8)StatusModuleActionResponseMessages::EVENT_LOG_ENTRY,
+			0,
+			(u8*)&entry,
+			SIZEOF_EVENT_LOG_ENTRY,
+			false
+		);
+
+		eventLogStreamSequenceNumber = entry.sequenceNumber + 1;
+		eventLogStreamRemainingEntries--;
+	}
+
+	if(eventLogStreamRemainingEntries == 0){
+		StatusReporterModuleEventLogEndMessage data;
+		data.nextSequenceNumber = eventLogStreamSequenceNumber;
+
+		SendModuleActionMessage(
+			MessageType::MODULE_ACTION_RESPONSE,
+			eventLogStreamReceiver,
+			(u8)StatusModuleActionResponseMessages::EVENT_LOG_END,
+			0,
+			(u8*)&data,
+			SIZEOF_STATUS_REPORTER_MODULE_EVENT_LOG_END_MESSAGE,
+			false
+		);
+	}
+}
+
 void StatusReporterModule::SendLiveReport(LiveReportTypes type, u32 extra, u32 extra2) const
 {
 	//Live reporting states are off=0, error=50, warn=100, info=150, debug=200
@@ -345,14 +394,12 @@ void StatusReporterModule::StopConnectionRSSIMeasurement(const MeshConnection& c
 }
 
 
-void StatusReporterModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent & advertisementReportEvent)
+void StatusReporterModule::GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent & advertisementReportEvent, const AdvertisementReportIndex& index)
 {
-	const u8* data = advertisementReportEvent.getData();
-	u16 dataLength = advertisementReportEvent.getDataLength();
+	const u8* data = index.data;
+	u16 dataLength = index.dataLength;
 
-	const advPacketHeader* packetHeader = (const advPacketHeader*)data;
-
-	switch (packetHeader->messageType)
+	switch (index.meshMessageType)
 	{
 	case MESSAGE_TYPE_JOIN_ME_V0:
 		if (dataLength == SIZEOF_ADV_PACKET_JOIN_ME)
@@ -515,6 +562,25 @@ bool StatusReporterModule::TerminalCommandHandler(char* commandArgs[], u8 comman
 
 					return true;
 				}
+			else if(commandArgsSize >= 4 && TERMARGS(3, "get_eventlog"))
+			{
+				//Optionally, the first sequence number and the maximum number of entries can be given
+				StatusReporterModuleGetEventLogMessage data;
+				data.firstSequenceNumber = commandArgsSize >= 5 ? strtoul(commandArgs[4], nullptr, 10) : 0;
+				data.maxEntries = commandArgsSize >= 6 ? atoi(commandArgs[5]) : 0xFFFF;
+
+				SendModuleActionMessage(
+					MessageType::MODULE_TRIGGER_ACTION,
+					destinationNode,
+					(u8)StatusModuleTriggerActionMessages::GET_EVENT_LOG,
+					0,
+					(u8*)&data,
+					SIZEOF_STATUS_REPORTER_MODULE_GET_EVENT_LOG_MESSAGE,
+					false
+				);
+
+				return true;
+			}
 			else if(commandArgsSize >= 4 && TERMARGS(3, "get_rebootreason"))
 			{
 				SendModuleActionMessage(
@@ -606,6 +672,16 @@ void StatusReporterModule::MeshMessageReceivedHandler(BaseConnection* connection
 			{
 				SendRebootReason(packet->header.sender);
 			}
+			//Starts streaming the event log, a new request replaces a running stream
+			else if(actionType == StatusModuleTriggerActionMessages::GET_EVENT_LOG)
+			{
+				StatusReporterModuleGetEventLogMessage* data = (StatusReporterModuleGetEventLogMessage*) (packet->data);
+
+				eventLogStreamReceiver = packet->header.sender;
+				eventLogStreamSequenceNumber = data->firstSequenceNumber;
+				eventLogStreamRemainingEntries = data->maxEntries;
+				if(eventLogStreamRemainingEntries == 0) SendEventLogEntries();
+			}
 		}
 	}
 
@@ -695,6 +771,21 @@ void StatusReporterModule::MeshMessageReceivedHandler(BaseConnection* connection
 #endif
 				logjson("STATUSMOD", "}" SEP);
 			}
+			else if(actionType == StatusModuleActionResponseMessages::EVENT_LOG_ENTRY)
+			{
+				EventLogEntry* data = (EventLogEntry*) (packet->data);
+
+				logjson("STATUSMOD", "{\"type\":\"event_log_entry\",\"nodeId\":%u,\"module\":%u,", packet->header.sender, (u32)moduleId);
+				logjson("STATUSMOD", "\"seq\":%u,\"time\":%u,\"event\":%u,", data->sequenceNumber, data->timestamp, (u32)data->type);
+				logjson("STATUSMOD", "\"info\":%u,\"partner\":%u,\"code\":%u", data->info, data->nodeId, data->code);
+				logjson("STATUSMOD", "}" SEP);
+			}
+			else if(actionType == StatusModuleActionResponseMessages::EVENT_LOG_END)
+			{
+				StatusReporterModuleEventLogEndMessage* data = (StatusReporterModuleEventLogEndMessage*) (packet->data);
+
+				logjson("STATUSMOD", "{\"type\":\"event_log_end\",\"nodeId\":%u,\"module\":%u,\"nextSeq\":%u}" SEP, packet->header.sender, (u32)moduleId, data->nextSequenceNumber);
+			}
 			else if(actionType == StatusModuleActionResponseMessages::REBOOT_REASON)
 			{
 				RamRetainStruct* data = (RamRetainStruct*) (packet->data);
@@ -128,6 +128,7 @@ public:
 			SET_KEEP_ALIVE = 9,
 			GET_DEVICE_INFO_V2 = 10,
 			SET_LIVEREPORTING = 11,
+			GET_EVENT_LOG = 12,
 		};
 
 		enum class StatusModuleActionResponseMessages : u8
@@ -142,6 +143,8 @@ public:
 			//DISCONNECT_REASON = 7, removed as of 21.05.2019
 			REBOOT_REASON = 8,
 			DEVICE_INFO_V2 = 10,
+			EVENT_LOG_ENTRY = 12,
+			EVENT_LOG_END = 13,
 		};
 
 		enum class StatusModuleGeneralMessages : u8
@@ -211,6 +214,25 @@ private:
 			} StatusReporterModuleErrorLogEntryMessage;
 			STATIC_ASSERT_SIZE(StatusReporterModuleErrorLogEntryMessage, 12);
 
+			//Requests the entries of the flash event log starting at the given sequence number
+			static constexpr int SIZEOF_STATUS_REPORTER_MODULE_GET_EVENT_LOG_MESSAGE = 6;
+			typedef struct
+			{
+				u32 firstSequenceNumber;
+				u16 maxEntries;
+
+			} StatusReporterModuleGetEventLogMessage;
+			STATIC_ASSERT_SIZE(StatusReporterModuleGetEventLogMessage, 6);
+
+			//Marks the end of an event log stream, the next request can continue at nextSequenceNumber
+			static constexpr int SIZEOF_STATUS_REPORTER_MODULE_EVENT_LOG_END_MESSAGE = 4;
+			typedef struct
+			{
+				u32 nextSequenceNumber;
+
+			} StatusReporterModuleEventLogEndMessage;
+			STATIC_ASSERT_SIZE(StatusReporterModuleEventLogEndMessage, 4);
+
 			static constexpr int SIZEOF_STATUS_REPORTER_MODULE_LIVE_REPORT_MESSAGE = 9;
 			typedef struct
 			{
@@ -227,6 +249,12 @@ private:
 		static constexpr int NUM_NODE_MEASUREMENTS = 20;
 		nodeMeasurement nodeMeasurements[NUM_NODE_MEASUREMENTS];
 
+		//The event log is streamed in small portions from the timer so that it does not flood the mesh
+		static constexpr int EVENT_LOG_ENTRIES_PER_TIMER_EVENT = 2;
+		NodeId eventLogStreamReceiver;
+		u32 eventLogStreamSequenceNumber;
+		u16 eventLogStreamRemainingEntries;
+
 		u8 batteryVoltageDv; //in decivolts
 		bool isADCInitialized;
 		u8 number_of_adc_channels;
@@ -246,6 +274,7 @@ private:
 		void SendAllConnections(NodeId toNode, MessageType messageType) const;
 		void SendErrors(NodeId toNode) const;
 		void SendRebootReason(NodeId toNode) const;
+		void SendEventLogEntries();
 
 		void StartConnectionRSSIMeasurement(MeshConnection& connection) const;
 		void StopConnectionRSSIMeasurement(const MeshConnection& connection) const;
@@ -276,7 +305,7 @@ private:
 
 		void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader* packetHeader) override;
 
-		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent) override;
+		void GapAdvertisementReportEventHandler(const GapAdvertisementReportEvent& advertisementReportEvent, const AdvertisementReportIndex& index) override;
 
 		void MeshConnectionChangedHandler(MeshConnection& connection) override;
 
@@ -0,0 +1,277 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH. 
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+#include <EventLog.h>
+#include <GlobalState.h>
+#include <Logger.h>
+#include <Utility.h>
+
+EventLog::EventLog()
+{
+	numPendingEvents = 0;
+	numEventsInFlight = 0;
+	firstPendingEventDs = 0;
+	numDroppedEvents = 0;
+
+	nextSequenceNumber = 1;
+	currentPage = 0;
+	writeIndex = 0;
+	pageRotationInProgress = false;
+	initialized = false;
+}
+
+EventLog & EventLog::getInstance()
+{
+	return GS->eventLog;
+}
+
+void EventLog::Init()
+{
+	if (EVENT_LOG_NUM_PAGES < 2) return;
+
+	const u16 entriesPerPage = GetEntriesPerPage();
+
+	//The newest entry is the one with the highest sequence number, new entries are appended behind it
+	bool found = false;
+	u32 newestSequenceNumber = 0;
+	for (u8 i = 0; i < EVENT_LOG_NUM_PAGES; i++) {
+		EventLogPage* page = GetPage(i);
+		if (page->magicNumber != EVENT_LOG_PAGE_MAGIC_NUMBER || page->entrySize != SIZEOF_EVENT_LOG_ENTRY) continue;
+
+		u16 numEntries = 0;
+		while (numEntries < entriesPerPage && !IsEntryEmpty(&page->entries[numEntries])) numEntries++;
+		if (numEntries == 0) continue;
+
+		u32 sequenceNumber = page->entries[numEntries - 1].sequenceNumber;
+		if (!found || sequenceNumber > newestSequenceNumber) {
+			found = true;
+			newestSequenceNumber = sequenceNumber;
+			currentPage = i;
+			writeIndex = numEntries;
+		}
+	}
+
+	if (found) {
+		nextSequenceNumber = newestSequenceNumber + 1;
+
+		//A rotation might have finished before the reboot without any entries being written to the new page
+		u8 nextPage = (currentPage + 1) % EVENT_LOG_NUM_PAGES;
+		if (writeIndex == entriesPerPage
+			&& GetPage(nextPage)->magicNumber == EVENT_LOG_PAGE_MAGIC_NUMBER
+			&& IsEntryEmpty(&GetPage(nextPage)->entries[0])
+		) {
+			currentPage = nextPage;
+			writeIndex = 0;
+		}
+	}
+	else if (GetPage(0)->magicNumber == EVENT_LOG_PAGE_MAGIC_NUMBER && GetPage(0)->entrySize == SIZEOF_EVENT_LOG_ENTRY) {
+		currentPage = 0;
+		writeIndex = 0;
+	}
+	else {
+		//The log is empty, so the first write rotates to the first page and prepares it
+		currentPage = EVENT_LOG_NUM_PAGES - 1;
+		writeIndex = entriesPerPage;
+	}
+
+	initialized = true;
+
+	logt("EVENTLOG", "EventLog page %u, entry %u, next sequence number %u", currentPage, writeIndex, nextSequenceNumber);
+}
+
+void EventLog::Log(EventLogEntryType type, u8 info, NodeId nodeId, u32 code)
+{
+	if (!initialized) return;
+
+	logt("EVENTLOG", "Event %u, info %u, nodeId %u, code %u", (u32)type, info, nodeId, code);
+
+	//Dropped events are counted and logged as soon as there is space again
+	if (numPendingEvents >= EVENT_LOG_PENDING_SIZE) {
+		numDroppedEvents++;
+		return;
+	}
+
+	AddPendingEvent(type, info, nodeId, code);
+}
+
+void EventLog::AddPendingEvent(EventLogEntryType type, u8 info, NodeId nodeId, u32 code)
+{
+	if (numPendingEvents == 0) firstPendingEventDs = GS->appTimerDs;
+
+	EventLogEntry* entry = &pendingEvents[numPendingEvents];
+	entry->sequenceNumber = nextSequenceNumber;
+	entry->timestamp = GS->node.IsInit() ? GS->timeManager.GetTime() : 0;
+	entry->type = type;
+	entry->info = info;
+	entry->nodeId = nodeId;
+	entry->code = code;
+
+	nextSequenceNumber++;
+	numPendingEvents++;
+}
+
+void EventLog::TimerEventHandler(u16 passedTimeDs)
+{
+	if (!initialized || numEventsInFlight > 0 || pageRotationInProgress) return;
+
+	if (numDroppedEvents > 0 && numPendingEvents < EVENT_LOG_PENDING_SIZE) {
+		AddPendingEvent(EventLogEntryType::EVENTS_DROPPED, 0, 0, numDroppedEvents);
+		numDroppedEvents = 0;
+	}
+
+	if (numPendingEvents < EVENT_LOG_BATCH_SIZE && (numPendingEvents == 0 || GS->appTimerDs - firstPendingEventDs < EVENT_LOG_FLUSH_INTERVAL_DS)) return;
+
+	//Events are only written while no other flash operation is queued so that the RecordStorage is not delayed,
+	//unless there is no space left for new events
+	if (GS->flashStorage.GetNumberOfActiveTasks() != 0 && numPendingEvents < EVENT_LOG_PENDING_SIZE) return;
+
+	if (writeIndex >= GetEntriesPerPage()) {
+		StartPageRotation();
+	}
+	else {
+		WritePendingEvents();
+	}
+}
+
+void EventLog::StartPageRotation()
+{
+	u8 nextPage = (currentPage + 1) % EVENT_LOG_NUM_PAGES;
+	EventLogPage* page = GetPage(nextPage);
+
+	logt("EVENTLOG", "Rotating to page %u", nextPage);
+
+	//Erase and header are queued together, so they can not fail halfway because the queue is full
+	if (GS->flashStorage.StartTransaction(2, SIZEOF_EVENT_LOG_PAGE_HEADER) != FlashStorageError::SUCCESS) return;
+
+	u16 pageHeader[2] = { EVENT_LOG_PAGE_MAGIC_NUMBER, SIZEOF_EVENT_LOG_ENTRY };
+	GS->flashStorage.ErasePage(((u32)page - FLASH_REGION_START_ADDRESS) / PAGE_SIZE, nullptr, 0);
+	GS->flashStorage.CacheAndWriteData((u32*)pageHeader, (u32*)page, SIZEOF_EVENT_LOG_PAGE_HEADER, nullptr, 0);
+
+	pageRotationInProgress = true;
+	if (GS->flashStorage.EndTransaction(this, (u32)FlashUserType::ROTATE_PAGE) != FlashStorageError::SUCCESS) {
+		pageRotationInProgress = false;
+	}
+}
+
+void EventLog::WritePendingEvents()
+{
+	u16 numEvents = GetEntriesPerPage() - writeIndex;
+	if (numEvents > numPendingEvents) numEvents = numPendingEvents;
+
+	if (GS->flashStorage.StartTransaction(1, numEvents * SIZEOF_EVENT_LOG_ENTRY) != FlashStorageError::SUCCESS) return;
+
+	GS->flashStorage.CacheAndWriteData((u32*)pendingEvents, (u32*)&GetPage(currentPage)->entries[writeIndex], numEvents * SIZEOF_EVENT_LOG_ENTRY, nullptr, 0);
+
+	numEventsInFlight = (u8)numEvents;
+	if (GS->flashStorage.EndTransaction(this, (u32)FlashUserType::WRITE_EVENTS) != FlashStorageError::SUCCESS) {
+		numEventsInFlight = 0;
+	}
+}
+
+void EventLog::FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashStorageError errorCode)
+{
+	if (task->header.userType == (u32)FlashUserType::WRITE_EVENTS) {
+		//The entries can not be written again without an erase, so they are given up if the write failed
+		if (errorCode != FlashStorageError::SUCCESS) {
+			logt("ERROR", "EventLog write failed %u", (u32)errorCode);
+			numDroppedEvents += numEventsInFlight;
+		}
+
+		writeIndex += numEventsInFlight;
+		numPendingEvents -= numEventsInFlight;
+		memmove(pendingEvents, pendingEvents + numEventsInFlight, numPendingEvents * SIZEOF_EVENT_LOG_ENTRY);
+		numEventsInFlight = 0;
+		if (numPendingEvents > 0) firstPendingEventDs = GS->appTimerDs;
+	}
+	else if (task->header.userType == (u32)FlashUserType::ROTATE_PAGE) {
+		pageRotationInProgress = false;
+
+		//If the rotation failed, it is tried again with the next write
+		if (errorCode == FlashStorageError::SUCCESS) {
+			currentPage = (currentPage + 1) % EVENT_LOG_NUM_PAGES;
+			writeIndex = 0;
+		}
+	}
+}
+
+bool EventLog::GetEntry(u32 minSequenceNumber, EventLogEntry* entry) const
+{
+	if (!initialized) return false;
+
+	bool found = false;
+	const u16 entriesPerPage = GetEntriesPerPage();
+
+	for (u8 i = 0; i < EVENT_LOG_NUM_PAGES; i++) {
+		const EventLogPage* page = GetPage(i);
+		if (page->magicNumber != EVENT_LOG_PAGE_MAGIC_NUMBER || page->entrySize != SIZEOF_EVENT_LOG_ENTRY) continue;
+
+		//Entries on a page are sorted, so the first matching one is the oldest of the page
+		for (u16 j = 0; j < entriesPerPage && !IsEntryEmpty(&page->entries[j]); j++) {
+			const EventLogEntry* candidate = &page->entries[j];
+			if (candidate->sequenceNumber < minSequenceNumber || candidate->type == EventLogEntryType::INVALID) continue;
+
+			if (!found || candidate->sequenceNumber < entry->sequenceNumber) {
+				*entry = *candidate;
+				found = true;
+			}
+			break;
+		}
+	}
+
+	//Pending events are newer than all events in flash, events that are currently written might be in both places
+	for (u8 i = 0; i < numPendingEvents && !found; i++) {
+		if (pendingEvents[i].sequenceNumber >= minSequenceNumber) {
+			*entry = pendingEvents[i];
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+u32 EventLog::GetNextSequenceNumber() const
+{
+	return nextSequenceNumber;
+}
+
+EventLogPage* EventLog::GetPage(u8 pageIndex) const
+{
+	return (EventLogPage*)(Utility::GetSettingsPageBaseAddress() - (EVENT_LOG_NUM_PAGES - pageIndex) * PAGE_SIZE);
+}
+
+u16 EventLog::GetEntriesPerPage()
+{
+	return (PAGE_SIZE - SIZEOF_EVENT_LOG_PAGE_HEADER) / SIZEOF_EVENT_LOG_ENTRY;
+}
+
+bool EventLog::IsEntryEmpty(const EventLogEntry* entry)
+{
+	return entry->sequenceNumber == 0xFFFFFFFF;
+}
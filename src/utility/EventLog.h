@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2019 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <types.h>
+#include <Config.h>
+#include <FlashStorage.h>
+
+/**
+ * The EventLog is a black box that keeps a record of important events such as reboots, disconnects
+ * and incidents in flash, so that they can still be read after a field failure.
+ *
+ * The log uses EVENT_LOG_NUM_PAGES flash pages directly below the RecordStorage pages as a ring.
+ * Each page starts with the magic bytes 0xEB01 (2 byte) and the size of an entry (2 byte), followed
+ * by entries that are only ever appended. Once the last page is full, the oldest page is erased
+ * and used again, so the log always contains the newest events.
+ *
+ * Every entry has a sequence number that keeps increasing across reboots and is used to find the
+ * newest entry after a reboot and to stream the log in order. Events are first collected in RAM and
+ * then written as a batch once the FlashStorage is idle, so that the log does not delay RecordStorage
+ * operations. Events that are still in RAM during a reset are lost.
+ */
+
+constexpr u16 EVENT_LOG_PAGE_MAGIC_NUMBER = 0xEB01;
+
+enum class EventLogEntryType : u8
+{
+	NONE = 0,
+	REBOOT = 1, //info: RebootReason, code: code1 of the reboot
+	GAP_DISCONNECTED = 2, //info: ConnectionType, nodeId: partner, code: hci disconnect reason
+	CONNECTION_REMOVED = 3, //info: ConnectionType, nodeId: partner, code: AppDisconnectReason
+	INCIDENT_SAVED = 4, //info: incident type, nodeId: node of the incident
+	INCIDENT_DELETED = 5, //info: incident type, nodeId: node of the incident
+	EVENTS_DROPPED = 6, //code: number of events that did not fit in RAM
+	INVALID = 0xFF //Erased flash
+};
+
+#pragma pack(push)
+#pragma pack(1)
+constexpr int SIZEOF_EVENT_LOG_ENTRY = 16;
+typedef struct
+{
+	u32 sequenceNumber; //Increases with every event, also across reboots
+	u32 timestamp; //Unix time in seconds once the time was synced, seconds since boot before
+	EventLogEntryType type;
+	u8 info;
+	NodeId nodeId;
+	u32 code;
+
+} EventLogEntry;
+STATIC_ASSERT_SIZE(EventLogEntry, 16);
+
+constexpr int SIZEOF_EVENT_LOG_PAGE_HEADER = 4;
+typedef struct
+{
+	u16 magicNumber;
+	u16 entrySize;
+	EventLogEntry entries[1];
+
+} EventLogPage;
+#pragma pack(pop)
+
+class EventLog : public FlashStorageEventListener
+{
+	private:
+		enum class FlashUserType : u32
+		{
+			WRITE_EVENTS,
+			ROTATE_PAGE
+		};
+
+		//Events that were logged but are not yet in flash
+		EventLogEntry pendingEvents[EVENT_LOG_PENDING_SIZE];
+		u8 numPendingEvents;
+		//Number of pending events that are currently written, these are removed once the write succeeded
+		u8 numEventsInFlight;
+		u32 firstPendingEventDs;
+		u32 numDroppedEvents;
+
+		u32 nextSequenceNumber;
+		u8 currentPage;
+		//Position of the next free entry on the current page
+		u16 writeIndex;
+		bool pageRotationInProgress;
+		bool initialized;
+
+		EventLogPage* GetPage(u8 pageIndex) const;
+		static u16 GetEntriesPerPage();
+		static bool IsEntryEmpty(const EventLogEntry* entry);
+
+		//Erases the next page of the ring and writes its header
+		void StartPageRotation();
+		//Queues the pending events that fit on the current page as a single write
+		void WritePendingEvents();
+		void AddPendingEvent(EventLogEntryType type, u8 info, NodeId nodeId, u32 code);
+
+	public:
+		EventLog();
+		static EventLog& getInstance();
+
+		//Searches the newest entry in flash, must be called before events are logged
+		void Init();
+
+		//Logs an event, the meaning of info, nodeId and code depends on the type
+		void Log(EventLogEntryType type, u8 info, NodeId nodeId, u32 code);
+
+		void TimerEventHandler(u16 passedTimeDs);
+
+		//Returns the oldest entry that has at least the given sequence number, either from flash or
+		//from the events that are not yet written. Returns false if there is no such entry
+		bool GetEntry(u32 minSequenceNumber, EventLogEntry* entry) const;
+
+		u32 GetNextSequenceNumber() const;
+
+		void FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashStorageError errorCode) override;
+};
@@ -36,18 +36,18 @@
 //TODO: NRF_BUSY and other errors of sd_flash_write should be handled
 //TODO: callback should use task pointe rinsted of struct
 //TODO: Is it necessary to provide a validation method after saving / erasing or does the softdevice already handle this?
-//TODO: if a transaction is started, first item will be executed even if not all transaction items could be saved
 //TODO: Does only support items with about 220 bytes because of PacketQueue element length limitation
 //TODO: WriteData is only able to write multiples of words
 
 FlashStorage::FlashStorage()
-	:taskQueue(taskBuffer, FLASH_STORAGE_QUEUE_SIZE)
+	:taskQueue(taskBuffer, FLASH_STORAGE_QUEUE_SIZE, taskIndex, sizeof(taskIndex) / sizeof(u16))
 {
 	currentTask = nullptr;
 	emptyHandler = nullptr;
 	transactionCounter = 0;
 	currentTransactionId = 0;
 	retryCallingSoftdevice = false;
+	numCoalescedTasks = 1;
 	
 	retryCount = FLASH_STORAGE_RETRY_COUNT;
 }
@@ -194,6 +194,52 @@ FlashStorageError FlashStorage::CacheAndWriteData(u32* source, u32* destination,
 	return FlashStorageError::SUCCESS;
 }
 
+FlashStorageError FlashStorage::StartTransaction(u16 numTasks, u16 cachedDataLength)
+{
+	if (currentTransactionId != 0) return FlashStorageError::TRANSACTION_IN_PROGRESS;
+
+	//Each task takes at most the size of a write task plus its cached data, a length field, padding and
+	//the byte that separates it from the read pointer. The end of the transaction is queued as a task as well.
+	u32 requiredBytes = (u32)numTasks * (SIZEOF_FLASH_STORAGE_TASK_ITEM_WRITE_DATA + 7) + cachedDataLength + SIZEOF_FLASH_STORAGE_TASK_ITEM_HEADER + 5;
+
+	if (requiredBytes >= taskQueue.GetFreeContiguousBytes() || taskQueue._numElements + numTasks + 1 > taskQueue.indexLength) {
+		logt("FLASH", "No space for transaction with %u tasks (%u bytes)", numTasks, requiredBytes);
+		return FlashStorageError::QUEUE_FULL;
+	}
+
+	transactionCounter++;
+	if (transactionCounter == 0) transactionCounter = 1;
+	currentTransactionId = transactionCounter;
+
+	logt("FLASH", "Start transaction %u", currentTransactionId);
+
+	return FlashStorageError::SUCCESS;
+}
+
+FlashStorageError FlashStorage::EndTransaction(FlashStorageEventListener* callback, u32 userType)
+{
+	if (currentTransactionId == 0) return FlashStorageError::WRONG_PARAM;
+
+	logt("FLASH", "End transaction %u", currentTransactionId);
+
+	FlashStorageTaskItem task;
+	task.header.command = FlashStorageCommand::END_TRANSACTION;
+	task.header.transactionId = currentTransactionId;
+	task.header.callback = callback;
+	task.header.userType = userType;
+
+	bool queued = taskQueue.Put((u8*)&task, SIZEOF_FLASH_STORAGE_TASK_ITEM_HEADER);
+	if (!queued) AbortLastInsertedTransaction();
+
+	currentTransactionId = 0;
+
+	if (!queued) return FlashStorageError::QUEUE_FULL;
+
+	ProcessQueue(false);
+
+	return FlashStorageError::SUCCESS;
+}
+
 //Aborts the transaction in progress because of a flash fail
 void FlashStorage::AbortTransactionInProgress(FlashStorageTaskItem* task, FlashStorageError errorCode) const
 {
@@ -257,9 +303,19 @@ void FlashStorage::ProcessQueue(bool continueCurrentTask)
 	//Get one item from the queue and execute it
 	SizedData data = taskQueue.PeekNext();
 	currentTask = (FlashStorageTaskItem*)data.data;
+	numCoalescedTasks = 1;
 
 	logt("FLASH", "processing command %u", (u32)currentTask->header.command);
 
+	//Writes that directly follow each other are programmed together to save the scheduling latency of each flash operation
+	u8* coalescedDestination = nullptr;
+	u16 coalescedLength = 0;
+	if (currentTask->header.command == FlashStorageCommand::WRITE_DATA
+		|| currentTask->header.command == FlashStorageCommand::WRITE_AND_CACHE_DATA
+	) {
+		numCoalescedTasks = CoalesceWrites(&coalescedDestination, &coalescedLength);
+	}
+
 	if(currentTask->header.command == FlashStorageCommand::ERASE_PAGE)
 	{
 		if(currentTask->params.erasePage.page == 0){
@@ -305,6 +361,11 @@ void FlashStorage::ProcessQueue(bool continueCurrentTask)
 			}
 		}
 	}
+	else if(numCoalescedTasks > 1){
+		logt("FLASH", "copy %u coalesced writes to %u, length %u", numCoalescedTasks, (u32)coalescedDestination, coalescedLength);
+
+		err = (u32)sd_flash_write((uint32_t*)coalescedDestination, (uint32_t*)coalesceBuffer, coalescedLength / 4);
+	}
 	else if(currentTask->header.command == FlashStorageCommand::WRITE_DATA){
 		FlashStorageTaskItemWriteData* params = &currentTask->params.writeData;
 
@@ -400,6 +461,12 @@ void FlashStorage::SystemEventHandler(u32 systemEvent)
 			ProcessQueue(true);
 			return;
 		}
+		else if(numCoalescedTasks > 1){
+			retryCount = FLASH_STORAGE_RETRY_COUNT;
+
+			//All writes that were merged into the failed operation are canceled
+			DiscardCoalescedTasks(FlashStorageError::FLASH_OPERATION_TIMED_OUT);
+		}
 		else {
 			//Discard task
 			taskQueue.DiscardNext();
@@ -420,7 +487,10 @@ void FlashStorage::SystemEventHandler(u32 systemEvent)
 		retryCount = FLASH_STORAGE_RETRY_COUNT;
 
 		logt("FLASH", "Flash operation success");
-		if(
+		if(numCoalescedTasks > 1){
+			DiscardCoalescedTasks(FlashStorageError::SUCCESS);
+		}
+		else if(
 				taskReference->header.command == FlashStorageCommand::ERASE_PAGE
 				|| taskReference->header.command == FlashStorageCommand::WRITE_DATA
 				|| currentTask->header.command == FlashStorageCommand::WRITE_AND_CACHE_DATA
@@ -455,6 +525,126 @@ void FlashStorage::SystemEventHandler(u32 systemEvent)
 	ProcessQueue(false);
 }
 
+bool FlashStorage::GetWriteRange(FlashStorageTaskItem* task, u8** start, u8** end, u8** source)
+{
+	if (task->header.command == FlashStorageCommand::WRITE_DATA) {
+		FlashStorageTaskItemWriteData* params = &task->params.writeData;
+		*start = (u8*)params->dataDestination;
+		*end = *start + params->dataLength / 4 * 4;
+		*source = (u8*)params->dataSource;
+		return true;
+	}
+	else if (task->header.command == FlashStorageCommand::WRITE_AND_CACHE_DATA) {
+		FlashStorageTaskItemWriteCachedData* params = &task->params.writeCachedData;
+		u8 padding = (4-params->dataLength%4)%4;
+		*start = (u8*)params->dataDestination;
+		*end = *start + params->dataLength + padding;
+		*source = params->data;
+		return true;
+	}
+	return false;
+}
+
+//Only writes that directly follow the current one in the queue and belong to the same transaction are merged, so that
+//no write is moved across an erase or any other task. Flash bits can only be cleared by programming, so overlapping
+//words are combined with AND, which leaves the same content in flash as programming the writes one after the other.
+u8 FlashStorage::CoalesceWrites(u8** destination, u16* length)
+{
+	u8* start;
+	u8* end;
+	u8* source;
+	if (!GetWriteRange(currentTask, &start, &end, &source) || end - start > FLASH_STORAGE_COALESCE_MAX_BYTES) return 1;
+
+	u8 numTasks = 1;
+	for (u16 pos = 1; pos < taskQueue._numElements && numTasks < 0xFF; pos++) {
+		FlashStorageTaskItem* task = (FlashStorageTaskItem*)taskQueue.PeekNext(pos).data;
+
+		u8* taskStart;
+		u8* taskEnd;
+		if (task->header.transactionId != currentTask->header.transactionId
+			|| !GetWriteRange(task, &taskStart, &taskEnd, &source)
+		) {
+			break;
+		}
+
+		//The destination must be word aligned relative to the merged range and must touch or overlap it
+		if ((taskStart > start ? taskStart - start : start - taskStart) % 4 != 0
+			|| taskStart > end
+			|| taskEnd < start
+		) {
+			break;
+		}
+
+		u8* mergedStart = taskStart < start ? taskStart : start;
+		u8* mergedEnd = taskEnd > end ? taskEnd : end;
+		if (mergedEnd - mergedStart > FLASH_STORAGE_COALESCE_MAX_BYTES) break;
+
+		start = mergedStart;
+		end = mergedEnd;
+		numTasks++;
+	}
+
+	if (numTasks == 1) return 1;
+
+	u8* buffer = (u8*)coalesceBuffer;
+	CheckedMemset(buffer, 0xFF, end - start);
+	for (u8 i = 0; i < numTasks; i++) {
+		u8* taskStart = nullptr;
+		u8* taskEnd = nullptr;
+		//All merged tasks were checked to be writes above
+		if (!GetWriteRange((FlashStorageTaskItem*)taskQueue.PeekNext(i).data, &taskStart, &taskEnd, &source)) break;
+		for (u16 j = 0; j < taskEnd - taskStart; j++) {
+			buffer[taskStart - start + j] &= source[j];
+		}
+	}
+
+	*destination = start;
+	*length = (u16)(end - start);
+
+	return numTasks;
+}
+
+void FlashStorage::DiscardCoalescedTasks(FlashStorageError errorCode)
+{
+	//Make copies of all tasks so that they are removed from the queue before a listener is called
+	u16 copyLength = 0;
+	for (u8 i = 0; i < numCoalescedTasks; i++) {
+		SizedData data = taskQueue.PeekNext(i);
+		copyLength += data.length + 4 + (4-data.length%4)%4;
+	}
+	DYNAMIC_ARRAY(buffer, copyLength);
+
+	u16 offset = 0;
+	for (u8 i = 0; i < numCoalescedTasks; i++) {
+		SizedData data = taskQueue.PeekNext();
+		((u16*)(buffer + offset))[0] = data.length;
+		memcpy(buffer + offset + 4, data.data, data.length);
+		offset += data.length + 4 + (4-data.length%4)%4;
+		taskQueue.DiscardNext();
+	}
+
+	u8 numTasks = numCoalescedTasks;
+	currentTask = nullptr;
+	numCoalescedTasks = 1;
+
+	offset = 0;
+	for (u8 i = 0; i < numTasks; i++) {
+		u16 dataLength = ((u16*)(buffer + offset))[0];
+		FlashStorageTaskItem* task = (FlashStorageTaskItem*)(buffer + offset + 4);
+		offset += dataLength + 4 + (4-dataLength%4)%4;
+
+		//A failing transaction is aborted once, just as if its first write had failed on its own
+		if (errorCode != FlashStorageError::SUCCESS && task->header.transactionId != 0) {
+			if (i == 0) AbortTransactionInProgress(task, errorCode);
+		}
+		else if (task->header.callback != nullptr) {
+			task->header.callback->FlashStorageItemExecuted(task, errorCode);
+		}
+	}
+
+	if (taskQueue._numElements == 0 && emptyHandler != nullptr) emptyHandler->FlashStorageQueueEmptyHandler();
+}
+
 u16 FlashStorage::GetNumberOfActiveTasks() const
 {
 	return taskQueue._numElements;
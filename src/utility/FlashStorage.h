@@ -34,6 +34,7 @@
 
 #pragma once
 
+#include <Config.h>
 #include <PacketQueue.h>
 
 class FlashStorageEventListener;
@@ -149,6 +150,7 @@ class FlashStorage
 	private:
 				
 		u32 taskBuffer[FLASH_STORAGE_QUEUE_SIZE/sizeof(u32)];
+		u16 taskIndex[PacketQueue::IndexLength(FLASH_STORAGE_QUEUE_SIZE, SIZEOF_FLASH_STORAGE_TASK_ITEM_HEADER)];
 		mutable PacketQueue taskQueue;
 
 		FlashStorageTaskItem* currentTask;
@@ -157,6 +159,11 @@ class FlashStorage
 		u16 currentTransactionId;
 		bool retryCallingSoftdevice;
 
+		//Data of queued writes that are programmed with a single flash operation
+		u32 coalesceBuffer[FLASH_STORAGE_COALESCE_MAX_BYTES / sizeof(u32)];
+		//Number of queued tasks that are executed by the current flash operation
+		u8 numCoalescedTasks;
+
 		FlashStorageEventListener* emptyHandler;
 
 		//Starts or continues to execute flash tasks
@@ -169,6 +176,16 @@ class FlashStorage
 
 		void AbortTransactionInProgress(u16 transactionId, bool removeNext) const;
 
+		//Returns the flash range that is programmed by a write task, returns false for all other tasks
+		static bool GetWriteRange(FlashStorageTaskItem* task, u8** start, u8** end, u8** source);
+
+		//Merges the current write task with the following writes to adjacent or overlapping destinations
+		//and returns the number of merged tasks, the merged data is placed in the coalesceBuffer
+		u8 CoalesceWrites(u8** destination, u16* length);
+
+		//Removes all tasks that were executed by the last flash operation and calls their callbacks
+		void DiscardCoalescedTasks(FlashStorageError errorCode);
+
 	public:
 		FlashStorage();
 
@@ -189,6 +206,13 @@ class FlashStorage
 		//Caches the data in an internal buffer before saving (destination page must be empty)
 		FlashStorageError CacheAndWriteData(u32* source, u32* destination, u16 length, FlashStorageEventListener* callback, u32 userType);
 
+		//Starts a transaction if the queue can hold numTasks tasks with a total of cachedDataLength bytes of cached data
+		//All tasks are then queued as part of the transaction and are only executed once the transaction is ended
+		FlashStorageError StartTransaction(u16 numTasks, u16 cachedDataLength);
+
+		//Ends the transaction and calls the callback once all of its tasks were executed
+		FlashStorageError EndTransaction(FlashStorageEventListener* callback, u32 userType);
+
 		//Return the number of tasks
 		u16 GetNumberOfActiveTasks() const;
 
@@ -35,7 +35,7 @@
 #include "Utility.h"
 
 //Data will be 4-byte aligned if all inputs are 4 byte aligned
-PacketQueue::PacketQueue(u32* buffer, u16 bufferLength)
+PacketQueue::PacketQueue(u32* buffer, u16 bufferLength, u16* indexBuffer, u16 indexLength)
 {
 	this->_numElements = 0;
 	this->numUnsentElements = 0;
@@ -53,6 +53,13 @@ PacketQueue::PacketQueue(u32* buffer, u16 bufferLength)
 	packetSendPosition = 0;
 	packetSentRemaining = 0;
 	packetFailedToQueueCounter = 0;
+
+	this->indexBuffer = indexBuffer;
+	this->indexLength = indexLength;
+	this->indexStart = 0;
+
+	reservedElement = nullptr;
+	reservedLength = 0;
 }
 
 //IF READ AND WRITE ARE EQUAL, THE QUEUE IS EMPTY
@@ -71,57 +78,124 @@ bool PacketQueue::Put(u8* data, u16 dataLength)
 
 u8* PacketQueue::Reserve(u16 dataLength)
 {
-	if (dataLength == 0) return nullptr;
+	u8* dataPointer = ReserveUncommitted(dataLength);
+
+	if(dataPointer != nullptr){
+		Commit(dataLength);
+	}
+
+	return dataPointer;
+}
+
+//Reserves space for an element without adding it to the queue, the element is only added once Commit is called
+//This allows the caller to write the element in place instead of copying it into the queue
+u8* PacketQueue::ReserveUncommitted(u16 maxDataLength)
+{
+	reservedElement = nullptr;
+
+	if (maxDataLength == 0) return nullptr;
+
+	if (_numElements >= indexLength) {
+		logt("PQ", "No index space for %u bytes", maxDataLength);
+		return nullptr;
+	}
 
-	if(dataLength + 10 > bufferLength){
-		logt("ERROR", "Too big");																	//LCOV_EXCL_LINE assertion
-		GS->logger.logCustomError(CustomErrorTypes::FATAL_PACKETQUEUE_PACKET_TOO_BIG, dataLength);	//LCOV_EXCL_LINE assertion
-		SIMEXCEPTION(IllegalArgumentException);														//LCOV_EXCL_LINE assertion
-		return nullptr;																				//LCOV_EXCL_LINE assertion
+	if(maxDataLength + 10 > bufferLength){
+		logt("ERROR", "Too big");																		//LCOV_EXCL_LINE assertion
+		GS->logger.logCustomError(CustomErrorTypes::FATAL_PACKETQUEUE_PACKET_TOO_BIG, maxDataLength);	//LCOV_EXCL_LINE assertion
+		SIMEXCEPTION(IllegalArgumentException);															//LCOV_EXCL_LINE assertion
+		return nullptr;																					//LCOV_EXCL_LINE assertion
 	}
 
 	//Padding makes sure that we only save 4-byte aligned data
-	u8 padding = (4-dataLength%4)%4;
+	u8 padding = (4-maxDataLength%4)%4;
 
 	//Keep 4 byte for sizeField and one byte to not let read and write pointers overlap
-	u16 elementSize = dataLength + 4 + 1 + padding;
+	u16 elementSize = maxDataLength + 4 + 1 + padding;
+
+	u8* element = writePointer;
 
 	//If the writePointer is ahead (or at the same point) of the read pointer && bufferSpace
 	//at the end is not enough && dataSize at the beginning is enough
 	if (writePointer >= readPointer && bufferEnd - writePointer <= elementSize && readPointer - bufferStart >= elementSize)
 	{
-		writePointer = bufferStart;
-		((u16*)writePointer)[0] = 0;
+		//The length field at the writePointer is already 0 and marks the wrap for the readers
+		element = bufferStart;
 	}
 
 	//Check if Buffer can hold the item
 	else if (readPointer <= writePointer && writePointer + elementSize >= bufferEnd)
 	{
-		logt("PQ", "No space for %u bytes", dataLength);
+		logt("PQ", "No space for %u bytes", maxDataLength);
 		return nullptr;
 	}
 	else if (readPointer > writePointer && writePointer + elementSize >= readPointer)
 	{
-		logt("PQ", "No space for %u bytes", dataLength);
+		logt("PQ", "No space for %u bytes", maxDataLength);
 		return nullptr;
 	}
 
-	((u16*)writePointer)[0] = dataLength;
-	u8* dataPointer = this->writePointer + 4; //jump over length field
+	reservedElement = element;
+	reservedLength = maxDataLength;
 
-	//logt("ERROR", "Put %u at %u", dataLength, dataPointer);
+	return element + 4; //jump over length field
+}
+
+//Adds the reserved element to the queue, dataLength can be smaller than the reserved length
+bool PacketQueue::Commit(u16 dataLength)
+{
+	if(reservedElement == nullptr || dataLength == 0 || dataLength > reservedLength){
+		logt("ERROR", "Commit without reservation");
+		SIMEXCEPTION(IllegalStateException);
+		reservedElement = nullptr;
+		return false;
+	}
+
+	//Padding makes sure that we only save 4-byte aligned data
+	u8 padding = (4-dataLength%4)%4;
+
+	((u16*)reservedElement)[0] = dataLength;
+	indexBuffer[(indexStart + _numElements) % indexLength] = (u16)(reservedElement - bufferStart);
 
 	//Move write Pointer to next field
-	this->writePointer += dataLength + 4 + padding; //4 byte length
+	this->writePointer = reservedElement + dataLength + 4 + padding; //4 byte length
 
 	//Set length to 0 for next datafield
 	((u16*)writePointer)[0] = 0;
 
+	reservedElement = nullptr;
 	_numElements++;
 
-	logt("PQ", "Reserve %u bytes, now %u elements", dataLength, _numElements);
+	logt("PQ", "Commit %u bytes, now %u elements", dataLength, _numElements);
 
-	return dataPointer;
+	return true;
+}
+
+//Returns the number of bytes that are used by the elements in the queue including their length fields and padding
+u16 PacketQueue::GetUsedBytes() const
+{
+	if (_numElements == 0) return 0;
+
+	if (writePointer > readPointer) {
+		return (u16)(writePointer - readPointer);
+	}
+	else {
+		return (u16)((bufferEnd - readPointer) + (writePointer - bufferStart));
+	}
+}
+
+//Returns the number of bytes that can be filled with elements in one piece, either behind the last element or
+//after wrapping to the start of the buffer. This includes the length fields, padding and the separating byte of each element
+u16 PacketQueue::GetFreeContiguousBytes() const
+{
+	if (readPointer > writePointer) {
+		return (u16)(readPointer - writePointer);
+	}
+
+	u16 tailBytes = (u16)(bufferEnd - writePointer);
+	u16 headBytes = (u16)(readPointer - bufferStart);
+
+	return tailBytes > headBytes ? tailBytes : headBytes;
 }
 
 SizedData PacketQueue::PeekNext() const
@@ -129,7 +203,7 @@ SizedData PacketQueue::PeekNext() const
 	return PeekNext(0);
 }
 
-SizedData PacketQueue::PeekNext(u8 pos) const
+SizedData PacketQueue::PeekNext(u16 pos) const
 {
 	SizedData data;
 	//If queue has been fully read, return empty data
@@ -139,34 +213,24 @@ SizedData PacketQueue::PeekNext(u8 pos) const
 		return data;
 	}
 
-	u8* virtualReadPointer = readPointer;
-
-	for(int i=0; i<=pos; i++){
-		//Check if we reached the end and wrap
-		if (((u16*)virtualReadPointer)[0] == 0 && writePointer < virtualReadPointer) {
-			virtualReadPointer = bufferStart;
-		}
-
-		if(i>0){
-			//Padding makes sure that we only save 4-byte aligned data
-			u8 padding = (4-((u16*)virtualReadPointer)[0]%4)%4;
-			virtualReadPointer += ((u16*)virtualReadPointer)[0] + 4 + padding; //4 byte length
-
-			//Check if we reached the end of entries and the next entry following is an empty one, if yes place read pointer at start
-			if (((u16*)virtualReadPointer)[0] == 0) {
-				virtualReadPointer = bufferStart;
-			}
-		}
-	}
+	u8* element = GetElement(pos);
 
-	data.length = ((u16*)virtualReadPointer)[0];
-	data.data = virtualReadPointer + 4; // 4 byte added for length field
+	data.length = ((u16*)element)[0];
+	data.data = element + 4; // 4 byte added for length field
 	
 	return data;
 }
 
+//Returns the element (starting with its length field) at the given position using the index
+u8* PacketQueue::GetElement(u16 pos) const
+{
+	return bufferStart + indexBuffer[(indexStart + pos) % indexLength];
+}
+
 void PacketQueue::DiscardNext()
 {
+	reservedElement = nullptr;
+
 	if (_numElements == 0) return;
 
 	//Check if we reached the end and wrap
@@ -178,6 +242,7 @@ void PacketQueue::DiscardNext()
 	u8 padding = (4-((u16*)readPointer)[0]%4)%4;
 	this->readPointer += ((u16*)readPointer)[0] + 4 + padding; //4 byte length
 	_numElements--;
+	indexStart = (indexStart + 1) % indexLength;
 
 	//Reset the pointers to buffer start if the queue is empty
 	if (readPointer == writePointer) {
@@ -192,53 +257,22 @@ void PacketQueue::DiscardNext()
 	logt("PQ", "DiscardNext, now %u elements", _numElements);
 }
 
-//Iterates over all items in order to find the last element
-SizedData PacketQueue::PeekLast()
+//Returns empty data if the queue is empty
+SizedData PacketQueue::PeekLast() const
 {
-	SizedData data = { nullptr, 0 };
-
-	//Return 0 length data in case we have no elements
-	if (_numElements == 0){
-		return data;
-	}
-
-	u16 virtualElementsLeft = _numElements;
-	u8* virtualReadPointer = readPointer;
-
-	//Iterate over the queue using a copy of read pointer and numElements until reaching the last element
-	while (virtualElementsLeft > 0)
-	{
-		//Check if we reached the end and wrap
-		if (((u16*)virtualReadPointer)[0] == 0 && writePointer < virtualReadPointer)
-			virtualReadPointer = bufferStart;
-
-		//Copy data reference into sizeData
-		data.length = ((u16*)virtualReadPointer)[0];
-		data.data = virtualReadPointer + 4; // 4 byte added for length field
-
-		//Do a virtual discard
-		//Padding makes sure that we only save 4-byte aligned data
-		u8 padding = (4-((u16*)virtualReadPointer)[0]%4)%4;
-
-		virtualReadPointer += (((u16*)virtualReadPointer)[0] + 4 + padding); //4 byte length
-		virtualElementsLeft--;
-	}
-
-	return data;
+	return PeekNext(_numElements - 1);
 }
 
 void PacketQueue::DiscardLast()
 {
+	reservedElement = nullptr;
+
 	if (_numElements == 0) {
 		return;
 	}
 
-	//Look for the last element
-	SizedData lastElement = PeekLast();
-
-	//Discard this element (No wrapping necessary because writePointer is always at the end of an element if it exists)
-	u8 padding = (4-lastElement.length%4)%4;
-	this->writePointer -= lastElement.length + 4 + padding; //4 byte length
+	//The writePointer moves back to the start of the last element (the end of the queue always directly follows the last element)
+	this->writePointer = GetElement(_numElements - 1);
 	_numElements--;
 
 	((u16*)writePointer)[0] = 0;
@@ -249,8 +283,8 @@ void PacketQueue::DiscardLast()
 	}
 	//If our writePointer is at buffer start, we have to find the correct position at the end of the buffer
 	else if (writePointer == bufferStart) {
-		lastElement = PeekLast();
-		padding = (4-lastElement.length%4)%4;
+		SizedData lastElement = PeekLast();
+		u8 padding = (4-lastElement.length%4)%4;
 
 		writePointer = lastElement.data + lastElement.length + padding; //put writePointe to the end of the last element
 		((u16*)writePointer)[0] = 0;
@@ -263,6 +297,8 @@ void PacketQueue::DiscardLast()
 void PacketQueue::Clean(void)
 {
 	_numElements = 0;
+	indexStart = 0;
+	reservedElement = nullptr;
 	readPointer = this->bufferStart;
 	writePointer = this->bufferStart;
 	((u16*)writePointer)[0] = 0;
@@ -274,15 +310,8 @@ void PacketQueue::Clean(void)
 void PacketQueue::Print() const
 {
 	logt("PQ", "Printing Queue: ");
-	u8* tmpReadPointer = readPointer;
 	for(u32 i=0; i<_numElements; i++){
-		//Check if we reached the end and wrap
-		if (((u16*)tmpReadPointer)[0] == 0 && writePointer < tmpReadPointer)
-			tmpReadPointer = bufferStart;
-
-		SizedData data;
-		data.length = ((u16*)tmpReadPointer)[0];
-		data.data = tmpReadPointer + 4; // 4 byte added for length field
+		SizedData data = PeekNext(i);
 
 		trace("%u: ", i);
 		for(u32 j=0; j<data.length; j++){
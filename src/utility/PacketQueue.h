@@ -31,6 +31,18 @@
 /*
  * The packet queue implements a circular buffer for sending packets of varying
  * sizes.
+ *
+ * Besides Put, which copies the data into the queue, space can be reserved so
+ * that the caller builds the element directly inside the queue. With
+ * ReserveUncommitted, the caller gets a region of up to maxDataLength bytes and
+ * publishes the element with Commit using the length that was really written.
+ * The reservation is dropped if it is not committed before the queue is
+ * modified again.
+ *
+ * Next to the buffer, the queue keeps a ring of element offsets so that any
+ * element, including the last one, can be accessed in constant time. The
+ * index must be large enough for the maximum number of elements, which can be
+ * calculated with IndexLength from the smallest element that is ever queued.
  */
 
 #pragma once
@@ -44,15 +56,21 @@ private:
 
 public:
 	//really public
-	PacketQueue(u32* buffer, u16 bufferLength);
+	PacketQueue(u32* buffer, u16 bufferLength, u16* indexBuffer, u16 indexLength);
+	//Number of index entries that are needed if no element is smaller than minDataLength
+	static constexpr u16 IndexLength(u16 bufferLength, u16 minDataLength){ return bufferLength / (minDataLength + 4 + (4 - minDataLength % 4) % 4) + 1; }
 	u8* Reserve(u16 dataLength);
+	u8* ReserveUncommitted(u16 maxDataLength);
+	bool Commit(u16 dataLength);
     bool Put(u8* data, u16 dataLength);
 	SizedData PeekNext() const;
-	SizedData PeekNext(u8 pos) const;
+	SizedData PeekNext(u16 pos) const;
 	void DiscardNext();
-	SizedData PeekLast();
+	SizedData PeekLast() const;
 	void DiscardLast();
 	void Clean(void);
+	u16 GetUsedBytes() const;
+	u16 GetFreeContiguousBytes() const;
 
 	void Print() const;
 
@@ -71,6 +89,16 @@ public:
 	u16 _numElements;
 	
 	u16 numUnsentElements; //Used for marking some packets as already sent (queued in the softdevice)
+
+	u16* indexBuffer; //Ring of element offsets relative to bufferStart, in queue order
+	u16 indexLength;
+	u16 indexStart; //Position of the first element in the index
+
+	u8* reservedElement; //Element that was reserved using ReserveUncommitted, nullptr if there is no reservation
+	u16 reservedLength; //Maximum data length of the reserved element
+
+private:
+	u8* GetElement(u16 pos) const;
 };
 
 
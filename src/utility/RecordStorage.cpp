@@ -46,6 +46,18 @@
  * The swap page is always empty whereas the other pages are marked active with the page header that is:
  * Magic bytes 0xAC71 (2 byte), followed by the page version that is always incrementing (2byte)
  *
+ * The number of times a page was erased is stored in a deactivated record with the reserved
+ * recordId RECORD_STORAGE_RECORD_ID_ERASE_COUNTER that is written directly after the erase, so the swap
+ * page only contains this record. When the page is activated, it stays in front of all other records.
+ * The page layout is therefore the same as before the erase counters were introduced: Older firmware
+ * treats the record as a deleted record and drops it during a defragmentation. It will however
+ * see a swap page that contains an erase counter as corrupt and erase it again, which does not lose any data.
+ * The repair also writes this record to the pages that it erases. Pages without this record have an
+ * unknown erase counter and are counted as being as worn as the most erased page.
+ *
+ * For wear leveling, new records are written to the pages in turn and a page that was erased much less
+ * often than the others, e.g. because it only holds records that never change, is moved as well.
+ *
  * A power loss during an operation will trigger the repair routine upon reboot that will erase corrupt
  * pages and will erase the latest page if the swapping did not complete.
  *
@@ -58,6 +70,14 @@
  * Once all pages are full, the page with the most possible free space is defragmented. Therefore,
  * all current and active records will be moved to the swap page. Afterwards this page is activated and
  * the old page is erased and becomes the new swap page.
+ * To avoid that a save has to wait for this, a page is already defragmented in the background once the
+ * free space runs low. The background defragmentation does one flash operation per timer event. Saves
+ * use the other pages in the meantime while deactivations wait until it is finished.
+ *
+ * To avoid searching all pages on every read, the location of the newest record of each recordId is kept
+ * in a sorted RAM index. It is built during Init, updated once a record was written and rebuilt after
+ * pages were erased by the repair or the defragmentation. If there are more recordIds than fit into the
+ * index, records that are not indexed are searched in flash.
 
  * The implementation does currently only support updating a record up to 65000 times and 65000 erase cycles of the settings pages
 
@@ -73,7 +93,7 @@
 
 
 RecordStorage::RecordStorage()
-	: opQueue(opBuffer, RECORD_STORAGE_QUEUE_SIZE)
+	: opQueue(opBuffer, RECORD_STORAGE_QUEUE_SIZE, opIndex, sizeof(opIndex) / sizeof(u16))
 {
 }
 
@@ -82,6 +102,7 @@ void RecordStorage::Init()
 	startPage = (u8*)Utility::GetSettingsPageBaseAddress();
 	numPages = RECORD_STORAGE_NUM_PAGES;
 	GS->flashStorage.SetQueueEmptyHandler(this);
+	RebuildRecordIndex();
 	isInit = true;
 }
 
@@ -181,10 +202,12 @@ void RecordStorage::SaveRecordInt(SaveRecordOperation* op)
 		u8* freeSpace = GetFreeRecordSpace(recordLength);
 
 		//If not, we must first defragment the page which has the most available space
+		//A running background defragmentation is finished as fast as possible instead
 		if (freeSpace == nullptr) {
 			RecordStoragePage* pageToDefragment = FindPageToDefragment();
 			if (pageToDefragment != nullptr) {
 				op->op.stage = 1;
+				defragmentInBackground = false;
 				return DefragmentPage(pageToDefragment, false);
 			}
 		}
@@ -238,6 +261,7 @@ void RecordStorage::SaveRecordInt(SaveRecordOperation* op)
 			//The crc is calculated over the record header and data, excluding the first two byte (crc and flags)
 			newRecord->crc = Utility::CalculateCrc8(((u8*)newRecord) + 2, newRecord->recordLength - 2);
 			op->op.stage = 2;
+			savingRecord = (RecordStorageRecord*)freeSpace;
 			GS->flashStorage.CacheAndWriteData((u32*)newRecord, (u32*)freeSpace, recordLength, this, 0);
 			return;
 
@@ -258,6 +282,12 @@ void RecordStorage::SaveRecordInt(SaveRecordOperation* op)
 	
 	if (op->op.stage == 2)
 	{
+		//The record is now in flash and is the newest one for its recordId
+		UpdateRecordIndex(savingRecord);
+		writePageIndex = (u8)(((u32)savingRecord - (u32)startPage) / PAGE_SIZE);
+		savingRecord = nullptr;
+		defragmentCheckPending = true;
+
 		return RecordOperationFinished(&op->op, RecordStorageResultCode::SUCCESS);
 	}
 }
@@ -296,6 +326,7 @@ void RecordStorage::DeactivateRecordInt(DeactivateRecordOperation* op)
 
 void RecordStorage::ClearAllSettings()
 {
+	recordIndexValid = false;
 	GS->flashStorage.ErasePages(Utility::GetSettingsPageBaseAddress()/PAGE_SIZE, RECORD_STORAGE_NUM_PAGES, nullptr, 0);
 }
 
@@ -319,6 +350,14 @@ void RecordStorage::RepairPages()
 	if (GS->flashStorage.GetNumberOfActiveTasks() != 0){
 		return;
 	}
+
+	//An erased page must not lose its erase counter, otherwise the wear leveling can not take it into account
+	if (repairErasedPage != nullptr)
+	{
+		WriteEraseCounterRecord(repairErasedPage, repairEraseCounter);
+		repairErasedPage = nullptr;
+		return;
+	}
 	
 	if (repairStep == 0)
 	{
@@ -328,6 +367,9 @@ void RecordStorage::RepairPages()
 			RecordStoragePageState pageState = GetPageState(page);
 
 			if (pageState == RecordStoragePageState::CORRUPT) {
+				repairErasedPage = page;
+				repairEraseCounter = GetPageEraseCounter(i) + 1;
+				recordIndexValid = false;
 				GS->flashStorage.ErasePage(((u32)page - FLASH_REGION_START_ADDRESS) / PAGE_SIZE, nullptr, 0);
 				return;
 			}
@@ -355,6 +397,9 @@ void RecordStorage::RepairPages()
 			}
 
 			//Clear the swap page
+			repairErasedPage = swapPage;
+			repairEraseCounter = GetPageEraseCounter(((u32)swapPage - (u32)startPage) / PAGE_SIZE) + 1;
+			recordIndexValid = false;
 			GS->flashStorage.ErasePage(((u32)swapPage - FLASH_REGION_START_ADDRESS) / PAGE_SIZE, nullptr, 0);
 			return;
 		}
@@ -402,7 +447,7 @@ void RecordStorage::RepairPages()
 			RecordStoragePageState pageState = GetPageState(page);
 
 			if (pageState == RecordStoragePageState::ACTIVE) {
-				RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+				RecordStorageRecord* record = GetFirstRecord(page);
 
 				//Iterate through all records to find the last valid one (record will then point to free space)
 				while (IsRecordValid(page, record)) {
@@ -430,6 +475,9 @@ void RecordStorage::RepairPages()
 	{
 		repairInProgress = false;
 
+		if (!recordIndexValid) RebuildRecordIndex();
+		defragmentCheckPending = true;
+
 		//Call the listener manually because we did not queue another task
 		ProcessQueue(true);
 	}
@@ -450,9 +498,10 @@ void RecordStorage::DefragmentPage(RecordStoragePage* pageToDefragment, bool for
 		defragmentStep = 0;
 		defragRecordCounter = 0;
 
-		if (!force && GetFreeSpaceOnPage(defragmentPage) == GetFreeSpaceWhenDefragmented(defragmentPage)) {
+		if (!force && GetFreeSpaceOnPage(defragmentPage) >= GetFreeSpaceWhenDefragmented(defragmentPage)) {
 			logt("RS", "No defrag possible");
 			defragmentInProgress = false;
+			defragmentInBackground = false;
 			return;
 		}
 
@@ -467,10 +516,12 @@ void RecordStorage::DefragmentPage(RecordStoragePage* pageToDefragment, bool for
 
 	if (defragmentStep == 0)
 	{
-		//Move records one by one to the swap page
-		RecordStorageRecord* record = (RecordStorageRecord*)defragmentPage->data;
-		RecordStorageRecord* swapRecord = (RecordStorageRecord*)defragmentSwapPage->data;
-		RecordStorageRecord* freeSpacePtr = (RecordStorageRecord*)defragmentSwapPage->data;
+		//Move records to the swap page, all moves that fit in the flash queue are queued at once so that
+		//the FlashStorage can program adjacent records together
+		RecordStorageRecord* record = GetFirstRecord(defragmentPage);
+		RecordStorageRecord* swapRecord = GetFirstRecord(defragmentSwapPage);
+		RecordStorageRecord* freeSpacePtr = GetFirstRecord(defragmentSwapPage);
+		bool movedRecords = false;
 
 		//This loop goes through all records, if it finds a record that needs to be moved (and wasn't already), it will move it
 		while (IsRecordValid(defragmentPage, record))
@@ -491,14 +542,20 @@ void RecordStorage::DefragmentPage(RecordStoragePage* pageToDefragment, bool for
 				//If the record was not found on the swap page, we must move it
 				if (!found) {
 					logt("RS", "Moving record %u", (u32)record);
-					GS->flashStorage.WriteData((u32*)record, (u32*)freeSpacePtr, record->recordLength, nullptr, 0);
-					return;
+					if (GS->flashStorage.WriteData((u32*)record, (u32*)freeSpacePtr, record->recordLength, nullptr, 0) != FlashStorageError::SUCCESS) {
+						return;
+					}
+					movedRecords = true;
+					freeSpacePtr = (RecordStorageRecord*)((u8*)freeSpacePtr + record->recordLength);
 				}
 			}
 			//Update reference to record
 			record = (RecordStorageRecord*)((u8*)record + record->recordLength);
 		}
 
+		//The moved records are checked again once they were written
+		if (movedRecords) return;
+
 		defragmentStep = 1;
 	}
 	
@@ -532,13 +589,29 @@ void RecordStorage::DefragmentPage(RecordStoragePage* pageToDefragment, bool for
 	else if (defragmentStep == 2)
 	{
 		//Finally, erase the page that we just swapped
+		defragmentEraseCounter = GetPageEraseCounter(((u32)defragmentPage - (u32)startPage) / PAGE_SIZE);
+		recordIndexValid = false;
 		GS->flashStorage.ErasePage(((u32)defragmentPage - FLASH_REGION_START_ADDRESS) / PAGE_SIZE, this, 0);
 
 		defragmentStep = 3;
 	}
 	else if (defragmentStep == 3)
+	{
+		//The erased page is now the swap page, it keeps its erase counter record until it is activated
+		//If the record can not be queued, this step is retried once the queue is empty
+		if (WriteEraseCounterRecord(defragmentPage, defragmentEraseCounter + 1) != FlashStorageError::SUCCESS) {
+			return;
+		}
+
+		defragmentStep = 4;
+	}
+	else if (defragmentStep == 4)
 	{
 		defragmentInProgress = false;
+		defragmentInBackground = false;
+
+		//The moved records have new locations
+		RebuildRecordIndex();
 
 		//Call the listener manually because we did not queue another task
 		ProcessQueue(true);
@@ -546,6 +619,66 @@ void RecordStorage::DefragmentPage(RecordStoragePage* pageToDefragment, bool for
 }
 
 
+//Starts to defragment the page with the most reclaimable space if the free space runs low
+//or moves the records of a page that was erased much less often than the others
+void RecordStorage::StartBackgroundDefragmentation()
+{
+	u32 maxEraseCounter = 0;
+	for (u32 i = 0; i < numPages; i++) {
+		u32 eraseCounter = GetPageEraseCounter(i);
+		if (eraseCounter > maxEraseCounter) maxEraseCounter = eraseCounter;
+	}
+	RecordStoragePage* leastErasedPage = FindLeastErasedPage();
+	if (leastErasedPage != nullptr) {
+		u32 minEraseCounter = GetPageEraseCounter(((u32)leastErasedPage - (u32)startPage) / PAGE_SIZE);
+		if (maxEraseCounter - minEraseCounter >= RECORD_STORAGE_WEAR_LEVELING_THRESHOLD) {
+			logt("RS", "Wear leveling, erase counters %u - %u", minEraseCounter, maxEraseCounter);
+
+			defragmentInBackground = true;
+			DefragmentPage(leastErasedPage, true);
+			return;
+		}
+	}
+
+	u16 maxFreeSpace = 0;
+	for (u32 i = 0; i < numPages; i++) {
+		RecordStoragePage* page = (RecordStoragePage*)(startPage + PAGE_SIZE * i);
+		u16 freeSpace = GetFreeSpaceOnPage(page);
+		if (freeSpace > maxFreeSpace) maxFreeSpace = freeSpace;
+	}
+	if (maxFreeSpace >= RECORD_STORAGE_BACKGROUND_DEFRAGMENT_FREE_BYTES) return;
+
+	//Only defragment if it is worth an erase cycle
+	RecordStoragePage* pageToDefragment = FindPageToDefragment();
+	if (pageToDefragment == nullptr
+		|| GetFreeSpaceWhenDefragmented(pageToDefragment) - GetFreeSpaceOnPage(pageToDefragment) < RECORD_STORAGE_BACKGROUND_DEFRAGMENT_FREE_BYTES)
+	{
+		return;
+	}
+
+	logt("RS", "Background defragmentation, free %u", maxFreeSpace);
+
+	defragmentInBackground = true;
+	DefragmentPage(pageToDefragment, false);
+}
+
+void RecordStorage::TimerEventHandler(u16 passedTimeDs)
+{
+	if (!isInit || repairInProgress) return;
+
+	//Only one flash operation is done per timer event and only if no other operation is waiting
+	if (GS->flashStorage.GetNumberOfActiveTasks() != 0) return;
+
+	if (defragmentInProgress) {
+		if (defragmentInBackground) DefragmentPage(nullptr, false);
+	}
+	else if (defragmentCheckPending && opQueue._numElements == 0) {
+		defragmentCheckPending = false;
+		StartBackgroundDefragmentation();
+	}
+}
+
+
 /*##################################### 
 # Various functions to read and helpers
 ##################################### */
@@ -622,6 +755,19 @@ SizedData RecordStorage::GetRecordData(u16 recordId) const
 //Will return the latest version of a record if its structure is valid
 //Will also return a record if it has been deactivated
 RecordStorageRecord* RecordStorage::GetRecord(u16 recordId) const
+{
+	if (recordIndexValid) {
+		u16 position = FindRecordIndexPosition(recordId);
+		if (position < recordIndexCount && recordIndex[position].recordId == recordId) {
+			return (RecordStorageRecord*)(startPage + recordIndex[position].wordOffset * 4);
+		}
+		if (recordIndexComplete) return nullptr;
+	}
+
+	return FindRecordInFlash(recordId);
+}
+
+RecordStorageRecord* RecordStorage::FindRecordInFlash(u16 recordId) const
 {
 	RecordStorageRecord* result = nullptr;
 
@@ -633,7 +779,7 @@ RecordStorageRecord* RecordStorage::GetRecord(u16 recordId) const
 		if(GetPageState(page) != RecordStoragePageState::ACTIVE) continue;
 
 		//Get first record
-		RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+		RecordStorageRecord* record = GetFirstRecord(page);
 
 		//Iterate through all valid records
 		while(IsRecordValid(page, record))
@@ -657,18 +803,90 @@ RecordStorageRecord* RecordStorage::GetRecord(u16 recordId) const
 	return result;
 }
 
+u16 RecordStorage::FindRecordIndexPosition(u16 recordId) const
+{
+	//Binary search for the first entry that is not smaller than the recordId
+	u16 low = 0;
+	u16 high = recordIndexCount;
+	while (low < high) {
+		u16 middle = (low + high) / 2;
+		if (recordIndex[middle].recordId < recordId) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+//Stores the record as the newest one for its recordId
+void RecordStorage::UpdateRecordIndex(RecordStorageRecord* record)
+{
+	if (!recordIndexValid || record == nullptr) return;
+
+	u16 position = FindRecordIndexPosition(record->recordId);
+	u16 wordOffset = (u16)(((u32)record - (u32)startPage) / 4);
+
+	if (position < recordIndexCount && recordIndex[position].recordId == record->recordId) {
+		recordIndex[position].wordOffset = wordOffset;
+	}
+	else if (recordIndexCount < RECORD_STORAGE_INDEX_SIZE) {
+		memmove(&recordIndex[position + 1], &recordIndex[position], (recordIndexCount - position) * sizeof(RecordStorageIndexEntry));
+		recordIndex[position].recordId = record->recordId;
+		recordIndex[position].wordOffset = wordOffset;
+		recordIndexCount++;
+	}
+	else {
+		logt("RS", "Record index full, id %u not indexed", record->recordId);
+		recordIndexComplete = false;
+	}
+}
+
+//Reads all records once, the newest record of a recordId is the one with the highest versionCounter
+void RecordStorage::RebuildRecordIndex()
+{
+	recordIndexCount = 0;
+	recordIndexComplete = true;
+	recordIndexValid = true;
+
+	for (u32 i = 0; i < numPages; i++)
+	{
+		RecordStoragePage* page = (RecordStoragePage*)(startPage + PAGE_SIZE * i);
+		if (GetPageState(page) != RecordStoragePageState::ACTIVE) continue;
+
+		RecordStorageRecord* record = GetFirstRecord(page);
+		while (IsRecordValid(page, record))
+		{
+			u16 position = FindRecordIndexPosition(record->recordId);
+			bool indexed = position < recordIndexCount && recordIndex[position].recordId == record->recordId;
+			if (!indexed || record->versionCounter > ((RecordStorageRecord*)(startPage + recordIndex[position].wordOffset * 4))->versionCounter) {
+				UpdateRecordIndex(record);
+			}
+
+			record = (RecordStorageRecord*)((u8*)record + record->recordLength);
+		}
+	}
+
+	logt("RS", "Record index built with %u records", recordIndexCount);
+}
+
 //Returns a pointer to the free space, otherwise returns nullptr
 u8* RecordStorage::GetFreeRecordSpace(u16 dataLength) const
 {
-	//Go through all pages
-	for(u32 i = 0; i<numPages; i++)
+	//Go through all pages, starting with the page that was written last so that all pages are used in turn
+	for(u32 j = 0; j<numPages; j++)
 	{
 		//Check if this page is active
+		u32 i = (writePageIndex + j) % numPages;
 		RecordStoragePage* page = (RecordStoragePage*)(startPage + PAGE_SIZE * i);
 		if(GetPageState(page) != RecordStoragePageState::ACTIVE) continue;
 
+		//The page that is being defragmented will be erased
+		if(defragmentInProgress && page == defragmentPage) continue;
+
 		//Get first record
-		RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+		RecordStorageRecord* record = GetFirstRecord(page);
 
 		//Iterate through all valid records
 		while(IsRecordValid(page, record))
@@ -690,7 +908,7 @@ u16 RecordStorage::GetFreeSpaceOnPage(RecordStoragePage* page) const
 	if (GetPageState(page) != RecordStoragePageState::ACTIVE) return 0;
 
 	//Get first record
-	RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+	RecordStorageRecord* record = GetFirstRecord(page);
 	//Iterate through all valid records until it jumps to the first invalid record
 	while (IsRecordValid(page, record)) {
 		record = (RecordStorageRecord*)((u8*)record + record->recordLength);
@@ -702,13 +920,14 @@ u16 RecordStorage::GetFreeSpaceOnPage(RecordStoragePage* page) const
 //Calculates the free storage that would be available when defragmenting the page
 u16 RecordStorage::GetFreeSpaceWhenDefragmented(RecordStoragePage* page) const
 {
-	u32 usedSpace = SIZEOF_RECORD_STORAGE_PAGE_HEADER;
+	//The swap page that the records are moved to also holds the erase counter record
+	u32 usedSpace = SIZEOF_RECORD_STORAGE_PAGE_HEADER + SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD;
 
 	//Should not happen, page is not active
 	if(GetPageState(page) != RecordStoragePageState::ACTIVE) return 0;
 
 	//Get first record
-	RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+	RecordStorageRecord* record = GetFirstRecord(page);
 
 	while (IsRecordValid(page, record))
 	{
@@ -757,14 +976,110 @@ bool RecordStorage::IsRecordValid(RecordStoragePage* page, RecordStorageRecord*
 	return true;
 }
 
+RecordStorageRecord* RecordStorage::GetFirstRecord(RecordStoragePage* page) const
+{
+	RecordStorageRecord* eraseCounterRecord = GetEraseCounterRecord(page);
+	if(eraseCounterRecord != nullptr){
+		return (RecordStorageRecord*)((u8*)eraseCounterRecord + eraseCounterRecord->recordLength);
+	}
+	return (RecordStorageRecord*)page->data;
+}
+
+RecordStorageRecord* RecordStorage::GetEraseCounterRecord(RecordStoragePage* page) const
+{
+	RecordStorageRecord* record = (RecordStorageRecord*)page->data;
+
+	//An empty record must not be checked as it would be reported as a crc error
+	if(record->recordId != RECORD_STORAGE_RECORD_ID_ERASE_COUNTER || record->recordLength != SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD){
+		return nullptr;
+	}
+	if(!IsRecordValid(page, record)){
+		return nullptr;
+	}
+	return record;
+}
+
+bool RecordStorage::ReadPageEraseCounter(u32 pageIndex, u32* eraseCounter) const
+{
+	RecordStoragePage* page = (RecordStoragePage*)(startPage + PAGE_SIZE * pageIndex);
+
+	RecordStorageRecord* eraseCounterRecord = GetEraseCounterRecord(page);
+	if(eraseCounterRecord == nullptr){
+		return false;
+	}
+
+	memcpy(eraseCounter, eraseCounterRecord->data, sizeof(u32));
+	return true;
+}
+
+u32 RecordStorage::GetPageEraseCounter(u32 pageIndex) const
+{
+	u32 eraseCounter = 0;
+	if(ReadPageEraseCounter(pageIndex, &eraseCounter)){
+		return eraseCounter;
+	}
+
+	//The erase counter of pages written by older firmware or of a page that lost its record during a power loss
+	//is unknown. Counting it as 0 would make the wear leveling move this page over and over until it caught up,
+	//so it is assumed to be as worn as the most erased page
+	u32 maxEraseCounter = 0;
+	for(u32 i = 0; i<numPages; i++)
+	{
+		if(ReadPageEraseCounter(i, &eraseCounter) && eraseCounter > maxEraseCounter){
+			maxEraseCounter = eraseCounter;
+		}
+	}
+	return maxEraseCounter;
+}
+
+FlashStorageError RecordStorage::WriteEraseCounterRecord(RecordStoragePage* page, u32 eraseCounter)
+{
+	u32 buffer[SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD / sizeof(u32)];
+	CheckedMemset(buffer, 0xFF, sizeof(buffer));
+	RecordStorageRecord* eraseCounterRecord = (RecordStorageRecord*)buffer;
+	eraseCounterRecord->recordActive = 0;
+	eraseCounterRecord->padding = 0;
+	eraseCounterRecord->recordLength = SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD;
+	eraseCounterRecord->recordId = RECORD_STORAGE_RECORD_ID_ERASE_COUNTER;
+	eraseCounterRecord->versionCounter = 1;
+	memcpy(eraseCounterRecord->data, &eraseCounter, sizeof(u32));
+	eraseCounterRecord->crc = Utility::CalculateCrc8(((u8*)eraseCounterRecord) + 2, eraseCounterRecord->recordLength - 2);
+
+	return GS->flashStorage.CacheAndWriteData(buffer, (u32*)page->data, SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD, nullptr, 0);
+}
+
+RecordStoragePage* RecordStorage::FindLeastErasedPage() const
+{
+	RecordStoragePage* result = nullptr;
+	u32 minEraseCounter = UINT32_MAX;
+
+	for(u32 i = 0; i<numPages; i++)
+	{
+		RecordStoragePage* page = (RecordStoragePage*)(startPage + PAGE_SIZE * i);
+		if(GetPageState(page) != RecordStoragePageState::ACTIVE) continue;
+
+		u32 eraseCounter = GetPageEraseCounter(i);
+		if(eraseCounter < minEraseCounter){
+			minEraseCounter = eraseCounter;
+			result = page;
+		}
+	}
+	return result;
+}
+
 RecordStoragePageState RecordStorage::GetPageState(RecordStoragePage* page) const
 {
 	if(page->magicNumber == RECORD_STORAGE_ACTIVE_PAGE_MAGIC_NUMBER){
 		return RecordStoragePageState::ACTIVE;
 	}
 
-	for(u32 i=0; i<PAGE_SIZE/4; i++){
-		if(((u32*)page)[i] != 0xFFFFFFFF){
+	//An empty page might already contain its erase counter record, the header must still be empty
+	if(*(u32*)page != 0xFFFFFFFF){
+		return RecordStoragePageState::CORRUPT;
+	}
+	u32 freeSpaceOffset = ((u32)GetFirstRecord(page) - (u32)page);
+	for(u32 i=freeSpaceOffset; i<PAGE_SIZE; i+=4){
+		if(((u32*)page)[i/4] != 0xFFFFFFFF){
 			return RecordStoragePageState::CORRUPT;
 		}
 	}
@@ -788,7 +1103,8 @@ void RecordStorage::FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashSt
 	//TODO: Use errorCode
 
 	//If either a repair or defrag is in Progress, do nothing, these are called from the QueueEmptyHandler
-	if (repairInProgress || defragmentInProgress) {
+	//Saves can continue during a background defragmentation
+	if (repairInProgress || (defragmentInProgress && !defragmentInBackground)) {
 		processQueueInProgress = false;
 		return;
 	}
@@ -798,6 +1114,12 @@ void RecordStorage::FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashSt
 		SizedData data = opQueue.PeekNext();
 		RecordStorageOperation* op = (RecordStorageOperation*)data.data;
 
+		//A record that was already copied by the defragmentation must not be deactivated, so we wait
+		if (defragmentInProgress && op->type == (u8)RecordStorageOperationType::DEACTIVATE_RECORD) {
+			processQueueInProgress = false;
+			return;
+		}
+
 		if (op->type == (u8)RecordStorageOperationType::SAVE_RECORD)
 		{
 			op->flashStorageErrorCode = errorCode;
@@ -825,7 +1147,7 @@ void RecordStorage::FlashStorageQueueEmptyHandler()
 			DefragmentPage(nullptr, false);
 		}
 	}
-	else if (defragmentInProgress)
+	else if (defragmentInProgress && !defragmentInBackground)
 	{
 		DefragmentPage(nullptr, false);
 	}
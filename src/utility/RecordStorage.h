@@ -30,6 +30,7 @@
 #pragma once
 
 #include <types.h>
+#include <Config.h>
 #include <FlashStorage.h>
 
 /**
@@ -67,6 +68,10 @@ typedef struct
 } RecordStorageRecord;
 STATIC_ASSERT_SIZE(RecordStorageRecord, 9);
 
+//The erase counter of a page is stored in a deactivated record that is placed before all other records,
+//older firmware that does not know this record will skip it and drop it once the page is defragmented
+constexpr int SIZEOF_RECORD_STORAGE_ERASE_COUNTER_RECORD = SIZEOF_RECORD_STORAGE_RECORD_HEADER + sizeof(u32);
+
 constexpr int SIZEOF_RECORD_STORAGE_PAGE_HEADER = 4;
 typedef struct
 {
@@ -76,6 +81,15 @@ typedef struct
 
 } RecordStoragePage;
 STATIC_ASSERT_SIZE(RecordStoragePage, 5);
+
+//Records are word aligned, so the offset is stored in words to address all pages
+typedef struct
+{
+		u16 recordId;
+		u16 wordOffset; //Offset of the newest record from the startPage
+
+} RecordStorageIndexEntry;
+STATIC_ASSERT_SIZE(RecordStorageIndexEntry, 4);
 typedef union
 {
 	struct {
@@ -150,11 +164,15 @@ class RecordStorage : public FlashStorageEventListener
 
 		//A queue that stores high level operations
 		u32 opBuffer[RECORD_STORAGE_QUEUE_SIZE/4];
+		u16 opIndex[PacketQueue::IndexLength(RECORD_STORAGE_QUEUE_SIZE, SIZEOF_RECORD_STORAGE_DEACTIVATE_RECORD_OP)];
 		PacketQueue opQueue;
 
 		//Variables for repair
 		bool repairInProgress = false;
 		u32 repairStep = 0;
+		//A page that was erased by the repair gets its erase counter record before the repair continues
+		RecordStoragePage* repairErasedPage = nullptr;
+		u32 repairEraseCounter = 0;
 
 		//Variables for defragmentation state
 		bool defragmentInProgress = false;
@@ -162,15 +180,33 @@ class RecordStorage : public FlashStorageEventListener
 		RecordStoragePage* defragmentSwapPage = nullptr;
 		u32 defragmentStep = 0;
 		u32 defragRecordCounter = 0;
+		u32 defragmentEraseCounter = 0;
+		//A background defragmentation is continued from the timer and does not block saves
+		bool defragmentInBackground = false;
+		bool defragmentCheckPending = false;
 
 		bool processQueueInProgress = false;
 
+		//New records are appended to this page until it is full, then the next page is used
+		u8 writePageIndex = 0;
+
+		//The index is sorted by recordId and points to the newest record of each recordId
+		RecordStorageIndexEntry recordIndex[RECORD_STORAGE_INDEX_SIZE];
+		u16 recordIndexCount = 0;
+		//The index is invalid while pages are erased and must be rebuilt afterwards
+		bool recordIndexValid = false;
+		//If not all recordIds fit into the index, records that are not found must still be searched in flash
+		bool recordIndexComplete = true;
+		//The record that is currently written by a save operation
+		RecordStorageRecord* savingRecord = nullptr;
+
 		//Stores a record
 		void SaveRecordInt(SaveRecordOperation* op);
 		//Removes a record
 		void DeactivateRecordInt(DeactivateRecordOperation* op);
 				
 		void DefragmentPage(RecordStoragePage* pageToDefragment, bool force);
+		void StartBackgroundDefragmentation();
 		void RepairPages();
 
 		void ProcessQueue(bool force);
@@ -184,11 +220,29 @@ class RecordStorage : public FlashStorageEventListener
 		u16 GetFreeSpaceWhenDefragmented(RecordStoragePage* page) const;
 
 		//Helpers
+		//Returns the first record of a page, the erase counter record is skipped
+		RecordStorageRecord* GetFirstRecord(RecordStoragePage* page) const;
+		//Returns the record that holds the erase counter of a page or nullptr if it is unknown
+		RecordStorageRecord* GetEraseCounterRecord(RecordStoragePage* page) const;
+		//Returns false if the page has no erase counter record
+		bool ReadPageEraseCounter(u32 pageIndex, u32* eraseCounter) const;
+		//Queues the erase counter record for an erased page
+		FlashStorageError WriteEraseCounterRecord(RecordStoragePage* page, u32 eraseCounter);
+		//Returns the active page that was erased the least number of times
+		RecordStoragePage* FindLeastErasedPage() const;
 		//Checks if a record is valid
 		bool IsRecordValid(RecordStoragePage* page, RecordStorageRecord* record) const;
 		//Looks through all pages and returns the page with the most space after defragmentation
 		RecordStoragePage * FindPageToDefragment() const;
 
+		//Record index
+		void RebuildRecordIndex();
+		void UpdateRecordIndex(RecordStorageRecord* record);
+		//Returns the position of the recordId in the index or the position where it would have to be inserted
+		u16 FindRecordIndexPosition(u16 recordId) const;
+		//Searches all pages for the newest record without using the index
+		RecordStorageRecord* FindRecordInFlash(u16 recordId) const;
+
 		bool isInit = false;
 		
 	public:
@@ -202,6 +256,8 @@ class RecordStorage : public FlashStorageEventListener
 		//Must only be called upon start
 		void InitialRepair();
 
+		void TimerEventHandler(u16 passedTimeDs);
+
 		//Stores a record (Operation is queued)
 		RecordStorageResultCode SaveRecord(u16 recordId, u8* data, u16 dataLength, RecordStorageEventListener* callback, u32 userType);
 		//Allows to cache some information until store completes
@@ -212,6 +268,9 @@ class RecordStorage : public FlashStorageEventListener
 		RecordStorageRecord* GetRecord(u16 recordId) const;
 		//Retrieves the data of a record
 		SizedData GetRecordData(u16 recordId) const;
+		//Returns how often a page was erased since the erase counters were introduced
+		//A page with an unknown erase counter reports the highest known erase counter
+		u32 GetPageEraseCounter(u32 pageIndex) const;
 		//Resets all settings
 		void ClearAllSettings();
 		
@@ -815,10 +815,11 @@ bool Terminal::PutIntoReadBuffer(const char* message)
 
 void Terminal::StdioCheckAndProcessLine()
 {
+	//Checked before locking as all other nodes, possibly on other threads, leave right away
+	if (cherrySimInstance->simConfig.terminalId != cherrySimInstance->currentNode->id && cherrySimInstance->simConfig.terminalId != 0) return;
 #ifdef SIM_ENABLED
 	std::lock_guard<std::mutex> guard(terminalMutex);
 #endif
-	if (cherrySimInstance->simConfig.terminalId != cherrySimInstance->currentNode->id && cherrySimInstance->simConfig.terminalId != 0) return;
 
 #if (defined(__unix) && !defined(CHERRYSIM_TESTER_ENABLED)) || defined(_WIN32)
 	if(!meshGwCommunication && _kbhit() != 0){ //FIXME: Not supported by eclipse console
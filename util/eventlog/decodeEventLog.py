@@ -0,0 +1,125 @@
+#Decodes the FruityMesh event log, either from a binary dump of the event log flash pages
+#(e.g. nrfjprog --readcode) or from the event_log_entry json lines that are printed after
+#"action <nodeId> status get_eventlog [firstSequenceNumber] [maxEntries]"
+#
+#Usage: python decodeEventLog.py dump.bin [pageSize]
+#       python decodeEventLog.py terminal.log
+
+import sys
+import json
+import struct
+import datetime
+
+PAGE_MAGIC_NUMBER = 0xEB01
+PAGE_HEADER_SIZE = 4
+ENTRY_FORMAT = "<IIBBHI"
+ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+
+EVENT_TYPES = {
+    1: "REBOOT",
+    2: "GAP_DISCONNECTED",
+    3: "CONNECTION_REMOVED",
+    4: "INCIDENT_SAVED",
+    5: "INCIDENT_DELETED",
+    6: "EVENTS_DROPPED",
+}
+
+REBOOT_REASONS = ["UNKNOWN", "HARDFAULT", "APP_FAULT", "SD_FAULT", "PIN_RESET", "WATCHDOG", "FROM_OFF_STATE",
+    "LOCAL_RESET", "REMOTE_RESET", "ENROLLMENT", "PREFERRED_CONNECTIONS", "DFU", "MODULE_ALLOCATOR_OUT_OF_MEMORY"]
+
+CONNECTION_TYPES = ["INVALID", "FRUITYMESH", "APP", "CLC_APP", "RESOLVER", "MESH_ACCESS"]
+
+APP_DISCONNECT_REASONS = ["UNKNOWN", "HANDSHAKE_TIMEOUT", "RECONNECT_TIMEOUT", "GAP_DISCONNECT_NO_REESTABLISH_REQUESTED",
+    "SAME_CLUSTERID", "TOO_MANY_SEND_RETRIES", "I_AM_SMALLER", "PARTNER_HAS_MASTERBIT", "SHOULD_WAIT_AS_SLAVE", "LEAF_NODE",
+    "STATIC_NODE", "QUEUE_NUM_MISMATCH", "CM_FAIL_NO_SPOT", "USER_REQUEST", "CURRENTLY_IN_HANDSHAKE", "GAP_CONNECTING_TIMEOUT",
+    "PENDING_TIMEOUT", "ENROLLMENT_TIMEOUT", "ENROLLMENT_TIMEOUT2", "NETWORK_ID_MISMATCH", "RECONNECT_BLE_ERROR",
+    "UNPREFERRED_CONNECTION", "EMERGENCY_DISCONNECT", "GAP_ERROR", "WRONG_PARTNERID", "ILLEGAL_TUNNELTYPE", "INVALID_KEY",
+    "INVALID_PACKET", "ENROLLMENT_RESPONSE_RECEIVED", "NEEDED_FOR_ENROLLMENT"]
+
+HCI_REASONS = {
+    0x08: "CONNECTION_TIMEOUT",
+    0x13: "REMOTE_USER_TERMINATED_CONNECTION",
+    0x16: "LOCAL_HOST_TERMINATED_CONNECTION",
+    0x22: "LMP_RESPONSE_TIMEOUT",
+    0x3B: "UNACCEPTABLE_CONNECTION_INTERVAL",
+    0x3D: "MIC_FAILURE",
+    0x3E: "CONN_FAILED_TO_BE_ESTABLISHED",
+}
+
+INCIDENT_TYPES = ["RESCUE_LANE", "BLACK_ICE", "TRAFFIC_JAM", "BREAK_DOWN"]
+
+def lookup(table, index):
+    if isinstance(table, dict):
+        return table.get(index, str(index))
+    return table[index] if index < len(table) else str(index)
+
+def formatTime(timestamp):
+    #Timestamps are seconds since boot until the node received the time from the mesh
+    if timestamp > 1000000000:
+        return datetime.datetime.utcfromtimestamp(timestamp).strftime("%Y-%m-%d %H:%M:%S UTC")
+    return "boot+%us" % timestamp
+
+def describe(eventType, info, nodeId, code):
+    if eventType == 1:
+        return "reason %s, code1 %u" % (lookup(REBOOT_REASONS, info), code)
+    if eventType == 2:
+        return "%s partner %u, hci %s" % (lookup(CONNECTION_TYPES, info), nodeId, lookup(HCI_REASONS, code))
+    if eventType == 3:
+        return "%s partner %u, reason %s" % (lookup(CONNECTION_TYPES, info), nodeId, lookup(APP_DISCONNECT_REASONS, code))
+    if eventType in (4, 5):
+        return "%s at node %u" % (lookup(INCIDENT_TYPES, info), nodeId)
+    if eventType == 6:
+        return "%u events lost" % code
+    return "info %u, nodeId %u, code %u" % (info, nodeId, code)
+
+def readBinaryDump(data, pageSize):
+    entries = []
+    for pageStart in range(0, len(data) - PAGE_HEADER_SIZE + 1, pageSize):
+        magicNumber, entrySize = struct.unpack_from("<HH", data, pageStart)
+        if magicNumber != PAGE_MAGIC_NUMBER or entrySize != ENTRY_SIZE:
+            continue
+        for offset in range(pageStart + PAGE_HEADER_SIZE, pageStart + pageSize - ENTRY_SIZE + 1, ENTRY_SIZE):
+            entry = struct.unpack_from(ENTRY_FORMAT, data, offset)
+            if entry[0] == 0xFFFFFFFF:
+                break
+            entries.append((None,) + entry)
+    return entries
+
+def readJsonLines(lines):
+    entries = []
+    for line in lines:
+        start = line.find("{")
+        if start < 0:
+            continue
+        try:
+            message = json.loads(line[start:])
+        except ValueError:
+            continue
+        if message.get("type") == "event_log_entry":
+            entries.append((message["nodeId"], message["seq"], message["time"], message["event"], message["info"], message["partner"], message["code"]))
+        elif message.get("type") == "event_log_end":
+            print("# node %u: continue with sequence number %u" % (message["nodeId"], message["nextSeq"]))
+    return entries
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s <dump.bin [pageSize] | terminal.log>" % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    if data[:2] == struct.pack("<H", PAGE_MAGIC_NUMBER) or data[:4] == b"\xff\xff\xff\xff":
+        pageSize = int(sys.argv[2]) if len(sys.argv) > 2 else 4096
+        entries = readBinaryDump(data, pageSize)
+    else:
+        entries = readJsonLines(data.decode("utf-8", "replace").splitlines())
+
+    #Pages are reused as a ring, so the sequence number gives the order of the events
+    entries.sort(key=lambda entry: (entry[0] or 0, entry[1]))
+    for nodeId, sequenceNumber, timestamp, eventType, info, partner, code in entries:
+        prefix = "" if nodeId is None else "node %u " % nodeId
+        print("%s#%u %s %s: %s" % (prefix, sequenceNumber, formatTime(timestamp), lookup(EVENT_TYPES, eventType), describe(eventType, info, partner, code)))
+
+if __name__ == "__main__":
+    main()